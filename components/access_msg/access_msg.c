@@ -0,0 +1,164 @@
+#include <string.h>
+
+#include "access_msg.h"
+
+// Posiciones dentro de los mensajes
+#define REQ_ID 4
+#define REQ_CARD 8
+#define REQ_DEVICE 16
+#define REQ_DOOR 24
+#define REQ_DIGITS 25
+#define REQ_CODE 26
+#define RESP_ID 4
+#define RESP_CODE 8
+#define RESP_DOOR 10
+#define RESP_TEXT_LEN 11
+#define RESP_HOLD 12
+
+static uint32_t get_le32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t get_le64(const uint8_t *p)
+{
+	return (uint64_t)get_le32(p) | (uint64_t)get_le32(p + 4) << 32;
+}
+
+static void put_le16(uint8_t *p, uint16_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+	put_le16(p, v);
+	put_le16(p + 2, v >> 16);
+}
+
+static void put_le64(uint8_t *p, uint64_t v)
+{
+	put_le32(p, v);
+	put_le32(p + 4, v >> 32);
+}
+
+static void put_header(uint8_t *p, uint8_t version, access_msg_type_t type, uint8_t flags)
+{
+	p[0] = ACCESS_MSG_MAGIC;
+	p[1] = version;
+	p[2] = type;
+	p[3] = flags;
+}
+
+bool access_msg_is_binary(const void *msg, size_t len)
+{
+	return len > 0 && ((const uint8_t *)msg)[0] == ACCESS_MSG_MAGIC;
+}
+
+int access_msg_type(const void *msg, size_t len)
+{
+	const uint8_t *p = msg;
+	if (len < ACCESS_MSG_HEADER || p[0] != ACCESS_MSG_MAGIC) return 0;
+	// Un HELLO puede elegir cualquier versión; el resto tiene que ser binario
+	if (p[2] == ACCESS_MSG_HELLO) return (len == ACCESS_MSG_HEADER) ? ACCESS_MSG_HELLO : 0;
+	if (p[1] != ACCESS_MSG_VERSION) return 0;
+	if (p[2] == ACCESS_MSG_REQUEST || p[2] == ACCESS_MSG_RESPONSE) return p[2];
+	return 0;
+}
+
+//------------------------------------------pedidos-------------------------------
+
+size_t access_msg_encode_request(const access_msg_request_t *request, uint8_t *buf, size_t size)
+{
+	size_t digits = strlen(request->code);
+	size_t device = strlen(request->device_id);
+	if (size < ACCESS_MSG_REQUEST_SIZE || digits > ACCESS_MSG_CODE_MAX || device > ACCESS_MSG_DEVICE_MAX) return 0;
+	for (size_t i = 0; i < digits; i++) {
+		if (request->code[i] < '0' || request->code[i] > '9') return 0;
+	}
+
+	memset(buf, 0, ACCESS_MSG_REQUEST_SIZE);
+	uint8_t flags = (request->has_card ? ACCESS_MSG_FLAG_CARD : 0) | (digits > 0 ? ACCESS_MSG_FLAG_CODE : 0);
+	put_header(buf, ACCESS_MSG_VERSION, ACCESS_MSG_REQUEST, flags);
+	put_le32(buf + REQ_ID, request->id);
+	put_le64(buf + REQ_CARD, request->has_card ? request->card : 0);
+	memcpy(buf + REQ_DEVICE, request->device_id, device);
+	buf[REQ_DOOR] = request->door;
+	buf[REQ_DIGITS] = digits;
+	for (size_t i = 0; i < digits; i++) {
+		buf[REQ_CODE + i / 2] |= (request->code[i] - '0') << ((i % 2) ? 0 : 4);
+	}
+	return ACCESS_MSG_REQUEST_SIZE;
+}
+
+bool access_msg_decode_request(const void *msg, size_t len, access_msg_request_t *request)
+{
+	const uint8_t *p = msg;
+	if (len != ACCESS_MSG_REQUEST_SIZE || access_msg_type(msg, len) != ACCESS_MSG_REQUEST) return false;
+	uint8_t digits = p[REQ_DIGITS];
+	if (digits > ACCESS_MSG_CODE_MAX || ((p[3] & ACCESS_MSG_FLAG_CODE) != 0) != (digits > 0)) return false;
+
+	memset(request, 0, sizeof(access_msg_request_t));
+	request->id = get_le32(p + REQ_ID);
+	request->has_card = (p[3] & ACCESS_MSG_FLAG_CARD) != 0;
+	request->card = get_le64(p + REQ_CARD);
+	memcpy(request->device_id, p + REQ_DEVICE, ACCESS_MSG_DEVICE_MAX);
+	request->door = p[REQ_DOOR];
+	for (int i = 0; i < digits; i++) {
+		uint8_t d = (p[REQ_CODE + i / 2] >> ((i % 2) ? 0 : 4)) & 0x0F;
+		if (d > 9) return false;
+		request->code[i] = '0' + d;
+	}
+	return true;
+}
+
+//------------------------------------------respuestas-------------------------------
+
+size_t access_msg_encode_response(const access_msg_response_t *response, uint8_t *buf, size_t size)
+{
+	size_t text = strlen(response->text);
+	if (text > ACCESS_MSG_TEXT_MAX || size < ACCESS_MSG_RESPONSE_SIZE + text) return 0;
+	put_header(buf, ACCESS_MSG_VERSION, ACCESS_MSG_RESPONSE, 0);
+	put_le32(buf + RESP_ID, response->id);
+	put_le16(buf + RESP_CODE, response->code);
+	buf[RESP_DOOR] = response->door;
+	buf[RESP_TEXT_LEN] = text;
+	put_le32(buf + RESP_HOLD, response->hold_ms);
+	memcpy(buf + ACCESS_MSG_RESPONSE_SIZE, response->text, text);
+	return ACCESS_MSG_RESPONSE_SIZE + text;
+}
+
+bool access_msg_decode_response(const void *msg, size_t len, access_msg_response_t *response)
+{
+	const uint8_t *p = msg;
+	if (len < ACCESS_MSG_RESPONSE_SIZE || access_msg_type(msg, len) != ACCESS_MSG_RESPONSE) return false;
+	uint8_t text = p[RESP_TEXT_LEN];
+	if (text > ACCESS_MSG_TEXT_MAX || len != ACCESS_MSG_RESPONSE_SIZE + (size_t)text) return false;
+
+	response->id = get_le32(p + RESP_ID);
+	response->code = p[RESP_CODE] | p[RESP_CODE + 1] << 8;
+	response->door = p[RESP_DOOR];
+	response->hold_ms = get_le32(p + RESP_HOLD);
+	for (int i = 0; i < text; i++) {
+		char c = p[ACCESS_MSG_RESPONSE_SIZE + i];
+		response->text[i] = ((c >= ' ' && c <= '~') || c == '\n') ? c : '?';
+	}
+	response->text[text] = '\0';
+	return true;
+}
+
+//------------------------------------------negociación-------------------------------
+
+size_t access_msg_encode_hello(uint8_t version, uint8_t *buf, size_t size)
+{
+	if (size < ACCESS_MSG_HEADER) return 0;
+	put_header(buf, version, ACCESS_MSG_HELLO, 0);
+	return ACCESS_MSG_HEADER;
+}
+
+uint8_t access_msg_hello_version(const void *msg, size_t len)
+{
+	if (access_msg_type(msg, len) != ACCESS_MSG_HELLO) return 0;
+	return ((const uint8_t *)msg)[1];
+}
@@ -0,0 +1,243 @@
+/*
+ * Tests of access_msg.c: fixed byte vectors for each message, round trips,
+ * malformed messages, and random bytes fed to the decoders.
+ *
+ * usage: access_msg_test [iterations]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "access_msg.h"
+#include "test_util.h"
+
+//------------------------------------------vectors-------------------------------
+
+static void test_request_vector(void)
+{
+	static const uint8_t expected[ACCESS_MSG_REQUEST_SIZE] = {
+		0xCA, 0x02, 0x01, 0x03,                          // header: card and code
+		0x2A, 0x00, 0x00, 0x00,                          // request 42
+		0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11,  // card
+		'2', '4', '0', '0', '1', 0, 0, 0,                // device
+		0x01,                                            // door
+		0x07,                                            // digits
+		0x12, 0x34, 0x56, 0x70, 0, 0, 0, 0,              // BCD, high nibble first
+		0, 0,
+	};
+	access_msg_request_t req = {
+		.id = 42,
+		.has_card = true,
+		.card = 0x1122334455667788ULL,
+		.code = "1234567",
+		.door = 1,
+		.device_id = "24001",
+	};
+	uint8_t buf[64];
+	size_t len = access_msg_encode_request(&req, buf, sizeof(buf));
+	CHECK(len == ACCESS_MSG_REQUEST_SIZE, "request len %zu", len);
+	CHECK(memcmp(buf, expected, sizeof(expected)) == 0, "request bytes");
+
+	access_msg_request_t out;
+	CHECK(access_msg_decode_request(buf, len, &out), "decode request");
+	CHECK(out.id == 42 && out.has_card && out.card == req.card && out.door == 1, "request fields");
+	CHECK(strcmp(out.code, "1234567") == 0 && strcmp(out.device_id, "24001") == 0, "request strings %s %s", out.code, out.device_id);
+	CHECK(access_msg_type(buf, len) == ACCESS_MSG_REQUEST, "request type");
+}
+
+static void test_response_vector(void)
+{
+	static const uint8_t expected[] = {
+		0xCA, 0x02, 0x02, 0x00,  // header
+		0x07, 0x00, 0x00, 0x01,  // request 0x01000007
+		0x65, 0x00,              // 101
+		0x02,                    // door
+		0x05,                    // text length
+		0x10, 0x27, 0x00, 0x00,  // 10000 ms
+		'H', 'o', 'l', 'a', '!',
+	};
+	access_msg_response_t resp = {
+		.id = 0x01000007,
+		.code = 101,
+		.door = 2,
+		.hold_ms = 10000,
+		.text = "Hola!",
+	};
+	uint8_t buf[64];
+	size_t len = access_msg_encode_response(&resp, buf, sizeof(buf));
+	CHECK(len == sizeof(expected), "response len %zu", len);
+	CHECK(memcmp(buf, expected, sizeof(expected)) == 0, "response bytes");
+
+	access_msg_response_t out;
+	CHECK(access_msg_decode_response(expected, sizeof(expected), &out), "decode response");
+	CHECK(out.id == resp.id && out.code == 101 && out.door == 2 && out.hold_ms == 10000, "response fields");
+	CHECK(strcmp(out.text, "Hola!") == 0, "text %s", out.text);
+
+	// Without text: 16 bytes
+	resp.text[0] = '\0';
+	CHECK(access_msg_encode_response(&resp, buf, sizeof(buf)) == ACCESS_MSG_RESPONSE_SIZE, "no text");
+	CHECK(access_msg_decode_response(buf, ACCESS_MSG_RESPONSE_SIZE, &out) && out.text[0] == '\0', "decode no text");
+}
+
+static void test_hello(void)
+{
+	uint8_t buf[8];
+	CHECK(access_msg_encode_hello(2, buf, sizeof(buf)) == ACCESS_MSG_HEADER, "hello len");
+	CHECK(access_msg_hello_version(buf, ACCESS_MSG_HEADER) == 2, "hello 2");
+	CHECK(access_msg_encode_hello(1, buf, sizeof(buf)) == ACCESS_MSG_HEADER, "hello 1 len");
+	CHECK(access_msg_hello_version(buf, ACCESS_MSG_HEADER) == 1, "hello 1: back to JSON");
+	CHECK(access_msg_hello_version(buf, ACCESS_MSG_HEADER + 1) == 0, "hello with trailing bytes");
+	CHECK(access_msg_encode_hello(2, buf, 3) == 0, "hello does not fit");
+}
+
+//------------------------------------------validation-------------------------------
+
+static void test_request_limits(void)
+{
+	access_msg_request_t req = { .id = 1, .device_id = "24001" };
+	uint8_t buf[ACCESS_MSG_REQUEST_SIZE];
+	access_msg_request_t out;
+
+	// Card only, code only, 16 digits
+	req.has_card = true;
+	req.card = 7;
+	CHECK(access_msg_encode_request(&req, buf, sizeof(buf)) && buf[3] == ACCESS_MSG_FLAG_CARD, "card only");
+	CHECK(access_msg_decode_request(buf, sizeof(buf), &out) && out.has_card && out.code[0] == '\0', "decode card only");
+	req.has_card = false;
+	strcpy(req.code, "0123456789012345");
+	CHECK(access_msg_encode_request(&req, buf, sizeof(buf)) && buf[3] == ACCESS_MSG_FLAG_CODE, "16 digits");
+	CHECK(access_msg_decode_request(buf, sizeof(buf), &out) && strcmp(out.code, req.code) == 0 && !out.has_card, "decode 16 digits");
+
+	// Invalid input
+	strcpy(req.code, "12a4");
+	CHECK(access_msg_encode_request(&req, buf, sizeof(buf)) == 0, "letter in code");
+	strcpy(req.code, "1234");
+	strcpy(req.device_id, "123456789");
+	CHECK(access_msg_encode_request(&req, buf, sizeof(buf)) == 0, "device too long");
+	strcpy(req.device_id, "12345678");
+	CHECK(access_msg_encode_request(&req, buf, sizeof(buf)) == ACCESS_MSG_REQUEST_SIZE, "8-char device");
+	CHECK(access_msg_decode_request(buf, sizeof(buf), &out) && strcmp(out.device_id, "12345678") == 0, "8-char device decoded");
+	CHECK(access_msg_encode_request(&req, buf, sizeof(buf) - 1) == 0, "small buffer");
+
+	// Malformed
+	uint8_t bad[ACCESS_MSG_REQUEST_SIZE];
+	memcpy(bad, buf, sizeof(bad));
+	bad[26] = 0xA0;  // first BCD byte
+	CHECK(!access_msg_decode_request(bad, sizeof(bad), &out), "BCD nibble > 9");
+	memcpy(bad, buf, sizeof(bad));
+	bad[3] = 0;
+	CHECK(!access_msg_decode_request(bad, sizeof(bad), &out), "digits without code flag");
+	memcpy(bad, buf, sizeof(bad));
+	bad[25] = ACCESS_MSG_CODE_MAX + 1;
+	CHECK(!access_msg_decode_request(bad, sizeof(bad), &out), "too many digits");
+	memcpy(bad, buf, sizeof(bad));
+	bad[1] = 3;
+	CHECK(!access_msg_decode_request(bad, sizeof(bad), &out), "other version");
+	CHECK(!access_msg_decode_request(buf, sizeof(buf) - 1, &out), "short");
+}
+
+static void test_response_limits(void)
+{
+	access_msg_response_t resp = { .id = 9, .code = 100 };
+	access_msg_response_t out;
+	uint8_t buf[64];
+
+	memset(resp.text, 'x', ACCESS_MSG_TEXT_MAX);
+	resp.text[ACCESS_MSG_TEXT_MAX] = '\0';
+	size_t len = access_msg_encode_response(&resp, buf, sizeof(buf));
+	CHECK(len == ACCESS_MSG_RESPONSE_SIZE + ACCESS_MSG_TEXT_MAX, "longest text");
+	CHECK(access_msg_decode_response(buf, len, &out) && strlen(out.text) == ACCESS_MSG_TEXT_MAX, "decode longest text");
+	CHECK(access_msg_encode_response(&resp, buf, len - 1) == 0, "small buffer");
+
+	// A code above 999 fits too
+	resp.code = 4321;
+	strcpy(resp.text, "Piso 3\nOficina B");
+	len = access_msg_encode_response(&resp, buf, sizeof(buf));
+	CHECK(access_msg_decode_response(buf, len, &out) && out.code == 4321 && strcmp(out.text, resp.text) == 0, "4-digit code, two lines");
+
+	// Characters the font lacks are replaced
+	buf[ACCESS_MSG_RESPONSE_SIZE] = 0xE1;
+	buf[ACCESS_MSG_RESPONSE_SIZE + 1] = '\t';
+	CHECK(access_msg_decode_response(buf, len, &out) && out.text[0] == '?' && out.text[1] == '?', "sanitized %s", out.text);
+
+	CHECK(!access_msg_decode_response(buf, len - 1, &out), "text length mismatch");
+	CHECK(!access_msg_decode_response(buf, len + 1, &out), "trailing byte");
+	buf[11] = ACCESS_MSG_TEXT_MAX + 1;  // text length field
+	CHECK(!access_msg_decode_response(buf, ACCESS_MSG_RESPONSE_SIZE + ACCESS_MSG_TEXT_MAX + 1, &out), "text too long");
+
+	// Text responses are not binary
+	CHECK(!access_msg_is_binary("1:101@7", 7) && !access_msg_is_binary("", 0), "text is not binary");
+	CHECK(access_msg_type("\xCA\x02\x07\x00", 4) == 0, "unknown type");
+	CHECK(access_msg_type("\xCA\x02\x02", 3) == 0, "short header");
+}
+
+//------------------------------------------random-------------------------------
+
+// Random bytes never crash the decoders, and what decodes re-encodes to the same bytes
+static void test_random(int iterations)
+{
+	uint32_t rng = 0x2545f491;
+	uint8_t msg[64];
+	uint8_t again[64];
+	int decoded = 0;
+	for (int i = 0; i < iterations; i++) {
+		size_t len = rng_next(&rng) % sizeof(msg);
+		for (size_t j = 0; j < len; j++) msg[j] = rng_next(&rng);
+		// Keep a valid header most of the time so the field checks are reached
+		if (len >= ACCESS_MSG_HEADER && rng_next(&rng) % 4 != 0) {
+			msg[0] = ACCESS_MSG_MAGIC;
+			msg[1] = ACCESS_MSG_VERSION;
+			msg[2] = 1 + rng_next(&rng) % 2;
+			if (msg[2] == ACCESS_MSG_REQUEST) {
+				len = ACCESS_MSG_REQUEST_SIZE;
+				msg[25] = rng_next(&rng) % (ACCESS_MSG_CODE_MAX + 1);
+				msg[3] = (msg[3] & ACCESS_MSG_FLAG_CARD) | (msg[25] ? ACCESS_MSG_FLAG_CODE : 0);
+				if (!(msg[3] & ACCESS_MSG_FLAG_CARD)) memset(msg + 8, 0, 8);
+				for (int k = 0; k < 8; k++) msg[26 + k] = (rng_next(&rng) % 10) << 4 | rng_next(&rng) % 10;
+				memset(msg + 26 + (msg[25] + 1) / 2, 0, 8 - (msg[25] + 1) / 2);
+				if (msg[25] % 2) msg[26 + msg[25] / 2] &= 0xF0;
+				memset(msg + 16, 0, 8);
+				memcpy(msg + 16, "dev", 3);
+				msg[34] = msg[35] = 0;
+			} else {
+				msg[3] = 0;
+				msg[11] = rng_next(&rng) % (ACCESS_MSG_TEXT_MAX + 1);
+				len = ACCESS_MSG_RESPONSE_SIZE + msg[11];
+				for (int k = 0; k < msg[11]; k++) msg[16 + k] = ' ' + rng_next(&rng) % 95;
+			}
+		}
+
+		access_msg_request_t req;
+		access_msg_response_t resp;
+		if (access_msg_decode_request(msg, len, &req)) {
+			decoded++;
+			CHECK(access_msg_encode_request(&req, again, sizeof(again)) == len && memcmp(again, msg, len) == 0, "request round trip %d", i);
+		}
+		if (access_msg_decode_response(msg, len, &resp)) {
+			decoded++;
+			CHECK(access_msg_encode_response(&resp, again, sizeof(again)) == len && memcmp(again, msg, len) == 0, "response round trip %d", i);
+		}
+		access_msg_hello_version(msg, len);
+		if (failures > 0) return;
+	}
+	CHECK(decoded > iterations / 2, "only %d of %d decoded", decoded, iterations);
+}
+
+int main(int argc, char **argv)
+{
+	int iterations = (argc > 1) ? atoi(argv[1]) : 200000;
+
+	test_request_vector();
+	test_response_vector();
+	test_hello();
+	test_request_limits();
+	test_response_limits();
+	test_random(iterations);
+
+	if (failures > 0) {
+		printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+	printf("all access_msg checks passed (%d random messages)\n", iterations);
+	return 0;
+}
@@ -0,0 +1,140 @@
+#ifndef MAIN_ACCESS_MSG_H_
+#define MAIN_ACCESS_MSG_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Formato binario de los pedidos y respuestas de acceso (versión 2 del
+ * protocolo; la 1 es el JSON de los pedidos y el texto "<puerta>:<código>@N"
+ * de las respuestas).
+ *
+ * Cada mensaje empieza con una cabecera de 4 bytes y sigue con campos de
+ * largo fijo, little endian:
+ *
+ *   0xCA | versión | tipo | banderas
+ *
+ *   PEDIDO (equipo -> backend), 36 bytes:
+ *     cabecera | pedido (4) | tarjeta (8) | equipo (8, ASCII completado con
+ *     ceros) | puerta (1) | dígitos (1) | código (8, BCD: dos dígitos por
+ *     byte, el primero en el nibble alto) | 0 (2)
+ *     banderas: bit 0 hay tarjeta, bit 1 hay código
+ *
+ *   RESPUESTA (backend -> equipo), 16 bytes más el texto:
+ *     cabecera | pedido (4, 0 si es una orden sin pedido) | código (2) |
+ *     puerta (1) | largo del texto (1) | tiempo abierta en ms (4, 0 = el de
+ *     siempre) | texto (ASCII, sin terminador, hasta ACCESS_MSG_TEXT_MAX)
+ *
+ *   HELLO (backend -> equipo), 4 bytes: la cabecera con la versión elegida.
+ *
+ * El primer byte no es un dígito, así que las respuestas binarias y las de
+ * texto llegan por el mismo tópico. Como code_entry, no depende de ESP-IDF
+ * y se prueba en Linux (ver host_test/).
+ */
+
+#define ACCESS_MSG_MAGIC 0xCA
+#define ACCESS_MSG_VERSION 2           // Versión binaria; 1 es JSON y texto
+#define ACCESS_MSG_HEADER 4
+#define ACCESS_MSG_REQUEST_SIZE 36
+#define ACCESS_MSG_RESPONSE_SIZE 16    // Sin el texto
+#define ACCESS_MSG_TEXT_MAX 32
+#define ACCESS_MSG_DEVICE_MAX 8
+#define ACCESS_MSG_CODE_MAX 16
+
+#define ACCESS_MSG_FLAG_CARD 0x01
+#define ACCESS_MSG_FLAG_CODE 0x02
+
+/**
+ * @brief Tipos de mensaje.
+ */
+typedef enum {
+	ACCESS_MSG_REQUEST = 1,
+	ACCESS_MSG_RESPONSE,
+	ACCESS_MSG_HELLO,
+} access_msg_type_t;
+
+/**
+ * @brief Pedido de acceso.
+ */
+typedef struct {
+	uint32_t id;                               /**< Número del pedido */
+	bool has_card;
+	uint64_t card;                             /**< Número de serie de la tarjeta */
+	char code[ACCESS_MSG_CODE_MAX + 1];        /**< Dígitos, "" si no hay código */
+	uint8_t door;
+	char device_id[ACCESS_MSG_DEVICE_MAX + 1];
+} access_msg_request_t;
+
+/**
+ * @brief Respuesta del backend.
+ */
+typedef struct {
+	uint32_t id;                               /**< Pedido que responde, 0 si es una orden */
+	uint16_t code;                             /**< 101, 111, 100, 102... */
+	uint8_t door;
+	uint32_t hold_ms;                          /**< Tiempo abierta, 0 = el de siempre */
+	char text[ACCESS_MSG_TEXT_MAX + 1];        /**< Texto a mostrar, "" si ninguno */
+} access_msg_response_t;
+
+/**
+ * @brief Indica si un mensaje es binario (empieza con ACCESS_MSG_MAGIC).
+ */
+bool access_msg_is_binary(const void *msg, size_t len);
+
+/**
+ * @brief Tipo de un mensaje binario.
+ *
+ * @return int access_msg_type_t, o 0 si la cabecera no es válida (los
+ * pedidos y respuestas tienen que ser de ACCESS_MSG_VERSION).
+ */
+int access_msg_type(const void *msg, size_t len);
+
+/**
+ * @brief Arma un pedido.
+ *
+ * @return size_t ACCESS_MSG_REQUEST_SIZE, o 0 si no entra en buf o el
+ * pedido no es válido (código con algo que no sea un dígito o muy largo,
+ * equipo de más de ACCESS_MSG_DEVICE_MAX caracteres).
+ */
+size_t access_msg_encode_request(const access_msg_request_t *request, uint8_t *buf, size_t size);
+
+/**
+ * @brief Lee un pedido (lo usa el backend; acá, las pruebas).
+ *
+ * @return true si es un pedido válido.
+ */
+bool access_msg_decode_request(const void *msg, size_t len, access_msg_request_t *request);
+
+/**
+ * @brief Arma una respuesta.
+ *
+ * @return size_t Bytes, o 0 si no entra en buf o el texto es muy largo.
+ */
+size_t access_msg_encode_response(const access_msg_response_t *response, uint8_t *buf, size_t size);
+
+/**
+ * @brief Lee una respuesta.
+ *
+ * Los caracteres del texto que la fuente no tiene (fuera de ' '..'~' y
+ * '\n') se cambian por '?'.
+ *
+ * @return true si es una respuesta válida.
+ */
+bool access_msg_decode_response(const void *msg, size_t len, access_msg_response_t *response);
+
+/**
+ * @brief Arma un HELLO con la versión elegida.
+ *
+ * @return size_t ACCESS_MSG_HEADER, o 0 si no entra en buf.
+ */
+size_t access_msg_encode_hello(uint8_t version, uint8_t *buf, size_t size);
+
+/**
+ * @brief Versión elegida en un HELLO.
+ *
+ * @return uint8_t Versión, 0 si el mensaje no es un HELLO.
+ */
+uint8_t access_msg_hello_version(const void *msg, size_t len);
+
+#endif /* MAIN_ACCESS_MSG_H_ */
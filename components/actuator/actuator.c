@@ -0,0 +1,164 @@
+#include <string.h>
+#include <stdlib.h>
+
+#include "driver/gpio.h"
+#include "esp_log.h"
+
+#include "actuator.h"
+
+#define TAG "ACTUATOR"
+
+struct actuator {
+	actuator_config_t config;
+	servo_handle_t servo;       // Solo en ACTUATOR_SERVO
+	bool open;                  // Relé: estado de la salida
+	actuator_done_cb_t done;    // Aviso del movimiento del servo en curso
+	void *done_arg;
+};
+
+// Operadores MCPWM en el orden en que se asignan a los servos
+static const struct {
+	mcpwm_unit_t unit;
+	mcpwm_timer_t timer;
+	mcpwm_io_signals_t signal;
+} servo_slots[ACTUATOR_MAX_SERVOS] = {
+	{ MCPWM_UNIT_0, MCPWM_TIMER_0, MCPWM0A },
+	{ MCPWM_UNIT_0, MCPWM_TIMER_1, MCPWM1A },
+	{ MCPWM_UNIT_0, MCPWM_TIMER_2, MCPWM2A },
+	{ MCPWM_UNIT_1, MCPWM_TIMER_0, MCPWM0A },
+	{ MCPWM_UNIT_1, MCPWM_TIMER_1, MCPWM1A },
+	{ MCPWM_UNIT_1, MCPWM_TIMER_2, MCPWM2A },
+};
+static uint8_t servos_used = 0;
+
+esp_err_t actuator_config_from_string(actuator_config_t *config, const char *spec)
+{
+	char type[8];
+	int gpio, a, b;
+	memset(config, 0, sizeof(actuator_config_t));
+
+	int n = sscanf(spec, "%7[a-z],%d,%d,%d", type, &gpio, &a, &b);
+	if (n < 3 || gpio < 0 || gpio >= GPIO_NUM_MAX) return ESP_ERR_INVALID_ARG;
+	config->gpio = gpio;
+	if (strcmp(type, "servo") == 0 && n == 4) {
+		if (a < 0 || a > 180 || b < 0 || b > 180) return ESP_ERR_INVALID_ARG;
+		config->type = ACTUATOR_SERVO;
+		config->closed_angle = a;
+		config->open_angle = b;
+		return ESP_OK;
+	}
+	if (strcmp(type, "relay") == 0 && n == 3) {
+		config->type = ACTUATOR_RELAY;
+		config->active_high = a != 0;
+		return ESP_OK;
+	}
+	return ESP_ERR_INVALID_ARG;
+}
+
+static void relay_set(struct actuator *act, bool open)
+{
+	act->open = open;
+	gpio_set_level(act->config.gpio, open == act->config.active_high);
+}
+
+esp_err_t actuator_create(const actuator_config_t *config, const servo_config_t *servo, float position, actuator_handle_t *handle)
+{
+	struct actuator *act = calloc(1, sizeof(struct actuator));
+	if (act == NULL) return ESP_ERR_NO_MEM;
+	act->config = *config;
+
+	esp_err_t err = ESP_OK;
+	if (config->type == ACTUATOR_SERVO) {
+		if (servos_used >= ACTUATOR_MAX_SERVOS) {
+			err = ESP_ERR_NO_MEM;
+		} else {
+			servo_config_t servo_config = *servo;
+			servo_config.gpio = config->gpio;
+			servo_config.unit = servo_slots[servos_used].unit;
+			servo_config.timer = servo_slots[servos_used].timer;
+			servo_config.signal = servo_slots[servos_used].signal;
+			servo_config.initial_angle = position;
+			err = servo_create(&servo_config, &act->servo);
+			if (err == ESP_OK) servos_used++;
+		}
+	} else if (config->type == ACTUATOR_RELAY && !GPIO_IS_VALID_OUTPUT_GPIO(config->gpio)) {
+		err = ESP_ERR_INVALID_ARG; // 34-39 son solo entradas
+	} else if (config->type == ACTUATOR_RELAY) {
+		// gpio_config() pasa el pin a la función GPIO (12-15 arrancan en JTAG).
+		// El nivel de reposo se fija antes de habilitar la salida, así no
+		// pulsa al arrancar, y se vuelve a aplicar con el pin ya configurado.
+		gpio_config_t relay_config = {
+			.pin_bit_mask = 1ULL << config->gpio,
+			.mode = GPIO_MODE_OUTPUT,
+			.pull_up_en = GPIO_PULLUP_DISABLE,
+			.pull_down_en = GPIO_PULLDOWN_DISABLE,
+			.intr_type = GPIO_INTR_DISABLE,
+		};
+		relay_set(act, false);
+		err = gpio_config(&relay_config);
+		if (err == ESP_OK) relay_set(act, false);
+	} else {
+		err = ESP_ERR_INVALID_ARG;
+	}
+
+	if (err != ESP_OK) {
+		ESP_LOGE(TAG, "no se pudo crear la cerradura en GPIO %d: %s", config->gpio, esp_err_to_name(err));
+		free(act);
+		return err;
+	}
+	*handle = act;
+	return ESP_OK;
+}
+
+// Traduce el aviso del servo al de la cerradura
+static void actuator_servo_done(servo_handle_t servo, void *arg)
+{
+	struct actuator *act = arg;
+	if (act->done) act->done(act, act->done_arg);
+}
+
+static esp_err_t actuator_move(struct actuator *act, bool open, actuator_done_cb_t done, void *arg)
+{
+	if (act->config.type == ACTUATOR_SERVO) {
+		// Un movimiento reemplazado no avisa, así que pisar done no pierde nada.
+		// Las llamadas vienen de una sola tarea por cerradura.
+		act->done = done;
+		act->done_arg = arg;
+		float angle = open ? act->config.open_angle : act->config.closed_angle;
+		return servo_move_to(act->servo, angle, actuator_servo_done, act);
+	}
+	relay_set(act, open);
+	if (done) done(act, arg);
+	return ESP_OK;
+}
+
+esp_err_t actuator_open(actuator_handle_t actuator, actuator_done_cb_t done, void *arg)
+{
+	return actuator_move(actuator, true, done, arg);
+}
+
+esp_err_t actuator_close(actuator_handle_t actuator, actuator_done_cb_t done, void *arg)
+{
+	return actuator_move(actuator, false, done, arg);
+}
+
+actuator_type_t actuator_get_type(actuator_handle_t actuator)
+{
+	return actuator->config.type;
+}
+
+bool actuator_is_moving(actuator_handle_t actuator)
+{
+	return actuator->config.type == ACTUATOR_SERVO && servo_is_moving(actuator->servo);
+}
+
+uint32_t actuator_remaining_ms(actuator_handle_t actuator)
+{
+	return (actuator->config.type == ACTUATOR_SERVO) ? servo_remaining_ms(actuator->servo) : 0;
+}
+
+float actuator_get_position(actuator_handle_t actuator)
+{
+	if (actuator->config.type == ACTUATOR_SERVO) return servo_get_angle(actuator->servo);
+	return actuator->open ? 1 : 0;
+}
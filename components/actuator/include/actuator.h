@@ -0,0 +1,113 @@
+#ifndef MAIN_ACTUATOR_H_
+#define MAIN_ACTUATOR_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "servo.h"
+
+/*
+ * Cerraduras de las puertas: un servo (cofre) o un relé (cerradura
+ * eléctrica) detrás de la misma interfaz. Abrir y cerrar no bloquean; el fin
+ * del movimiento se avisa con un callback.
+ */
+
+/** Máximo de servos: operador A de los tres timers de las dos unidades MCPWM */
+#define ACTUATOR_MAX_SERVOS 6
+
+/**
+ * @brief Tipo de cerradura.
+ */
+typedef enum {
+	ACTUATOR_SERVO = 0,     /**< Servo en un operador MCPWM libre */
+	ACTUATOR_RELAY,         /**< Salida GPIO: activa = abierta */
+} actuator_type_t;
+
+/**
+ * @brief Configuración de una cerradura.
+ */
+typedef struct {
+	actuator_type_t type;
+	int gpio;               /**< Salida del servo o del relé */
+	float closed_angle;     /**< Servo: ángulo cerrado */
+	float open_angle;       /**< Servo: ángulo abierto */
+	bool active_high;       /**< Relé: nivel que abre */
+} actuator_config_t;
+
+/**
+ * @brief Handle de una cerradura.
+ */
+typedef struct actuator *actuator_handle_t;
+
+/**
+ * @brief Aviso de fin de apertura o cierre. Puede correr en la tarea de
+ * esp_timer (servo) o en la que llamó (relé): no debe bloquear.
+ */
+typedef void (*actuator_done_cb_t)(actuator_handle_t actuator, void *arg);
+
+/**
+ * @brief Arma una configuración desde un texto de Kconfig:
+ * "servo,GPIO,cerrado,abierto" (p. ej. "servo,2,60,10") o "relay,GPIO,nivel"
+ * (p. ej. "relay,16,1").
+ *
+ * @param config Configuración a completar.
+ * @param spec Texto.
+ * @return esp_err_t ESP_OK o ESP_ERR_INVALID_ARG.
+ */
+esp_err_t actuator_config_from_string(actuator_config_t *config, const char *spec);
+
+/**
+ * @brief Crea una cerradura. Los servos toman el próximo operador MCPWM libre.
+ *
+ * @param config Configuración.
+ * @param servo Parámetros comunes de los servos (pulsos, velocidad,
+ * aceleración, frecuencia); se ignoran en un relé. gpio, unit, timer,
+ * signal e initial_angle los completa esta función.
+ * @param position Servo: último ángulo conocido (no se envía hasta el primer
+ * movimiento). Relé: ignorado, arranca cerrado.
+ * @param handle Devuelve el handle.
+ * @return esp_err_t ESP_OK, ESP_ERR_INVALID_ARG o ESP_ERR_NO_MEM si no quedan operadores.
+ */
+esp_err_t actuator_create(const actuator_config_t *config, const servo_config_t *servo, float position, actuator_handle_t *handle);
+
+/**
+ * @brief Abre la cerradura.
+ *
+ * @param actuator Cerradura.
+ * @param done Se llama al terminar (puede ser NULL).
+ * @param arg Argumento de done.
+ * @return esp_err_t Resultado.
+ */
+esp_err_t actuator_open(actuator_handle_t actuator, actuator_done_cb_t done, void *arg);
+
+/**
+ * @brief Cierra la cerradura. Interrumpe una apertura en curso.
+ *
+ * @param actuator Cerradura.
+ * @param done Se llama al terminar (puede ser NULL).
+ * @param arg Argumento de done.
+ * @return esp_err_t Resultado.
+ */
+esp_err_t actuator_close(actuator_handle_t actuator, actuator_done_cb_t done, void *arg);
+
+/**
+ * @brief Tipo de la cerradura.
+ */
+actuator_type_t actuator_get_type(actuator_handle_t actuator);
+
+/**
+ * @brief Indica si la cerradura se está moviendo.
+ */
+bool actuator_is_moving(actuator_handle_t actuator);
+
+/**
+ * @brief Tiempo que le falta al movimiento en curso, en ms (0 en un relé).
+ */
+uint32_t actuator_remaining_ms(actuator_handle_t actuator);
+
+/**
+ * @brief Posición actual: ángulo del servo, 1 o 0 para un relé abierto o cerrado.
+ */
+float actuator_get_position(actuator_handle_t actuator);
+
+#endif /* MAIN_ACTUATOR_H_ */
@@ -0,0 +1,118 @@
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "code_entry.h"
+
+static void entry_clear(code_entry_t *entry)
+{
+	memset(entry->code, 0, sizeof(entry->code));
+	entry->len = 0;
+	entry->code_ready = false;
+	entry->has_card = false;
+	entry->card = 0;
+}
+
+// Copia la credencial a submitted y deja el ingreso vacío
+static code_entry_result_t entry_submit(code_entry_t *entry)
+{
+	memcpy(entry->submitted.code, entry->code, sizeof(entry->code));
+	entry->submitted.has_card = entry->has_card;
+	entry->submitted.card = entry->card;
+	entry_clear(entry);
+	return CODE_ENTRY_SUBMIT;
+}
+
+// El código está completo: se envía o, con tarjeta obligatoria, se la espera
+static code_entry_result_t entry_code_done(code_entry_t *entry)
+{
+	if (entry->policy.require_card && !entry->has_card) {
+		entry->code_ready = true;
+		return CODE_ENTRY_WAIT_CARD;
+	}
+	return entry_submit(entry);
+}
+
+void code_entry_init(code_entry_t *entry, const code_entry_policy_t *policy)
+{
+	memset(entry, 0, sizeof(code_entry_t));
+	entry->policy = *policy;
+	if (entry->policy.max_len < 1 || entry->policy.max_len > CODE_ENTRY_MAX_LEN) entry->policy.max_len = CODE_ENTRY_MAX_LEN;
+	if (entry->policy.min_len < 1) entry->policy.min_len = 1;
+	if (entry->policy.min_len > entry->policy.max_len) entry->policy.min_len = entry->policy.max_len;
+}
+
+bool code_entry_busy(const code_entry_t *entry)
+{
+	return entry->len > 0 || entry->has_card;
+}
+
+uint32_t code_entry_remaining(const code_entry_t *entry, uint32_t now_ms)
+{
+	if (!code_entry_busy(entry)) return UINT32_MAX;
+	uint32_t elapsed = now_ms - entry->last_ms;
+	return (elapsed < entry->policy.timeout_ms) ? entry->policy.timeout_ms - elapsed : 0;
+}
+
+code_entry_result_t code_entry_tick(code_entry_t *entry, uint32_t now_ms)
+{
+	if (code_entry_busy(entry) && code_entry_remaining(entry, now_ms) == 0) {
+		entry_clear(entry);
+		return CODE_ENTRY_TIMEOUT;
+	}
+	return CODE_ENTRY_IGNORED;
+}
+
+code_entry_result_t code_entry_key(code_entry_t *entry, char key, uint32_t now_ms)
+{
+	code_entry_tick(entry, now_ms);
+
+	if (key == entry->policy.cancel_key) {
+		if (!code_entry_busy(entry)) return CODE_ENTRY_IGNORED;
+		entry_clear(entry);
+		return CODE_ENTRY_CANCELLED;
+	}
+	// Con el código listo solo falta la tarjeta: las teclas no lo cambian
+	if (entry->code_ready) return CODE_ENTRY_IGNORED;
+
+	if (key >= '0' && key <= '9') {
+		if (entry->len >= entry->policy.max_len) return CODE_ENTRY_IGNORED;
+		entry->code[entry->len++] = key;
+		entry->last_ms = now_ms;
+		if (entry->policy.auto_submit && entry->len == entry->policy.max_len) return entry_code_done(entry);
+		return CODE_ENTRY_DIGIT;
+	}
+	if (key == entry->policy.submit_key && entry->len >= entry->policy.min_len) {
+		entry->last_ms = now_ms;
+		return entry_code_done(entry);
+	}
+	return CODE_ENTRY_IGNORED;
+}
+
+code_entry_result_t code_entry_card(code_entry_t *entry, uint64_t card, uint32_t now_ms)
+{
+	if (!entry->policy.require_card) return CODE_ENTRY_IGNORED;
+	code_entry_tick(entry, now_ms);
+
+	// Una tarjeta nueva reemplaza a la anterior
+	entry->has_card = true;
+	entry->card = card;
+	entry->last_ms = now_ms;
+	if (entry->code_ready) return entry_submit(entry);
+	return CODE_ENTRY_CARD;
+}
+
+size_t code_entry_json(const code_entry_credential_t *credential, const char *device_id, char *buf, size_t size)
+{
+	int len;
+	if (credential->code[0] != '\0' && credential->has_card) {
+		len = snprintf(buf, size, "{\"device_id\":\"%s\",\"code\":\"%s\",\"card\":\"%" PRIu64 "\"}",
+			device_id, credential->code, credential->card);
+	} else if (credential->has_card) {
+		len = snprintf(buf, size, "{\"device_id\":\"%s\",\"card\":\"%" PRIu64 "\"}", device_id, credential->card);
+	} else {
+		len = snprintf(buf, size, "{\"device_id\":\"%s\",\"code\":\"%s\"}", device_id, credential->code);
+	}
+	if (len < 0 || (size_t)len >= size) return 0;
+	return len;
+}
@@ -0,0 +1,66 @@
+/*
+ * Throughput of code_entry.c: keys per second for each policy, over a
+ * stream of random keypad keys (digits, '*', '#') 300 ms apart, with the
+ * occasional pause longer than the timeout.
+ *
+ * usage: code_entry_bench [keys]
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "code_entry.h"
+#include "test_util.h"
+
+typedef struct {
+	const char *name;
+	code_entry_policy_t policy;
+} bench_case_t;
+
+static const bench_case_t cases[] = {
+	{ "default",       CODE_ENTRY_POLICY_DEFAULT },
+	{ "pin_4_8",       { .min_len = 4, .max_len = 8, .timeout_ms = 15000, .cancel_key = '*', .submit_key = '#' } },
+	{ "auto_submit_6", { .min_len = 6, .max_len = 6, .auto_submit = true, .timeout_ms = 15000, .cancel_key = '*', .submit_key = '#' } },
+	{ "code_and_card", { .min_len = 6, .max_len = 6, .require_card = true, .timeout_ms = 15000, .cancel_key = '*', .submit_key = '#' } },
+};
+
+static double now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+int main(int argc, char **argv)
+{
+	int nkeys = (argc > 1) ? atoi(argv[1]) : 10000000;
+	char *keys = malloc(nkeys);
+	if (keys == NULL) return 2;
+
+	// Mostly digits, so codes get completed
+	uint32_t rng = 12345;
+	for (int i = 0; i < nkeys; i++) {
+		uint32_t r = rng_range(&rng, 16);
+		keys[i] = (r < 12) ? '0' + r % 10 : (r < 15) ? '#' : '*';
+	}
+
+	printf("%-16s %12s %10s %10s %8s\n", "policy", "keys", "submits", "timeouts", "ns/key");
+	for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+		code_entry_t e;
+		code_entry_init(&e, &cases[c].policy);
+		uint32_t now = 0;
+		unsigned submits = 0, timeouts = 0;
+
+		double t0 = now_us();
+		for (int i = 0; i < nkeys; i++) {
+			now += (i % 997 == 0) ? 20000 : 300;
+			if (code_entry_tick(&e, now) == CODE_ENTRY_TIMEOUT) timeouts++;
+			if (cases[c].policy.require_card && i % 7 == 0) code_entry_card(&e, i, now);
+			if (code_entry_key(&e, keys[i], now) == CODE_ENTRY_SUBMIT) submits++;
+		}
+		double t1 = now_us();
+		printf("%-16s %12d %10u %10u %8.1f\n", cases[c].name, nkeys, submits, timeouts, (t1 - t0) * 1e3 / nkeys);
+	}
+	free(keys);
+	return 0;
+}
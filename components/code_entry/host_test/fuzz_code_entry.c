@@ -0,0 +1,103 @@
+/*
+ * Fuzz test of code_entry.c: arbitrary bytes are decoded as a policy and
+ * a sequence of keys, cards and clock jumps, and the state invariants are
+ * checked after every step.
+ *
+ * Built with clang and -DCODE_ENTRY_LIBFUZZER=ON it is a libFuzzer target.
+ * Otherwise it runs random inputs from a fixed seed:
+ *
+ * usage: code_entry_fuzz [iterations] [seed]
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "code_entry.h"
+#include "test_util.h"
+
+static void check_state(const code_entry_t *e, uint32_t now)
+{
+	const code_entry_policy_t *p = &e->policy;
+	CHECK(p->min_len >= 1 && p->min_len <= p->max_len && p->max_len <= CODE_ENTRY_MAX_LEN,
+		"policy %u..%u", p->min_len, p->max_len);
+	CHECK(e->len <= p->max_len && e->code[e->len] == '\0' && strlen(e->code) == e->len, "length %u", e->len);
+	for (int i = 0; i < e->len; i++) CHECK(e->code[i] >= '0' && e->code[i] <= '9', "non digit 0x%02x", e->code[i]);
+	CHECK(!e->code_ready || (p->require_card && !e->has_card && e->len >= p->min_len), "code_ready");
+	CHECK(!e->has_card || p->require_card, "card without require_card");
+	uint32_t left = code_entry_remaining(e, now);
+	CHECK(code_entry_busy(e) ? left <= p->timeout_ms : left == UINT32_MAX, "remaining %u", left);
+}
+
+static void check_submit(const code_entry_t *e)
+{
+	const code_entry_credential_t *c = &e->submitted;
+	size_t len = strlen(c->code);
+	CHECK(len >= e->policy.min_len && len <= e->policy.max_len, "submitted length %zu", len);
+	CHECK(c->has_card == e->policy.require_card, "submitted card");
+	CHECK(!code_entry_busy(e), "busy after submit");
+	// The longest credential must fit in the buffer the application uses
+	char json[128];
+	CHECK(code_entry_json(c, "0123456789abcdef0123456789abcdef", json, sizeof(json)) > 0, "json");
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	if (size < 4) return 0;
+	code_entry_policy_t p = {
+		.min_len = data[0] % 20,      // out of range values too
+		.max_len = data[1] % 20,
+		.auto_submit = data[2] & 1,
+		.require_card = data[2] & 2,
+		.timeout_ms = 1 + data[3] * 100,
+		.cancel_key = '*',
+		.submit_key = '#',
+	};
+	code_entry_t e;
+	code_entry_init(&e, &p);
+	uint32_t now = (data[2] & 4) ? UINT32_MAX - 1000 : 0;
+
+	for (size_t i = 4; i + 1 < size; i += 2) {
+		uint8_t op = data[i];
+		uint8_t arg = data[i + 1];
+		code_entry_result_t r;
+		switch (op & 3) {
+		case 0:
+		case 1:
+			now += arg * 10;
+			r = code_entry_key(&e, (char)(op >> 2), now);   // 0..63: digits, '*', '#' and others
+			break;
+		case 2:
+			now += arg * 10;
+			r = code_entry_card(&e, (uint64_t)op << 56 | arg, now);
+			break;
+		default:
+			now += (uint32_t)arg << (op >> 3);               // jumps up to 2^31
+			r = code_entry_tick(&e, now);
+			break;
+		}
+		if (r == CODE_ENTRY_SUBMIT) check_submit(&e);
+		check_state(&e, now);
+		if (failures > 0) abort();
+	}
+	return 0;
+}
+
+#ifndef CODE_ENTRY_LIBFUZZER
+int main(int argc, char **argv)
+{
+	int iterations = (argc > 1) ? atoi(argv[1]) : 200000;
+	uint32_t rng = (argc > 2) ? (uint32_t)strtoul(argv[2], NULL, 0) : 0x9E3779B9;
+	uint8_t data[256];
+
+	for (int it = 0; it < iterations; it++) {
+		size_t size = rng_range(&rng, sizeof(data));
+		for (size_t i = 0; i < size; i++) {
+			// Half of the keys from the keypad alphabet, so codes get completed
+			uint32_t r = rng_next(&rng);
+			data[i] = (i >= 4 && (i % 2) == 0 && (r & 0x100)) ? (uint8_t)("0123456789*#"[r % 12] << 2) : (uint8_t)r;
+		}
+		LLVMFuzzerTestOneInput(data, size);
+	}
+	printf("code_entry fuzz: %d inputs, no invariant broken\n", iterations);
+	return 0;
+}
+#endif
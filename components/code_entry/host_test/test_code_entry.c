@@ -0,0 +1,338 @@
+/*
+ * Tests of code_entry.c: fixed scenarios for each policy and properties
+ * checked over random key/card/time sequences.
+ *
+ * usage: code_entry_test [sequences]
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "code_entry.h"
+#include "test_util.h"
+
+static const code_entry_policy_t policy_default = CODE_ENTRY_POLICY_DEFAULT;
+
+// Types the keys of a string 100 ms apart, returns the result of the last one
+static code_entry_result_t type_keys(code_entry_t *e, const char *keys, uint32_t *now)
+{
+	code_entry_result_t r = CODE_ENTRY_IGNORED;
+	for (const char *k = keys; *k; k++) {
+		r = code_entry_key(e, *k, *now);
+		*now += 100;
+	}
+	return r;
+}
+
+//------------------------------------------scenarios-------------------------------
+
+static void test_default_policy(void)
+{
+	code_entry_t e;
+	uint32_t now = 1000;
+	char json[128];
+	code_entry_init(&e, &policy_default);
+
+	CHECK(type_keys(&e, "123456", &now) == CODE_ENTRY_DIGIT, "digits");
+	CHECK(code_entry_key(&e, '#', now) == CODE_ENTRY_SUBMIT, "submit");
+	CHECK(strcmp(e.submitted.code, "123456") == 0 && !e.submitted.has_card, "submitted %s", e.submitted.code);
+	CHECK(!code_entry_busy(&e), "cleared after submit");
+	code_entry_json(&e.submitted, "abc", json, sizeof(json));
+	CHECK(strcmp(json, "{\"device_id\":\"abc\",\"code\":\"123456\"}") == 0, "json %s", json);
+
+	// Short codes are kept until completed
+	CHECK(type_keys(&e, "12345#", &now) == CODE_ENTRY_IGNORED, "short submit");
+	CHECK(type_keys(&e, "6#", &now) == CODE_ENTRY_SUBMIT, "completed submit");
+	CHECK(strcmp(e.submitted.code, "123456") == 0, "completed %s", e.submitted.code);
+
+	// Extra digits are dropped
+	CHECK(type_keys(&e, "1234567", &now) == CODE_ENTRY_IGNORED, "seventh digit");
+	CHECK(type_keys(&e, "#", &now) == CODE_ENTRY_SUBMIT && strcmp(e.submitted.code, "123456") == 0, "6 of 7");
+
+	// Cancel, and cancel with nothing typed
+	CHECK(type_keys(&e, "12*", &now) == CODE_ENTRY_CANCELLED && !code_entry_busy(&e), "cancel");
+	CHECK(type_keys(&e, "*", &now) == CODE_ENTRY_IGNORED, "cancel when idle");
+	CHECK(type_keys(&e, "AD#", &now) == CODE_ENTRY_IGNORED && !code_entry_busy(&e), "letters");
+
+	// Cards are not part of the default policy
+	CHECK(code_entry_card(&e, 42, now) == CODE_ENTRY_IGNORED && !code_entry_busy(&e), "card");
+}
+
+static void test_timeout(void)
+{
+	code_entry_t e;
+	uint32_t now = 5000;
+	code_entry_init(&e, &policy_default);
+
+	CHECK(code_entry_remaining(&e, now) == UINT32_MAX, "idle remaining");
+	type_keys(&e, "123", &now);
+	uint32_t last = now - 100;
+	CHECK(code_entry_remaining(&e, last + 5000) == 10000, "remaining %u", code_entry_remaining(&e, last + 5000));
+	CHECK(code_entry_tick(&e, last + 14999) == CODE_ENTRY_IGNORED && code_entry_busy(&e), "before timeout");
+	CHECK(code_entry_remaining(&e, last + 20000) == 0, "remaining after timeout");
+	CHECK(code_entry_tick(&e, last + 15000) == CODE_ENTRY_TIMEOUT && !code_entry_busy(&e), "timeout");
+
+	// A key after the timeout starts a new code, without calling tick
+	now = 1000;
+	type_keys(&e, "999", &now);
+	now += 15000;
+	type_keys(&e, "123456#", &now);
+	CHECK(strcmp(e.submitted.code, "123456") == 0, "new code after timeout: %s", e.submitted.code);
+
+	// The millisecond clock wraps after 49 days
+	now = UINT32_MAX - 150;
+	type_keys(&e, "12", &now);
+	CHECK(now < 1000, "clock wrapped");
+	CHECK(code_entry_remaining(&e, now) == 14900, "remaining across wrap %u", code_entry_remaining(&e, now));
+	CHECK(type_keys(&e, "3456#", &now) == CODE_ENTRY_SUBMIT && strcmp(e.submitted.code, "123456") == 0, "across wrap");
+}
+
+static void test_variable_length(void)
+{
+	code_entry_policy_t p = policy_default;
+	p.min_len = 4;
+	p.max_len = 8;
+	code_entry_t e;
+	uint32_t now = 0;
+	code_entry_init(&e, &p);
+
+	CHECK(type_keys(&e, "123#", &now) == CODE_ENTRY_IGNORED, "3 digits");
+	CHECK(type_keys(&e, "4#", &now) == CODE_ENTRY_SUBMIT && strcmp(e.submitted.code, "1234") == 0, "4 digits");
+	CHECK(type_keys(&e, "123456789#", &now) == CODE_ENTRY_SUBMIT && strcmp(e.submitted.code, "12345678") == 0,
+		"8 of 9: %s", e.submitted.code);
+
+	// Out of range policies are clamped
+	p.min_len = 0;
+	p.max_len = 40;
+	code_entry_init(&e, &p);
+	CHECK(e.policy.min_len == 1 && e.policy.max_len == CODE_ENTRY_MAX_LEN, "clamp %u..%u", e.policy.min_len, e.policy.max_len);
+	p.min_len = 9;
+	p.max_len = 5;
+	code_entry_init(&e, &p);
+	CHECK(e.policy.min_len == 5, "min > max");
+}
+
+static void test_auto_submit(void)
+{
+	code_entry_policy_t p = policy_default;
+	p.min_len = 4;
+	p.max_len = 4;
+	p.auto_submit = true;
+	code_entry_t e;
+	uint32_t now = 0;
+	code_entry_init(&e, &p);
+
+	CHECK(type_keys(&e, "123", &now) == CODE_ENTRY_DIGIT, "3 digits");
+	CHECK(type_keys(&e, "4", &now) == CODE_ENTRY_SUBMIT && strcmp(e.submitted.code, "1234") == 0, "auto submit");
+	CHECK(!code_entry_busy(&e), "cleared");
+	// '#' still submits before max_len when min_len allows it
+	p.min_len = 2;
+	code_entry_init(&e, &p);
+	CHECK(type_keys(&e, "12#", &now) == CODE_ENTRY_SUBMIT && strcmp(e.submitted.code, "12") == 0, "early submit");
+}
+
+static void test_code_and_card(void)
+{
+	code_entry_policy_t p = policy_default;
+	p.require_card = true;
+	code_entry_t e;
+	uint32_t now = 0;
+	char json[128];
+	code_entry_init(&e, &p);
+
+	// Code first
+	CHECK(type_keys(&e, "123456#", &now) == CODE_ENTRY_WAIT_CARD, "waits for the card");
+	CHECK(type_keys(&e, "78#", &now) == CODE_ENTRY_IGNORED, "keys while waiting");
+	CHECK(code_entry_card(&e, 1234567890123ULL, now) == CODE_ENTRY_SUBMIT, "card completes");
+	CHECK(strcmp(e.submitted.code, "123456") == 0 && e.submitted.has_card && e.submitted.card == 1234567890123ULL, "credential");
+	code_entry_json(&e.submitted, "abc", json, sizeof(json));
+	CHECK(strcmp(json, "{\"device_id\":\"abc\",\"code\":\"123456\",\"card\":\"1234567890123\"}") == 0, "json %s", json);
+	CHECK(code_entry_json(&e.submitted, "abc", json, 20) == 0, "json doesn't fit");
+
+	// Card first, a second card replaces it
+	CHECK(code_entry_card(&e, 1, now) == CODE_ENTRY_CARD, "card stored");
+	CHECK(code_entry_card(&e, 2, now) == CODE_ENTRY_CARD, "card replaced");
+	CHECK(type_keys(&e, "654321#", &now) == CODE_ENTRY_SUBMIT && e.submitted.card == 2, "code completes");
+
+	// Cancel and timeout drop both
+	code_entry_card(&e, 3, now);
+	CHECK(type_keys(&e, "*", &now) == CODE_ENTRY_CANCELLED && !code_entry_busy(&e), "cancel card");
+	type_keys(&e, "123456#", &now);
+	CHECK(code_entry_tick(&e, now + 15000) == CODE_ENTRY_TIMEOUT, "waiting card times out");
+	CHECK(code_entry_card(&e, 4, now + 15000) == CODE_ENTRY_CARD, "late card starts over");
+}
+
+//------------------------------------------properties-------------------------------
+// Random sequences of keys, cards and time steps. The test keeps its own
+// account of what was typed, following the documented behavior, and checks
+// every result against it.
+
+static const char alphabet[] = "0123456789*#ABCD";
+
+typedef struct {
+	uint8_t kind;        // 0 key, 1 card, 2 tick
+	char key;
+	uint64_t card;
+	uint32_t delta_ms;   // time since the previous operation
+} op_t;
+
+#define MAX_OPS 64
+
+static void random_ops(uint32_t *rng, const code_entry_policy_t *p, op_t *ops, int n)
+{
+	for (int i = 0; i < n; i++) {
+		uint32_t r = rng_range(rng, 100);
+		ops[i].kind = (r < 80) ? 0 : (r < 90 && p->require_card) ? 1 : 2;
+		ops[i].key = alphabet[rng_range(rng, sizeof(alphabet) - 1)];
+		ops[i].card = rng_next(rng) % 8;
+		r = rng_range(rng, 100);
+		if (r < 80) ops[i].delta_ms = rng_range(rng, 2000);
+		else if (r < 90) ops[i].delta_ms = p->timeout_ms - 1 + rng_range(rng, 3);  // around the timeout
+		else ops[i].delta_ms = rng_next(rng);                                    // anything, even wrapping
+	}
+}
+
+static void random_policy(uint32_t *rng, code_entry_policy_t *p)
+{
+	*p = policy_default;
+	p->max_len = 1 + rng_range(rng, CODE_ENTRY_MAX_LEN);
+	p->min_len = 1 + rng_range(rng, p->max_len);
+	p->auto_submit = rng_range(rng, 2);
+	p->require_card = rng_range(rng, 2);
+	p->timeout_ms = 1 + rng_range(rng, 30000);
+}
+
+static void run_ops(const code_entry_policy_t *p, const op_t *ops, int n, uint32_t base, code_entry_result_t *results, int seq)
+{
+	code_entry_t e;
+	code_entry_init(&e, p);
+
+	char typed[CODE_ENTRY_MAX_LEN + 1] = {0};   // digits of the current attempt
+	int ntyped = 0;
+	bool ready = false, has_card = false, busy = false;
+	uint64_t card = 0;
+	uint32_t now = base, last = base;
+
+	for (int i = 0; i < n; i++) {
+		const op_t *op = &ops[i];
+		now += op->delta_ms;
+		// Past the timeout the attempt is over
+		bool expired = busy && now - last >= p->timeout_ms;
+		if (expired) {
+			ntyped = 0;
+			typed[0] = '\0';
+			ready = has_card = busy = false;
+		}
+
+		code_entry_result_t r;
+		if (op->kind == 0) r = code_entry_key(&e, op->key, now);
+		else if (op->kind == 1) r = code_entry_card(&e, op->card, now);
+		else r = code_entry_tick(&e, now);
+		results[i] = r;
+
+		// What each result allows
+		bool digit = op->kind == 0 && op->key >= '0' && op->key <= '9';
+		switch (r) {
+		case CODE_ENTRY_DIGIT:
+			CHECK(digit && !ready && ntyped < p->max_len, "seq %d op %d: digit not allowed", seq, i);
+			if (ntyped < CODE_ENTRY_MAX_LEN) typed[ntyped++] = op->key;
+			typed[ntyped] = '\0';
+			CHECK(!(p->auto_submit && ntyped == p->max_len), "seq %d op %d: missed auto submit", seq, i);
+			busy = true;
+			last = now;
+			break;
+		case CODE_ENTRY_CARD:
+			CHECK(p->require_card && op->kind == 1 && !ready, "seq %d op %d: card not allowed", seq, i);
+			has_card = busy = true;
+			card = op->card;
+			last = now;
+			break;
+		case CODE_ENTRY_WAIT_CARD:
+			CHECK((op->kind == 0 && op->key == p->submit_key) || (digit && p->auto_submit), "seq %d op %d: wait card key", seq, i);
+			if (digit && ntyped < CODE_ENTRY_MAX_LEN) typed[ntyped++] = op->key;
+			typed[ntyped] = '\0';
+			CHECK(p->require_card && !has_card && ntyped >= p->min_len, "seq %d op %d: wait card", seq, i);
+			ready = busy = true;
+			last = now;
+			break;
+		case CODE_ENTRY_SUBMIT:
+			if (digit && ntyped < CODE_ENTRY_MAX_LEN) typed[ntyped++] = op->key;
+			typed[ntyped] = '\0';
+			CHECK(strcmp(e.submitted.code, typed) == 0, "seq %d op %d: submitted %s, typed %s", seq, i, e.submitted.code, typed);
+			CHECK(ntyped >= p->min_len && ntyped <= p->max_len, "seq %d op %d: length %d", seq, i, ntyped);
+			if (op->kind == 1) {
+				CHECK(ready && e.submitted.card == op->card, "seq %d op %d: card submit", seq, i);
+			} else if (digit) {
+				CHECK(p->auto_submit && ntyped == p->max_len, "seq %d op %d: digit submit", seq, i);
+			} else {
+				CHECK(op->kind == 0 && op->key == p->submit_key, "seq %d op %d: submit key", seq, i);
+			}
+			CHECK(e.submitted.has_card == p->require_card, "seq %d op %d: has_card", seq, i);
+			if (op->kind != 1 && p->require_card) CHECK(has_card && e.submitted.card == card, "seq %d op %d: card", seq, i);
+			ntyped = 0;
+			typed[0] = '\0';
+			ready = has_card = busy = false;
+			break;
+		case CODE_ENTRY_CANCELLED:
+			CHECK(op->kind == 0 && op->key == p->cancel_key && busy, "seq %d op %d: cancel", seq, i);
+			ntyped = 0;
+			typed[0] = '\0';
+			ready = has_card = busy = false;
+			break;
+		case CODE_ENTRY_TIMEOUT:
+			CHECK(op->kind == 2 && expired, "seq %d op %d: unexpected timeout", seq, i);
+			break;
+		case CODE_ENTRY_IGNORED:
+			// Inputs that must have done something
+			CHECK(!(op->kind == 2 && expired), "seq %d op %d: timeout missed", seq, i);
+			CHECK(!(digit && !ready && ntyped < p->max_len), "seq %d op %d: digit dropped", seq, i);
+			CHECK(!(op->kind == 0 && op->key == p->cancel_key && busy), "seq %d op %d: cancel dropped", seq, i);
+			CHECK(!(op->kind == 1 && p->require_card), "seq %d op %d: card dropped", seq, i);
+			CHECK(!(op->kind == 0 && op->key == p->submit_key && !ready && ntyped >= p->min_len), "seq %d op %d: submit dropped", seq, i);
+			break;
+		}
+
+		// State agrees with the account
+		CHECK(e.len == ntyped && strcmp(e.code, typed) == 0, "seq %d op %d: code %s, typed %s", seq, i, e.code, typed);
+		CHECK(code_entry_busy(&e) == busy, "seq %d op %d: busy", seq, i);
+		uint32_t left = code_entry_remaining(&e, now);
+		CHECK(busy ? left <= p->timeout_ms : left == UINT32_MAX, "seq %d op %d: remaining %u", seq, i, left);
+	}
+}
+
+static void test_properties(int sequences)
+{
+	uint32_t rng = 0x2545F491;
+	op_t ops[MAX_OPS];
+	code_entry_result_t results[MAX_OPS], shifted[MAX_OPS];
+
+	for (int seq = 0; seq < sequences && failures < 20; seq++) {
+		code_entry_policy_t p;
+		random_policy(&rng, &p);
+		int n = 1 + rng_range(&rng, MAX_OPS);
+		random_ops(&rng, &p, ops, n);
+
+		run_ops(&p, ops, n, 0, results, seq);
+		// Only time differences matter: the same sequence near the wrap gives the same results
+		run_ops(&p, ops, n, UINT32_MAX - rng_range(&rng, 60000), shifted, seq);
+		CHECK(memcmp(results, shifted, n * sizeof(results[0])) == 0, "seq %d: depends on the clock origin", seq);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	int sequences = (argc > 1) ? atoi(argv[1]) : 20000;
+
+	test_default_policy();
+	test_timeout();
+	test_variable_length();
+	test_auto_submit();
+	test_code_and_card();
+	test_properties(sequences);
+
+	if (failures > 0) {
+		printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+	printf("all code_entry checks passed (%d random sequences)\n", sequences);
+	return 0;
+}
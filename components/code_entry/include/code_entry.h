@@ -0,0 +1,146 @@
+#ifndef MAIN_CODE_ENTRY_H_
+#define MAIN_CODE_ENTRY_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Máquina de estados del ingreso de códigos por teclado.
+ *
+ * No depende de ESP-IDF ni de FreeRTOS: el reloj se pasa en cada llamada
+ * (milisegundos de 32 bits, se admite que den la vuelta), así se compila
+ * y se prueba en Linux (ver host_test/).
+ */
+
+/** Máximo de dígitos de un código */
+#define CODE_ENTRY_MAX_LEN 16
+
+/**
+ * @brief Política de ingreso.
+ */
+typedef struct {
+	uint8_t min_len;        /**< Dígitos mínimos para enviar (1..max_len) */
+	uint8_t max_len;        /**< Dígitos máximos (1..CODE_ENTRY_MAX_LEN) */
+	bool auto_submit;       /**< Enviar al llegar a max_len, sin esperar la tecla de envío */
+	bool require_card;      /**< Código y tarjeta: el envío espera a tener los dos */
+	uint32_t timeout_ms;    /**< Inactividad que descarta lo ingresado */
+	char cancel_key;        /**< Tecla que borra lo ingresado */
+	char submit_key;        /**< Tecla de envío */
+} code_entry_policy_t;
+
+/** Política original: 6 dígitos, '*' cancela, '#' envía, 15 s de espera */
+#define CODE_ENTRY_POLICY_DEFAULT { \
+	.min_len = 6, \
+	.max_len = 6, \
+	.auto_submit = false, \
+	.require_card = false, \
+	.timeout_ms = 15000, \
+	.cancel_key = '*', \
+	.submit_key = '#', \
+}
+
+/**
+ * @brief Resultado de cada entrada.
+ */
+typedef enum {
+	CODE_ENTRY_IGNORED = 0, /**< No cambió nada (tecla desconocida, buffer lleno, envío incompleto) */
+	CODE_ENTRY_DIGIT,       /**< Se agregó un dígito */
+	CODE_ENTRY_CARD,        /**< Se guardó la tarjeta, falta el código */
+	CODE_ENTRY_WAIT_CARD,   /**< El código está completo, falta la tarjeta */
+	CODE_ENTRY_CANCELLED,   /**< Se borró lo ingresado */
+	CODE_ENTRY_TIMEOUT,     /**< Venció la espera y se borró lo ingresado */
+	CODE_ENTRY_SUBMIT,      /**< Credencial completa en code_entry_t::submitted */
+} code_entry_result_t;
+
+/**
+ * @brief Credencial lista para enviar.
+ */
+typedef struct {
+	char code[CODE_ENTRY_MAX_LEN + 1];  /**< Dígitos, "" si no hay código */
+	bool has_card;                      /**< Se presentó una tarjeta */
+	uint64_t card;                      /**< Número de serie de la tarjeta */
+} code_entry_credential_t;
+
+/**
+ * @brief Estado del ingreso. Los campos son de solo lectura fuera del módulo.
+ */
+typedef struct {
+	code_entry_policy_t policy;
+	char code[CODE_ENTRY_MAX_LEN + 1];  /**< Dígitos ingresados hasta ahora */
+	uint8_t len;
+	bool code_ready;                    /**< Código completo esperando la tarjeta */
+	bool has_card;
+	uint64_t card;
+	uint32_t last_ms;                   /**< Hora de la última entrada */
+	code_entry_credential_t submitted;  /**< Última credencial enviada */
+} code_entry_t;
+
+/**
+ * @brief Inicializa el ingreso vacío.
+ *
+ * @param entry Estado a inicializar.
+ * @param policy Política; los valores fuera de rango se ajustan.
+ */
+void code_entry_init(code_entry_t *entry, const code_entry_policy_t *policy);
+
+/**
+ * @brief Procesa una tecla.
+ *
+ * Antes de la tecla se aplica el vencimiento: una tecla que llega pasado
+ * timeout_ms empieza un código nuevo.
+ *
+ * @param entry Estado del ingreso.
+ * @param key Carácter de la tecla.
+ * @param now_ms Hora actual.
+ * @return code_entry_result_t Qué hizo la tecla.
+ */
+code_entry_result_t code_entry_key(code_entry_t *entry, char key, uint32_t now_ms);
+
+/**
+ * @brief Procesa una tarjeta. Solo se usa con require_card.
+ *
+ * @param entry Estado del ingreso.
+ * @param card Número de serie.
+ * @param now_ms Hora actual.
+ * @return code_entry_result_t CODE_ENTRY_CARD, CODE_ENTRY_SUBMIT si ya había
+ * un código completo, o CODE_ENTRY_IGNORED sin require_card.
+ */
+code_entry_result_t code_entry_card(code_entry_t *entry, uint64_t card, uint32_t now_ms);
+
+/**
+ * @brief Aplica el vencimiento sin entrada nueva.
+ *
+ * @param entry Estado del ingreso.
+ * @param now_ms Hora actual.
+ * @return code_entry_result_t CODE_ENTRY_TIMEOUT si se borró lo ingresado.
+ */
+code_entry_result_t code_entry_tick(code_entry_t *entry, uint32_t now_ms);
+
+/**
+ * @brief Tiempo hasta que vence lo ingresado, para dormir hasta entonces.
+ *
+ * @param entry Estado del ingreso.
+ * @param now_ms Hora actual.
+ * @return uint32_t Milisegundos (0 si ya venció), UINT32_MAX si no hay nada ingresado.
+ */
+uint32_t code_entry_remaining(const code_entry_t *entry, uint32_t now_ms);
+
+/**
+ * @brief Indica si hay algo ingresado.
+ */
+bool code_entry_busy(const code_entry_t *entry);
+
+/**
+ * @brief Arma el JSON de una credencial, con el formato que espera el backend:
+ * {"device_id":"...","code":"..."} y/o "card":"...".
+ *
+ * @param credential Credencial enviada.
+ * @param device_id Identificador del equipo.
+ * @param buf Buffer de salida.
+ * @param size Tamaño del buffer.
+ * @return size_t Largo del JSON, 0 si no entra en el buffer.
+ */
+size_t code_entry_json(const code_entry_credential_t *credential, const char *device_id, char *buf, size_t size);
+
+#endif /* MAIN_CODE_ENTRY_H_ */
@@ -0,0 +1,288 @@
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "cred_cache.h"
+
+//------------------------------------------SipHash-2-4-------------------------------
+
+#define ROTL(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIPROUND do { \
+		v0 += v1; v1 = ROTL(v1, 13); v1 ^= v0; v0 = ROTL(v0, 32); \
+		v2 += v3; v3 = ROTL(v3, 16); v3 ^= v2; \
+		v0 += v3; v3 = ROTL(v3, 21); v3 ^= v0; \
+		v2 += v1; v1 = ROTL(v1, 17); v1 ^= v2; v2 = ROTL(v2, 32); \
+	} while (0)
+
+static uint64_t load_le64(const uint8_t *p)
+{
+	uint64_t v = 0;
+	for (int i = 7; i >= 0; i--) v = (v << 8) | p[i];
+	return v;
+}
+
+uint64_t cred_cache_siphash(const uint8_t key[CRED_CACHE_KEY_LEN], const void *data, size_t len)
+{
+	const uint8_t *in = data;
+	uint64_t k0 = load_le64(key);
+	uint64_t k1 = load_le64(key + 8);
+	uint64_t v0 = 0x736f6d6570736575ULL ^ k0;
+	uint64_t v1 = 0x646f72616e646f6dULL ^ k1;
+	uint64_t v2 = 0x6c7967656e657261ULL ^ k0;
+	uint64_t v3 = 0x7465646279746573ULL ^ k1;
+
+	size_t blocks = len & ~(size_t)7;
+	for (size_t i = 0; i < blocks; i += 8) {
+		uint64_t m = load_le64(in + i);
+		v3 ^= m;
+		SIPROUND;
+		SIPROUND;
+		v0 ^= m;
+	}
+
+	// Último bloque: los bytes que sobran y el largo en el byte alto
+	uint64_t b = (uint64_t)len << 56;
+	for (size_t i = 0; i < (len & 7); i++) b |= (uint64_t)in[blocks + i] << (8 * i);
+	v3 ^= b;
+	SIPROUND;
+	SIPROUND;
+	v0 ^= b;
+
+	v2 ^= 0xff;
+	SIPROUND;
+	SIPROUND;
+	SIPROUND;
+	SIPROUND;
+	return v0 ^ v1 ^ v2 ^ v3;
+}
+
+uint32_t cred_cache_key_id(const uint8_t key[CRED_CACHE_KEY_LEN])
+{
+	static const char label[] = "cred_cache";
+	return (uint32_t)cred_cache_siphash(key, label, sizeof(label) - 1);
+}
+
+//------------------------------------------tabla-------------------------------
+
+void cred_cache_init(cred_cache_t *cache, cred_entry_t *entries, uint32_t capacity, const uint8_t key[CRED_CACHE_KEY_LEN])
+{
+	memset(cache, 0, sizeof(cred_cache_t));
+	cache->entries = entries;
+	cache->capacity = capacity;
+	memcpy(cache->key, key, CRED_CACHE_KEY_LEN);
+}
+
+static int hex_digit(char c)
+{
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+bool cred_cache_parse_key(const char *hex, uint8_t key[CRED_CACHE_KEY_LEN])
+{
+	if (strlen(hex) != 2 * CRED_CACHE_KEY_LEN) return false;
+	for (int i = 0; i < CRED_CACHE_KEY_LEN; i++) {
+		int hi = hex_digit(hex[2 * i]), lo = hex_digit(hex[2 * i + 1]);
+		if (hi < 0 || lo < 0) return false;
+		key[i] = (uint8_t)(hi << 4 | lo);
+	}
+	return true;
+}
+
+uint64_t cred_cache_hash(const cred_cache_t *cache, bool has_card, uint64_t card, const char *code)
+{
+	uint8_t msg[1 + 8 + 1 + 32];
+	size_t len = 0;
+	if (has_card) {
+		msg[len++] = 'C';
+		for (int i = 0; i < 8; i++) msg[len++] = (uint8_t)(card >> (8 * i));
+	}
+	if (code != NULL && code[0] != '\0') {
+		size_t n = strnlen(code, sizeof(msg) - len - 1);
+		msg[len++] = 'P';
+		memcpy(msg + len, code, n);
+		len += n;
+	}
+	return cred_cache_siphash(cache->key, msg, len);
+}
+
+// Posición de hash, o donde habría que insertarlo
+static uint32_t cache_find(const cred_cache_t *cache, uint64_t hash, bool *found)
+{
+	uint32_t lo = 0, hi = cache->count;
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (cache->entries[mid].hash < hash) lo = mid + 1;
+		else hi = mid;
+	}
+	*found = lo < cache->count && cache->entries[lo].hash == hash;
+	return lo;
+}
+
+static bool entry_expired(const cred_entry_t *entry, uint32_t now)
+{
+	return entry->expires != 0 && (now == 0 || now >= entry->expires);
+}
+
+cred_cache_result_t cred_cache_check(const cred_entry_t *entry, uint8_t door, uint32_t now)
+{
+	if (entry_expired(entry, now)) return CRED_CACHE_EXPIRED;
+	if (door >= 8 || !(entry->doors & (1u << door))) return CRED_CACHE_WRONG_DOOR;
+	return CRED_CACHE_HIT;
+}
+
+cred_cache_result_t cred_cache_lookup(const cred_cache_t *cache, uint64_t hash, uint8_t door, uint32_t now, cred_entry_t *entry)
+{
+	bool found;
+	uint32_t pos = cache_find(cache, hash, &found);
+	if (!found) return CRED_CACHE_MISS;
+	const cred_entry_t *e = &cache->entries[pos];
+	if (entry) *entry = *e;
+	return cred_cache_check(e, door, now);
+}
+
+bool cred_cache_put(cred_cache_t *cache, const cred_entry_t *entry)
+{
+	bool found;
+	uint32_t pos = cache_find(cache, entry->hash, &found);
+	if (!found) {
+		if (cache->count >= cache->capacity) return false;
+		memmove(&cache->entries[pos + 1], &cache->entries[pos], (cache->count - pos) * sizeof(cred_entry_t));
+		cache->count++;
+	}
+	cache->entries[pos] = *entry;
+	return true;
+}
+
+bool cred_cache_remove(cred_cache_t *cache, uint64_t hash)
+{
+	bool found;
+	uint32_t pos = cache_find(cache, hash, &found);
+	if (!found) return false;
+	memmove(&cache->entries[pos], &cache->entries[pos + 1], (cache->count - pos - 1) * sizeof(cred_entry_t));
+	cache->count--;
+	return true;
+}
+
+uint32_t cred_cache_purge(cred_cache_t *cache, uint32_t now)
+{
+	if (now == 0) return 0;
+	uint32_t kept = 0;
+	for (uint32_t i = 0; i < cache->count; i++) {
+		if (!entry_expired(&cache->entries[i], now)) cache->entries[kept++] = cache->entries[i];
+	}
+	uint32_t removed = cache->count - kept;
+	cache->count = kept;
+	return removed;
+}
+
+//------------------------------------------sincronización-------------------------------
+
+typedef enum {
+	OP_NONE = 0,   // Línea vacía
+	OP_CLEAR,
+	OP_PUT,
+	OP_REMOVE,
+	OP_VERSION,
+	OP_INVALID,
+} sync_op_type_t;
+
+typedef struct {
+	sync_op_type_t type;
+	cred_entry_t entry;
+	uint32_t version;
+} sync_op_t;
+
+#define SYNC_LINE_MAX 64
+
+static void sync_parse_line(const char *line, sync_op_t *op)
+{
+	unsigned grant, doors;
+	char extra;
+	memset(op, 0, sizeof(sync_op_t));
+	op->type = OP_INVALID;
+
+	switch (line[0]) {
+	case '\0':
+	case '\r':
+		op->type = OP_NONE;
+		break;
+	case '*':
+		if (line[1] == '\0' || line[1] == '\r') op->type = OP_CLEAR;
+		break;
+	case '+':
+		if (sscanf(line + 1, " %" SCNx64 " %u %x %" SCNu32 " %c", &op->entry.hash, &grant, &doors, &op->entry.expires, &extra) == 4
+			&& grant <= UINT16_MAX && doors <= 0xFF) {
+			op->entry.grant = grant;
+			op->entry.doors = doors;
+			op->type = OP_PUT;
+		}
+		break;
+	case '-':
+		if (sscanf(line + 1, " %" SCNx64 " %c", &op->entry.hash, &extra) == 1) op->type = OP_REMOVE;
+		break;
+	case 'V':
+		if (sscanf(line + 1, " %" SCNu32 " %c", &op->version, &extra) == 1) op->type = OP_VERSION;
+		break;
+	}
+}
+
+// Recorre las líneas del mensaje; con apply en false solo valida y cuenta
+static int sync_run(cred_cache_t *cache, const char *msg, size_t len, bool apply)
+{
+	char line[SYNC_LINE_MAX];
+	bool cleared = false;
+	uint32_t added = 0;
+	int ops = 0;
+	size_t pos = 0;
+
+	while (pos < len) {
+		size_t end = pos;
+		while (end < len && msg[end] != '\n') end++;
+		if (end - pos >= sizeof(line)) return -1;
+		memcpy(line, msg + pos, end - pos);
+		line[end - pos] = '\0';
+		pos = end + 1;
+
+		sync_op_t op;
+		sync_parse_line(line, &op);
+		bool found;
+		switch (op.type) {
+		case OP_NONE:
+			continue;
+		case OP_INVALID:
+			return -1;
+		case OP_CLEAR:
+			if (apply) cache->count = 0;
+			cleared = true;
+			added = 0;
+			break;
+		case OP_PUT:
+			if (apply) cred_cache_put(cache, &op.entry);
+			else if (cleared) added++;
+			else {
+				cache_find(cache, op.entry.hash, &found);
+				if (!found) added++;
+			}
+			break;
+		case OP_REMOVE:
+			if (apply) cred_cache_remove(cache, op.entry.hash);
+			break;
+		case OP_VERSION:
+			if (apply) cache->version = op.version;
+			break;
+		}
+		ops++;
+	}
+	if (!apply && (cleared ? 0 : cache->count) + added > cache->capacity) return -1;
+	return ops;
+}
+
+int cred_cache_apply(cred_cache_t *cache, const char *msg, size_t len)
+{
+	if (sync_run(cache, msg, len, false) < 0) return -1;
+	return sync_run(cache, msg, len, true);
+}
@@ -0,0 +1,52 @@
+#include "nvs.h"
+
+#include "cred_cache_nvs.h"
+
+// NVS "cred_cache": "entries" (blob con la tabla tal cual), "version" y
+// "key_id", un hash de la clave con la que se calcularon los hashes
+#define CRED_CACHE_NAMESPACE "cred_cache"
+
+esp_err_t cred_cache_load(cred_cache_t *cache)
+{
+	nvs_handle_t nvs;
+	uint32_t id, version;
+	size_t size = 0;
+	esp_err_t err = nvs_open(CRED_CACHE_NAMESPACE, NVS_READONLY, &nvs);
+	if (err != ESP_OK) return err;
+
+	err = nvs_get_u32(nvs, "key_id", &id);
+	if (err == ESP_OK) err = nvs_get_u32(nvs, "version", &version);
+	if (err == ESP_OK) err = nvs_get_blob(nvs, "entries", NULL, &size);
+	if (err == ESP_OK && (id != cred_cache_key_id(cache->key) || size % sizeof(cred_entry_t) != 0 || size / sizeof(cred_entry_t) > cache->capacity)) {
+		err = ESP_ERR_INVALID_STATE;
+	}
+	if (err == ESP_OK && size > 0) err = nvs_get_blob(nvs, "entries", cache->entries, &size);
+	nvs_close(nvs);
+	if (err != ESP_OK) return err;
+
+	// Una tabla desordenada no se puede buscar por bisección: se descarta
+	uint32_t count = size / sizeof(cred_entry_t);
+	for (uint32_t i = 1; i < count; i++) {
+		if (cache->entries[i - 1].hash >= cache->entries[i].hash) {
+			cache->count = 0;
+			return ESP_ERR_INVALID_STATE;
+		}
+	}
+	cache->count = count;
+	cache->version = version;
+	return ESP_OK;
+}
+
+esp_err_t cred_cache_save(const cred_cache_t *cache)
+{
+	nvs_handle_t nvs;
+	esp_err_t err = nvs_open(CRED_CACHE_NAMESPACE, NVS_READWRITE, &nvs);
+	if (err != ESP_OK) return err;
+
+	err = nvs_set_blob(nvs, "entries", cache->entries, cache->count * sizeof(cred_entry_t));
+	if (err == ESP_OK) err = nvs_set_u32(nvs, "version", cache->version);
+	if (err == ESP_OK) err = nvs_set_u32(nvs, "key_id", cred_cache_key_id(cache->key));
+	if (err == ESP_OK) err = nvs_commit(nvs);
+	nvs_close(nvs);
+	return err;
+}
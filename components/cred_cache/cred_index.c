@@ -0,0 +1,170 @@
+#include <string.h>
+
+#include "cred_index.h"
+
+// Por debajo de este rango la interpolación no gana: se sigue con binaria
+#define INTERPOLATION_MIN_RANGE 16
+// Pasos de interpolación antes de pasar a binaria (protege de tablas no uniformes)
+#define INTERPOLATION_MAX_STEPS 8
+
+uint32_t cred_index_crc32(uint32_t crc, const void *data, size_t len)
+{
+	// Tabla de 16 entradas: dos pasos por byte, sin ocupar 1 KB de flash
+	static const uint32_t table[16] = {
+		0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+		0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+	};
+	const uint8_t *p = data;
+	crc = ~crc;
+	for (size_t i = 0; i < len; i++) {
+		crc ^= p[i];
+		crc = (crc >> 4) ^ table[crc & 0x0f];
+		crc = (crc >> 4) ^ table[crc & 0x0f];
+	}
+	return ~crc;
+}
+
+static void index_clear(cred_index_t *index)
+{
+	memset(index, 0, sizeof(cred_index_t));
+}
+
+// Una sección de n bytes en offset, dentro de total
+static bool section_fits(uint32_t offset, uint64_t n, uint32_t total, uint32_t align)
+{
+	return offset % align == 0 && offset <= total && n <= total - offset;
+}
+
+cred_index_status_t cred_index_open(cred_index_t *index, const void *image, size_t size, uint32_t key_id, bool check_order)
+{
+	const uint8_t *base = image;
+	cred_index_header_t h;
+	index_clear(index);
+
+	if (size < sizeof(h)) return CRED_INDEX_BAD_HEADER;
+	memcpy(&h, base, sizeof(h));
+	if (h.magic != CRED_INDEX_MAGIC || h.format != CRED_INDEX_FORMAT || h.header_size != sizeof(h)) {
+		return CRED_INDEX_BAD_HEADER;
+	}
+	if (h.key_id != key_id) return CRED_INDEX_WRONG_KEY;
+
+	// La imagen termina con la última sección
+	uint64_t ends[3] = {
+		(uint64_t)h.bloom_offset + h.bloom_bits / 8,
+		(uint64_t)h.keys_offset + (uint64_t)h.count * sizeof(uint64_t),
+		(uint64_t)h.attrs_offset + (uint64_t)h.count * sizeof(cred_index_attr_t),
+	};
+	uint64_t end = sizeof(h);
+	for (int i = 0; i < 3; i++) {
+		if (ends[i] > end) end = ends[i];
+	}
+	if (end > size) return CRED_INDEX_BAD_LAYOUT;
+	uint32_t total = (uint32_t)end;
+	if ((h.bloom_bits & (h.bloom_bits - 1)) != 0 || (h.bloom_bits != 0 && (h.bloom_bits < 8 || h.bloom_hashes < 1 || h.bloom_hashes > 16))) {
+		return CRED_INDEX_BAD_LAYOUT;
+	}
+	if (!section_fits(h.bloom_offset, h.bloom_bits / 8, total, 1)
+		|| !section_fits(h.keys_offset, (uint64_t)h.count * sizeof(uint64_t), total, sizeof(uint64_t))
+		|| !section_fits(h.attrs_offset, (uint64_t)h.count * sizeof(cred_index_attr_t), total, 4)
+		|| h.bloom_offset < sizeof(h) || h.keys_offset < sizeof(h) || h.attrs_offset < sizeof(h)) {
+		return CRED_INDEX_BAD_LAYOUT;
+	}
+	if (cred_index_crc32(0, base + sizeof(h), total - sizeof(h)) != h.crc32) return CRED_INDEX_BAD_CRC;
+
+	const uint64_t *keys = (const uint64_t *)(base + h.keys_offset);
+	if (check_order) {
+		for (uint32_t i = 1; i < h.count; i++) {
+			if (keys[i - 1] >= keys[i]) return CRED_INDEX_UNSORTED;
+		}
+	}
+
+	index->keys = keys;
+	index->attrs = (const cred_index_attr_t *)(base + h.attrs_offset);
+	index->count = h.count;
+	index->version = h.version;
+	index->generation = h.generation;
+	if (h.bloom_bits > 0) {
+		index->bloom = base + h.bloom_offset;
+		index->bloom_mask = h.bloom_bits - 1;
+		index->bloom_hashes = h.bloom_hashes;
+	}
+	return CRED_INDEX_OK;
+}
+
+size_t cred_index_bloom_size(const cred_index_t *index)
+{
+	return index->bloom ? (index->bloom_mask + 1) / 8 : 0;
+}
+
+bool cred_index_bloom_check(const cred_index_t *index, uint64_t hash)
+{
+	if (index->bloom == NULL) return true;
+	// Doble hash sobre las dos mitades del SipHash, que ya es uniforme
+	uint32_t h1 = (uint32_t)hash;
+	uint32_t h2 = (uint32_t)(hash >> 32) | 1;
+	for (uint8_t i = 0; i < index->bloom_hashes; i++) {
+		uint32_t bit = (h1 + i * h2) & index->bloom_mask;
+		if (!(index->bloom[bit >> 3] & (1u << (bit & 7)))) return false;
+	}
+	return true;
+}
+
+// Posición estimada de hash entre lo y hi, con aritmética de 64 bits: las
+// diferencias se achican hasta 32 bits para que el producto no desborde
+static uint32_t interpolate(uint64_t hash, uint64_t klo, uint64_t khi, uint32_t lo, uint32_t hi)
+{
+	uint64_t span = khi - klo;
+	uint64_t offset = hash - klo;
+	int shift = 0;
+	while ((span >> shift) > UINT32_MAX) shift++;
+	uint64_t den = span >> shift;
+	if (den == 0) return lo;
+	uint64_t pos = lo + (offset >> shift) * (hi - lo) / den;
+	return pos > hi ? hi : (uint32_t)pos;
+}
+
+int32_t cred_index_find(const cred_index_t *index, uint64_t hash)
+{
+	const uint64_t *keys = index->keys;
+	if (index->count == 0) return -1;
+	uint32_t lo = 0, hi = index->count - 1;
+	if (hash < keys[lo] || hash > keys[hi]) return -1;
+
+	if (index->search == CRED_INDEX_SEARCH_INTERPOLATION) {
+		// Invariante: keys[lo] <= hash <= keys[hi]
+		for (int step = 0; step < INTERPOLATION_MAX_STEPS && hi - lo > INTERPOLATION_MIN_RANGE; step++) {
+			uint32_t pos = interpolate(hash, keys[lo], keys[hi], lo, hi);
+			uint64_t k = keys[pos];
+			if (k == hash) return pos;
+			if (k < hash) lo = pos + 1;
+			else hi = pos - 1;
+			if (hash < keys[lo] || hash > keys[hi]) return -1;
+		}
+	}
+
+	// Binaria en [lo, hi]
+	uint32_t end = hi + 1;
+	while (lo < end) {
+		uint32_t mid = lo + (end - lo) / 2;
+		if (keys[mid] < hash) lo = mid + 1;
+		else end = mid;
+	}
+	return (lo <= hi && keys[lo] == hash) ? (int32_t)lo : -1;
+}
+
+cred_cache_result_t cred_index_lookup(const cred_index_t *index, uint64_t hash, uint8_t door, uint32_t now, cred_entry_t *entry)
+{
+	if (!cred_index_bloom_check(index, hash)) return CRED_CACHE_MISS;
+	int32_t pos = cred_index_find(index, hash);
+	if (pos < 0) return CRED_CACHE_MISS;
+
+	const cred_index_attr_t *a = &index->attrs[pos];
+	cred_entry_t e = {
+		.hash = hash,
+		.expires = a->expires,
+		.grant = a->grant,
+		.doors = a->doors,
+	};
+	if (entry) *entry = e;
+	return cred_cache_check(&e, door, now);
+}
@@ -0,0 +1,237 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "esp_partition.h"
+#include "esp_log.h"
+#include "rom/miniz.h"
+
+#include "cred_index_partition.h"
+
+#define TAG "CRED_INDEX"
+
+#define SLOTS 2
+#define DICT_SIZE (1 << CRED_SYNC_WINDOW_BITS) // Diccionario circular de tinfl; después, ventana del filtro
+
+typedef struct {
+	const esp_partition_t *part;
+	esp_partition_mmap_handle_t map;
+	const void *image;
+	bool mapped;
+	uint8_t *bloom_copy;
+	uint32_t generation;
+} slot_t;
+
+static slot_t slots[SLOTS];
+static int active_slot = -1;
+static int received_slot = -1;  // Completa, esperando cred_index_commit()
+static uint32_t index_key_id;
+static size_t index_bloom_ram_max;
+
+// Transferencia en curso; todo se pide en el BEGIN y se libera al terminar
+static cred_sync_t *receiver = NULL;
+static tinfl_decompressor *inflator = NULL;
+static uint8_t *dict = NULL;
+static size_t dict_pos;
+static bool inflate_done;
+
+//------------------------------------------particiones-------------------------------
+
+static void slot_release(slot_t *slot)
+{
+	if (slot->mapped) esp_partition_munmap(slot->map);
+	slot->mapped = false;
+	free(slot->bloom_copy);
+	slot->bloom_copy = NULL;
+}
+
+// Abre la imagen de una partición; si no es válida la deja sin mapear
+static bool slot_open(slot_t *slot, cred_index_t *index, bool check_order)
+{
+	slot_release(slot);
+	if (esp_partition_mmap(slot->part, 0, slot->part->size, ESP_PARTITION_MMAP_DATA, &slot->image, &slot->map) != ESP_OK) {
+		return false;
+	}
+	slot->mapped = true;
+	cred_index_status_t status = cred_index_open(index, slot->image, slot->part->size, index_key_id, check_order);
+	if (status != CRED_INDEX_OK) {
+		ESP_LOGI(TAG, "sin imagen válida en \"%s\" (%d)", slot->part->label, status);
+		slot_release(slot);
+		return false;
+	}
+	slot->generation = index->generation;
+
+	size_t bloom_size = cred_index_bloom_size(index);
+	if (bloom_size > 0 && bloom_size <= index_bloom_ram_max) {
+		slot->bloom_copy = malloc(bloom_size);
+		if (slot->bloom_copy != NULL) {
+			memcpy(slot->bloom_copy, index->bloom, bloom_size);
+			index->bloom = slot->bloom_copy;
+		}
+	}
+	ESP_LOGI(TAG, "\"%s\": %" PRIu32 " credenciales, versión %" PRIu32 ", generación %" PRIu32 ", filtro de %u bytes en %s",
+		slot->part->label, index->count, index->version, index->generation, (unsigned)bloom_size, slot->bloom_copy ? "RAM" : "flash");
+	return true;
+}
+
+esp_err_t cred_index_mount(cred_index_t *index, const char *prefix, uint32_t key_id, size_t bloom_ram_max)
+{
+	memset(index, 0, sizeof(cred_index_t));
+	index_key_id = key_id;
+	index_bloom_ram_max = bloom_ram_max;
+	active_slot = -1;
+
+	cred_index_t found[SLOTS];
+	bool valid[SLOTS] = { false };
+	for (int i = 0; i < SLOTS; i++) {
+		char label[17];
+		snprintf(label, sizeof(label), "%s%d", prefix, i);
+		slot_release(&slots[i]);
+		slots[i].part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+		if (slots[i].part == NULL) return ESP_ERR_NOT_FOUND;
+		// El orden ya lo verificó quien escribió la imagen y lo cubre el CRC
+		valid[i] = slot_open(&slots[i], &found[i], false);
+	}
+
+	// La generación da la vuelta: se compara la diferencia
+	for (int i = 0; i < SLOTS; i++) {
+		if (valid[i] && (active_slot < 0 || (int32_t)(found[i].generation - found[active_slot].generation) > 0)) active_slot = i;
+	}
+	for (int i = 0; i < SLOTS; i++) {
+		if (i != active_slot) slot_release(&slots[i]);
+	}
+	if (active_slot < 0) return ESP_ERR_INVALID_STATE;
+	*index = found[active_slot];
+	return ESP_OK;
+}
+
+void cred_index_commit(void)
+{
+	if (received_slot < 0) return;
+	if (active_slot >= 0) slot_release(&slots[active_slot]);
+	active_slot = received_slot;
+	received_slot = -1;
+}
+
+//------------------------------------------sincronización-------------------------------
+
+static bool storage_erase(void *ctx, uint32_t offset, uint32_t size)
+{
+	return esp_partition_erase_range(ctx, offset, size) == ESP_OK;
+}
+
+static bool storage_write(void *ctx, uint32_t offset, const void *data, uint32_t size)
+{
+	return esp_partition_write(ctx, offset, data, size) == ESP_OK;
+}
+
+static bool storage_read(void *ctx, uint32_t offset, void *data, uint32_t size)
+{
+	return esp_partition_read(ctx, offset, data, size) == ESP_OK;
+}
+
+void cred_index_receive_abort(void)
+{
+	if (receiver != NULL && receiver->active) ESP_LOGW(TAG, "transferencia %" PRIu32 " descartada", receiver->transfer);
+	free(receiver);
+	free(inflator);
+	free(dict);
+	receiver = NULL;
+	inflator = NULL;
+	dict = NULL;
+}
+
+static cred_sync_status_t receive_begin(const cred_sync_msg_t *msg, const cred_index_t *active)
+{
+	// El mismo BEGIN otra vez (QoS 1) no reinicia la transferencia
+	if (receiver != NULL && receiver->active && receiver->transfer == msg->transfer && receiver->next_seq == 1) return CRED_SYNC_DUPLICATE;
+	cred_index_receive_abort();
+	if (slots[0].part == NULL || slots[1].part == NULL) return CRED_SYNC_ERR_SPACE;
+
+	receiver = malloc(sizeof(cred_sync_t));
+	inflator = malloc(sizeof(tinfl_decompressor));
+	dict = malloc(DICT_SIZE);
+	if (receiver == NULL || inflator == NULL || dict == NULL) {
+		cred_index_receive_abort();
+		return CRED_SYNC_ERR_SPACE;
+	}
+	tinfl_init(inflator);
+	dict_pos = 0;
+	inflate_done = false;
+
+	// Se escribe en la partición que no está en uso, con la generación siguiente
+	int target = (active_slot == 0) ? 1 : 0;
+	received_slot = -1;
+	slot_release(&slots[target]);
+	cred_sync_storage_t storage = {
+		.ctx = (void *)slots[target].part,
+		.erase = storage_erase,
+		.write = storage_write,
+		.read = storage_read,
+		.size = slots[target].part->size,
+		.sector = slots[target].part->erase_size,
+	};
+	uint32_t generation = (active_slot >= 0) ? slots[active_slot].generation + 1 : 1;
+	cred_sync_status_t status = cred_sync_begin(receiver, &storage, msg, active_slot >= 0 ? active : NULL, index_key_id, generation);
+	if (status != CRED_SYNC_OK) {
+		cred_index_receive_abort();
+		return status;
+	}
+	ESP_LOGI(TAG, "transferencia %" PRIu32 " (%s, %" PRIu32 " registros) a \"%s\"", msg->transfer,
+		msg->kind == CRED_SYNC_DELTA ? "delta" : "copia", msg->records, slots[target].part->label);
+	return CRED_SYNC_OK;
+}
+
+// Descomprime un trozo del flujo zlib y pasa lo que sale a cred_sync
+static cred_sync_status_t receive_data(const cred_sync_msg_t *msg)
+{
+	const uint8_t *in = msg->payload;
+	size_t len = msg->payload_len;
+	bool more_output = true;
+	while (!inflate_done && (len > 0 || more_output)) {
+		size_t in_bytes = len;
+		size_t out_bytes = DICT_SIZE - dict_pos;
+		tinfl_status status = tinfl_decompress(inflator, in, &in_bytes, dict, dict + dict_pos, &out_bytes,
+			TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_HAS_MORE_INPUT | TINFL_FLAG_COMPUTE_ADLER32);
+		in += in_bytes;
+		len -= in_bytes;
+		if (status < TINFL_STATUS_DONE) return CRED_SYNC_ERR_INFLATE;
+		cred_sync_status_t fed = cred_sync_feed(receiver, dict + dict_pos, out_bytes);
+		if (fed != CRED_SYNC_OK) return fed;
+		dict_pos = (dict_pos + out_bytes) & (DICT_SIZE - 1);
+		inflate_done = (status == TINFL_STATUS_DONE);
+		more_output = (status == TINFL_STATUS_HAS_MORE_OUTPUT);
+	}
+	return (len > 0) ? CRED_SYNC_ERR_INFLATE : CRED_SYNC_OK;  // Datos después del final
+}
+
+static cred_sync_status_t receive_end(const cred_sync_msg_t *msg, cred_index_t *next)
+{
+	if (!inflate_done) return CRED_SYNC_ERR_INFLATE;
+	int target = (active_slot == 0) ? 1 : 0;
+	// El diccionario ya no hace falta: es la ventana del filtro
+	cred_sync_status_t status = cred_sync_finish(receiver, msg, dict, DICT_SIZE);
+	if (status != CRED_SYNC_COMPLETE) return status;
+	if (!slot_open(&slots[target], next, true)) return CRED_SYNC_ERR_FLASH;
+	received_slot = target;
+	return CRED_SYNC_COMPLETE;
+}
+
+cred_sync_status_t cred_index_receive(const void *msg, size_t len, const cred_index_t *active, cred_index_t *next)
+{
+	cred_sync_msg_t m;
+	cred_sync_status_t status = cred_sync_parse(msg, len, &m);
+	if (status == CRED_SYNC_OK) {
+		if (m.type == CRED_SYNC_MSG_BEGIN) {
+			return receive_begin(&m, active);
+		}
+		status = (receiver != NULL) ? cred_sync_next(receiver, &m) : CRED_SYNC_ERR_SEQUENCE;
+		if (status == CRED_SYNC_DUPLICATE) return status;
+		if (status == CRED_SYNC_OK) {
+			status = (m.type == CRED_SYNC_MSG_DATA) ? receive_data(&m) : receive_end(&m, next);
+		}
+	}
+	if (status != CRED_SYNC_OK) cred_index_receive_abort();
+	return status;
+}
@@ -0,0 +1,297 @@
+#include <string.h>
+
+#include "cred_sync.h"
+
+#define HEADER_SIZE sizeof(cred_index_header_t)
+#define ATTR_SIZE sizeof(cred_index_attr_t)
+
+static uint32_t get_le32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t get_le64(const uint8_t *p)
+{
+	return (uint64_t)get_le32(p) | (uint64_t)get_le32(p + 4) << 32;
+}
+
+//------------------------------------------mensajes-------------------------------
+
+cred_sync_status_t cred_sync_parse(const void *msg, size_t len, cred_sync_msg_t *out)
+{
+	const uint8_t *p = msg;
+	memset(out, 0, sizeof(cred_sync_msg_t));
+	if (len < CRED_SYNC_MSG_HEADER) return CRED_SYNC_ERR_FORMAT;
+
+	out->type = p[0];
+	out->kind = p[1];
+	out->transfer = get_le32(p + 4);
+	out->seq = get_le32(p + 8);
+	out->payload = p + CRED_SYNC_MSG_HEADER;
+	out->payload_len = len - CRED_SYNC_MSG_HEADER;
+	if (cred_index_crc32(0, out->payload, out->payload_len) != get_le32(p + 12)) return CRED_SYNC_ERR_CRC;
+
+	switch (out->type) {
+	case CRED_SYNC_MSG_BEGIN:
+		if (out->payload_len != 8 || out->seq != 0 || out->kind > CRED_SYNC_DELTA) return CRED_SYNC_ERR_FORMAT;
+		out->base_version = get_le32(out->payload);
+		out->records = get_le32(out->payload + 4);
+		return CRED_SYNC_OK;
+	case CRED_SYNC_MSG_DATA:
+		return CRED_SYNC_OK;
+	case CRED_SYNC_MSG_END:
+		if (out->payload_len != 4) return CRED_SYNC_ERR_FORMAT;
+		out->length = get_le32(out->payload);
+		return CRED_SYNC_OK;
+	default:
+		return CRED_SYNC_ERR_FORMAT;
+	}
+}
+
+//------------------------------------------flash-------------------------------
+
+// Borra los sectores de [offset, offset + len) que todavía no se usaron
+static bool ensure_erased(cred_sync_t *sync, uint32_t offset, uint32_t len)
+{
+	uint32_t sector = sync->storage.sector;
+	for (uint32_t s = offset / sector; s <= (offset + len - 1) / sector; s++) {
+		if (sync->erased[s / 8] & (1u << (s % 8))) continue;
+		if (!sync->storage.erase(sync->storage.ctx, s * sector, sector)) return false;
+		sync->erased[s / 8] |= 1u << (s % 8);
+	}
+	return true;
+}
+
+static bool write_at(cred_sync_t *sync, uint32_t offset, const void *data, uint32_t len)
+{
+	if (len == 0) return true;
+	return ensure_erased(sync, offset, len) && sync->storage.write(sync->storage.ctx, offset, data, len);
+}
+
+// Los buffers de hashes y atributos terminan en la entrada count
+static bool flush(cred_sync_t *sync)
+{
+	uint32_t keys_at = sync->keys_offset + sync->count * sizeof(uint64_t) - sync->keys_len;
+	uint32_t attrs_at = sync->attrs_offset + sync->count * ATTR_SIZE - sync->attrs_len;
+	if (!write_at(sync, keys_at, sync->keys_buf, sync->keys_len)) return false;
+	if (!write_at(sync, attrs_at, sync->attrs_buf, sync->attrs_len)) return false;
+	sync->keys_len = 0;
+	sync->attrs_len = 0;
+	return true;
+}
+
+static cred_sync_status_t emit(cred_sync_t *sync, uint64_t hash, const cred_index_attr_t *attr)
+{
+	if (sync->count >= sync->capacity) return CRED_SYNC_ERR_FORMAT;
+	memcpy(sync->keys_buf + sync->keys_len, &hash, sizeof(hash));
+	memcpy(sync->attrs_buf + sync->attrs_len, attr, ATTR_SIZE);
+	sync->keys_len += sizeof(hash);
+	sync->attrs_len += ATTR_SIZE;
+	sync->count++;
+	if (sync->keys_len == CRED_SYNC_BUF && !flush(sync)) return CRED_SYNC_ERR_FLASH;
+	return CRED_SYNC_OK;
+}
+
+//------------------------------------------mezcla-------------------------------
+
+// Copia las entradas de la base menores que hash y saltea la igual
+static cred_sync_status_t copy_base(cred_sync_t *sync, uint64_t hash, bool to_end)
+{
+	const cred_index_t *base = sync->base;
+	if (base == NULL) return CRED_SYNC_OK;
+	while (sync->base_pos < base->count && (to_end || base->keys[sync->base_pos] < hash)) {
+		cred_sync_status_t status = emit(sync, base->keys[sync->base_pos], &base->attrs[sync->base_pos]);
+		if (status != CRED_SYNC_OK) return status;
+		sync->base_pos++;
+	}
+	if (!to_end && sync->base_pos < base->count && base->keys[sync->base_pos] == hash) sync->base_pos++;
+	return CRED_SYNC_OK;
+}
+
+static cred_sync_status_t record(cred_sync_t *sync, const uint8_t *r)
+{
+	uint32_t n = sync->received / CRED_SYNC_RECORD_SIZE;  // Ya sumado el de este registro
+	uint64_t hash = get_le64(r + 1);
+	if (n > sync->records) return CRED_SYNC_ERR_FORMAT;
+	if (n > 1 && hash <= sync->last_hash) return CRED_SYNC_ERR_ORDER;
+	sync->last_hash = hash;
+
+	cred_sync_status_t status = copy_base(sync, hash, false);
+	if (status != CRED_SYNC_OK) return status;
+	switch (r[0]) {
+	case CRED_SYNC_OP_PUT: {
+		cred_index_attr_t attr = {
+			.expires = get_le32(r + 9),
+			.grant = (uint16_t)(r[13] | r[14] << 8),
+			.doors = r[15],
+		};
+		return emit(sync, hash, &attr);
+	}
+	case CRED_SYNC_OP_REMOVE:
+		return CRED_SYNC_OK;
+	default:
+		return CRED_SYNC_ERR_FORMAT;
+	}
+}
+
+//------------------------------------------transferencia-------------------------------
+
+cred_sync_status_t cred_sync_begin(cred_sync_t *sync, const cred_sync_storage_t *storage, const cred_sync_msg_t *begin,
+	const cred_index_t *base, uint32_t key_id, uint32_t generation)
+{
+	memset(sync, 0, sizeof(cred_sync_t));
+	sync->storage = *storage;
+	if (begin->kind == CRED_SYNC_DELTA) {
+		if (base == NULL || base->version != begin->base_version) return CRED_SYNC_ERR_BASE;
+		sync->base = base;
+	}
+
+	// Lugar para el peor caso: ninguna alta reemplaza a una entrada de la base
+	uint64_t capacity = (uint64_t)begin->records + (sync->base ? sync->base->count : 0);
+	uint64_t bloom_bits = 0;
+	if (capacity > 0) {
+		bloom_bits = 8;
+		while (bloom_bits < capacity * CRED_SYNC_BLOOM_BITS) bloom_bits <<= 1;
+	}
+	uint64_t keys_offset = HEADER_SIZE;
+	uint64_t attrs_offset = keys_offset + capacity * sizeof(uint64_t);
+	uint64_t bloom_offset = attrs_offset + capacity * ATTR_SIZE;
+	uint64_t end = bloom_offset + bloom_bits / 8;
+	if (end > storage->size || storage->size / storage->sector > CRED_SYNC_MAX_SECTORS) return CRED_SYNC_ERR_SPACE;
+
+	sync->transfer = begin->transfer;
+	sync->next_seq = 1;
+	sync->key_id = key_id;
+	sync->generation = generation;
+	sync->records = begin->records;
+	sync->capacity = (uint32_t)capacity;
+	sync->keys_offset = (uint32_t)keys_offset;
+	sync->attrs_offset = (uint32_t)attrs_offset;
+	sync->bloom_offset = (uint32_t)bloom_offset;
+	sync->bloom_bits = (uint32_t)bloom_bits;
+	// Sin la cabecera vieja la partición queda inválida hasta el final
+	if (!ensure_erased(sync, 0, HEADER_SIZE)) return CRED_SYNC_ERR_FLASH;
+	sync->active = true;
+	return CRED_SYNC_OK;
+}
+
+cred_sync_status_t cred_sync_next(cred_sync_t *sync, const cred_sync_msg_t *msg)
+{
+	if (!sync->active || msg->transfer != sync->transfer) return CRED_SYNC_ERR_SEQUENCE;
+	if (msg->seq == sync->next_seq - 1) return CRED_SYNC_DUPLICATE;
+	if (msg->seq != sync->next_seq) return CRED_SYNC_ERR_SEQUENCE;
+	sync->next_seq++;
+	return CRED_SYNC_OK;
+}
+
+cred_sync_status_t cred_sync_feed(cred_sync_t *sync, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	if (!sync->active) return CRED_SYNC_ERR_SEQUENCE;
+	while (len > 0) {
+		size_t n = CRED_SYNC_RECORD_SIZE - sync->partial_len;
+		if (n > len) n = len;
+		memcpy(sync->partial + sync->partial_len, p, n);
+		sync->partial_len += n;
+		sync->received += n;
+		p += n;
+		len -= n;
+		if (sync->partial_len < CRED_SYNC_RECORD_SIZE) break;
+		sync->partial_len = 0;
+		cred_sync_status_t status = record(sync, sync->partial);
+		if (status != CRED_SYNC_OK) {
+			cred_sync_abort(sync);
+			return status;
+		}
+	}
+	return CRED_SYNC_OK;
+}
+
+// Filtro de Bloom por ventanas de work_size bytes, releyendo los hashes de la flash
+static bool build_bloom(cred_sync_t *sync, uint8_t hashes, uint8_t *work, size_t work_size)
+{
+	uint32_t bytes = sync->bloom_bits / 8;
+	uint32_t mask = sync->bloom_bits - 1;
+	for (uint32_t win = 0; win < bytes; win += work_size) {
+		uint32_t n = (bytes - win < work_size) ? bytes - win : (uint32_t)work_size;
+		memset(work, 0, n);
+		for (uint32_t i = 0; i < sync->count; i += CRED_SYNC_BUF / sizeof(uint64_t)) {
+			uint32_t block = sync->count - i;
+			if (block > CRED_SYNC_BUF / sizeof(uint64_t)) block = CRED_SYNC_BUF / sizeof(uint64_t);
+			if (!sync->storage.read(sync->storage.ctx, sync->keys_offset + i * sizeof(uint64_t), sync->keys_buf, block * sizeof(uint64_t))) {
+				return false;
+			}
+			for (uint32_t k = 0; k < block; k++) {
+				uint64_t hash;
+				memcpy(&hash, sync->keys_buf + k * sizeof(uint64_t), sizeof(hash));
+				uint32_t h1 = (uint32_t)hash;
+				uint32_t h2 = (uint32_t)(hash >> 32) | 1;
+				for (uint8_t j = 0; j < hashes; j++) {
+					uint32_t bit = (h1 + j * h2) & mask;
+					if (bit / 8 - win < n) work[bit / 8 - win] |= 1u << (bit & 7);
+				}
+			}
+		}
+		if (!write_at(sync, sync->bloom_offset + win, work, n)) return false;
+	}
+	return true;
+}
+
+// Cierra la imagen: resto de la base, filtro, CRC releído y por último la cabecera
+static cred_sync_status_t seal(cred_sync_t *sync, const cred_sync_msg_t *end, uint8_t *work, size_t work_size)
+{
+	if (end->length != sync->received || sync->received != sync->records * CRED_SYNC_RECORD_SIZE) return CRED_SYNC_ERR_FORMAT;
+	cred_sync_status_t status = copy_base(sync, 0, true);
+	if (status != CRED_SYNC_OK) return status;
+	if (!flush(sync)) return CRED_SYNC_ERR_FLASH;
+
+	// Cantidad óptima de funciones para el tamaño final: (m / n) ln 2
+	uint8_t hashes = 0;
+	if (sync->count == 0) sync->bloom_bits = 0;
+	if (sync->bloom_bits > 0) {
+		uint64_t k = ((uint64_t)sync->bloom_bits * 693147 / 1000000 + sync->count / 2) / sync->count;
+		hashes = k < 1 ? 1 : k > 16 ? 16 : (uint8_t)k;
+		if (!build_bloom(sync, hashes, work, work_size)) return CRED_SYNC_ERR_FLASH;
+	}
+
+	// Mismo final que calcula cred_index_open()
+	uint32_t total = sync->bloom_offset + sync->bloom_bits / 8;
+	if (sync->attrs_offset + sync->count * ATTR_SIZE > total) total = sync->attrs_offset + sync->count * ATTR_SIZE;
+	uint32_t crc = 0;
+	for (uint32_t at = HEADER_SIZE; at < total; at += CRED_SYNC_BUF) {
+		uint32_t n = (total - at < CRED_SYNC_BUF) ? total - at : CRED_SYNC_BUF;
+		if (!sync->storage.read(sync->storage.ctx, at, sync->attrs_buf, n)) return CRED_SYNC_ERR_FLASH;
+		crc = cred_index_crc32(crc, sync->attrs_buf, n);
+	}
+
+	cred_index_header_t h = {
+		.magic = CRED_INDEX_MAGIC,
+		.format = CRED_INDEX_FORMAT,
+		.header_size = HEADER_SIZE,
+		.key_id = sync->key_id,
+		.version = sync->transfer,
+		.count = sync->count,
+		.bloom_bits = sync->bloom_bits,
+		.bloom_hashes = hashes,
+		.bloom_offset = sync->bloom_offset,
+		.keys_offset = sync->keys_offset,
+		.attrs_offset = sync->attrs_offset,
+		.crc32 = crc,
+		.generation = sync->generation,
+	};
+	return write_at(sync, 0, &h, HEADER_SIZE) ? CRED_SYNC_COMPLETE : CRED_SYNC_ERR_FLASH;
+}
+
+cred_sync_status_t cred_sync_finish(cred_sync_t *sync, const cred_sync_msg_t *end, uint8_t *work, size_t work_size)
+{
+	if (!sync->active) return CRED_SYNC_ERR_SEQUENCE;
+	cred_sync_status_t status = seal(sync, end, work, work_size);
+	cred_sync_abort(sync);
+	return status;
+}
+
+void cred_sync_abort(cred_sync_t *sync)
+{
+	sync->active = false;
+	sync->base = NULL;
+}
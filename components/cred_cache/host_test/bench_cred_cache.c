@@ -0,0 +1,60 @@
+/*
+ * Cost of a local access decision: hash of the credential plus lookup, for
+ * tables of several sizes, half of the lookups hitting.
+ *
+ * usage: cred_cache_bench [lookups]
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cred_cache.h"
+#include "test_util.h"
+
+static const uint32_t sizes[] = { 16, 512, 2048, 100000 };
+
+static double now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+int main(int argc, char **argv)
+{
+	int nlookups = (argc > 1) ? atoi(argv[1]) : 2000000;
+	uint8_t key[CRED_CACHE_KEY_LEN] = { 0 };
+
+	printf("%-10s %12s %10s %10s %10s\n", "entries", "lookups", "hits", "ns/hash", "ns/lookup");
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		uint32_t n = sizes[s];
+		cred_entry_t *entries = malloc(n * sizeof(cred_entry_t));
+		if (entries == NULL) return 2;
+		cred_cache_t cache;
+		cred_cache_init(&cache, entries, n, key);
+
+		// Cards 0, 2, 4...: odd cards miss
+		for (uint32_t i = 0; i < n; i++) {
+			cred_entry_t e = { .hash = cred_cache_hash(&cache, true, 2 * i, NULL), .grant = 101, .doors = 1 };
+			cred_cache_put(&cache, &e);
+		}
+
+		uint32_t rng = 777;
+		uint64_t *hashes = malloc(nlookups * sizeof(uint64_t));
+		if (hashes == NULL) return 2;
+		double t0 = now_us();
+		for (int i = 0; i < nlookups; i++) {
+			hashes[i] = cred_cache_hash(&cache, true, rng_range(&rng, 2 * n), NULL);
+		}
+		double t1 = now_us();
+		unsigned hits = 0;
+		for (int i = 0; i < nlookups; i++) {
+			if (cred_cache_lookup(&cache, hashes[i], 0, 1000, NULL) == CRED_CACHE_HIT) hits++;
+		}
+		double t2 = now_us();
+		printf("%-10u %12d %10u %10.1f %10.1f\n", n, nlookups, hits, (t1 - t0) * 1e3 / nlookups, (t2 - t1) * 1e3 / nlookups);
+		free(hashes);
+		free(entries);
+	}
+	return 0;
+}
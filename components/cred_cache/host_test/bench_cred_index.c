@@ -0,0 +1,89 @@
+/*
+ * Lookups in the static index for 1k to 100k credentials: binary search
+ * against interpolation, with and without the Bloom filter. The filter pays
+ * off when most presented credentials are unknown, so each size is measured
+ * with 50% and 5% of the lookups hitting.
+ *
+ * usage: cred_index_bench [lookups]
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cred_index.h"
+#include "index_image.h"
+#include "test_util.h"
+
+static const uint32_t sizes[] = { 1000, 10000, 50000, 100000 };
+static const uint32_t hit_percent[] = { 50, 5 };
+
+static double now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static double run(const cred_index_t *index, const uint64_t *hashes, int n, unsigned *hits)
+{
+	double t0 = now_us();
+	*hits = 0;
+	for (int i = 0; i < n; i++) {
+		if (cred_index_lookup(index, hashes[i], 0, 1000, NULL) == CRED_CACHE_HIT) (*hits)++;
+	}
+	return (now_us() - t0) * 1e3 / n;
+}
+
+int main(int argc, char **argv)
+{
+	int nlookups = (argc > 1) ? atoi(argv[1]) : 2000000;
+	uint8_t key[CRED_CACHE_KEY_LEN] = { 0 };
+	cred_cache_t cache;
+	cred_cache_init(&cache, NULL, 0, key);
+	uint32_t id = cred_cache_key_id(key);
+
+	printf("%-8s %6s %10s %8s %10s %10s %10s %10s\n", "entries", "hits", "image", "bloom",
+		"binary", "interp", "bin+bloom", "int+bloom");
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		uint32_t n = sizes[s];
+		// Cards 0, 2, 4...: odd cards miss
+		uint64_t *keys = malloc(n * sizeof(uint64_t));
+		uint64_t *hashes = malloc(nlookups * sizeof(uint64_t));
+		if (keys == NULL || hashes == NULL) return 2;
+		for (uint32_t i = 0; i < n; i++) keys[i] = cred_cache_hash(&cache, true, 2 * i, NULL);
+
+		size_t plain_size, bloom_size;
+		void *plain = index_image_build(keys, NULL, n, id, 0, 0, &plain_size);
+		void *filtered = index_image_build(keys, NULL, n, id, 8, 5, &bloom_size);
+		cred_index_t without, with;
+		if (cred_index_open(&without, plain, plain_size, id, false) != CRED_INDEX_OK
+			|| cred_index_open(&with, filtered, bloom_size, id, false) != CRED_INDEX_OK) {
+			return 2;
+		}
+
+		for (size_t p = 0; p < sizeof(hit_percent) / sizeof(hit_percent[0]); p++) {
+			uint32_t rng = 777;
+			for (int i = 0; i < nlookups; i++) {
+				uint32_t card = rng_range(&rng, n);
+				hashes[i] = cred_cache_hash(&cache, true, rng_range(&rng, 100) < hit_percent[p] ? 2 * card : 2 * card + 1, NULL);
+			}
+			double ns[4];
+			unsigned hits;
+			without.search = CRED_INDEX_SEARCH_BINARY;
+			ns[0] = run(&without, hashes, nlookups, &hits);
+			without.search = CRED_INDEX_SEARCH_INTERPOLATION;
+			ns[1] = run(&without, hashes, nlookups, &hits);
+			with.search = CRED_INDEX_SEARCH_BINARY;
+			ns[2] = run(&with, hashes, nlookups, &hits);
+			with.search = CRED_INDEX_SEARCH_INTERPOLATION;
+			ns[3] = run(&with, hashes, nlookups, &hits);
+			printf("%-8u %5u%% %10zu %8zu %10.1f %10.1f %10.1f %10.1f\n", n, 100 * hits / nlookups, bloom_size,
+				cred_index_bloom_size(&with), ns[0], ns[1], ns[2], ns[3]);
+		}
+		free(plain);
+		free(filtered);
+		free(hashes);
+		free(keys);
+	}
+	return 0;
+}
@@ -0,0 +1,81 @@
+/*
+ * Builds cred_index images in memory for the host tests, with the same
+ * layout as tools/cred_index.py.
+ */
+#ifndef CRED_INDEX_IMAGE_H_
+#define CRED_INDEX_IMAGE_H_
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "cred_index.h"
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+/*
+ * keys: count distinct hashes (sorted in place). Every entry gets grant 101,
+ * door 0 and no expiry, except those with attrs. bits_per_entry 0 leaves the
+ * filter out. Returns a malloc'd image, aligned to 8, and its size.
+ */
+static void *index_image_build(uint64_t *keys, const cred_index_attr_t *attrs, uint32_t count, uint32_t key_id,
+	uint32_t bits_per_entry, uint8_t hashes, size_t *size)
+{
+	qsort(keys, count, sizeof(uint64_t), cmp_u64);
+
+	cred_index_header_t h = {
+		.magic = CRED_INDEX_MAGIC,
+		.format = CRED_INDEX_FORMAT,
+		.header_size = sizeof(cred_index_header_t),
+		.key_id = key_id,
+		.version = 1,
+		.count = count,
+	};
+	if (bits_per_entry > 0 && count > 0) {
+		h.bloom_bits = 8;
+		while (h.bloom_bits < (uint64_t)count * bits_per_entry) h.bloom_bits <<= 1;
+		h.bloom_hashes = hashes;
+	}
+	h.bloom_offset = sizeof(h);
+	h.keys_offset = (h.bloom_offset + h.bloom_bits / 8 + 7) & ~7u;
+	h.attrs_offset = h.keys_offset + count * sizeof(uint64_t);
+	*size = h.attrs_offset + count * sizeof(cred_index_attr_t);
+
+	uint8_t *image = aligned_alloc(8, (*size + 7) & ~(size_t)7);
+	if (image == NULL) return NULL;
+	memset(image, 0, *size);
+	memcpy(image + h.keys_offset, keys, count * sizeof(uint64_t));
+	cred_index_attr_t *a = (cred_index_attr_t *)(image + h.attrs_offset);
+	for (uint32_t i = 0; i < count; i++) {
+		if (attrs) a[i] = attrs[i];
+		else a[i] = (cred_index_attr_t){ .grant = 101, .doors = 1 };
+	}
+
+	// Filter with the same double hashing as cred_index_bloom_check()
+	uint8_t *bloom = image + h.bloom_offset;
+	for (uint32_t i = 0; i < count && h.bloom_bits > 0; i++) {
+		uint32_t h1 = (uint32_t)keys[i], h2 = (uint32_t)(keys[i] >> 32) | 1;
+		for (uint8_t k = 0; k < hashes; k++) {
+			uint32_t bit = (h1 + k * h2) & (h.bloom_bits - 1);
+			bloom[bit >> 3] |= 1u << (bit & 7);
+		}
+	}
+
+	h.crc32 = cred_index_crc32(0, image + sizeof(h), *size - sizeof(h));
+	memcpy(image, &h, sizeof(h));
+	return image;
+}
+
+// Rewrites the CRC after a test modifies the body
+static __attribute__((unused)) void index_image_reseal(void *image, size_t size)
+{
+	cred_index_header_t h;
+	memcpy(&h, image, sizeof(h));
+	h.crc32 = cred_index_crc32(0, (uint8_t *)image + sizeof(h), size - sizeof(h));
+	memcpy(image, &h, sizeof(h));
+}
+
+#endif /* CRED_INDEX_IMAGE_H_ */
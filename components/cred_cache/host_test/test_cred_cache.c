@@ -0,0 +1,228 @@
+/*
+ * Tests of cred_cache.c: SipHash reference vectors, lookups with expiry and
+ * doors, sync messages, and the table against a naive model over random
+ * put/remove sequences.
+ *
+ * usage: cred_cache_test [operations]
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "cred_cache.h"
+#include "test_util.h"
+
+#define CAPACITY 64
+
+static const uint8_t test_key[CRED_CACHE_KEY_LEN] = {
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+};
+
+static cred_entry_t storage[CAPACITY];
+
+static void cache_setup(cred_cache_t *cache, uint32_t capacity)
+{
+	cred_cache_init(cache, storage, capacity, test_key);
+}
+
+static cred_entry_t entry(uint64_t hash, uint16_t grant, uint8_t doors, uint32_t expires)
+{
+	cred_entry_t e = { .hash = hash, .grant = grant, .doors = doors, .expires = expires };
+	return e;
+}
+
+static int apply_str(cred_cache_t *cache, const char *msg)
+{
+	return cred_cache_apply(cache, msg, strlen(msg));
+}
+
+//------------------------------------------scenarios-------------------------------
+
+static void test_siphash(void)
+{
+	// Vectors of the SipHash paper (key 00..0f, message 00..n-1)
+	uint8_t msg[16];
+	for (int i = 0; i < 16; i++) msg[i] = i;
+	CHECK(cred_cache_siphash(test_key, msg, 0) == 0x726fdb47dd0e0e31ULL, "empty");
+	CHECK(cred_cache_siphash(test_key, msg, 1) == 0x74f839c593dc67fdULL, "1 byte");
+	CHECK(cred_cache_siphash(test_key, msg, 15) == 0xa129ca6149be45e5ULL, "15 bytes");
+
+	uint8_t key[CRED_CACHE_KEY_LEN];
+	CHECK(cred_cache_parse_key("000102030405060708090a0b0c0d0e0f", key) && memcmp(key, test_key, sizeof(key)) == 0, "parse key");
+	CHECK(!cred_cache_parse_key("000102030405060708090a0b0c0d0e0", key), "short key");
+	CHECK(!cred_cache_parse_key("000102030405060708090a0b0c0d0e0g", key), "bad digit");
+}
+
+static void test_hash(void)
+{
+	cred_cache_t cache;
+	cache_setup(&cache, CAPACITY);
+
+	uint64_t card = cred_cache_hash(&cache, true, 1234, NULL);
+	uint64_t code = cred_cache_hash(&cache, false, 0, "123456");
+	uint64_t both = cred_cache_hash(&cache, true, 1234, "123456");
+	CHECK(card == cred_cache_hash(&cache, true, 1234, ""), "empty code is no code");
+	CHECK(card != code && card != both && code != both, "kinds differ");
+	CHECK(card != cred_cache_hash(&cache, true, 1235, NULL), "cards differ");
+	CHECK(code != cred_cache_hash(&cache, false, 0, "123457"), "codes differ");
+
+	// Card 1234 is 'C' d2 04 00 00 00 00 00 00
+	uint8_t msg[] = { 'C', 0xd2, 0x04, 0, 0, 0, 0, 0, 0, 'P', '1', '2', '3', '4', '5', '6' };
+	CHECK(both == cred_cache_siphash(test_key, msg, sizeof(msg)), "documented encoding");
+}
+
+static void test_lookup(void)
+{
+	cred_cache_t cache;
+	cred_entry_t e;
+	cache_setup(&cache, CAPACITY);
+
+	CHECK(cred_cache_lookup(&cache, 1, 0, 1000, &e) == CRED_CACHE_MISS, "empty");
+	CHECK(cred_cache_put(&cache, &(cred_entry_t){ .hash = 10, .grant = 101, .doors = 0x01 }), "put");
+	CHECK(cred_cache_put(&cache, &(cred_entry_t){ .hash = 20, .grant = 111, .doors = 0x06, .expires = 2000 }), "put expiring");
+
+	CHECK(cred_cache_lookup(&cache, 10, 0, 1000, &e) == CRED_CACHE_HIT && e.grant == 101, "hit");
+	CHECK(cred_cache_lookup(&cache, 10, 0, 0, NULL) == CRED_CACHE_HIT, "no expiry needs no clock");
+	CHECK(cred_cache_lookup(&cache, 10, 1, 1000, NULL) == CRED_CACHE_WRONG_DOOR, "other door");
+	CHECK(cred_cache_lookup(&cache, 10, 9, 1000, NULL) == CRED_CACHE_WRONG_DOOR, "door out of range");
+	CHECK(cred_cache_lookup(&cache, 15, 0, 1000, NULL) == CRED_CACHE_MISS, "between entries");
+
+	CHECK(cred_cache_lookup(&cache, 20, 2, 1999, &e) == CRED_CACHE_HIT && e.grant == 111, "before expiry");
+	CHECK(cred_cache_lookup(&cache, 20, 2, 2000, NULL) == CRED_CACHE_EXPIRED, "at expiry");
+	CHECK(cred_cache_lookup(&cache, 20, 2, 0, NULL) == CRED_CACHE_EXPIRED, "no clock");
+
+	// Replacing keeps one entry per hash
+	CHECK(cred_cache_put(&cache, &(cred_entry_t){ .hash = 10, .grant = 100, .doors = 0xFF }), "replace");
+	CHECK(cache.count == 2, "count %u", cache.count);
+	CHECK(cred_cache_lookup(&cache, 10, 5, 1000, &e) == CRED_CACHE_HIT && e.grant == 100, "replaced");
+
+	CHECK(cred_cache_purge(&cache, 0) == 0 && cache.count == 2, "purge without clock");
+	CHECK(cred_cache_purge(&cache, 3000) == 1 && cache.count == 1, "purge");
+	CHECK(cred_cache_remove(&cache, 10) && !cred_cache_remove(&cache, 10) && cache.count == 0, "remove");
+
+	// Full table
+	cache_setup(&cache, 2);
+	CHECK(cred_cache_put(&cache, &(cred_entry_t){ .hash = 1 }) && cred_cache_put(&cache, &(cred_entry_t){ .hash = 2 }), "fill");
+	CHECK(!cred_cache_put(&cache, &(cred_entry_t){ .hash = 3 }), "full");
+	CHECK(cred_cache_put(&cache, &(cred_entry_t){ .hash = 2, .grant = 101 }), "replace when full");
+}
+
+static void test_sync(void)
+{
+	cred_cache_t cache;
+	cred_entry_t e;
+	cache_setup(&cache, 4);
+
+	CHECK(apply_str(&cache, "*\n+ 00000000000000aa 101 1 0\n+ bb 111 3 1700000000\nV 7\n") == 4, "snapshot");
+	CHECK(cache.count == 2 && cache.version == 7, "count %u version %u", cache.count, cache.version);
+	CHECK(cred_cache_lookup(&cache, 0xaa, 0, 100, &e) == CRED_CACHE_HIT && e.grant == 101, "aa");
+	CHECK(cred_cache_lookup(&cache, 0xbb, 1, 100, &e) == CRED_CACHE_HIT && e.grant == 111 && e.expires == 1700000000, "bb");
+
+	// Delta, with CRLF and a trailing newline missing
+	CHECK(apply_str(&cache, "- aa\r\n+ cc 100 ff 0\r\nV 8") == 3, "delta");
+	CHECK(cache.count == 2 && cache.version == 8, "after delta");
+	CHECK(cred_cache_lookup(&cache, 0xaa, 0, 100, NULL) == CRED_CACHE_MISS, "removed");
+
+	// Invalid messages change nothing
+	const char *bad[] = {
+		"+ dd 101 1\nV 9\n",               // Missing expiry
+		"+ dd 101 1 0 extra\nV 9\n",
+		"+ dd 70000 1 0\n",                // Grant out of range
+		"+ dd 101 100 0\n",                // Doors out of range
+		"? dd\n",
+		"V nine\n",
+		"+ zz 101 1 0\n",
+		"*x\n",
+	};
+	for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+		CHECK(apply_str(&cache, bad[i]) == -1, "bad %zu", i);
+		CHECK(cache.count == 2 && cache.version == 8, "bad %zu applied", i);
+	}
+	char long_line[128];
+	memset(long_line, ' ', sizeof(long_line) - 1);
+	long_line[0] = '-';
+	long_line[sizeof(long_line) - 1] = '\0';
+	CHECK(apply_str(&cache, long_line) == -1, "line too long");
+
+	// Capacity: three new ones do not fit, a snapshot of four does
+	CHECK(apply_str(&cache, "+ 1 101 1 0\n+ 2 101 1 0\n+ 3 101 1 0\n") == -1 && cache.count == 2, "overflow");
+	CHECK(apply_str(&cache, "+ 1 101 1 0\n+ 2 101 1 0\n") == 2 && cache.count == 4, "fill");
+	CHECK(apply_str(&cache, "+ 1 111 1 0\n") == 1 && cache.count == 4, "replace when full");
+	CHECK(apply_str(&cache, "*\n+ 5 101 1 0\n+ 6 101 1 0\n+ 7 101 1 0\n+ 8 101 1 0\nV 10\n") == 6, "snapshot when full");
+	CHECK(cache.count == 4 && cache.version == 10, "snapshot applied");
+	CHECK(apply_str(&cache, "") == 0 && apply_str(&cache, "\n\n") == 0, "empty");
+}
+
+//------------------------------------------properties-------------------------------
+
+// The table must behave like an unsorted list searched linearly
+static void test_model(int nops)
+{
+	cred_cache_t cache;
+	cred_entry_t model[CAPACITY];
+	uint32_t model_count = 0;
+	uint32_t rng = 4242;
+	cache_setup(&cache, CAPACITY);
+
+	for (int op = 0; op < nops && failures == 0; op++) {
+		// Few distinct hashes, so puts replace and removes hit
+		uint64_t hash = (uint64_t)rng_range(&rng, 3 * CAPACITY / 2) * 0x9e3779b97f4a7c15ULL;
+		uint32_t found = model_count;
+		for (uint32_t i = 0; i < model_count; i++) {
+			if (model[i].hash == hash) found = i;
+		}
+
+		switch (rng_range(&rng, 3)) {
+		case 0: {
+			cred_entry_t e = entry(hash, rng_range(&rng, 200), rng_range(&rng, 256), rng_range(&rng, 3) * 1000);
+			bool fits = found < model_count || model_count < CAPACITY;
+			CHECK(cred_cache_put(&cache, &e) == fits, "put %d", op);
+			if (found < model_count) model[found] = e;
+			else if (fits) model[model_count++] = e;
+			break;
+		}
+		case 1:
+			CHECK(cred_cache_remove(&cache, hash) == (found < model_count), "remove %d", op);
+			if (found < model_count) model[found] = model[--model_count];
+			break;
+		default: {
+			cred_entry_t e;
+			uint8_t door = rng_range(&rng, 8);
+			uint32_t now = rng_range(&rng, 3000);
+			cred_cache_result_t r = cred_cache_lookup(&cache, hash, door, now, &e);
+			cred_cache_result_t expected = CRED_CACHE_MISS;
+			if (found < model_count) {
+				const cred_entry_t *m = &model[found];
+				if (m->expires != 0 && (now == 0 || now >= m->expires)) expected = CRED_CACHE_EXPIRED;
+				else if (!(m->doors & (1u << door))) expected = CRED_CACHE_WRONG_DOOR;
+				else expected = CRED_CACHE_HIT;
+				CHECK(e.grant == m->grant && e.doors == m->doors && e.expires == m->expires, "entry %d", op);
+			}
+			CHECK(r == expected, "lookup %d: %d, expected %d", op, r, expected);
+			break;
+		}
+		}
+
+		CHECK(cache.count == model_count, "count %u, expected %u", cache.count, model_count);
+		for (uint32_t i = 1; i < cache.count; i++) {
+			CHECK(cache.entries[i - 1].hash < cache.entries[i].hash, "order at %u after op %d", i, op);
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	int nops = (argc > 1) ? atoi(argv[1]) : 200000;
+
+	test_siphash();
+	test_hash();
+	test_lookup();
+	test_sync();
+	test_model(nops);
+
+	if (failures) {
+		printf("%d failures\n", failures);
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+}
@@ -0,0 +1,263 @@
+/*
+ * Tests of cred_index.c: image validation, both search paths against a
+ * bsearch() reference, the Bloom filter, and (with --image) an image built by
+ * tools/cred_index.py from creds_fixture.csv.
+ *
+ * usage: cred_index_test [lookups]
+ *        cred_index_test --image file.bin
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cred_index.h"
+#include "index_image.h"
+#include "test_util.h"
+
+static const uint8_t test_key[CRED_CACHE_KEY_LEN] = {
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+};
+
+static uint64_t rng64(uint32_t *rng)
+{
+	uint64_t hi = rng_next(rng);
+	return hi << 32 | rng_next(rng);
+}
+
+// Distinct random keys; with clustered, packed in a few narrow ranges
+static uint64_t *make_keys(uint32_t count, uint32_t seed, bool clustered)
+{
+	uint64_t *keys = malloc(count * sizeof(uint64_t));
+	uint32_t rng = seed;
+	for (uint32_t i = 0; i < count; i++) {
+		keys[i] = clustered ? (uint64_t)rng_range(&rng, 4) << 60 | (uint64_t)i * 7919 : rng64(&rng);
+	}
+	return keys;
+}
+
+// Reference search: keys is sorted once index_image_build() returns
+static int32_t reference_find(const uint64_t *keys, uint32_t count, uint64_t hash)
+{
+	const uint64_t *k = bsearch(&hash, keys, count, sizeof(uint64_t), cmp_u64);
+	return k ? (int32_t)(k - keys) : -1;
+}
+
+//------------------------------------------scenarios-------------------------------
+
+static void test_crc(void)
+{
+	CHECK(cred_index_crc32(0, "123456789", 9) == 0xcbf43926, "check value");
+	uint32_t crc = cred_index_crc32(0, "12345", 5);
+	CHECK(cred_index_crc32(crc, "6789", 4) == 0xcbf43926, "incremental");
+}
+
+static void test_open(void)
+{
+	uint32_t id = cred_cache_key_id(test_key);
+	uint64_t *keys = make_keys(100, 1, false);
+	size_t size;
+	uint8_t *image = index_image_build(keys, NULL, 100, id, 8, 5, &size);
+	cred_index_t index;
+
+	CHECK(cred_index_open(&index, image, size, id, true) == CRED_INDEX_OK, "valid");
+	CHECK(index.count == 100 && index.version == 1 && index.bloom != NULL, "fields");
+	CHECK(cred_index_open(&index, image, size + 4096, id, true) == CRED_INDEX_OK, "inside a larger partition");
+	CHECK(cred_index_open(&index, image, size - 1, id, true) == CRED_INDEX_BAD_LAYOUT && index.count == 0, "truncated");
+	CHECK(cred_index_open(&index, image, 10, id, true) == CRED_INDEX_BAD_HEADER, "shorter than the header");
+	CHECK(cred_index_open(&index, image, size, id + 1, true) == CRED_INDEX_WRONG_KEY, "other key");
+
+	cred_index_header_t *h = (cred_index_header_t *)image;
+	h->magic ^= 1;
+	CHECK(cred_index_open(&index, image, size, id, true) == CRED_INDEX_BAD_HEADER, "magic");
+	h->magic ^= 1;
+	h->format = 2;
+	CHECK(cred_index_open(&index, image, size, id, true) == CRED_INDEX_BAD_HEADER, "format");
+	h->format = CRED_INDEX_FORMAT;
+	h->bloom_bits -= 8;
+	CHECK(cred_index_open(&index, image, size, id, true) == CRED_INDEX_BAD_LAYOUT, "bloom not a power of 2");
+	h->bloom_bits += 8;
+	h->count = 0x10000000;
+	CHECK(cred_index_open(&index, image, size, id, true) == CRED_INDEX_BAD_LAYOUT, "huge count");
+	h->count = 100;
+	h->keys_offset += 4;
+	CHECK(cred_index_open(&index, image, size, id, true) == CRED_INDEX_BAD_LAYOUT, "misaligned keys");
+	h->keys_offset -= 4;
+	CHECK(cred_index_open(&index, image, size, id, true) == CRED_INDEX_OK, "restored");
+
+	image[size - 1] ^= 0x40;
+	CHECK(cred_index_open(&index, image, size, id, true) == CRED_INDEX_BAD_CRC, "flipped bit");
+	image[size - 1] ^= 0x40;
+
+	// Unsorted but sealed: only the full check notices
+	uint64_t *k = (uint64_t *)(image + h->keys_offset);
+	uint64_t tmp = k[10];
+	k[10] = k[11];
+	k[11] = tmp;
+	index_image_reseal(image, size);
+	CHECK(cred_index_open(&index, image, size, id, true) == CRED_INDEX_UNSORTED, "unsorted");
+	CHECK(cred_index_open(&index, image, size, id, false) == CRED_INDEX_OK, "unsorted, not checked");
+	free(image);
+
+	// Empty index: everything misses
+	image = index_image_build(keys, NULL, 0, id, 8, 5, &size);
+	CHECK(cred_index_open(&index, image, size, id, true) == CRED_INDEX_OK && index.bloom == NULL, "empty");
+	CHECK(cred_index_lookup(&index, keys[0], 0, 0, NULL) == CRED_CACHE_MISS, "empty lookup");
+	free(image);
+	free(keys);
+}
+
+static void test_attrs(void)
+{
+	uint32_t id = cred_cache_key_id(test_key);
+	uint64_t keys[3] = { 30, 10, 20 };
+	// After sorting: 10, 20, 30
+	cred_index_attr_t attrs[3] = {
+		{ .grant = 101, .doors = 0x01 },
+		{ .grant = 111, .doors = 0x06, .expires = 2000 },
+		{ .grant = 100, .doors = 0xff },
+	};
+	size_t size;
+	void *image = index_image_build(keys, attrs, 3, id, 0, 0, &size);
+	cred_index_t index;
+	cred_entry_t e;
+	CHECK(cred_index_open(&index, image, size, id, true) == CRED_INDEX_OK && index.bloom == NULL, "open");
+
+	CHECK(cred_index_lookup(&index, 10, 0, 1000, &e) == CRED_CACHE_HIT && e.grant == 101 && e.hash == 10, "10");
+	CHECK(cred_index_lookup(&index, 10, 1, 1000, NULL) == CRED_CACHE_WRONG_DOOR, "10 other door");
+	CHECK(cred_index_lookup(&index, 20, 2, 1999, &e) == CRED_CACHE_HIT && e.grant == 111, "20");
+	CHECK(cred_index_lookup(&index, 20, 2, 2000, NULL) == CRED_CACHE_EXPIRED, "20 expired");
+	CHECK(cred_index_lookup(&index, 20, 2, 0, NULL) == CRED_CACHE_EXPIRED, "20 without clock");
+	CHECK(cred_index_lookup(&index, 30, 7, 0, &e) == CRED_CACHE_HIT && e.grant == 100, "30");
+	CHECK(cred_index_lookup(&index, 15, 0, 0, NULL) == CRED_CACHE_MISS, "between");
+	CHECK(cred_index_lookup(&index, 5, 0, 0, NULL) == CRED_CACHE_MISS && cred_index_lookup(&index, 35, 0, 0, NULL) == CRED_CACHE_MISS, "outside");
+	free(image);
+}
+
+//------------------------------------------properties-------------------------------
+
+// Both search paths agree with bsearch(), present and absent keys
+static void test_search(uint32_t count, bool clustered, int lookups)
+{
+	uint32_t id = cred_cache_key_id(test_key);
+	uint64_t *keys = make_keys(count, 77 + count, clustered);
+	size_t size;
+	void *image = index_image_build(keys, NULL, count, id, 0, 0, &size);
+	cred_index_t index;
+	CHECK(cred_index_open(&index, image, size, id, true) == CRED_INDEX_OK, "open %u", count);
+
+	uint32_t rng = 99;
+	for (int i = 0; i < lookups && failures == 0; i++) {
+		uint64_t hash;
+		switch (rng_range(&rng, 4)) {
+		case 0: hash = keys[rng_range(&rng, count)]; break;
+		case 1: hash = keys[rng_range(&rng, count)] + 1; break;
+		case 2: hash = keys[rng_range(&rng, count)] - 1; break;
+		default: hash = rng64(&rng); break;
+		}
+		int32_t expected = reference_find(keys, count, hash);
+		index.search = CRED_INDEX_SEARCH_INTERPOLATION;
+		int32_t a = cred_index_find(&index, hash);
+		index.search = CRED_INDEX_SEARCH_BINARY;
+		int32_t b = cred_index_find(&index, hash);
+		CHECK(a == expected && b == expected, "%s %u: %016llx at %d/%d, expected %d",
+			clustered ? "clustered" : "uniform", count, (unsigned long long)hash, a, b, expected);
+	}
+	// Ends of the table
+	index.search = CRED_INDEX_SEARCH_INTERPOLATION;
+	CHECK(cred_index_find(&index, keys[0]) == 0 && cred_index_find(&index, keys[count - 1]) == (int32_t)count - 1, "ends");
+	free(image);
+	free(keys);
+}
+
+// No false negatives; false positives close to (1 - e^(-kn/m))^k
+static void test_bloom(uint32_t count, uint32_t bits_per_entry, uint8_t hashes)
+{
+	uint32_t id = cred_cache_key_id(test_key);
+	uint64_t *keys = make_keys(count, 5, false);
+	size_t size;
+	void *image = index_image_build(keys, NULL, count, id, bits_per_entry, hashes, &size);
+	cred_index_t index;
+	CHECK(cred_index_open(&index, image, size, id, true) == CRED_INDEX_OK, "open");
+
+	for (uint32_t i = 0; i < count; i++) {
+		CHECK(cred_index_bloom_check(&index, keys[i]), "false negative at %u", i);
+		if (failures) break;
+	}
+	uint32_t rng = 1234, fp = 0, trials = 200000;
+	for (uint32_t i = 0; i < trials; i++) {
+		if (cred_index_bloom_check(&index, rng64(&rng))) fp++;
+	}
+	double m = index.bloom_mask + 1.0;
+	double expected = 1;
+	for (int k = 0; k < hashes; k++) expected *= 1 - exp(-(double)hashes * count / m);
+	double rate = (double)fp / trials;
+	CHECK(rate < expected * 1.3 + 0.001, "false positives %.4f, expected %.4f", rate, expected);
+	printf("bloom %u entries, %.1f bits/entry, %u hashes: %.4f false positives (expected %.4f)\n",
+		count, m / count, hashes, rate, expected);
+	free(image);
+	free(keys);
+}
+
+//------------------------------------------image from the tool-------------------------------
+
+static int test_image(const char *path)
+{
+	FILE *f = fopen(path, "rb");
+	if (f == NULL) {
+		printf("cannot open %s\n", path);
+		return 1;
+	}
+	static uint64_t buf[4096];
+	size_t size = fread(buf, 1, sizeof(buf), f);
+	fclose(f);
+
+	cred_cache_t cache;
+	cred_entry_t storage[1], e;
+	cred_cache_init(&cache, storage, 1, test_key);
+	cred_index_t index;
+	CHECK(cred_index_open(&index, buf, size, cred_cache_key_id(test_key), true) == CRED_INDEX_OK, "open");
+	CHECK(index.count == 5, "5 distinct credentials, got %u", index.count);
+
+	uint64_t card = cred_cache_hash(&cache, true, 1000, NULL);
+	uint64_t code = cred_cache_hash(&cache, false, 0, "123456");
+	uint64_t both = cred_cache_hash(&cache, true, 2000, "654321");
+	CHECK(cred_index_lookup(&index, card, 0, 1000, &e) == CRED_CACHE_HIT && e.grant == 101, "card");
+	CHECK(cred_index_lookup(&index, code, 1, 1000, &e) == CRED_CACHE_HIT && e.grant == 111, "code");
+	CHECK(cred_index_lookup(&index, both, 1, 1000, &e) == CRED_CACHE_HIT && e.expires == 4000000000u, "card and code");
+	CHECK(cred_index_lookup(&index, both, 0, 1000, NULL) == CRED_CACHE_WRONG_DOOR, "card and code, door 0");
+	CHECK(cred_index_lookup(&index, 0xff, 0, 1000, &e) == CRED_CACHE_HIT && e.grant == 100, "raw hash");
+	CHECK(cred_index_lookup(&index, cred_cache_hash(&cache, true, 3000, NULL), 0, 1000, NULL) == CRED_CACHE_EXPIRED, "expired");
+	CHECK(cred_index_lookup(&index, cred_cache_hash(&cache, true, 1001, NULL), 0, 1000, NULL) == CRED_CACHE_MISS, "unknown");
+	CHECK(cred_index_lookup(&index, cred_cache_hash(&cache, false, 0, "1000"), 0, 1000, NULL) == CRED_CACHE_MISS, "code is not card");
+
+	if (failures) {
+		printf("%d failures\n", failures);
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc > 2 && strcmp(argv[1], "--image") == 0) return test_image(argv[2]);
+	int lookups = (argc > 1) ? atoi(argv[1]) : 100000;
+
+	test_crc();
+	test_open();
+	test_attrs();
+	uint32_t sizes[] = { 1, 2, 17, 1000, 50000 };
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		test_search(sizes[i], false, lookups);
+		test_search(sizes[i], true, lookups);
+	}
+	test_bloom(50000, 8, 5);
+	test_bloom(50000, 16, 11);
+
+	if (failures) {
+		printf("%d failures\n", failures);
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+}
@@ -0,0 +1,563 @@
+/*
+ * Tests of cred_sync.c against a RAM partition that behaves like NOR flash
+ * (erase to 0xff, writes only clear bits): snapshots and deltas against a
+ * reference model, rejected transfers, and an interrupted transfer. With
+ * --messages it replays transfers written by tools/cred_index.py, inflated
+ * with zlib like the device does with tinfl.
+ *
+ * usage: cred_sync_test [entries]
+ *        cred_sync_test --messages snapshot_dir [delta_dir]
+ */
+#include <dirent.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cred_sync.h"
+#include "index_image.h"
+#include "test_util.h"
+
+#if CRED_SYNC_TEST_ZLIB
+#include <zlib.h>
+#endif
+
+#define SECTOR 4096
+
+static const uint8_t test_key[CRED_CACHE_KEY_LEN] = {
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+};
+
+//------------------------------------------flash-------------------------------
+
+typedef struct {
+	uint8_t *data;
+	uint32_t size;
+	uint32_t erases;
+	uint32_t writes;
+	uint32_t bad_writes;  // Bits from 0 to 1: write without erase
+} ram_flash_t;
+
+static bool flash_erase(void *ctx, uint32_t offset, uint32_t size)
+{
+	ram_flash_t *f = ctx;
+	if (offset % SECTOR || size % SECTOR || offset + size > f->size) return false;
+	memset(f->data + offset, 0xff, size);
+	f->erases++;
+	return true;
+}
+
+static bool flash_write(void *ctx, uint32_t offset, const void *data, uint32_t size)
+{
+	ram_flash_t *f = ctx;
+	const uint8_t *p = data;
+	if (offset + size > f->size) return false;
+	for (uint32_t i = 0; i < size; i++) {
+		if ((f->data[offset + i] & p[i]) != p[i]) f->bad_writes++;
+		f->data[offset + i] &= p[i];
+	}
+	f->writes++;
+	return true;
+}
+
+static bool flash_read(void *ctx, uint32_t offset, void *data, uint32_t size)
+{
+	ram_flash_t *f = ctx;
+	if (offset + size > f->size) return false;
+	memcpy(data, f->data + offset, size);
+	return true;
+}
+
+// Partition full of garbage, like a used one
+static void flash_init(ram_flash_t *f, uint32_t size)
+{
+	memset(f, 0, sizeof(*f));
+	f->size = size;
+	f->data = aligned_alloc(8, size);
+	for (uint32_t i = 0; i < size; i++) f->data[i] = (uint8_t)(i * 131 + 7);
+}
+
+static cred_sync_storage_t flash_storage(ram_flash_t *f)
+{
+	cred_sync_storage_t s = {
+		.ctx = f,
+		.erase = flash_erase,
+		.write = flash_write,
+		.read = flash_read,
+		.size = f->size,
+		.sector = SECTOR,
+	};
+	return s;
+}
+
+//------------------------------------------messages-------------------------------
+
+typedef struct {
+	uint8_t op;
+	uint64_t hash;
+	cred_index_attr_t attr;
+} rec_t;
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+	for (int i = 0; i < 4; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static size_t make_msg(uint8_t *buf, uint8_t type, uint8_t kind, uint32_t transfer, uint32_t seq, const void *payload, size_t len)
+{
+	memset(buf, 0, CRED_SYNC_MSG_HEADER);
+	buf[0] = type;
+	buf[1] = kind;
+	put_le32(buf + 4, transfer);
+	put_le32(buf + 8, seq);
+	put_le32(buf + 12, cred_index_crc32(0, payload, len));
+	memcpy(buf + CRED_SYNC_MSG_HEADER, payload, len);
+	return CRED_SYNC_MSG_HEADER + len;
+}
+
+static cred_sync_msg_t begin_msg(uint8_t kind, uint32_t transfer, uint32_t base_version, uint32_t records)
+{
+	static uint8_t buf[CRED_SYNC_MSG_HEADER + 8];
+	uint8_t payload[8];
+	put_le32(payload, base_version);
+	put_le32(payload + 4, records);
+	cred_sync_msg_t m;
+	cred_sync_parse(buf, make_msg(buf, CRED_SYNC_MSG_BEGIN, kind, transfer, 0, payload, 8), &m);
+	return m;
+}
+
+static cred_sync_msg_t end_msg(uint32_t transfer, uint32_t seq, uint32_t length)
+{
+	static uint8_t buf[CRED_SYNC_MSG_HEADER + 4];
+	uint8_t payload[4];
+	put_le32(payload, length);
+	cred_sync_msg_t m;
+	cred_sync_parse(buf, make_msg(buf, CRED_SYNC_MSG_END, 0, transfer, seq, payload, 4), &m);
+	return m;
+}
+
+static void encode(uint8_t *out, const rec_t *r)
+{
+	out[0] = r->op;
+	for (int i = 0; i < 8; i++) out[1 + i] = (uint8_t)(r->hash >> (8 * i));
+	put_le32(out + 9, r->attr.expires);
+	out[13] = (uint8_t)r->attr.grant;
+	out[14] = (uint8_t)(r->attr.grant >> 8);
+	out[15] = r->attr.doors;
+}
+
+static uint8_t work[2048];
+
+// Whole transfer, with the records cut in random pieces
+static cred_sync_status_t transfer(ram_flash_t *f, uint8_t kind, uint32_t version, const cred_index_t *base,
+	const rec_t *recs, uint32_t n, uint32_t generation, uint32_t *rng)
+{
+	static cred_sync_t sync;
+	cred_sync_storage_t storage = flash_storage(f);
+	cred_sync_msg_t begin = begin_msg(kind, version, base ? base->version : 0, n);
+	cred_sync_status_t status = cred_sync_begin(&sync, &storage, &begin, base, cred_cache_key_id(test_key), generation);
+	if (status != CRED_SYNC_OK) return status;
+
+	uint8_t *stream = malloc((size_t)n * CRED_SYNC_RECORD_SIZE + 1);
+	for (uint32_t i = 0; i < n; i++) encode(stream + (size_t)i * CRED_SYNC_RECORD_SIZE, &recs[i]);
+	size_t len = (size_t)n * CRED_SYNC_RECORD_SIZE;
+	for (size_t pos = 0; pos < len && status == CRED_SYNC_OK;) {
+		size_t piece = 1 + rng_range(rng, 100);
+		if (piece > len - pos) piece = len - pos;
+		status = cred_sync_feed(&sync, stream + pos, piece);
+		pos += piece;
+	}
+	free(stream);
+	if (status != CRED_SYNC_OK) {
+		CHECK(!sync.active, "an error aborts the transfer");
+		return status;
+	}
+	cred_sync_msg_t end = end_msg(version, 1, len);
+	return cred_sync_finish(&sync, &end, work, sizeof(work));
+}
+
+static int cmp_rec(const void *a, const void *b)
+{
+	uint64_t x = ((const rec_t *)a)->hash, y = ((const rec_t *)b)->hash;
+	return (x > y) - (x < y);
+}
+
+static uint64_t rng64(uint32_t *rng)
+{
+	uint64_t hi = rng_next(rng);
+	return hi << 32 | rng_next(rng);
+}
+
+static rec_t random_put(uint64_t hash, uint32_t *rng)
+{
+	rec_t r = {
+		.op = CRED_SYNC_OP_PUT,
+		.hash = hash,
+		.attr = { .expires = rng_range(rng, 3) * 1000, .grant = 100 + rng_range(rng, 12), .doors = 1 + rng_range(rng, 255) },
+	};
+	return r;
+}
+
+// Entries of the image must be exactly the model (sorted, no removes)
+static void check_image(ram_flash_t *f, const rec_t *model, uint32_t n, uint32_t version, uint32_t generation, const char *what)
+{
+	cred_index_t index;
+	CHECK(cred_index_open(&index, f->data, f->size, cred_cache_key_id(test_key), true) == CRED_INDEX_OK, "%s: open", what);
+	CHECK(index.count == n && index.version == version && index.generation == generation,
+		"%s: count %u version %u generation %u", what, index.count, index.version, index.generation);
+	CHECK(f->bad_writes == 0, "%s: %u writes without erase", what, f->bad_writes);
+	for (uint32_t i = 0; i < n && i < index.count && failures == 0; i++) {
+		CHECK(index.keys[i] == model[i].hash && memcmp(&index.attrs[i], &model[i].attr, sizeof(cred_index_attr_t)) == 0,
+			"%s: entry %u", what, i);
+		CHECK(cred_index_bloom_check(&index, model[i].hash), "%s: false negative %u", what, i);
+	}
+}
+
+//------------------------------------------scenarios-------------------------------
+
+static void test_parse(void)
+{
+	uint8_t buf[64];
+	cred_sync_msg_t m;
+	uint8_t payload[8] = { 7, 0, 0, 0, 3, 0, 0, 0 };
+	size_t len = make_msg(buf, CRED_SYNC_MSG_BEGIN, CRED_SYNC_DELTA, 8, 0, payload, 8);
+	CHECK(cred_sync_parse(buf, len, &m) == CRED_SYNC_OK && m.type == CRED_SYNC_MSG_BEGIN && m.kind == CRED_SYNC_DELTA, "begin");
+	CHECK(m.transfer == 8 && m.base_version == 7 && m.records == 3, "begin fields");
+	buf[len - 1] ^= 1;
+	CHECK(cred_sync_parse(buf, len, &m) == CRED_SYNC_ERR_CRC, "flipped bit");
+	CHECK(cred_sync_parse(buf, 10, &m) == CRED_SYNC_ERR_FORMAT, "short");
+	len = make_msg(buf, CRED_SYNC_MSG_BEGIN, CRED_SYNC_DELTA, 8, 0, payload, 4);
+	CHECK(cred_sync_parse(buf, len, &m) == CRED_SYNC_ERR_FORMAT, "short begin");
+	len = make_msg(buf, CRED_SYNC_MSG_BEGIN, 5, 8, 0, payload, 8);
+	CHECK(cred_sync_parse(buf, len, &m) == CRED_SYNC_ERR_FORMAT, "unknown kind");
+	len = make_msg(buf, 9, 0, 8, 1, payload, 8);
+	CHECK(cred_sync_parse(buf, len, &m) == CRED_SYNC_ERR_FORMAT, "unknown type");
+	len = make_msg(buf, CRED_SYNC_MSG_DATA, 0, 8, 1, payload, 0);
+	CHECK(cred_sync_parse(buf, len, &m) == CRED_SYNC_OK && m.payload_len == 0, "empty data");
+	len = make_msg(buf, CRED_SYNC_MSG_END, 0, 8, 2, payload, 4);
+	CHECK(cred_sync_parse(buf, len, &m) == CRED_SYNC_OK && m.length == 7, "end");
+}
+
+static void test_sequence(void)
+{
+	ram_flash_t f;
+	flash_init(&f, 16 * SECTOR);
+	cred_sync_storage_t storage = flash_storage(&f);
+	cred_sync_t sync;
+	cred_sync_msg_t begin = begin_msg(CRED_SYNC_SNAPSHOT, 5, 0, 0);
+	CHECK(cred_sync_begin(&sync, &storage, &begin, NULL, 1, 1) == CRED_SYNC_OK, "begin");
+
+	cred_sync_msg_t m = { .type = CRED_SYNC_MSG_DATA, .transfer = 5, .seq = 1 };
+	CHECK(cred_sync_next(&sync, &m) == CRED_SYNC_OK, "1");
+	CHECK(cred_sync_next(&sync, &m) == CRED_SYNC_DUPLICATE, "1 again");
+	m.seq = 3;
+	CHECK(cred_sync_next(&sync, &m) == CRED_SYNC_ERR_SEQUENCE, "gap");
+	m.seq = 2;
+	m.transfer = 6;
+	CHECK(cred_sync_next(&sync, &m) == CRED_SYNC_ERR_SEQUENCE, "other transfer");
+	m.transfer = 5;
+	CHECK(cred_sync_next(&sync, &m) == CRED_SYNC_OK, "2");
+	cred_sync_abort(&sync);
+	CHECK(cred_sync_next(&sync, &m) == CRED_SYNC_ERR_SEQUENCE && cred_sync_feed(&sync, "x", 1) == CRED_SYNC_ERR_SEQUENCE, "after abort");
+	free(f.data);
+}
+
+// Snapshot into one partition, then a delta from it into the other
+static void test_snapshot_delta(uint32_t n)
+{
+	uint32_t rng = 2024;
+	ram_flash_t a, b;
+	flash_init(&a, 256 * SECTOR);
+	flash_init(&b, 256 * SECTOR);
+
+	rec_t *model = malloc(2 * n * sizeof(rec_t));
+	for (uint32_t i = 0; i < n; i++) model[i] = random_put(rng64(&rng), &rng);
+	qsort(model, n, sizeof(rec_t), cmp_rec);
+	CHECK(transfer(&a, CRED_SYNC_SNAPSHOT, 10, NULL, model, n, 1, &rng) == CRED_SYNC_COMPLETE, "snapshot");
+	check_image(&a, model, n, 10, 1, "snapshot");
+
+	cred_index_t base;
+	CHECK(cred_index_open(&base, a.data, a.size, cred_cache_key_id(test_key), true) == CRED_INDEX_OK, "base");
+	uint32_t probes = 0, misses = 0;
+	for (int i = 0; i < 10000; i++) {
+		uint64_t h = rng64(&rng);
+		if (cred_index_bloom_check(&base, h)) probes++;
+		if (cred_index_find(&base, h) < 0) misses++;
+	}
+	CHECK(misses == 10000 && probes < 300, "absent keys: %u pass the filter", probes);
+
+	// Delta: a third of the entries change, a third go, absent removes and new puts
+	rec_t *delta = malloc(2 * n * sizeof(rec_t));
+	uint32_t nd = 0;
+	for (uint32_t i = 0; i < n; i++) {
+		switch (rng_range(&rng, 3)) {
+		case 0: delta[nd++] = random_put(model[i].hash, &rng); break;
+		case 1: delta[nd++] = (rec_t){ .op = CRED_SYNC_OP_REMOVE, .hash = model[i].hash }; break;
+		}
+	}
+	for (uint32_t i = 0; i < n / 2; i++) {
+		uint64_t h = rng64(&rng);
+		delta[nd++] = rng_range(&rng, 4) ? random_put(h, &rng) : (rec_t){ .op = CRED_SYNC_OP_REMOVE, .hash = h };
+	}
+	qsort(delta, nd, sizeof(rec_t), cmp_rec);
+
+	// Model after the delta: merge by hand
+	rec_t *after = malloc((n + nd) * sizeof(rec_t));
+	uint32_t na = 0, i = 0, j = 0;
+	while (i < n || j < nd) {
+		if (j == nd || (i < n && model[i].hash < delta[j].hash)) {
+			after[na++] = model[i++];
+			continue;
+		}
+		if (i < n && model[i].hash == delta[j].hash) i++;
+		if (delta[j].op == CRED_SYNC_OP_PUT) after[na++] = delta[j];
+		j++;
+	}
+
+	CHECK(transfer(&b, CRED_SYNC_DELTA, 11, &base, delta, nd, 2, &rng) == CRED_SYNC_COMPLETE, "delta");
+	check_image(&b, after, na, 11, 2, "delta");
+
+	// A delta must start from the active version
+	cred_sync_t sync;
+	cred_sync_storage_t storage = flash_storage(&b);
+	cred_sync_msg_t begin = begin_msg(CRED_SYNC_DELTA, 11, 9, nd);
+	CHECK(cred_sync_begin(&sync, &storage, &begin, &base, 1, 3) == CRED_SYNC_ERR_BASE, "wrong base");
+	CHECK(cred_sync_begin(&sync, &storage, &begin, NULL, 1, 3) == CRED_SYNC_ERR_BASE, "no base");
+	// Rejected at begin: the previous image is still there
+	check_image(&b, after, na, 11, 2, "after a rejected delta");
+
+	free(after);
+	free(delta);
+	free(model);
+	free(a.data);
+	free(b.data);
+}
+
+static void test_rejected(void)
+{
+	uint32_t rng = 5;
+	ram_flash_t f;
+	flash_init(&f, 16 * SECTOR);
+	rec_t recs[40];
+	for (uint32_t i = 0; i < 40; i++) recs[i] = random_put((uint64_t)(i + 1) << 40, &rng);
+	cred_index_t index;
+	uint32_t id = cred_cache_key_id(test_key);
+
+	CHECK(transfer(&f, CRED_SYNC_SNAPSHOT, 1, NULL, recs, 40, 1, &rng) == CRED_SYNC_COMPLETE, "valid");
+	CHECK(cred_index_open(&index, f.data, f.size, id, true) == CRED_INDEX_OK, "valid open");
+
+	// An aborted transfer leaves the partition without an image
+	recs[20].hash = recs[19].hash;
+	CHECK(transfer(&f, CRED_SYNC_SNAPSHOT, 2, NULL, recs, 40, 2, &rng) == CRED_SYNC_ERR_ORDER, "repeated hash");
+	CHECK(cred_index_open(&index, f.data, f.size, id, false) == CRED_INDEX_BAD_HEADER, "invalid after an error");
+	recs[20].hash = recs[19].hash - 1;
+	CHECK(transfer(&f, CRED_SYNC_SNAPSHOT, 2, NULL, recs, 40, 2, &rng) == CRED_SYNC_ERR_ORDER, "unsorted");
+	recs[20].hash = (uint64_t)21 << 40;
+	recs[5].op = 9;
+	CHECK(transfer(&f, CRED_SYNC_SNAPSHOT, 2, NULL, recs, 40, 2, &rng) == CRED_SYNC_ERR_FORMAT, "unknown op");
+	recs[5].op = CRED_SYNC_OP_PUT;
+
+	// Records and lengths must match the BEGIN and the END
+	static cred_sync_t sync;
+	cred_sync_storage_t storage = flash_storage(&f);
+	uint8_t stream[41 * CRED_SYNC_RECORD_SIZE];
+	for (uint32_t i = 0; i < 40; i++) encode(stream + i * CRED_SYNC_RECORD_SIZE, &recs[i]);
+	encode(stream + 40 * CRED_SYNC_RECORD_SIZE, &(rec_t){ .op = CRED_SYNC_OP_PUT, .hash = UINT64_MAX });
+
+	cred_sync_msg_t begin = begin_msg(CRED_SYNC_SNAPSHOT, 3, 0, 39);
+	cred_sync_begin(&sync, &storage, &begin, NULL, id, 3);
+	CHECK(cred_sync_feed(&sync, stream, 40 * CRED_SYNC_RECORD_SIZE) == CRED_SYNC_ERR_FORMAT, "more records than announced");
+
+	begin = begin_msg(CRED_SYNC_SNAPSHOT, 3, 0, 41);
+	cred_sync_begin(&sync, &storage, &begin, NULL, id, 3);
+	CHECK(cred_sync_feed(&sync, stream, 40 * CRED_SYNC_RECORD_SIZE) == CRED_SYNC_OK, "fewer records");
+	cred_sync_msg_t end = end_msg(3, 1, 40 * CRED_SYNC_RECORD_SIZE);
+	CHECK(cred_sync_finish(&sync, &end, work, sizeof(work)) == CRED_SYNC_ERR_FORMAT, "fewer records than announced");
+
+	begin = begin_msg(CRED_SYNC_SNAPSHOT, 3, 0, 41);
+	cred_sync_begin(&sync, &storage, &begin, NULL, id, 3);
+	CHECK(cred_sync_feed(&sync, stream, sizeof(stream) - 3) == CRED_SYNC_OK, "cut record");
+	end = end_msg(3, 1, sizeof(stream) - 3);
+	CHECK(cred_sync_finish(&sync, &end, work, sizeof(work)) == CRED_SYNC_ERR_FORMAT, "cut record at the end");
+
+	begin = begin_msg(CRED_SYNC_SNAPSHOT, 3, 0, 41);
+	cred_sync_begin(&sync, &storage, &begin, NULL, id, 3);
+	cred_sync_feed(&sync, stream, sizeof(stream));
+	end = end_msg(3, 1, sizeof(stream) + 16);
+	CHECK(cred_sync_finish(&sync, &end, work, sizeof(work)) == CRED_SYNC_ERR_FORMAT, "END length");
+
+	// 16 sectors hold about 3800 credentials
+	begin = begin_msg(CRED_SYNC_SNAPSHOT, 3, 0, 5000);
+	CHECK(cred_sync_begin(&sync, &storage, &begin, NULL, id, 3) == CRED_SYNC_ERR_SPACE, "does not fit");
+
+	// Everything removed: empty index without filter
+	CHECK(transfer(&f, CRED_SYNC_SNAPSHOT, 4, NULL, recs, 40, 4, &rng) == CRED_SYNC_COMPLETE, "refill");
+	cred_index_open(&index, f.data, f.size, id, true);
+	ram_flash_t g;
+	flash_init(&g, 16 * SECTOR);
+	for (uint32_t i = 0; i < 40; i++) recs[i].op = CRED_SYNC_OP_REMOVE;
+	CHECK(transfer(&g, CRED_SYNC_DELTA, 5, &index, recs, 40, 5, &rng) == CRED_SYNC_COMPLETE, "remove all");
+	CHECK(cred_index_open(&index, g.data, g.size, id, true) == CRED_INDEX_OK && index.count == 0 && index.bloom == NULL, "empty");
+	CHECK(cred_index_lookup(&index, recs[0].hash, 0, 0, NULL) == CRED_CACHE_MISS, "empty lookup");
+	free(g.data);
+	free(f.data);
+}
+
+// The filter built by windows from flash is the one the host tool would build
+static void test_bloom_windows(uint32_t n)
+{
+	uint32_t rng = 99;
+	ram_flash_t f;
+	flash_init(&f, 512 * SECTOR);
+	rec_t *recs = malloc(n * sizeof(rec_t));
+	uint64_t *keys = malloc(n * sizeof(uint64_t));
+	for (uint32_t i = 0; i < n; i++) recs[i] = random_put(rng64(&rng), &rng);
+	qsort(recs, n, sizeof(rec_t), cmp_rec);
+	for (uint32_t i = 0; i < n; i++) keys[i] = recs[i].hash;
+
+	clock_t t0 = clock();
+	CHECK(transfer(&f, CRED_SYNC_SNAPSHOT, 1, NULL, recs, n, 1, &rng) == CRED_SYNC_COMPLETE, "snapshot of %u", n);
+	double ms = (clock() - t0) * 1000.0 / CLOCKS_PER_SEC;
+
+	cred_index_t index, reference;
+	cred_index_open(&index, f.data, f.size, cred_cache_key_id(test_key), true);
+	size_t size;
+	void *image = index_image_build(keys, NULL, n, 1, CRED_SYNC_BLOOM_BITS, index.bloom_hashes, &size);
+	cred_index_open(&reference, image, size, 1, true);
+	CHECK(cred_index_bloom_size(&index) == cred_index_bloom_size(&reference)
+		&& memcmp(index.bloom, reference.bloom, cred_index_bloom_size(&index)) == 0, "same filter");
+	printf("snapshot of %u: %u erases, %u writes, %.1f ms on the host, %u hashes, filter of %zu bytes\n",
+		n, f.erases, f.writes, ms, index.bloom_hashes, cred_index_bloom_size(&index));
+	free(image);
+	free(keys);
+	free(recs);
+	free(f.data);
+}
+
+//------------------------------------------transfers from the tool-------------------------------
+
+#if CRED_SYNC_TEST_ZLIB
+static int cmp_name(const void *a, const void *b)
+{
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Replays the messages of a directory in name order, like the device would receive them
+static cred_sync_status_t replay(const char *dir, ram_flash_t *f, const cred_index_t *base, uint32_t generation)
+{
+	DIR *d = opendir(dir);
+	if (d == NULL) return CRED_SYNC_ERR_FORMAT;
+	char *names[4096];
+	int count = 0;
+	struct dirent *e;
+	while ((e = readdir(d)) != NULL && count < 4096) {
+		if (strstr(e->d_name, ".bin")) names[count++] = strdup(e->d_name);
+	}
+	closedir(d);
+	qsort(names, count, sizeof(char *), cmp_name);
+
+	static cred_sync_t sync;
+	static uint8_t msg[4096], out[1 << CRED_SYNC_WINDOW_BITS];
+	cred_sync_storage_t storage = flash_storage(f);
+	z_stream z = { 0 };
+	inflateInit2(&z, CRED_SYNC_WINDOW_BITS);  // Rejects streams with a larger window, as tinfl does
+	cred_sync_status_t status = CRED_SYNC_OK;
+	for (int i = 0; i < count && (status == CRED_SYNC_OK || status == CRED_SYNC_DUPLICATE); i++) {
+		char path[512];
+		snprintf(path, sizeof(path), "%s/%s", dir, names[i]);
+		FILE *file = fopen(path, "rb");
+		size_t len = fread(msg, 1, sizeof(msg), file);
+		fclose(file);
+
+		cred_sync_msg_t m;
+		status = cred_sync_parse(msg, len, &m);
+		if (status != CRED_SYNC_OK) break;
+		if (m.type == CRED_SYNC_MSG_BEGIN) {
+			status = cred_sync_begin(&sync, &storage, &m, base, cred_cache_key_id(test_key), generation);
+			continue;
+		}
+		status = cred_sync_next(&sync, &m);
+		if (status != CRED_SYNC_OK) continue;
+		if (m.type == CRED_SYNC_MSG_END) {
+			status = cred_sync_finish(&sync, &m, work, sizeof(work));
+			continue;
+		}
+		z.next_in = (uint8_t *)m.payload;
+		z.avail_in = m.payload_len;
+		do {
+			z.next_out = out;
+			z.avail_out = sizeof(out);
+			int r = inflate(&z, Z_NO_FLUSH);
+			if (r != Z_OK && r != Z_STREAM_END && r != Z_BUF_ERROR) status = CRED_SYNC_ERR_INFLATE;
+			else status = cred_sync_feed(&sync, out, sizeof(out) - z.avail_out);
+		} while (status == CRED_SYNC_OK && z.avail_out == 0);
+	}
+	inflateEnd(&z);
+	for (int i = 0; i < count; i++) free(names[i]);
+	return status;
+}
+
+static int test_messages(const char *snapshot, const char *delta)
+{
+	ram_flash_t a, b;
+	flash_init(&a, 16 * SECTOR);
+	flash_init(&b, 16 * SECTOR);
+	cred_cache_t cache;
+	cred_cache_init(&cache, NULL, 0, test_key);
+	cred_index_t index;
+	cred_entry_t e;
+	uint64_t card = cred_cache_hash(&cache, true, 1000, NULL);
+	uint64_t code = cred_cache_hash(&cache, false, 0, "123456");
+	uint64_t expired = cred_cache_hash(&cache, true, 3000, NULL);
+	uint64_t added = cred_cache_hash(&cache, true, 4000, NULL);
+
+	CHECK(replay(snapshot, &a, NULL, 1) == CRED_SYNC_COMPLETE, "snapshot");
+	CHECK(cred_index_open(&index, a.data, a.size, cred_cache_key_id(test_key), true) == CRED_INDEX_OK && index.count == 5, "snapshot open");
+	CHECK(cred_index_lookup(&index, card, 0, 1000, &e) == CRED_CACHE_HIT && e.grant == 101, "card");
+	CHECK(cred_index_lookup(&index, code, 1, 1000, &e) == CRED_CACHE_HIT && e.grant == 111, "code");
+	CHECK(cred_index_lookup(&index, expired, 0, 1000, NULL) == CRED_CACHE_EXPIRED, "expired");
+	CHECK(cred_index_lookup(&index, 0xff, 0, 1000, &e) == CRED_CACHE_HIT && e.grant == 100, "raw hash");
+
+	if (delta != NULL) {
+		CHECK(replay(delta, &b, &index, 2) == CRED_SYNC_COMPLETE, "delta");
+		CHECK(cred_index_open(&index, b.data, b.size, cred_cache_key_id(test_key), true) == CRED_INDEX_OK && index.count == 5, "delta open");
+		CHECK(cred_index_lookup(&index, card, 0, 1000, &e) == CRED_CACHE_HIT && e.grant == 101, "card kept");
+		CHECK(cred_index_lookup(&index, code, 1, 1000, &e) == CRED_CACHE_HIT && e.grant == 100, "code changed");
+		CHECK(cred_index_lookup(&index, expired, 0, 1000, NULL) == CRED_CACHE_MISS, "removed");
+		CHECK(cred_index_lookup(&index, added, 7, 1000, &e) == CRED_CACHE_HIT && e.grant == 111, "added");
+	}
+	free(a.data);
+	free(b.data);
+	if (failures) {
+		printf("%d failures\n", failures);
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+}
+#endif
+
+int main(int argc, char **argv)
+{
+	if (argc > 2 && strcmp(argv[1], "--messages") == 0) {
+#if CRED_SYNC_TEST_ZLIB
+		return test_messages(argv[2], argc > 3 ? argv[3] : NULL);
+#else
+		printf("built without zlib\n");
+		return 1;
+#endif
+	}
+	uint32_t entries = (argc > 1) ? atoi(argv[1]) : 50000;
+
+	test_parse();
+	test_sequence();
+	test_snapshot_delta(2000);
+	test_rejected();
+	test_bloom_windows(entries);
+
+	if (failures) {
+		printf("%d failures\n", failures);
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+}
@@ -0,0 +1,166 @@
+#ifndef MAIN_CRED_CACHE_H_
+#define MAIN_CRED_CACHE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Caché local de credenciales para decidir un acceso sin ir al backend.
+ *
+ * Guarda hashes, no números de tarjeta ni códigos: SipHash-2-4 de 64 bits
+ * con una clave de 128 bits del equipo. Cada entrada lleva el código de
+ * respuesta a aplicar (101, 111, 100), las puertas que abre y su
+ * vencimiento. La tabla está ordenada por hash y se busca por bisección.
+ *
+ * Este archivo y cred_cache.c no dependen de ESP-IDF (el reloj se pasa en
+ * cada llamada, en segundos Unix), así se prueban en Linux (ver
+ * host_test/). La persistencia en NVS está en cred_cache_nvs.h.
+ */
+
+/** Largo de la clave del hash */
+#define CRED_CACHE_KEY_LEN 16
+
+/** Todas las puertas */
+#define CRED_CACHE_ALL_DOORS 0xFF
+
+/**
+ * @brief Una credencial.
+ */
+typedef struct {
+	uint64_t hash;          /**< cred_cache_hash() de la credencial */
+	uint32_t expires;       /**< Segundos Unix de vencimiento, 0 si no vence */
+	uint16_t grant;         /**< Código de respuesta a aplicar */
+	uint8_t doors;          /**< Bit N: abre la puerta N */
+	uint8_t reserved;
+} cred_entry_t;
+
+/**
+ * @brief Tabla de credenciales. Los campos son de solo lectura fuera del módulo.
+ */
+typedef struct {
+	cred_entry_t *entries;  /**< Ordenadas por hash, sin repetidos */
+	uint32_t count;
+	uint32_t capacity;
+	uint32_t version;       /**< Versión del backend con la que se sincronizó, 0 si nunca */
+	uint8_t key[CRED_CACHE_KEY_LEN];
+} cred_cache_t;
+
+/**
+ * @brief Resultado de una búsqueda.
+ */
+typedef enum {
+	CRED_CACHE_MISS = 0,    /**< La credencial no está */
+	CRED_CACHE_HIT,         /**< Está vigente y abre la puerta pedida */
+	CRED_CACHE_EXPIRED,     /**< Está pero venció, o no hay hora para saberlo */
+	CRED_CACHE_WRONG_DOOR,  /**< Está vigente pero no abre esa puerta */
+} cred_cache_result_t;
+
+/**
+ * @brief Inicializa una tabla vacía sobre un arreglo del llamador.
+ *
+ * @param cache Tabla.
+ * @param entries Arreglo de capacity entradas.
+ * @param capacity Máximo de credenciales.
+ * @param key Clave del hash.
+ */
+void cred_cache_init(cred_cache_t *cache, cred_entry_t *entries, uint32_t capacity, const uint8_t key[CRED_CACHE_KEY_LEN]);
+
+/**
+ * @brief Convierte una clave en hexadecimal (32 dígitos) a bytes.
+ *
+ * @return true si el texto es válido.
+ */
+bool cred_cache_parse_key(const char *hex, uint8_t key[CRED_CACHE_KEY_LEN]);
+
+/**
+ * @brief Hash de una credencial, el mismo que calcula el backend.
+ *
+ * Mensaje: 'C' y el número de serie en 8 bytes little endian si hay
+ * tarjeta, seguido de 'P' y los dígitos en ASCII si hay código.
+ *
+ * @param cache Tabla (aporta la clave).
+ * @param has_card Hay tarjeta.
+ * @param card Número de serie.
+ * @param code Dígitos, NULL o "" si no hay código.
+ * @return uint64_t Hash.
+ */
+uint64_t cred_cache_hash(const cred_cache_t *cache, bool has_card, uint64_t card, const char *code);
+
+/**
+ * @brief SipHash-2-4 de 64 bits.
+ */
+uint64_t cred_cache_siphash(const uint8_t key[CRED_CACHE_KEY_LEN], const void *data, size_t len);
+
+/**
+ * @brief Identificador de una clave, para saber con cuál se calcularon los
+ * hashes de una tabla guardada sin guardar la clave.
+ */
+uint32_t cred_cache_key_id(const uint8_t key[CRED_CACHE_KEY_LEN]);
+
+/**
+ * @brief Valida una entrada encontrada: vencimiento y puerta.
+ *
+ * @param entry Entrada.
+ * @param door Puerta pedida.
+ * @param now Segundos Unix, 0 si todavía no hay hora.
+ * @return cred_cache_result_t CRED_CACHE_HIT, CRED_CACHE_EXPIRED o CRED_CACHE_WRONG_DOOR.
+ */
+cred_cache_result_t cred_cache_check(const cred_entry_t *entry, uint8_t door, uint32_t now);
+
+/**
+ * @brief Busca una credencial.
+ *
+ * @param cache Tabla.
+ * @param hash Hash de la credencial.
+ * @param door Puerta pedida.
+ * @param now Segundos Unix, 0 si todavía no hay hora (las entradas que vencen cuentan como vencidas).
+ * @param entry Devuelve la entrada si está (puede ser NULL).
+ * @return cred_cache_result_t Resultado.
+ */
+cred_cache_result_t cred_cache_lookup(const cred_cache_t *cache, uint64_t hash, uint8_t door, uint32_t now, cred_entry_t *entry);
+
+/**
+ * @brief Agrega o reemplaza una credencial.
+ *
+ * @return true si entró (false si la tabla está llena).
+ */
+bool cred_cache_put(cred_cache_t *cache, const cred_entry_t *entry);
+
+/**
+ * @brief Quita una credencial.
+ *
+ * @return true si estaba.
+ */
+bool cred_cache_remove(cred_cache_t *cache, uint64_t hash);
+
+/**
+ * @brief Quita las credenciales vencidas.
+ *
+ * @param now Segundos Unix; con 0 no se quita nada.
+ * @return uint32_t Cantidad quitada.
+ */
+uint32_t cred_cache_purge(cred_cache_t *cache, uint32_t now);
+
+/**
+ * @brief Aplica un mensaje de sincronización del backend.
+ *
+ * Una operación por línea:
+ *  - "*": borra todo (principio de una copia completa).
+ *  - "+ <hash> <grant> <puertas> <vence>": agrega o reemplaza; hash y
+ *    puertas en hexadecimal, grant y vence en decimal.
+ *  - "- <hash>": quita.
+ *  - "V <versión>": versión alcanzada al terminar el mensaje.
+ *
+ * El mensaje se valida completo antes de tocar la tabla: si una línea está
+ * mal, o no entran todas las credenciales nuevas (sin descontar las que el
+ * mismo mensaje quita), no se aplica nada.
+ *
+ * @param cache Tabla.
+ * @param msg Mensaje (no hace falta el terminador nulo).
+ * @param len Largo.
+ * @return int Operaciones aplicadas, o -1 si el mensaje no es válido.
+ */
+int cred_cache_apply(cred_cache_t *cache, const char *msg, size_t len);
+
+#endif /* MAIN_CRED_CACHE_H_ */
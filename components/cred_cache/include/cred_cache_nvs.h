@@ -0,0 +1,26 @@
+#ifndef MAIN_CRED_CACHE_NVS_H_
+#define MAIN_CRED_CACHE_NVS_H_
+
+#include "esp_err.h"
+#include "cred_cache.h"
+
+/**
+ * @brief Carga la tabla guardada en NVS (namespace "cred_cache").
+ *
+ * Se descarta si fue guardada con otra clave o no entra en la tabla.
+ *
+ * @param cache Tabla inicializada con cred_cache_init().
+ * @return esp_err_t ESP_OK, ESP_ERR_NVS_NOT_FOUND si no hay nada guardado o
+ * ESP_ERR_INVALID_STATE si no coincide la clave o el tamaño.
+ */
+esp_err_t cred_cache_load(cred_cache_t *cache);
+
+/**
+ * @brief Guarda la tabla en NVS.
+ *
+ * @param cache Tabla.
+ * @return esp_err_t Resultado.
+ */
+esp_err_t cred_cache_save(const cred_cache_t *cache);
+
+#endif /* MAIN_CRED_CACHE_NVS_H_ */
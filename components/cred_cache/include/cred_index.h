@@ -0,0 +1,144 @@
+#ifndef MAIN_CRED_INDEX_H_
+#define MAIN_CRED_INDEX_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cred_cache.h"
+
+/*
+ * Índice estático de credenciales para decenas de miles de entradas.
+ *
+ * Es una imagen de solo lectura, armada en la PC con tools/cred_index.py y
+ * grabada en una partición que se mapea en memoria:
+ *
+ *   cabecera | filtro de Bloom | hashes (uint64_t, ordenados) | atributos
+ *
+ * Las secciones pueden estar en cualquier orden (las imágenes que arma el
+ * equipo al sincronizar llevan el filtro al final) y con huecos entre ellas.
+ * El filtro descarta en O(1) casi todas las credenciales desconocidas sin
+ * tocar la tabla. Las que pasan se buscan por interpolación (los hashes de
+ * SipHash están distribuidos uniformemente) con búsqueda binaria como
+ * respaldo. Los hashes y la clave son los de cred_cache: la caché en RAM
+ * queda como capa de cambios por encima del índice.
+ *
+ * Todos los enteros son little endian. Como cred_cache.c, no depende de
+ * ESP-IDF; el montaje de la partición está en cred_index_partition.h.
+ */
+
+#define CRED_INDEX_MAGIC 0x31584943  // "CIX1"
+#define CRED_INDEX_FORMAT 1
+
+/**
+ * @brief Cabecera de la imagen (48 bytes).
+ */
+typedef struct {
+	uint32_t magic;         /**< CRED_INDEX_MAGIC */
+	uint16_t format;        /**< CRED_INDEX_FORMAT */
+	uint16_t header_size;   /**< sizeof(cred_index_header_t) */
+	uint32_t key_id;        /**< cred_cache_key_id() de la clave de los hashes */
+	uint32_t version;       /**< Versión del backend de la que sale la imagen */
+	uint32_t count;         /**< Credenciales */
+	uint32_t bloom_bits;    /**< Bits del filtro, potencia de 2; 0 sin filtro */
+	uint8_t bloom_hashes;   /**< Bits que marca cada credencial (1..16) */
+	uint8_t reserved[3];
+	uint32_t bloom_offset;  /**< Desde el principio de la imagen */
+	uint32_t keys_offset;   /**< Alineado a 8 */
+	uint32_t attrs_offset;
+	uint32_t crc32;         /**< CRC-32 (el de zlib) de todo lo que sigue a la cabecera */
+	uint32_t generation;    /**< Fuera del CRC; entre dos particiones manda la mayor */
+} cred_index_header_t;
+
+/**
+ * @brief Atributos de una credencial, en el mismo orden que los hashes.
+ */
+typedef struct {
+	uint32_t expires;       /**< Segundos Unix de vencimiento, 0 si no vence */
+	uint16_t grant;         /**< Código de respuesta a aplicar */
+	uint8_t doors;          /**< Bit N: abre la puerta N */
+	uint8_t reserved;
+} cred_index_attr_t;
+
+/**
+ * @brief Estrategia de búsqueda en la tabla.
+ */
+typedef enum {
+	CRED_INDEX_SEARCH_INTERPOLATION = 0,  /**< Interpolación y binaria al final (por defecto) */
+	CRED_INDEX_SEARCH_BINARY,             /**< Solo binaria */
+} cred_index_search_t;
+
+/**
+ * @brief Resultado de abrir una imagen.
+ */
+typedef enum {
+	CRED_INDEX_OK = 0,
+	CRED_INDEX_BAD_HEADER,  /**< Magic, formato o tamaño de la cabecera */
+	CRED_INDEX_BAD_LAYOUT,  /**< Secciones fuera de la imagen o desalineadas */
+	CRED_INDEX_BAD_CRC,
+	CRED_INDEX_WRONG_KEY,   /**< Hashes calculados con otra clave */
+	CRED_INDEX_UNSORTED,    /**< Hashes desordenados o repetidos */
+} cred_index_status_t;
+
+/**
+ * @brief Índice abierto. Apunta a la imagen; no copia nada.
+ */
+typedef struct {
+	const uint64_t *keys;
+	const cred_index_attr_t *attrs;
+	uint32_t count;
+	uint32_t version;
+	uint32_t generation;
+	const uint8_t *bloom;   /**< NULL sin filtro; se puede apuntar a una copia en RAM */
+	uint32_t bloom_mask;
+	uint8_t bloom_hashes;
+	cred_index_search_t search;
+} cred_index_t;
+
+/**
+ * @brief Valida una imagen y prepara el índice.
+ *
+ * @param index Índice.
+ * @param image Imagen (alineada a 8).
+ * @param size Bytes disponibles; la imagen puede ser más corta (partición).
+ * @param key_id cred_cache_key_id() de la clave del equipo.
+ * @param check_order Recorre la tabla para verificar el orden (O(n)).
+ * @return cred_index_status_t Resultado; si no es CRED_INDEX_OK el índice queda vacío.
+ */
+cred_index_status_t cred_index_open(cred_index_t *index, const void *image, size_t size, uint32_t key_id, bool check_order);
+
+/**
+ * @brief Bytes del filtro de Bloom (para copiarlo a RAM).
+ */
+size_t cred_index_bloom_size(const cred_index_t *index);
+
+/**
+ * @brief Indica si el filtro admite un hash. false: seguro que no está.
+ */
+bool cred_index_bloom_check(const cred_index_t *index, uint64_t hash);
+
+/**
+ * @brief Busca un hash en la tabla, sin el filtro.
+ *
+ * @return int32_t Posición, o -1 si no está.
+ */
+int32_t cred_index_find(const cred_index_t *index, uint64_t hash);
+
+/**
+ * @brief Busca una credencial: filtro, tabla y validación de la entrada.
+ *
+ * @param index Índice.
+ * @param hash cred_cache_hash() de la credencial.
+ * @param door Puerta pedida.
+ * @param now Segundos Unix, 0 si todavía no hay hora.
+ * @param entry Devuelve la entrada si está (puede ser NULL).
+ * @return cred_cache_result_t Resultado, como cred_cache_lookup().
+ */
+cred_cache_result_t cred_index_lookup(const cred_index_t *index, uint64_t hash, uint8_t door, uint32_t now, cred_entry_t *entry);
+
+/**
+ * @brief CRC-32 de zlib, acumulable (crc = 0 al principio).
+ */
+uint32_t cred_index_crc32(uint32_t crc, const void *data, size_t len);
+
+#endif /* MAIN_CRED_INDEX_H_ */
@@ -0,0 +1,58 @@
+#ifndef MAIN_CRED_INDEX_PARTITION_H_
+#define MAIN_CRED_INDEX_PARTITION_H_
+
+#include "esp_err.h"
+#include "cred_index.h"
+#include "cred_sync.h"
+
+/*
+ * El índice vive en dos particiones, "<prefijo>0" y "<prefijo>1": una activa
+ * y la otra para recibir la próxima imagen por cred_index_receive(). La
+ * activa es la válida con la generación mayor, así que una sincronización
+ * cortada (reinicio, corte de luz) deja la anterior en uso.
+ */
+
+/**
+ * @brief Mapea las particiones del índice y abre la activa.
+ *
+ * La tabla queda en flash (la lee la caché del SPI). El filtro de Bloom se
+ * copia a RAM si no supera bloom_ram_max bytes; si no, también se lee de flash.
+ *
+ * @param index Índice.
+ * @param prefix Prefijo de las particiones (tipo data).
+ * @param key_id cred_cache_key_id() de la clave del equipo.
+ * @param bloom_ram_max Máximo de RAM para el filtro.
+ * @return esp_err_t ESP_OK, ESP_ERR_NOT_FOUND si no hay particiones o
+ * ESP_ERR_INVALID_STATE si ninguna tiene una imagen válida (el índice queda
+ * vacío, pero se pueden recibir imágenes).
+ */
+esp_err_t cred_index_mount(cred_index_t *index, const char *prefix, uint32_t key_id, size_t bloom_ram_max);
+
+/**
+ * @brief Procesa un mensaje de sincronización (ver cred_sync.h).
+ *
+ * Descomprime con la tinfl de la ROM y escribe en la partición inactiva.
+ * Durante una transferencia usa unos 16 KB de RAM, que libera al terminar.
+ *
+ * @param msg Mensaje completo.
+ * @param len Bytes.
+ * @param active Índice en uso: base de los deltas. Solo se lee.
+ * @param next Con CRED_SYNC_COMPLETE, el índice nuevo ya abierto.
+ * @return cred_sync_status_t CRED_SYNC_OK si falta más, CRED_SYNC_COMPLETE
+ * si hay que pasar a next y llamar a cred_index_commit(), o un error (la
+ * transferencia se descarta).
+ */
+cred_sync_status_t cred_index_receive(const void *msg, size_t len, const cred_index_t *active, cred_index_t *next);
+
+/**
+ * @brief Deja activa la partición recibida y suelta la anterior. Llamar
+ * cuando nadie usa ya el índice viejo.
+ */
+void cred_index_commit(void);
+
+/**
+ * @brief Descarta la transferencia en curso (por ejemplo, al perder el broker).
+ */
+void cred_index_receive_abort(void);
+
+#endif /* MAIN_CRED_INDEX_PARTITION_H_ */
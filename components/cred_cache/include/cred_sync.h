@@ -0,0 +1,202 @@
+#ifndef MAIN_CRED_SYNC_H_
+#define MAIN_CRED_SYNC_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cred_index.h"
+
+/*
+ * Sincronización del índice estático por MQTT, sin tener la lista en RAM.
+ *
+ * El backend manda una transferencia en mensajes binarios con una cabecera
+ * de 16 bytes (little endian) seguida del contenido:
+ *
+ *   tipo (1) | clase (1) | 0 (2) | transferencia (4) | secuencia (4) | CRC-32 del contenido (4)
+ *
+ *   BEGIN  secuencia 0; contenido: versión base (4), registros (4)
+ *   DATA   secuencia 1, 2...; contenido: un trozo del flujo zlib
+ *   END    secuencia siguiente; contenido: bytes descomprimidos (4)
+ *
+ * La transferencia es la versión que se alcanza. Descomprimido, el flujo es
+ * una serie de registros de 16 bytes ordenados por hash, sin repetidos:
+ *
+ *   operación (1) | hash (8) | vencimiento (4) | respuesta (2) | puertas (1)
+ *
+ * Una copia completa (CRED_SYNC_SNAPSHOT) solo tiene altas. Un delta
+ * (CRED_SYNC_DELTA) parte del índice activo, que tiene que estar en la
+ * versión base, y agrega, reemplaza o quita. En los dos casos el equipo
+ * mezcla los registros con la base y escribe una imagen nueva en la otra
+ * partición, en orden y con buffers chicos: hashes y atributos mientras
+ * llegan, el filtro de Bloom y el CRC al final, releyendo la flash. La
+ * cabecera se escribe última; hasta entonces la imagen no es válida y el
+ * índice activo sigue en uso.
+ *
+ * Como cred_index.c, no depende de ESP-IDF: la flash se accede con las
+ * funciones de cred_sync_storage_t y la descompresión la hace quien llama
+ * (cred_index_partition.c usa la tinfl de la ROM).
+ */
+
+#define CRED_SYNC_MSG_HEADER 16
+#define CRED_SYNC_RECORD_SIZE 16
+#define CRED_SYNC_WINDOW_BITS 12       // Ventana de deflate (4 KB): lo que necesita el descompresor
+#define CRED_SYNC_BLOOM_BITS 8         // Bits del filtro por credencial
+#define CRED_SYNC_MAX_SECTORS 512      // Particiones de hasta 2 MB con sectores de 4 KB
+#define CRED_SYNC_BUF 256              // Buffers de escritura: una página de flash
+
+/**
+ * @brief Tipos de mensaje.
+ */
+typedef enum {
+	CRED_SYNC_MSG_BEGIN = 1,
+	CRED_SYNC_MSG_DATA,
+	CRED_SYNC_MSG_END,
+} cred_sync_msg_type_t;
+
+/**
+ * @brief Clase de transferencia.
+ */
+typedef enum {
+	CRED_SYNC_SNAPSHOT = 0,  /**< Copia completa */
+	CRED_SYNC_DELTA,         /**< Cambios desde la versión base */
+} cred_sync_kind_t;
+
+/**
+ * @brief Operación de un registro.
+ */
+typedef enum {
+	CRED_SYNC_OP_PUT = 1,
+	CRED_SYNC_OP_REMOVE,
+} cred_sync_op_t;
+
+/**
+ * @brief Resultado de las operaciones de sincronización.
+ */
+typedef enum {
+	CRED_SYNC_OK = 0,
+	CRED_SYNC_COMPLETE,        /**< Imagen nueva escrita y sellada */
+	CRED_SYNC_DUPLICATE,       /**< Mensaje repetido (QoS 1): se ignora */
+	CRED_SYNC_ERR_FORMAT,      /**< Mensaje o registro mal formado */
+	CRED_SYNC_ERR_CRC,
+	CRED_SYNC_ERR_SEQUENCE,    /**< Falta un mensaje o es de otra transferencia */
+	CRED_SYNC_ERR_BASE,        /**< El delta no parte de la versión activa */
+	CRED_SYNC_ERR_ORDER,       /**< Registros desordenados o repetidos */
+	CRED_SYNC_ERR_SPACE,       /**< No entra en la partición */
+	CRED_SYNC_ERR_FLASH,
+	CRED_SYNC_ERR_INFLATE,     /**< Flujo comprimido inválido (lo informa quien descomprime) */
+} cred_sync_status_t;
+
+/**
+ * @brief Mensaje decodificado.
+ */
+typedef struct {
+	cred_sync_msg_type_t type;
+	cred_sync_kind_t kind;
+	uint32_t transfer;         /**< Versión que se alcanza */
+	uint32_t seq;
+	const uint8_t *payload;    /**< Contenido (DATA) */
+	size_t payload_len;
+	uint32_t base_version;     /**< BEGIN de un delta */
+	uint32_t records;          /**< BEGIN */
+	uint32_t length;           /**< END: bytes descomprimidos */
+} cred_sync_msg_t;
+
+/**
+ * @brief Acceso a la partición donde se escribe la imagen nueva.
+ *
+ * Las funciones devuelven false si falla la flash. Escribir solo puede
+ * pasar bits de 1 a 0: cred_sync borra cada sector antes de usarlo.
+ */
+typedef struct {
+	void *ctx;
+	bool (*erase)(void *ctx, uint32_t offset, uint32_t size);
+	bool (*write)(void *ctx, uint32_t offset, const void *data, uint32_t size);
+	bool (*read)(void *ctx, uint32_t offset, void *data, uint32_t size);
+	uint32_t size;             /**< Bytes de la partición */
+	uint32_t sector;           /**< Bytes que borra erase(), potencia de 2 */
+} cred_sync_storage_t;
+
+/**
+ * @brief Transferencia en curso.
+ */
+typedef struct {
+	cred_sync_storage_t storage;
+	const cred_index_t *base;  /**< Índice que se mezcla (delta); NULL en una copia */
+	uint32_t base_pos;         /**< Próxima entrada de la base a copiar */
+	uint32_t transfer;
+	uint32_t next_seq;
+	uint32_t key_id;
+	uint32_t generation;       /**< La de la imagen nueva */
+	uint32_t records;          /**< Registros anunciados */
+	uint32_t received;         /**< Bytes descomprimidos recibidos */
+	uint32_t capacity;         /**< Entradas que entran en las secciones */
+	uint32_t count;            /**< Entradas escritas */
+	uint32_t keys_offset;
+	uint32_t attrs_offset;
+	uint32_t bloom_offset;
+	uint32_t bloom_bits;
+	uint64_t last_hash;        /**< Para verificar el orden */
+	bool active;
+	uint8_t partial[CRED_SYNC_RECORD_SIZE];  /**< Registro cortado entre dos trozos */
+	uint8_t partial_len;
+	uint16_t keys_len;
+	uint16_t attrs_len;
+	uint8_t keys_buf[CRED_SYNC_BUF];
+	uint8_t attrs_buf[CRED_SYNC_BUF];
+	uint8_t erased[CRED_SYNC_MAX_SECTORS / 8];  /**< Sectores ya borrados */
+} cred_sync_t;
+
+/**
+ * @brief Decodifica un mensaje y verifica su CRC.
+ */
+cred_sync_status_t cred_sync_parse(const void *msg, size_t len, cred_sync_msg_t *out);
+
+/**
+ * @brief Empieza una transferencia con su mensaje BEGIN.
+ *
+ * Reserva lugar para la base más los registros anunciados y borra el
+ * primer sector, así una imagen anterior en la partición deja de valer.
+ *
+ * @param sync Transferencia (se reinicia aunque hubiera otra en curso).
+ * @param storage Partición de destino (la que no está activa).
+ * @param begin Mensaje BEGIN.
+ * @param base Índice activo, o NULL si no hay.
+ * @param key_id cred_cache_key_id() de la clave del equipo.
+ * @param generation Generación de la imagen nueva (mayor que la activa).
+ * @return cred_sync_status_t CRED_SYNC_OK, CRED_SYNC_ERR_BASE, CRED_SYNC_ERR_SPACE o CRED_SYNC_ERR_FLASH.
+ */
+cred_sync_status_t cred_sync_begin(cred_sync_t *sync, const cred_sync_storage_t *storage, const cred_sync_msg_t *begin,
+	const cred_index_t *base, uint32_t key_id, uint32_t generation);
+
+/**
+ * @brief Verifica que un mensaje DATA o END sea el que sigue.
+ *
+ * @return cred_sync_status_t CRED_SYNC_OK, CRED_SYNC_DUPLICATE (el anterior
+ * otra vez) o CRED_SYNC_ERR_SEQUENCE.
+ */
+cred_sync_status_t cred_sync_next(cred_sync_t *sync, const cred_sync_msg_t *msg);
+
+/**
+ * @brief Procesa registros ya descomprimidos, cortados en cualquier lugar.
+ */
+cred_sync_status_t cred_sync_feed(cred_sync_t *sync, const void *data, size_t len);
+
+/**
+ * @brief Termina la transferencia con su mensaje END: copia lo que queda de
+ * la base, arma el filtro, calcula el CRC y escribe la cabecera.
+ *
+ * @param sync Transferencia.
+ * @param end Mensaje END.
+ * @param work Buffer para armar el filtro por ventanas (más grande, menos pasadas).
+ * @param work_size Bytes de work, múltiplo de 8.
+ * @return cred_sync_status_t CRED_SYNC_COMPLETE o un error.
+ */
+cred_sync_status_t cred_sync_finish(cred_sync_t *sync, const cred_sync_msg_t *end, uint8_t *work, size_t work_size);
+
+/**
+ * @brief Descarta la transferencia en curso. La imagen a medias no es válida.
+ */
+void cred_sync_abort(cred_sync_t *sync);
+
+#endif /* MAIN_CRED_SYNC_H_ */
@@ -0,0 +1,262 @@
+/*
+ * Tests of inflight.c: ID sequence, matching by ID and by door, deadlines
+ * across the 32-bit clock wrap, eviction when full, the latency histogram,
+ * and random request/response/timeout sequences checked against a simple
+ * model.
+ *
+ * usage: inflight_test [sequences]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "inflight.h"
+#include "test_util.h"
+
+#define TIMEOUT_MS 3000
+
+//------------------------------------------scenarios-------------------------------
+
+static void test_ids(void)
+{
+	inflight_t t;
+	inflight_init(&t, TIMEOUT_MS, 0);
+	CHECK(inflight_start(&t, 0, 0, 0, 0, NULL) == 1, "0 is skipped");
+	CHECK(inflight_start(&t, 0, 0, 0, 0, NULL) == 2, "monotonic");
+
+	// Wrap: UINT32_MAX, then 1
+	inflight_init(&t, TIMEOUT_MS, UINT32_MAX);
+	uint32_t a = inflight_start(&t, 0, 0, 0, 0, NULL);
+	uint32_t b = inflight_start(&t, 0, 0, 0, 0, NULL);
+	CHECK(a == UINT32_MAX && b == 1, "wrap %u %u", a, b);
+	CHECK(inflight_count(&t) == 2, "count %d", inflight_count(&t));
+}
+
+static void test_match(void)
+{
+	inflight_t t;
+	inflight_entry_t e;
+	inflight_init(&t, TIMEOUT_MS, 100);
+	uint32_t a = inflight_start(&t, 1, 0, 0x1234, 1000, NULL);
+	uint32_t b = inflight_start(&t, 2, 101, 0x5678, 1010, NULL);
+
+	CHECK(inflight_match(&t, b, 1100, &e), "match b");
+	CHECK(e.id == b && e.door == 2 && e.local == 101 && e.hash == 0x5678, "entry b");
+	CHECK(!inflight_match(&t, b, 1110, &e), "b twice");
+	CHECK(!inflight_match(&t, 0, 1110, &e), "id 0");
+	CHECK(!inflight_match(&t, 99, 1110, &e), "unknown id");
+	CHECK(inflight_match(&t, a, 1500, &e) && e.door == 1 && e.hash == 0x1234, "match a");
+	CHECK(t.answered == 2 && t.unmatched == 3, "answered %u unmatched %u", t.answered, t.unmatched);
+	CHECK(t.latency_max_ms == 500, "max %u", t.latency_max_ms);
+	CHECK(inflight_count(&t) == 0, "empty");
+}
+
+// A response that arrives after its deadline must not match the next request
+static void test_late_response(void)
+{
+	inflight_t t;
+	inflight_entry_t expired[INFLIGHT_MAX];
+	inflight_entry_t e;
+	inflight_init(&t, TIMEOUT_MS, 7);
+	uint32_t first = inflight_start(&t, 0, 0, 1, 0, NULL);
+
+	CHECK(inflight_expire(&t, TIMEOUT_MS - 1, expired, INFLIGHT_MAX) == 0, "not yet");
+	CHECK(inflight_remaining(&t, TIMEOUT_MS - 1) == 1, "1 ms left");
+	CHECK(inflight_expire(&t, TIMEOUT_MS, expired, INFLIGHT_MAX) == 1 && expired[0].id == first, "expired at deadline");
+	CHECK(inflight_remaining(&t, TIMEOUT_MS) == UINT32_MAX, "nothing pending");
+
+	uint32_t next = inflight_start(&t, 0, 0, 2, TIMEOUT_MS + 500, NULL);
+	CHECK(!inflight_match(&t, first, TIMEOUT_MS + 600, &e), "late response dropped");
+	CHECK(inflight_match(&t, next, TIMEOUT_MS + 700, &e) && e.hash == 2, "next request answered");
+	CHECK(t.timeouts == 1 && t.unmatched == 1 && t.answered == 1, "stats");
+}
+
+// Untagged responses: the oldest request of the door, never another door's
+static void test_match_door(void)
+{
+	inflight_t t;
+	inflight_entry_t e;
+	inflight_init(&t, TIMEOUT_MS, UINT32_MAX - 1);  // IDs wrap between a and b
+	uint32_t a = inflight_start(&t, 1, 0, 0xa, 1000, NULL);
+	inflight_start(&t, 2, 0, 0xc, 1005, NULL);
+	uint32_t b = inflight_start(&t, 1, 0, 0xb, 1010, NULL);
+
+	CHECK(inflight_pending(&t, 1) && inflight_pending(&t, 2) && !inflight_pending(&t, 0), "pending");
+	CHECK(!inflight_match_door(&t, 0, 1100, &e), "no request for door 0");
+	CHECK(t.unmatched == 0 && t.answered == 0, "miss not counted");
+	CHECK(inflight_match_door(&t, 1, 1100, &e) && e.id == a && e.hash == 0xa, "oldest of door 1 (%u)", e.id);
+	CHECK(inflight_match_door(&t, 1, 1200, &e) && e.id == b && e.hash == 0xb, "then the next (%u)", e.id);
+	CHECK(!inflight_pending(&t, 1) && inflight_pending(&t, 2), "door 2 untouched");
+	CHECK(!inflight_match(&t, a, 1300, NULL), "tagged response after untagged match");
+	CHECK(t.answered == 2 && inflight_count(&t) == 1, "answered %u", t.answered);
+}
+
+static void test_clock_wrap(void)
+{
+	inflight_t t;
+	inflight_entry_t expired[INFLIGHT_MAX];
+	inflight_init(&t, TIMEOUT_MS, 1);
+	uint32_t start = UINT32_MAX - 1000;
+	inflight_start(&t, 0, 0, 0, start, NULL);
+	CHECK(inflight_remaining(&t, start + 100) == TIMEOUT_MS - 100, "remaining %u", inflight_remaining(&t, start + 100));
+	inflight_start(&t, 0, 0, 0, start + 1500, NULL);  // Past the wrap
+
+	CHECK(inflight_expire(&t, start + 2999, expired, INFLIGHT_MAX) == 0, "before wrap deadline");
+	CHECK(inflight_expire(&t, start + 3000, expired, INFLIGHT_MAX) == 1, "wrap deadline");
+	CHECK(inflight_remaining(&t, start + 3000) == 1500, "second remaining %u", inflight_remaining(&t, start + 3000));
+	CHECK(inflight_expire(&t, start + 4500, expired, INFLIGHT_MAX) == 1, "second deadline");
+}
+
+static void test_eviction(void)
+{
+	inflight_t t;
+	inflight_entry_t evicted;
+	inflight_entry_t expired[INFLIGHT_MAX];
+	inflight_init(&t, TIMEOUT_MS, UINT32_MAX - 3);  // IDs wrap while full
+	uint32_t ids[INFLIGHT_MAX];
+	for (int i = 0; i < INFLIGHT_MAX; i++) {
+		ids[i] = inflight_start(&t, i, 0, i, i, &evicted);
+		CHECK(evicted.id == 0, "slot %d free", i);
+	}
+	uint32_t extra = inflight_start(&t, 0, 0, 99, 10, &evicted);
+	CHECK(evicted.id == ids[0] && evicted.hash == 0, "oldest evicted (%u)", evicted.id);
+	CHECK(inflight_count(&t) == INFLIGHT_MAX && t.timeouts == 1, "still full");
+	CHECK(!inflight_match(&t, ids[0], 20, NULL), "evicted not matched");
+
+	// All expire together, oldest first, even across the ID wrap
+	int n = inflight_expire(&t, 10 + TIMEOUT_MS, expired, INFLIGHT_MAX);
+	CHECK(n == INFLIGHT_MAX, "expired %d", n);
+	for (int i = 0; i + 1 < n; i++) {
+		CHECK(expired[i].id == ids[i + 1], "order %d: %u", i, expired[i].id);
+	}
+	CHECK(expired[n - 1].id == extra, "newest last");
+
+	// With little room, the rest stays for the next call
+	inflight_start(&t, 0, 0, 0, 0, NULL);
+	inflight_start(&t, 0, 0, 0, 0, NULL);
+	CHECK(inflight_expire(&t, TIMEOUT_MS, expired, 1) == 1 && inflight_count(&t) == 1, "max 1");
+}
+
+static void test_percentile(void)
+{
+	inflight_t t;
+	inflight_init(&t, 100000, 1);
+	CHECK(inflight_percentile(&t, 50) == 0, "no data");
+
+	// 90 fast (< 50 ms), 9 at 150 ms, 1 at 5000 ms
+	for (int i = 0; i < 100; i++) {
+		uint32_t id = inflight_start(&t, 0, 0, 0, 0, NULL);
+		uint32_t ms = (i < 90) ? 20 : (i < 99) ? 150 : 5000;
+		inflight_match(&t, id, ms, NULL);
+	}
+	CHECK(inflight_percentile(&t, 50) == 50, "p50 %u", inflight_percentile(&t, 50));
+	CHECK(inflight_percentile(&t, 90) == 50, "p90 %u", inflight_percentile(&t, 90));
+	CHECK(inflight_percentile(&t, 95) == 200, "p95 %u", inflight_percentile(&t, 95));
+	CHECK(inflight_percentile(&t, 99) == 200, "p99 %u", inflight_percentile(&t, 99));
+	CHECK(inflight_percentile(&t, 100) == 5000, "p100 %u", inflight_percentile(&t, 100));
+	CHECK(t.hist[0] == 90 && t.hist[2] == 9 && t.hist[INFLIGHT_HIST - 1] == 1, "histogram");
+
+	// Never above the slowest response
+	inflight_init(&t, 100000, 1);
+	inflight_match(&t, inflight_start(&t, 0, 0, 0, 0, NULL), 60, NULL);
+	CHECK(inflight_percentile(&t, 99) == 60, "capped %u", inflight_percentile(&t, 99));
+}
+
+//------------------------------------------properties-------------------------------
+
+typedef struct {
+	uint32_t id;
+	uint32_t sent;
+} model_t;
+
+// Random starts, responses (some after their deadline) and timer ticks. The
+// model keeps what was started and not yet answered, expired or evicted.
+static void test_properties(int sequences)
+{
+	uint32_t rng = 0x1f123bb5;
+	for (int s = 0; s < sequences; s++) {
+		inflight_t t;
+		model_t model[64];
+		int pending = 0;
+		uint32_t answered = 0;
+		uint32_t now = rng_next(&rng);  // Any start, wraps included
+		inflight_init(&t, TIMEOUT_MS, rng_next(&rng));
+		uint32_t last_id = 0;
+
+		for (int step = 0; step < 60; step++) {
+			now += rng_next(&rng) % 1500;
+			uint32_t op = rng_next(&rng) % 3;
+			if (op == 0) {
+				inflight_entry_t evicted;
+				uint32_t id = inflight_start(&t, 0, 0, now, now, &evicted);
+				CHECK(id != 0 && (last_id == 0 || id != last_id), "new id %u", id);
+				last_id = id;
+				if (evicted.id != 0) {
+					CHECK(pending == INFLIGHT_MAX && evicted.id == model[0].id, "evicted the oldest");
+					memmove(&model[0], &model[1], sizeof(model_t) * --pending);
+				}
+				model[pending++] = (model_t){ id, now };
+			} else if (op == 1 && pending > 0) {
+				int k = rng_next(&rng) % pending;
+				inflight_entry_t e;
+				uint32_t id = model[k].id;
+				bool late = (uint32_t)(now - model[k].sent) >= TIMEOUT_MS;
+				if (late) {
+					// The timer would have fired first
+					inflight_entry_t expired[INFLIGHT_MAX];
+					int n = inflight_expire(&t, now, expired, INFLIGHT_MAX);
+					int m = 0;
+					for (int i = 0; i < pending; i++) {
+						if ((uint32_t)(now - model[i].sent) >= TIMEOUT_MS) {
+							CHECK(m < n && expired[m].id == model[i].id, "expired %d", i);
+							m++;
+						} else {
+							model[i - m] = model[i];
+						}
+					}
+					CHECK(m == n, "expired %d of %d", n, m);
+					pending -= m;
+					CHECK(!inflight_match(&t, id, now, &e), "late response matched");
+				} else {
+					CHECK(inflight_match(&t, id, now, &e) && e.hash == model[k].sent, "response");
+					answered++;
+					memmove(&model[k], &model[k + 1], sizeof(model_t) * (pending - k - 1));
+					pending--;
+				}
+			} else {
+				uint32_t left = inflight_remaining(&t, now);
+				uint32_t expect = UINT32_MAX;
+				for (int i = 0; i < pending; i++) {
+					uint32_t elapsed = now - model[i].sent;
+					uint32_t l = elapsed >= TIMEOUT_MS ? 0 : TIMEOUT_MS - elapsed;
+					if (l < expect) expect = l;
+				}
+				CHECK(left == expect, "remaining %u, expected %u", left, expect);
+			}
+			CHECK(inflight_count(&t) == pending, "count %d, model %d", inflight_count(&t), pending);
+			CHECK(t.answered == answered, "answered %u, model %u", t.answered, answered);
+			if (failures > 0) return;
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	int sequences = (argc > 1) ? atoi(argv[1]) : 20000;
+
+	test_ids();
+	test_match();
+	test_late_response();
+	test_match_door();
+	test_clock_wrap();
+	test_eviction();
+	test_percentile();
+	test_properties(sequences);
+
+	if (failures > 0) {
+		printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+	printf("all inflight checks passed (%d random sequences)\n", sequences);
+	return 0;
+}
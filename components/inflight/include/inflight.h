@@ -0,0 +1,140 @@
+#ifndef MAIN_INFLIGHT_H_
+#define MAIN_INFLIGHT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Pedidos de acceso en vuelo.
+ *
+ * Cada pedido al backend lleva un número que crece de a uno y espera la
+ * respuesta con ese número hasta un plazo. Una respuesta cuyo número no
+ * está en la tabla (tardía, repetida o de un arranque anterior) se
+ * descarta, así nunca abre la puerta para la persona siguiente. Además se
+ * cuentan las latencias para ver la cola de la distribución.
+ *
+ * Como code_entry, no depende de ESP-IDF: el reloj se pasa en cada llamada
+ * (milisegundos de 32 bits, se admite que den la vuelta) y se prueba en
+ * Linux (ver host_test/).
+ */
+
+/** Pedidos en vuelo a la vez; con la tabla llena el más viejo se da por vencido */
+#define INFLIGHT_MAX 8
+
+/** Intervalos del histograma de latencias: < 50, 100, 200 ... 3200 ms y el resto */
+#define INFLIGHT_HIST 8
+#define INFLIGHT_HIST_FIRST_MS 50
+
+/**
+ * @brief Un pedido.
+ */
+typedef struct {
+	uint32_t id;            /**< 0: libre */
+	uint32_t sent_ms;       /**< Hora del envío */
+	uint64_t hash;          /**< Hash de la credencial, para revocarla */
+	uint16_t local;         /**< Respuesta ya aplicada sin esperar (apertura optimista), 0 si ninguna */
+	uint8_t door;           /**< Puerta pedida */
+} inflight_entry_t;
+
+/**
+ * @brief Tabla de pedidos. Los campos son de solo lectura fuera del módulo.
+ */
+typedef struct {
+	inflight_entry_t entries[INFLIGHT_MAX];
+	uint32_t next_id;
+	uint32_t timeout_ms;
+	uint32_t answered;      /**< Respuestas que encontraron su pedido */
+	uint32_t timeouts;      /**< Pedidos vencidos o desplazados */
+	uint32_t unmatched;     /**< Respuestas sin pedido en vuelo */
+	uint32_t latency_max_ms;
+	uint32_t hist[INFLIGHT_HIST];
+} inflight_t;
+
+/**
+ * @brief Inicializa una tabla vacía.
+ *
+ * @param inflight Tabla.
+ * @param timeout_ms Plazo de cada pedido.
+ * @param first_id Primer número (por ejemplo, al azar en cada arranque); 0 se saltea.
+ */
+void inflight_init(inflight_t *inflight, uint32_t timeout_ms, uint32_t first_id);
+
+/**
+ * @brief Anota un pedido.
+ *
+ * @param inflight Tabla.
+ * @param door Puerta.
+ * @param local Respuesta ya aplicada, 0 si decide el backend.
+ * @param hash Hash de la credencial.
+ * @param now_ms Hora actual.
+ * @param evicted Con la tabla llena, el pedido más viejo, que se da por
+ * vencido (id 0 si no hubo). Puede ser NULL.
+ * @return uint32_t Número del pedido, nunca 0.
+ */
+uint32_t inflight_start(inflight_t *inflight, uint8_t door, uint16_t local, uint64_t hash, uint32_t now_ms, inflight_entry_t *evicted);
+
+/**
+ * @brief Busca y quita el pedido de una respuesta, y anota la latencia.
+ *
+ * @param inflight Tabla.
+ * @param id Número de la respuesta.
+ * @param now_ms Hora actual.
+ * @param entry Devuelve el pedido (puede ser NULL).
+ * @return true si estaba en vuelo.
+ */
+bool inflight_match(inflight_t *inflight, uint32_t id, uint32_t now_ms, inflight_entry_t *entry);
+
+/**
+ * @brief Como inflight_match() pero para una respuesta sin número: toma el
+ * pedido más viejo de la puerta (CONFIG_INFLIGHT_ACCEPT_UNTAGGED). Si no hay
+ * ninguno no cuenta como descartada, porque puede ser una orden a distancia.
+ *
+ * @param inflight Tabla.
+ * @param door Puerta de la respuesta.
+ * @param now_ms Hora actual.
+ * @param entry Devuelve el pedido (puede ser NULL).
+ * @return true si había un pedido de esa puerta.
+ */
+bool inflight_match_door(inflight_t *inflight, uint8_t door, uint32_t now_ms, inflight_entry_t *entry);
+
+/**
+ * @brief Indica si hay algún pedido en vuelo para una puerta.
+ */
+bool inflight_pending(const inflight_t *inflight, uint8_t door);
+
+/**
+ * @brief Quita los pedidos cuyo plazo venció.
+ *
+ * @param inflight Tabla.
+ * @param now_ms Hora actual.
+ * @param expired Devuelve los pedidos vencidos, del más viejo al más nuevo.
+ * @param max Lugar en expired (INFLIGHT_MAX alcanza siempre).
+ * @return int Cantidad de pedidos vencidos.
+ */
+int inflight_expire(inflight_t *inflight, uint32_t now_ms, inflight_entry_t *expired, int max);
+
+/**
+ * @brief Tiempo hasta el próximo plazo, para armar un timer.
+ *
+ * @return uint32_t Milisegundos (0 si ya venció), UINT32_MAX si no hay pedidos.
+ */
+uint32_t inflight_remaining(const inflight_t *inflight, uint32_t now_ms);
+
+/**
+ * @brief Pedidos en vuelo.
+ */
+int inflight_count(const inflight_t *inflight);
+
+/**
+ * @brief Percentil de la latencia según el histograma.
+ *
+ * @param inflight Tabla.
+ * @param percent 1..100.
+ * @return uint32_t Límite superior del intervalo donde cae, sin pasar de
+ * latency_max_ms (que es lo que devuelve el último intervalo), 0 si todavía
+ * no hubo respuestas.
+ */
+uint32_t inflight_percentile(const inflight_t *inflight, unsigned percent);
+
+#endif /* MAIN_INFLIGHT_H_ */
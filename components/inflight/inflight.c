@@ -0,0 +1,153 @@
+#include <string.h>
+
+#include "inflight.h"
+
+// El reloj da la vuelta: se compara la diferencia
+static bool entry_expired(const inflight_t *inflight, const inflight_entry_t *entry, uint32_t now_ms)
+{
+	return (uint32_t)(now_ms - entry->sent_ms) >= inflight->timeout_ms;
+}
+
+// Los números también dan la vuelta; el más viejo es el de menor diferencia con next_id
+static bool entry_older(const inflight_entry_t *a, const inflight_entry_t *b)
+{
+	return (int32_t)(a->id - b->id) < 0;
+}
+
+static void record_latency(inflight_t *inflight, uint32_t ms)
+{
+	int bucket = 0;
+	uint32_t limit = INFLIGHT_HIST_FIRST_MS;
+	while (bucket < INFLIGHT_HIST - 1 && ms >= limit) {
+		bucket++;
+		limit *= 2;
+	}
+	inflight->hist[bucket]++;
+	if (ms > inflight->latency_max_ms) inflight->latency_max_ms = ms;
+	inflight->answered++;
+}
+
+void inflight_init(inflight_t *inflight, uint32_t timeout_ms, uint32_t first_id)
+{
+	memset(inflight, 0, sizeof(inflight_t));
+	inflight->timeout_ms = timeout_ms;
+	inflight->next_id = first_id;
+}
+
+uint32_t inflight_start(inflight_t *inflight, uint8_t door, uint16_t local, uint64_t hash, uint32_t now_ms, inflight_entry_t *evicted)
+{
+	inflight_entry_t *slot = NULL;
+	for (int i = 0; i < INFLIGHT_MAX; i++) {
+		inflight_entry_t *entry = &inflight->entries[i];
+		if (entry->id == 0) {
+			slot = entry;
+			break;
+		}
+		if (slot == NULL || entry_older(entry, slot)) slot = entry;
+	}
+	if (evicted != NULL) *evicted = *slot;  // Libre: id 0
+	if (slot->id != 0) inflight->timeouts++;
+
+	if (inflight->next_id == 0) inflight->next_id = 1;
+	slot->id = inflight->next_id++;
+	slot->sent_ms = now_ms;
+	slot->hash = hash;
+	slot->local = local;
+	slot->door = door;
+	return slot->id;
+}
+
+bool inflight_match(inflight_t *inflight, uint32_t id, uint32_t now_ms, inflight_entry_t *entry)
+{
+	for (int i = 0; id != 0 && i < INFLIGHT_MAX; i++) {
+		inflight_entry_t *slot = &inflight->entries[i];
+		if (slot->id != id) continue;
+		if (entry != NULL) *entry = *slot;
+		record_latency(inflight, now_ms - slot->sent_ms);
+		slot->id = 0;
+		return true;
+	}
+	inflight->unmatched++;
+	return false;
+}
+
+bool inflight_match_door(inflight_t *inflight, uint8_t door, uint32_t now_ms, inflight_entry_t *entry)
+{
+	inflight_entry_t *oldest = NULL;
+	for (int i = 0; i < INFLIGHT_MAX; i++) {
+		inflight_entry_t *slot = &inflight->entries[i];
+		if (slot->id == 0 || slot->door != door) continue;
+		if (oldest == NULL || entry_older(slot, oldest)) oldest = slot;
+	}
+	if (oldest == NULL) return false;
+	if (entry != NULL) *entry = *oldest;
+	record_latency(inflight, now_ms - oldest->sent_ms);
+	oldest->id = 0;
+	return true;
+}
+
+bool inflight_pending(const inflight_t *inflight, uint8_t door)
+{
+	for (int i = 0; i < INFLIGHT_MAX; i++) {
+		if (inflight->entries[i].id != 0 && inflight->entries[i].door == door) return true;
+	}
+	return false;
+}
+
+int inflight_expire(inflight_t *inflight, uint32_t now_ms, inflight_entry_t *expired, int max)
+{
+	int count = 0;
+	for (int i = 0; i < INFLIGHT_MAX && count < max; i++) {
+		inflight_entry_t *slot = &inflight->entries[i];
+		if (slot->id == 0 || !entry_expired(inflight, slot, now_ms)) continue;
+		// Inserción ordenada: son a lo sumo INFLIGHT_MAX
+		int j = count++;
+		while (j > 0 && entry_older(slot, &expired[j - 1])) {
+			expired[j] = expired[j - 1];
+			j--;
+		}
+		expired[j] = *slot;
+		slot->id = 0;
+		inflight->timeouts++;
+	}
+	return count;
+}
+
+uint32_t inflight_remaining(const inflight_t *inflight, uint32_t now_ms)
+{
+	uint32_t remaining = UINT32_MAX;
+	for (int i = 0; i < INFLIGHT_MAX; i++) {
+		const inflight_entry_t *slot = &inflight->entries[i];
+		if (slot->id == 0) continue;
+		uint32_t elapsed = now_ms - slot->sent_ms;
+		uint32_t left = (elapsed >= inflight->timeout_ms) ? 0 : inflight->timeout_ms - elapsed;
+		if (left < remaining) remaining = left;
+	}
+	return remaining;
+}
+
+int inflight_count(const inflight_t *inflight)
+{
+	int count = 0;
+	for (int i = 0; i < INFLIGHT_MAX; i++) {
+		if (inflight->entries[i].id != 0) count++;
+	}
+	return count;
+}
+
+uint32_t inflight_percentile(const inflight_t *inflight, unsigned percent)
+{
+	if (inflight->answered == 0) return 0;
+	if (percent > 100) percent = 100;
+	// Respuestas que tienen que quedar a la izquierda, redondeando hacia arriba
+	uint64_t target = ((uint64_t)inflight->answered * percent + 99) / 100;
+	if (target == 0) target = 1;
+	uint64_t seen = 0;
+	uint32_t limit = INFLIGHT_HIST_FIRST_MS;
+	for (int bucket = 0; bucket < INFLIGHT_HIST - 1; bucket++) {
+		seen += inflight->hist[bucket];
+		if (seen >= target) return limit < inflight->latency_max_ms ? limit : inflight->latency_max_ms;
+		limit *= 2;
+	}
+	return inflight->latency_max_ms;
+}
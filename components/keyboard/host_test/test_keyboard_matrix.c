@@ -0,0 +1,126 @@
+/*
+ * Tests of keyboard_matrix.c: ghost detection and the integrator debounce
+ * fed with synthetic bounce patterns (hand-written, not recorded from a keypad).
+ *
+ * A trace has one character per sample of the 5 ms sample clock:
+ * '1' the key reads pressed, '0' it reads released.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "keyboard_matrix.h"
+#include "test_util.h"
+
+#define SAMPLE_MS 5
+#define DEBOUNCE_MS 20
+
+typedef struct {
+    const char *name;
+    const char *trace;
+    int downs;       // expected press edges
+    int ups;         // expected release edges
+} trace_case_t;
+
+static const trace_case_t traces[] = {
+    { "clean press",
+      "0000111111111111111100000000000", 1, 1 },
+    // contact bounce on make and on break
+    { "bouncy press",
+      "0001011011101111111111111111011101001000000000000", 1, 1 },
+    // a noise spike shorter than the debounce time
+    { "glitch",
+      "00000110000000000000", 0, 0 },
+    // isolated drop-outs while held don't release the key
+    { "held with drop-outs",
+      "0001111111110111111110111111111011111111000000000", 1, 1 },
+    // "11" typed fast: 60 ms press, 40 ms release, 60 ms press
+    { "fast double press",
+      "000111111111111000000001111111111110000000000", 2, 2 },
+    // same, with bounce on every edge
+    { "fast double press, bouncy",
+      "0001011111111110100000101111111111010000000000", 2, 2 },
+};
+
+static void run_trace(const trace_case_t *c)
+{
+    const uint16_t key = KEYBOARD_BIT(2, 1);
+    keyboard_debounce_t db;
+    keyboard_debounce_init(&db, DEBOUNCE_MS, SAMPLE_MS);
+
+    int downs = 0, ups = 0;
+    for (const char *p = c->trace; *p; p++) {
+        uint16_t changed = keyboard_debounce_update(&db, *p == '1' ? key : 0);
+        CHECK((changed & ~key) == 0, "%s: edge on another key", c->name);
+        if (changed & key) {
+            if (db.state & key) downs++;
+            else ups++;
+        }
+    }
+    CHECK(downs == c->downs && ups == c->ups, "%s: %d downs/%d ups, expected %d/%d",
+          c->name, downs, ups, c->downs, c->ups);
+    CHECK(keyboard_debounce_idle(&db), "%s: not idle at the end", c->name);
+}
+
+static void test_latency(void)
+{
+    // A clean press is reported after exactly DEBOUNCE_MS
+    keyboard_debounce_t db;
+    keyboard_debounce_init(&db, DEBOUNCE_MS, SAMPLE_MS);
+    int samples = 0;
+    while (keyboard_debounce_update(&db, 1) == 0 && samples < 100) samples++;
+    CHECK((samples + 1) * SAMPLE_MS == DEBOUNCE_MS, "press seen after %d ms", (samples + 1) * SAMPLE_MS);
+
+    // Debounce shorter than a sample still needs one sample
+    keyboard_debounce_init(&db, 1, SAMPLE_MS);
+    CHECK(keyboard_debounce_update(&db, 1) == 1, "1 ms debounce");
+}
+
+static void test_rollover(void)
+{
+    keyboard_debounce_t db;
+    keyboard_debounce_init(&db, DEBOUNCE_MS, SAMPLE_MS);
+    uint16_t a = KEYBOARD_BIT(0, 0), b = KEYBOARD_BIT(3, 3);
+    uint16_t changed = 0;
+
+    for (int i = 0; i < 4; i++) changed |= keyboard_debounce_update(&db, a);
+    CHECK(changed == a && db.state == a, "first key");
+    changed = 0;
+    for (int i = 0; i < 4; i++) changed |= keyboard_debounce_update(&db, a | b);
+    CHECK(changed == b && db.state == (a | b), "second key while the first is held");
+    changed = 0;
+    for (int i = 0; i < 4; i++) changed |= keyboard_debounce_update(&db, b);
+    CHECK(changed == a && db.state == b, "first key released");
+}
+
+static void test_ghosting(void)
+{
+    // Two rows sharing two columns: three real keys plus the phantom
+    CHECK(keyboard_matrix_ghosted(KEYBOARD_BIT(0, 0) | KEYBOARD_BIT(0, 1) | KEYBOARD_BIT(1, 0) | KEYBOARD_BIT(1, 1), 4),
+          "rectangle 0,0-1,1");
+    CHECK(keyboard_matrix_ghosted(KEYBOARD_BIT(0, 2) | KEYBOARD_BIT(0, 3) | KEYBOARD_BIT(3, 2) | KEYBOARD_BIT(3, 3), 4),
+          "rectangle 0,2-3,3");
+    // Chords without a shared pair of columns are valid
+    CHECK(!keyboard_matrix_ghosted(KEYBOARD_BIT(0, 0) | KEYBOARD_BIT(0, 1) | KEYBOARD_BIT(1, 2), 4), "three keys");
+    CHECK(!keyboard_matrix_ghosted(KEYBOARD_BIT(0, 0) | KEYBOARD_BIT(1, 0) | KEYBOARD_BIT(2, 0) | KEYBOARD_BIT(3, 0), 4),
+          "whole column");
+    CHECK(!keyboard_matrix_ghosted(0x000F, 4), "whole row");
+    CHECK(!keyboard_matrix_ghosted(0, 4), "nothing pressed");
+    // Rows beyond num_rows are ignored
+    CHECK(!keyboard_matrix_ghosted(KEYBOARD_BIT(0, 0) | KEYBOARD_BIT(0, 1) | KEYBOARD_BIT(3, 0) | KEYBOARD_BIT(3, 1), 3),
+          "3-row keypad");
+}
+
+int main(void)
+{
+    for (size_t i = 0; i < sizeof(traces) / sizeof(traces[0]); i++) run_trace(&traces[i]);
+    test_latency();
+    test_rollover();
+    test_ghosting();
+
+    if (failures > 0) {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("all keyboard_matrix checks passed\n");
+    return 0;
+}
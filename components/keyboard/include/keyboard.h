@@ -10,30 +10,117 @@
 
 
 #ifndef _KEYBOARD_H
+#define _KEYBOARD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "driver/gpio.h"
+#include "esp_err.h"
+
+/** Max keypads scanned by the driver */
+#define KEYBOARD_MAX_KEYPADS 2
+/** Max rows and columns of a keypad */
+#define KEYBOARD_MAX_ROWS 4
+#define KEYBOARD_MAX_COLS 4
+
+/**
+ * @brief Keypad configuration
+ */
+typedef struct {
+    uint8_t num_rows;                      /**< rows (outputs), 1..4 */
+    uint8_t num_cols;                      /**< columns (inputs with pull-up), 1..4 */
+    bool cols_external_pullup;             /**< the board pulls the columns up: allows input-only GPIO 34-39 */
+    gpio_num_t rows[KEYBOARD_MAX_ROWS];    /**< row pins */
+    gpio_num_t cols[KEYBOARD_MAX_COLS];    /**< column pins */
+    char layout[KEYBOARD_MAX_ROWS * KEYBOARD_MAX_COLS + 1]; /**< num_rows*num_cols keys, row by row */
+} keyboard_config_t;
+
+/**
+ * @brief Keypad handle
+ */
+typedef struct keyboard *keyboard_handle_t;
+
+/**
+ * @brief Keyboard event types
+ */
+typedef enum {
+    KEYBOARD_EVENT_DOWN = 0,   /**< key pressed */
+    KEYBOARD_EVENT_UP,         /**< key released */
+    KEYBOARD_EVENT_HOLD,       /**< key pressed for CONFIG_KEYBOARD_HOLD_MS */
+    KEYBOARD_EVENT_REPEAT,     /**< every CONFIG_KEYBOARD_REPEAT_MS after HOLD */
+} keyboard_event_type_t;
 
 /**
- * @brief Init the keyboard
+ * @brief Keyboard event
+ */
+typedef struct {
+    keyboard_event_type_t type;
+    uint8_t keypad;            /**< id of the keypad (order of creation) */
+    char key;                  /**< key of the layout */
+    uint16_t state;            /**< every pressed key after the event, bit row*4+col (for chords) */
+    TickType_t tick;           /**< tick count of the scan that saw it */
+} keyboard_event_t;
+
+/**
+ * @brief Add a keypad to the driver.
+ * The first call starts the scan task. Every keypad shares the event
+ * queue and the sample clock, and all of them are read in the same pass.
+ * While no key is pressed the rows are kept low and the columns
+ * wake the scan task through an edge interrupt, so nothing is polled.
+ * Call it at startup, before keys are pressed.
+ * 
+ * @param config keypad configuration
+ * @param handle returns the keypad handle
+ * @return esp_err_t ESP_OK, ESP_ERR_INVALID_ARG for a bad config
+ *  or ESP_ERR_NO_MEM when there are KEYBOARD_MAX_KEYPADS already
+ */
+esp_err_t keyboard_create(const keyboard_config_t *config, keyboard_handle_t *handle);
+
+/**
+ * @brief Get the id reported in the events of a keypad
  * 
+ * @param handle keypad handle
+ * @return uint8_t keypad id
  */
-void keyboard_init();
+uint8_t keyboard_get_id(keyboard_handle_t handle);
 
+/**
+ * @brief Build a config from pin lists ("4,13,12,15") and a layout string
+ * ("123A456B789C*0#D"), as they come from Kconfig.
+ * Rows must be output pins. Columns need a pull-up: input-only GPIO 34-39
+ * have no internal one, so they are only accepted with external_pullup.
+ * 
+ * @param config config to fill
+ * @param rows row pins separated by commas
+ * @param cols column pins separated by commas
+ * @param layout keys, row by row
+ * @param external_pullup the board has pull-ups on the columns
+ * @return esp_err_t ESP_OK or ESP_ERR_INVALID_ARG
+ */
+esp_err_t keyboard_config_from_strings(keyboard_config_t *config, const char *rows, const char *cols, const char *layout, bool external_pullup);
 
 /**
- * @brief Get the last keyboard, you need to
- *  get 1 in keyboard_check() before to get a valid char 
+ * @brief Override a config with the one stored in NVS, if any.
+ * Namespace "keyboard", strings kpN_rows, kpN_cols and kpN_layout; the
+ * external pull-up setting of the config is kept.
+ * The config is left unchanged when the stored one is missing or invalid.
  * 
- * @return char return the last_char
+ * @param config config to override
+ * @param index keypad number (N)
+ * @return esp_err_t ESP_OK if the config was loaded from NVS
  */
-char keyboard_get_char();
+esp_err_t keyboard_config_load(keyboard_config_t *config, uint8_t index);
 
 
 /**
- * @brief Check the keyboard. 
- * if its pressed any key,save the char.
+ * @brief Wait for the next keyboard event, from any keypad.
  * 
- * @return int  its 1 if key pressed or 0 if not
+ * @param event where the event is copied
+ * @param timeout max ticks to wait
+ * @return true if an event was received, false on timeout
  */
-int keyboard_check();
+bool keyboard_get_event(keyboard_event_t *event, TickType_t timeout);
 
 
 
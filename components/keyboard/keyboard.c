@@ -1,91 +1,373 @@
+#include <string.h>
+#include <stdlib.h>
 #include "keyboard.h"
+#include "keyboard_matrix.h"
 #include <driver/gpio.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/queue.h"
+#include "esp_timer.h"
+#include "esp_rom_sys.h"
+#include "esp_attr.h"
+#include "nvs.h"
+#if CONFIG_IDF_TARGET_ESP32
+#include "soc/gpio_struct.h"
+#endif
 
-#define NUM_ROW 4
-#define NUM_COL 4
+// Reposo: filas en bajo y columnas con interrupción por flanco descendente.
+// Solo se muestrea, cada CONFIG_KEYBOARD_SAMPLE_MS, desde que se aprieta una
+// tecla hasta que se sueltan todas. Todos los teclados comparten el reloj de
+// muestreo y se leen en la misma pasada.
+#define SETTLE_US 5 // Estabilización de las columnas tras bajar una fila
+#define HOLD_TICKS pdMS_TO_TICKS(CONFIG_KEYBOARD_HOLD_MS)
+#define REPEAT_TICKS pdMS_TO_TICKS(CONFIG_KEYBOARD_REPEAT_MS)
+#define NUM_KEYS (KEYBOARD_MAX_ROWS * KEYBOARD_MAX_COLS)
 
-#define COL_1 GPIO_NUM_33
-#define COL_2 GPIO_NUM_32
-#define COL_3 GPIO_NUM_21
-#define COL_4 GPIO_NUM_0
+struct keyboard {
+    uint8_t id;
+    keyboard_config_t config;
+    keyboard_debounce_t debounce;
+    uint16_t held;                 // Teclas que ya generaron HOLD
+    TickType_t down_tick[NUM_KEYS];
+    TickType_t next_repeat[NUM_KEYS];
+#if CONFIG_IDF_TARGET_ESP32
+    // Máscaras precalculadas por banco: [0] GPIO 0-31 (out_w1ts/out_w1tc/in),
+    // [1] GPIO 32-39 (out1_w1ts/out1_w1tc/in1)
+    uint32_t row_mask[KEYBOARD_MAX_ROWS][2];
+    uint32_t col_mask[KEYBOARD_MAX_COLS][2];
+    uint32_t all_rows[2];
+#endif
+};
 
-#define ROW_1 GPIO_NUM_4
-#define ROW_2 GPIO_NUM_13
-#define ROW_3 GPIO_NUM_12
-#define ROW_4 GPIO_NUM_15
+static struct keyboard _keypads[KEYBOARD_MAX_KEYPADS];
+static uint8_t _num_keypads = 0;
+static SemaphoreHandle_t _activity = NULL; // La ISR avisa que se apretó una tecla
+static QueueHandle_t _events = NULL;
+static esp_timer_handle_t _sample_timer = NULL;
+static uint32_t _dropped = 0; // Eventos descartados por cola llena
 
-gpio_num_t rows[NUM_ROW] = { ROW_1, ROW_2, ROW_3, ROW_4 };
-gpio_num_t cols[NUM_COL] = { COL_1, COL_2, COL_3, COL_4 };
+#if CONFIG_IDF_TARGET_ESP32
+static void _masks_init(struct keyboard *kb) {
+    for (int i = 0; i < kb->config.num_rows; i++) {
+        gpio_num_t pin = kb->config.rows[i];
+        kb->row_mask[i][pin / 32] = 1u << (pin % 32);
+        kb->all_rows[pin / 32] |= 1u << (pin % 32);
+    }
+    for (int i = 0; i < kb->config.num_cols; i++) {
+        gpio_num_t pin = kb->config.cols[i];
+        kb->col_mask[i][pin / 32] = 1u << (pin % 32);
+    }
+}
 
-#define GPIO_INPUT_COLUMNS ((1ULL<<COL_1) | (1ULL<<COL_2) | (1ULL<<COL_3) | (1ULL<<COL_4))
-#define GPIO_OUTPUT_ROWS ((1ULL<<ROW_1) | (1ULL<<ROW_2) | (1ULL<<ROW_3) | (1ULL<<ROW_4))
+FORCE_INLINE_ATTR void _rows_high(const uint32_t mask[2]) {
+    GPIO.out_w1ts = mask[0];
+    GPIO.out1_w1ts.val = mask[1];
+}
 
-// Keypad layout: [row][col]
-char const KEYS[NUM_ROW][NUM_COL] = {
-    { '1', '2' , '3' ,'A' },
-    { '4', '5' , '6' ,'B' },
-    { '7', '8' , '9' ,'C' },
-    { '*', '0' , '#' ,'D' },
-};
+FORCE_INLINE_ATTR void _rows_low(const uint32_t mask[2]) {
+    GPIO.out_w1tc = mask[0];
+    GPIO.out1_w1tc.val = mask[1];
+}
+
+static void _all_rows_set(struct keyboard *kb, uint32_t level) {
+    if (level) _rows_high(kb->all_rows);
+    else _rows_low(kb->all_rows);
+}
+#else
+static void _masks_init(struct keyboard *kb) {
+}
+
+static void _all_rows_set(struct keyboard *kb, uint32_t level) {
+    for (int i = 0; i < kb->config.num_rows; i++) gpio_set_level(kb->config.rows[i], level);
+}
+#endif
+
+static void _columns_isr(void *arg) {
+    BaseType_t woken = pdFALSE;
+    // El escaneo también produce flancos: se deshabilita hasta volver al reposo
+    for (int k = 0; k < _num_keypads; k++) {
+        for (int i = 0; i < _keypads[k].config.num_cols; i++) gpio_intr_disable(_keypads[k].config.cols[i]);
+    }
+    xSemaphoreGiveFromISR(_activity, &woken);
+    if (woken) portYIELD_FROM_ISR();
+}
+
+static void _idle_enter(void) {
+    for (int k = 0; k < _num_keypads; k++) _all_rows_set(&_keypads[k], 0);
+    xSemaphoreTake(_activity, 0); // Descarta avisos generados durante el escaneo
+    for (int k = 0; k < _num_keypads; k++) {
+        for (int i = 0; i < _keypads[k].config.num_cols; i++) gpio_intr_enable(_keypads[k].config.cols[i]);
+    }
+    // Una tecla apretada antes de habilitar la interrupción no genera flanco
+    for (int k = 0; k < _num_keypads; k++) {
+        for (int i = 0; i < _keypads[k].config.num_cols; i++) {
+            if (!gpio_get_level(_keypads[k].config.cols[i])) {
+                xSemaphoreGive(_activity);
+                return;
+            }
+        }
+    }
+}
+
+static void _scan_begin(void) {
+    for (int k = 0; k < _num_keypads; k++) {
+        for (int i = 0; i < _keypads[k].config.num_cols; i++) gpio_intr_disable(_keypads[k].config.cols[i]);
+        _all_rows_set(&_keypads[k], 1);
+    }
+}
+
+// Lee la matriz completa: un bit por tecla apretada (ver KEYBOARD_BIT).
+// Siempre recorre todas las filas, así el costo no depende de las teclas.
+// Está en IRAM para poder llamarse desde una ISR o un timer de alta frecuencia.
+#if CONFIG_IDF_TARGET_ESP32
+static IRAM_ATTR uint16_t _scan(const struct keyboard *kb) {
+    uint16_t state = 0;
+    for (uint8_t row = 0; row < kb->config.num_rows; row++) {
+        _rows_low(kb->row_mask[row]);
+        esp_rom_delay_us(SETTLE_US);  // Pequeño retraso para permitir la estabilización
+        uint32_t in0 = GPIO.in;
+        uint32_t in1 = GPIO.in1.val;
+        _rows_high(kb->row_mask[row]);
+        for (uint8_t col = 0; col < kb->config.num_cols; col++) {
+            if (!((in0 & kb->col_mask[col][0]) | (in1 & kb->col_mask[col][1]))) state |= KEYBOARD_BIT(row, col);
+        }
+    }
+    return state;
+}
+#else
+static uint16_t _scan(const struct keyboard *kb) {
+    uint16_t state = 0;
+    for (uint8_t row = 0; row < kb->config.num_rows; row++) {
+        gpio_set_level(kb->config.rows[row], 0);
+        esp_rom_delay_us(SETTLE_US);  // Pequeño retraso para permitir la estabilización
+        for (uint8_t col = 0; col < kb->config.num_cols; col++) {
+            if (!gpio_get_level(kb->config.cols[col])) state |= KEYBOARD_BIT(row, col);
+        }
+        gpio_set_level(kb->config.rows[row], 1);
+    }
+    return state;
+}
+#endif
+
+static void _send(struct keyboard *kb, keyboard_event_type_t type, uint8_t index, TickType_t tick) {
+    uint8_t row = index / KEYBOARD_MAX_COLS;
+    uint8_t col = index % KEYBOARD_MAX_COLS;
+    keyboard_event_t event = {
+        .type = type,
+        .keypad = kb->id,
+        .key = kb->config.layout[row * kb->config.num_cols + col],
+        .state = kb->debounce.state,
+        .tick = tick,
+    };
+    if (xQueueSend(_events, &event, 0) != pdTRUE) {
+        _dropped++;
+        printf("keyboard: cola llena, %lu eventos descartados\n", (unsigned long)_dropped);
+    }
+}
+
+// Pasa una lectura por el debounce y genera los eventos de un teclado
+static void _process(struct keyboard *kb, uint16_t sample, TickType_t now) {
+    // Una lectura con ghosting no dice nada de las teclas: no se integra
+    uint16_t edges = keyboard_matrix_ghosted(sample, kb->config.num_rows) ? 0 : keyboard_debounce_update(&kb->debounce, sample);
+    uint16_t stable = kb->debounce.state;
 
-static char _last_key = 0;
-static char _last_checked_key = 0; // Para almacenar la última tecla verificada
-static TickType_t _last_key_time = 0; // Para almacenar el tiempo de la última verificación
+    for (uint8_t i = 0; i < NUM_KEYS; i++) {
+        uint16_t bit = 1u << i;
+        if (edges & bit) {
+            if (stable & bit) {
+                _send(kb, KEYBOARD_EVENT_DOWN, i, now);
+                kb->down_tick[i] = now;
+            } else {
+                _send(kb, KEYBOARD_EVENT_UP, i, now);
+            }
+            kb->held &= ~bit;
+        } else if ((stable & bit) && !(kb->held & bit) && now - kb->down_tick[i] >= HOLD_TICKS) {
+            _send(kb, KEYBOARD_EVENT_HOLD, i, now);
+            kb->held |= bit;
+            kb->next_repeat[i] = now + REPEAT_TICKS;
+        } else if ((kb->held & bit) && (int32_t)(now - kb->next_repeat[i]) >= 0) {
+            _send(kb, KEYBOARD_EVENT_REPEAT, i, now);
+            kb->next_repeat[i] += REPEAT_TICKS;
+        }
+    }
+}
+
+// Reloj de muestreo: lee todos los teclados en la misma pasada. Cuando en
+// todos se soltaron las teclas se detiene y vuelve al reposo.
+static void _sample(void *arg) {
+    uint16_t samples[KEYBOARD_MAX_KEYPADS];
+    bool idle = true;
+
+    for (int k = 0; k < _num_keypads; k++) samples[k] = _scan(&_keypads[k]);
+    TickType_t now = xTaskGetTickCount();
+    for (int k = 0; k < _num_keypads; k++) {
+        _process(&_keypads[k], samples[k], now);
+        idle = idle && keyboard_debounce_idle(&_keypads[k].debounce);
+    }
+
+    if (idle) {
+        esp_timer_stop(_sample_timer);
+        _idle_enter(); // Se soltaron todas las teclas
+    }
+}
+
+// Arranca el reloj de muestreo cuando la ISR avisa que se apretó una tecla
+static void _keyboard_task(void *arg) {
+    while (1) {
+        xSemaphoreTake(_activity, portMAX_DELAY);
+        _scan_begin();
+        esp_timer_start_periodic(_sample_timer, CONFIG_KEYBOARD_SAMPLE_MS * 1000);
+    }
+}
+
+static uint64_t _pin_mask(const gpio_num_t *pins, uint8_t count) {
+    uint64_t mask = 0;
+    for (int i = 0; i < count; i++) mask |= 1ULL << pins[i];
+    return mask;
+}
 
-static void _columns_config(void) {
+static void _columns_config(const keyboard_config_t *config) {
     gpio_config_t col_config;
-    col_config.pin_bit_mask = GPIO_INPUT_COLUMNS;
-    col_config.intr_type = GPIO_INTR_DISABLE; // interrupt type: falling and rising edge
+    col_config.pin_bit_mask = _pin_mask(config->cols, config->num_cols);
+    col_config.intr_type = GPIO_INTR_NEGEDGE; // interrupt type: falling edge
     col_config.mode = GPIO_MODE_INPUT;
-    col_config.pull_up_en = GPIO_PULLUP_ENABLE;
-    col_config.pull_down_en = GPIO_PULLUP_DISABLE;
+    // 34-39 no tienen pull-up interno: con pull-ups en la placa no se habilita
+    col_config.pull_up_en = config->cols_external_pullup ? GPIO_PULLUP_DISABLE : GPIO_PULLUP_ENABLE;
+    col_config.pull_down_en = GPIO_PULLDOWN_DISABLE;
     gpio_config(&col_config);
 }
 
-static void _rows_config(void) {
+static void _rows_config(const keyboard_config_t *config) {
     gpio_config_t row_config;
-    row_config.pin_bit_mask = GPIO_OUTPUT_ROWS;
+    row_config.pin_bit_mask = _pin_mask(config->rows, config->num_rows);
     row_config.intr_type = GPIO_INTR_DISABLE;   // interrupt disable
     row_config.mode = GPIO_MODE_OUTPUT;
     row_config.pull_up_en = GPIO_PULLUP_DISABLE;
-    row_config.pull_down_en = GPIO_PULLUP_DISABLE;
+    row_config.pull_down_en = GPIO_PULLDOWN_DISABLE;
     gpio_config(&row_config);
 }
 
-void keyboard_init() {
+// Cola, reloj de muestreo y tarea compartidos por todos los teclados
+static esp_err_t _shared_init(void) {
+    if (_events != NULL) return ESP_OK;
     printf("Iniciando keyboard \n");
-    _columns_config();    
-    _rows_config();
-    for (int i = 0; i < NUM_ROW; i++) gpio_set_level(rows[i], 1);
+    _activity = xSemaphoreCreateBinary();
+    _events = xQueueCreate(CONFIG_KEYBOARD_QUEUE_LEN, sizeof(keyboard_event_t));
+    if (_activity == NULL || _events == NULL) return ESP_ERR_NO_MEM;
+    const esp_timer_create_args_t timer_args = {
+        .callback = _sample,
+        .name = "keyboard_sample",
+    };
+    esp_err_t err = esp_timer_create(&timer_args, &_sample_timer);
+    if (err != ESP_OK) return err;
+    // Puede estar instalado por otro componente
+    err = gpio_install_isr_service(0);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) return err;
+    if (xTaskCreate(_keyboard_task, "keyboard_scan", 2048, NULL, 6, NULL) != pdPASS) return ESP_ERR_NO_MEM;
+    return ESP_OK;
 }
 
-char keyboard_get_char() {
-    return _last_key;
+esp_err_t keyboard_create(const keyboard_config_t *config, keyboard_handle_t *handle) {
+    if (config->num_rows < 1 || config->num_rows > KEYBOARD_MAX_ROWS ||
+        config->num_cols < 1 || config->num_cols > KEYBOARD_MAX_COLS ||
+        strlen(config->layout) != config->num_rows * config->num_cols) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (_num_keypads >= KEYBOARD_MAX_KEYPADS) return ESP_ERR_NO_MEM;
+    esp_err_t err = _shared_init();
+    if (err != ESP_OK) return err;
+
+    // Se detiene el muestreo mientras se agrega el teclado
+    esp_timer_stop(_sample_timer);
+    struct keyboard *kb = &_keypads[_num_keypads];
+    memset(kb, 0, sizeof(struct keyboard));
+    kb->id = _num_keypads;
+    kb->config = *config;
+    keyboard_debounce_init(&kb->debounce, CONFIG_KEYBOARD_DEBOUNCE_MS, CONFIG_KEYBOARD_SAMPLE_MS);
+    _columns_config(config);
+    _rows_config(config);
+    _masks_init(kb);
+    for (int i = 0; i < config->num_cols; i++) {
+        gpio_intr_disable(config->cols[i]);
+        gpio_isr_handler_add(config->cols[i], _columns_isr, NULL);
+    }
+    _num_keypads++;
+    _idle_enter();
+
+    *handle = kb;
+    return ESP_OK;
 }
 
-int keyboard_check() {
-    const TickType_t debounce_delay = 300  / portTICK_PERIOD_MS; // Tiempo de debounce
+uint8_t keyboard_get_id(keyboard_handle_t handle) {
+    return handle->id;
+}
 
-    for (uint8_t row = 0; row < NUM_ROW; row++) {
-        gpio_set_level(rows[row], 0);
-        vTaskDelay(1 / portTICK_PERIOD_MS);  // Pequeño retraso para permitir la estabilización
-        for (uint8_t col = 0; col < NUM_COL; col++) {
-            if (!gpio_get_level(cols[col])) {
-                char current_key = KEYS[row][col];
-                TickType_t current_time = xTaskGetTickCount();
+bool keyboard_get_event(keyboard_event_t *event, TickType_t timeout) {
+    if (_events == NULL) return false;
+    return xQueueReceive(_events, event, timeout) == pdTRUE;
+}
 
-                if (current_key != _last_checked_key || (current_time - _last_key_time) > debounce_delay) {
-                    _last_key = current_key;
-                    _last_checked_key = current_key;
-                    _last_key_time = current_time;
-                    gpio_set_level(rows[row], 1);  // Restaurar el nivel de la fila
-                    return 1;
-                }
-            }
-        }
-        gpio_set_level(rows[row], 1);
+// Lista de pines separados por comas ("4,13,12,15")
+// input_only: se aceptan los pines de solo entrada (34-39), que tampoco tienen pull-up
+static int _parse_pins(const char *list, gpio_num_t *pins, int max, bool input_only) {
+    int count = 0;
+    const char *p = list;
+    while (*p != '\0' && count < max) {
+        char *end;
+        long pin = strtol(p, &end, 10);
+        if (end == p || pin < 0 || pin >= GPIO_NUM_MAX) return -1;
+        if (!input_only && !GPIO_IS_VALID_OUTPUT_GPIO(pin)) return -1;
+        pins[count++] = pin;
+        p = end;
+        while (*p == ',' || *p == ' ') p++;
     }
-    return 0;
+    return (*p == '\0') ? count : -1;
+}
+
+esp_err_t keyboard_config_from_strings(keyboard_config_t *config, const char *rows, const char *cols, const char *layout, bool external_pullup) {
+    memset(config, 0, sizeof(keyboard_config_t));
+    // Las filas son salidas; las columnas, entradas con pull-up
+    int num_rows = _parse_pins(rows, config->rows, KEYBOARD_MAX_ROWS, false);
+    int num_cols = _parse_pins(cols, config->cols, KEYBOARD_MAX_COLS, external_pullup);
+    if (num_rows <= 0 || num_cols <= 0) return ESP_ERR_INVALID_ARG;
+    config->cols_external_pullup = external_pullup;
+    config->num_rows = num_rows;
+    config->num_cols = num_cols;
+    if (strlen(layout) != num_rows * num_cols) return ESP_ERR_INVALID_ARG;
+    snprintf(config->layout, sizeof(config->layout), "%s", layout);
+    return ESP_OK;
+}
+
+esp_err_t keyboard_config_load(keyboard_config_t *config, uint8_t index) {
+    // NVS "keyboard": kpN_rows, kpN_cols y kpN_layout como strings
+    char key[16];
+    char rows[32], cols[32], layout[KEYBOARD_MAX_ROWS * KEYBOARD_MAX_COLS + 1];
+    size_t len;
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open("keyboard", NVS_READONLY, &nvs);
+    if (err != ESP_OK) return err;
+
+    snprintf(key, sizeof(key), "kp%u_rows", index);
+    len = sizeof(rows);
+    err = nvs_get_str(nvs, key, rows, &len);
+    if (err == ESP_OK) {
+        snprintf(key, sizeof(key), "kp%u_cols", index);
+        len = sizeof(cols);
+        err = nvs_get_str(nvs, key, cols, &len);
+    }
+    if (err == ESP_OK) {
+        snprintf(key, sizeof(key), "kp%u_layout", index);
+        len = sizeof(layout);
+        err = nvs_get_str(nvs, key, layout, &len);
+    }
+    nvs_close(nvs);
+    if (err != ESP_OK) return err;
+
+    // Solo se reemplaza la configuración si la de NVS es válida
+    keyboard_config_t loaded;
+    err = keyboard_config_from_strings(&loaded, rows, cols, layout, config->cols_external_pullup);
+    if (err != ESP_OK) return err;
+    *config = loaded;
+    return ESP_OK;
 }
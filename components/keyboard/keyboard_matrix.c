@@ -0,0 +1,55 @@
+#include <string.h>
+
+#include "keyboard_matrix.h"
+
+#define ROW_MASK ((1u << KEYBOARD_MAX_COLS) - 1)
+
+bool keyboard_matrix_ghosted(uint16_t state, uint8_t num_rows) {
+    for (uint8_t r1 = 0; r1 < num_rows; r1++) {
+        uint16_t row1 = (state >> (r1 * KEYBOARD_MAX_COLS)) & ROW_MASK;
+        if (row1 == 0) continue;
+        for (uint8_t r2 = r1 + 1; r2 < num_rows; r2++) {
+            uint16_t common = row1 & (state >> (r2 * KEYBOARD_MAX_COLS)) & ROW_MASK;
+            // Dos o más columnas en común
+            if (common & (common - 1)) return true;
+        }
+    }
+    return false;
+}
+
+void keyboard_debounce_init(keyboard_debounce_t *db, uint32_t debounce_ms, uint32_t sample_ms) {
+    memset(db, 0, sizeof(keyboard_debounce_t));
+    uint32_t samples = (debounce_ms + sample_ms - 1) / sample_ms;
+    if (samples < 1) samples = 1;
+    if (samples > UINT8_MAX) samples = UINT8_MAX;
+    db->max = samples;
+}
+
+uint16_t keyboard_debounce_update(keyboard_debounce_t *db, uint16_t sample) {
+    uint16_t changed = 0;
+    for (uint8_t i = 0; i < KEYBOARD_MAX_ROWS * KEYBOARD_MAX_COLS; i++) {
+        uint16_t bit = 1u << i;
+        uint8_t *integ = &db->integrator[i];
+        if (sample & bit) {
+            if (*integ < db->max) (*integ)++;
+        } else if (*integ > 0) {
+            (*integ)--;
+        }
+        if (*integ == db->max && !(db->state & bit)) {
+            db->state |= bit;
+            changed |= bit;
+        } else if (*integ == 0 && (db->state & bit)) {
+            db->state &= ~bit;
+            changed |= bit;
+        }
+    }
+    return changed;
+}
+
+bool keyboard_debounce_idle(const keyboard_debounce_t *db) {
+    if (db->state != 0) return false;
+    for (uint8_t i = 0; i < KEYBOARD_MAX_ROWS * KEYBOARD_MAX_COLS; i++) {
+        if (db->integrator[i] != 0) return false;
+    }
+    return true;
+}
@@ -0,0 +1,73 @@
+/*
+ * Lógica pura del teclado matricial (sin GPIO ni FreeRTOS), para poder
+ * probarla en el host.
+ */
+#ifndef _KEYBOARD_MATRIX_H
+#define _KEYBOARD_MATRIX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Los mismos que en keyboard.h; se repiten para compilar sin ESP-IDF (host_test)
+#ifndef KEYBOARD_MAX_ROWS
+#define KEYBOARD_MAX_ROWS 4
+#define KEYBOARD_MAX_COLS 4
+#endif
+
+// Bit de la tecla [row][col] en la palabra de estado de 16 bits
+#define KEYBOARD_BIT(row, col) (1u << ((row) * KEYBOARD_MAX_COLS + (col)))
+
+/**
+ * @brief Detecta patrones de ghosting en una lectura de la matriz.
+ *
+ * Con tres teclas en las esquinas de un rectángulo aparece una cuarta
+ * fantasma, y no se puede saber cuál de las cuatro está realmente apretada.
+ * Eso ocurre cuando dos filas comparten dos o más columnas.
+ *
+ * @param state Lectura de la matriz (un bit por tecla, ver KEYBOARD_BIT).
+ * @param num_rows Filas de la matriz.
+ * @return true si la lectura es ambigua y debe descartarse.
+ */
+bool keyboard_matrix_ghosted(uint16_t state, uint8_t num_rows);
+
+/**
+ * @brief Estado del debounce por integrador de cada tecla.
+ */
+typedef struct {
+    uint8_t integrator[KEYBOARD_MAX_ROWS * KEYBOARD_MAX_COLS]; // 0..max por tecla
+    uint8_t max;      // Muestras seguidas para cambiar de estado
+    uint16_t state;   // Teclas apretadas, ya sin rebotes
+} keyboard_debounce_t;
+
+/**
+ * @brief Inicializa el debounce con todas las teclas sueltas.
+ *
+ * @param db Estado del debounce.
+ * @param debounce_ms Tiempo que una tecla debe mantenerse para cambiar de estado.
+ * @param sample_ms Periodo del reloj de muestreo.
+ */
+void keyboard_debounce_init(keyboard_debounce_t *db, uint32_t debounce_ms, uint32_t sample_ms);
+
+/**
+ * @brief Procesa una muestra de la matriz.
+ *
+ * El integrador de cada tecla sube con cada muestra apretada y baja con
+ * cada muestra suelta; la tecla cambia de estado al llegar a max o a 0.
+ * Un rebote solo demora el cambio, y dos pulsaciones reales separadas por
+ * más de debounce_ms generan dos flancos.
+ *
+ * @param db Estado del debounce.
+ * @param sample Lectura de la matriz.
+ * @return uint16_t Teclas que cambiaron de estado (db->state tiene el nuevo estado).
+ */
+uint16_t keyboard_debounce_update(keyboard_debounce_t *db, uint16_t sample);
+
+/**
+ * @brief Indica si no hay teclas apretadas ni cambios pendientes.
+ *
+ * @param db Estado del debounce.
+ * @return true si todos los integradores están en 0.
+ */
+bool keyboard_debounce_idle(const keyboard_debounce_t *db);
+
+#endif
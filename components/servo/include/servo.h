@@ -0,0 +1,111 @@
+#ifndef MAIN_SERVO_H_
+#define MAIN_SERVO_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "driver/mcpwm.h"
+
+/*
+ * Motor de movimiento de servos sobre MCPWM.
+ *
+ * Cada movimiento sigue un perfil trapezoidal (aceleración, velocidad
+ * máxima, desaceleración) que se calcula completo al empezar: un ancho de
+ * pulso por periodo del PWM. Un esp_timer con el mismo periodo carga el
+ * siguiente valor en el comparador, así que ninguna tarea queda bloqueada
+ * y la velocidad no depende de CONFIG_FREERTOS_HZ.
+ */
+
+/** Máximo de periodos de PWM de un movimiento (a 50 Hz, 10 s) */
+#define SERVO_MAX_SAMPLES 512
+
+/**
+ * @brief Configuración de un servo.
+ */
+typedef struct {
+	int gpio;                   /**< Salida de la señal */
+	mcpwm_unit_t unit;          /**< Unidad MCPWM */
+	mcpwm_timer_t timer;        /**< Timer MCPWM; el servo usa su operador A */
+	mcpwm_io_signals_t signal;  /**< Señal que corresponde a unit/timer, p. ej. MCPWM0A */
+	uint32_t frequency;         /**< Frecuencia del PWM en Hz (50 para servos analógicos) */
+	uint32_t min_us;            /**< Pulso en 0 grados */
+	uint32_t max_us;            /**< Pulso en 180 grados */
+	float max_speed;            /**< Velocidad máxima en grados/s */
+	float acceleration;         /**< Aceleración y desaceleración en grados/s² */
+	float initial_angle;        /**< Posición conocida al crear; no se envía hasta el primer movimiento */
+} servo_config_t;
+
+/**
+ * @brief Handle de un servo.
+ */
+typedef struct servo *servo_handle_t;
+
+/**
+ * @brief Aviso de fin de movimiento. Corre en la tarea de esp_timer: no debe bloquear.
+ *
+ * @param servo Servo que llegó.
+ * @param arg Argumento pasado a servo_move_to().
+ */
+typedef void (*servo_done_cb_t)(servo_handle_t servo, void *arg);
+
+/**
+ * @brief Configura el MCPWM y el timer de movimiento de un servo.
+ *
+ * @param config Configuración.
+ * @param handle Devuelve el handle.
+ * @return esp_err_t ESP_OK, ESP_ERR_INVALID_ARG o ESP_ERR_NO_MEM.
+ */
+esp_err_t servo_create(const servo_config_t *config, servo_handle_t *handle);
+
+/**
+ * @brief Convierte un ángulo en ancho de pulso.
+ *
+ * @param servo Servo.
+ * @param angle Ángulo entre 0 y 180 grados.
+ * @return uint32_t Ancho de pulso en microsegundos.
+ */
+uint32_t servo_angle_to_duty_us(servo_handle_t servo, float angle);
+
+/**
+ * @brief Empieza un movimiento hacia un ángulo y vuelve enseguida.
+ *
+ * Si hay un movimiento en curso se reemplaza: el nuevo parte de la posición
+ * y, si va en el mismo sentido, de la velocidad actuales. Un cambio de
+ * sentido parte de velocidad cero.
+ *
+ * @param servo Servo.
+ * @param angle Destino entre 0 y 180 grados.
+ * @param done Se llama al llegar (puede ser NULL). No se llama si el
+ * movimiento es reemplazado por otro.
+ * @param arg Argumento de done.
+ * @return esp_err_t ESP_OK o ESP_ERR_INVALID_SIZE si el perfil supera SERVO_MAX_SAMPLES.
+ */
+esp_err_t servo_move_to(servo_handle_t servo, float angle, servo_done_cb_t done, void *arg);
+
+/**
+ * @brief Pone el servo en un ángulo sin perfil, cancelando el movimiento en curso.
+ *
+ * @param servo Servo.
+ * @param angle Ángulo entre 0 y 180 grados.
+ */
+void servo_set_angle(servo_handle_t servo, float angle);
+
+/**
+ * @brief Ángulo enviado al servo en el último periodo.
+ */
+float servo_get_angle(servo_handle_t servo);
+
+/**
+ * @brief Indica si hay un movimiento en curso.
+ */
+bool servo_is_moving(servo_handle_t servo);
+
+/**
+ * @brief Tiempo que le falta al movimiento en curso.
+ *
+ * @param servo Servo.
+ * @return uint32_t Milisegundos, 0 si está quieto.
+ */
+uint32_t servo_remaining_ms(servo_handle_t servo);
+
+#endif /* MAIN_SERVO_H_ */
@@ -0,0 +1,277 @@
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+#include "servo.h"
+
+#define TAG "SERVO"
+
+struct servo {
+	servo_config_t config;
+	int64_t period_us;                           // Periodo del PWM: un valor nuevo por periodo
+	esp_timer_handle_t timer;
+	portMUX_TYPE lock;                           // Protege lo que sigue, compartido con servo_tick()
+	uint16_t samples[2][SERVO_MAX_SAMPLES];      // Perfil en curso y el siguiente (ancho de pulso en us)
+	uint8_t active;                              // Buffer del perfil en curso
+	uint16_t count;                              // Muestras del perfil en curso
+	uint16_t index;                              // Próxima muestra a enviar
+	uint16_t duty_us;                            // Último pulso enviado
+	uint16_t prev_duty_us;                       // Pulso del periodo anterior (para la velocidad)
+	bool moving;
+	bool armed;                                  // El timer está programado
+	int64_t next_us;                             // Hora de la próxima muestra
+	servo_done_cb_t done;
+	void *done_arg;
+};
+
+// Perfil trapezoidal desde 0 hasta una distancia positiva, con velocidad inicial
+typedef struct {
+	float v0;
+	float vpeak;
+	float a_acc;
+	float a_dec;
+	float t_acc;
+	float t_cruise;
+	float t_dec;
+} profile_t;
+
+static void profile_plan(profile_t *p, float dist, float v0, float vmax, float a)
+{
+	if (v0 > vmax) v0 = vmax;
+	p->v0 = v0;
+	p->a_acc = a;
+	p->a_dec = a;
+
+	// Demasiado rápido para frenar a tiempo: solo se frena, con la desaceleración justa
+	if (v0 * v0 / (2 * a) >= dist) {
+		p->vpeak = v0;
+		p->a_dec = v0 * v0 / (2 * dist);
+		p->t_acc = 0;
+		p->t_cruise = 0;
+		p->t_dec = v0 / p->a_dec;
+		return;
+	}
+
+	float vpeak = vmax;
+	float d_acc = (vpeak * vpeak - v0 * v0) / (2 * a);
+	float d_dec = vpeak * vpeak / (2 * a);
+	if (d_acc + d_dec > dist) {
+		// Triangular: no llega a la velocidad máxima
+		vpeak = sqrtf((2 * a * dist + v0 * v0) / 2);
+		d_acc = (vpeak * vpeak - v0 * v0) / (2 * a);
+		d_dec = vpeak * vpeak / (2 * a);
+	}
+	p->vpeak = vpeak;
+	p->t_acc = (vpeak - v0) / a;
+	p->t_dec = vpeak / a;
+	p->t_cruise = fmaxf(0, (dist - d_acc - d_dec) / vpeak);
+}
+
+static float profile_total(const profile_t *p)
+{
+	return p->t_acc + p->t_cruise + p->t_dec;
+}
+
+static float profile_position(const profile_t *p, float t)
+{
+	if (t < p->t_acc) return p->v0 * t + 0.5f * p->a_acc * t * t;
+	float d = p->v0 * p->t_acc + 0.5f * p->a_acc * p->t_acc * p->t_acc;
+	t -= p->t_acc;
+	if (t < p->t_cruise) return d + p->vpeak * t;
+	d += p->vpeak * p->t_cruise;
+	t -= p->t_cruise;
+	if (t > p->t_dec) t = p->t_dec;
+	return d + p->vpeak * t - 0.5f * p->a_dec * t * t;
+}
+
+static float duty_to_angle(const struct servo *s, uint32_t duty_us)
+{
+	return ((float)duty_us - s->config.min_us) * 180.0f / (s->config.max_us - s->config.min_us);
+}
+
+uint32_t servo_angle_to_duty_us(servo_handle_t servo, float angle)
+{
+	if (angle < 0) angle = 0;
+	if (angle > 180) angle = 180;
+	return servo->config.min_us + (uint32_t)lroundf(angle * (servo->config.max_us - servo->config.min_us) / 180.0f);
+}
+
+static void servo_output(struct servo *s, uint32_t duty_us)
+{
+	mcpwm_set_duty_in_us(s->config.unit, s->config.timer, MCPWM_OPR_A, duty_us);
+}
+
+// Una muestra por periodo del PWM. Se reprograma contra la hora de inicio,
+// así la latencia del callback no se acumula.
+static void servo_tick(void *arg)
+{
+	struct servo *s = arg;
+	servo_done_cb_t done = NULL;
+	void *done_arg = NULL;
+	bool send = false, rearm = false;
+	uint16_t duty = 0;
+
+	portENTER_CRITICAL(&s->lock);
+	if (s->moving) {
+		duty = s->samples[s->active][s->index++];
+		s->prev_duty_us = s->duty_us;
+		s->duty_us = duty;
+		send = true;
+		if (s->index >= s->count) {
+			s->moving = false;
+			done = s->done;
+			done_arg = s->done_arg;
+		}
+	}
+	rearm = s->moving;
+	s->armed = rearm;
+	if (rearm) s->next_us += s->period_us;
+	int64_t delay = s->next_us - esp_timer_get_time();
+	portEXIT_CRITICAL(&s->lock);
+
+	if (send) servo_output(s, duty);
+	if (rearm) esp_timer_start_once(s->timer, delay > 0 ? delay : 0);
+	if (done) done(s, done_arg);
+}
+
+esp_err_t servo_create(const servo_config_t *config, servo_handle_t *handle)
+{
+	if (config->frequency == 0 || config->max_us <= config->min_us || config->max_speed <= 0 || config->acceleration <= 0) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	struct servo *s = calloc(1, sizeof(struct servo));
+	if (s == NULL) return ESP_ERR_NO_MEM;
+	s->config = *config;
+	s->period_us = 1000000 / config->frequency;
+	portMUX_INITIALIZE(&s->lock);
+	s->duty_us = servo_angle_to_duty_us(s, config->initial_angle);
+	s->prev_duty_us = s->duty_us;
+
+	const esp_timer_create_args_t timer_args = {
+		.callback = servo_tick,
+		.arg = s,
+		.name = "servo",
+	};
+	esp_err_t err = esp_timer_create(&timer_args, &s->timer);
+	if (err != ESP_OK) {
+		free(s);
+		return err;
+	}
+
+	mcpwm_gpio_init(config->unit, config->signal, config->gpio);
+	mcpwm_config_t pwm_config = {
+		.frequency = config->frequency,
+		.cmpr_a = 0,     // Sin pulso hasta el primer movimiento
+		.cmpr_b = 0,
+		.counter_mode = MCPWM_UP_COUNTER,
+		.duty_mode = MCPWM_DUTY_MODE_0,
+	};
+	err = mcpwm_init(config->unit, config->timer, &pwm_config);
+	if (err != ESP_OK) {
+		esp_timer_delete(s->timer);
+		free(s);
+		return err;
+	}
+	*handle = s;
+	return ESP_OK;
+}
+
+esp_err_t servo_move_to(servo_handle_t servo, float angle, servo_done_cb_t done, void *arg)
+{
+	struct servo *s = servo;
+	if (angle < 0) angle = 0;
+	if (angle > 180) angle = 180;
+
+	// Punto de partida: lo último enviado y la velocidad de ese periodo
+	portENTER_CRITICAL(&s->lock);
+	float from = duty_to_angle(s, s->duty_us);
+	float velocity = s->moving ? (duty_to_angle(s, s->duty_us) - duty_to_angle(s, s->prev_duty_us)) * 1e6f / s->period_us : 0;
+	uint8_t next = s->active ^ 1;
+	portEXIT_CRITICAL(&s->lock);
+
+	float dist = fabsf(angle - from);
+	float dir = (angle >= from) ? 1.0f : -1.0f;
+	float v0 = fmaxf(0, velocity * dir);  // Un cambio de sentido parte de cero
+	uint16_t count = 1;
+	float period = s->period_us / 1e6f;
+
+	// El perfil completo se calcula acá, fuera del timer
+	if (dist > 0) {
+		profile_t p;
+		profile_plan(&p, dist, v0, s->config.max_speed, s->config.acceleration);
+		float total = profile_total(&p);
+		uint32_t n = (uint32_t)ceilf(total / period);
+		if (n > SERVO_MAX_SAMPLES) {
+			ESP_LOGE(TAG, "movimiento de %.1f s, máximo %d periodos", total, SERVO_MAX_SAMPLES);
+			return ESP_ERR_INVALID_SIZE;
+		}
+		count = (n > 0) ? n : 1;
+		for (uint16_t k = 0; k + 1 < count; k++) {
+			float pos = fminf(profile_position(&p, (k + 1) * period), dist);
+			s->samples[next][k] = servo_angle_to_duty_us(s, from + dir * pos);
+		}
+	}
+	s->samples[next][count - 1] = servo_angle_to_duty_us(s, angle);
+
+	bool arm;
+	portENTER_CRITICAL(&s->lock);
+	s->active = next;
+	s->count = count;
+	s->index = 0;
+	s->done = done;
+	s->done_arg = arg;
+	s->moving = true;
+	arm = !s->armed;
+	if (arm) {
+		s->armed = true;
+		s->next_us = esp_timer_get_time() + s->period_us;
+	}
+	portEXIT_CRITICAL(&s->lock);
+
+	if (arm) esp_timer_start_once(s->timer, s->period_us);
+	return ESP_OK;
+}
+
+void servo_set_angle(servo_handle_t servo, float angle)
+{
+	struct servo *s = servo;
+	uint16_t duty = servo_angle_to_duty_us(s, angle);
+
+	portENTER_CRITICAL(&s->lock);
+	s->moving = false;   // Si el timer está programado, se detiene solo
+	s->duty_us = duty;
+	s->prev_duty_us = duty;
+	portEXIT_CRITICAL(&s->lock);
+	servo_output(s, duty);
+}
+
+float servo_get_angle(servo_handle_t servo)
+{
+	struct servo *s = servo;
+	portENTER_CRITICAL(&s->lock);
+	uint16_t duty = s->duty_us;
+	portEXIT_CRITICAL(&s->lock);
+	return duty_to_angle(s, duty);
+}
+
+bool servo_is_moving(servo_handle_t servo)
+{
+	struct servo *s = servo;
+	portENTER_CRITICAL(&s->lock);
+	bool moving = s->moving;
+	portEXIT_CRITICAL(&s->lock);
+	return moving;
+}
+
+uint32_t servo_remaining_ms(servo_handle_t servo)
+{
+	struct servo *s = servo;
+	portENTER_CRITICAL(&s->lock);
+	uint32_t left = s->moving ? s->count - s->index : 0;
+	portEXIT_CRITICAL(&s->lock);
+	return left * s->period_us / 1000;
+}
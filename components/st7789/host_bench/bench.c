@@ -0,0 +1,309 @@
+/*
+ * Benchmark of the st7789 primitives and of every application screen,
+ * run against the host backend (st7789_host.c).
+ *
+ * For each case it reports SPI transactions, payload bytes, DC toggles,
+ * modeled bus time at 20/40/80 MHz and host CPU time. Transactions and
+ * bytes are deterministic, so they are checked against budgets.txt and
+ * any case over budget makes the program (and the build) fail.
+ *
+ * usage: st7789_bench [budgets.txt]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "st7789.h"
+#include "st7789_host.h"
+#include "ui.h"
+
+// spi_device_transmit() cost that doesn't depend on the payload
+// (queueing, interrupt, task switch), measured on an ESP32 at 240 MHz.
+#define TRANS_OVERHEAD_US 15.0
+
+#define MAX_CASES 32
+
+typedef void (*bench_fn_t)(TFT_t * dev);
+
+typedef struct {
+	const char *name;
+	bench_fn_t run;
+	bench_fn_t setup;          // not measured
+	bool frame_buffer;
+} bench_case_t;
+
+typedef struct {
+	char name[32];
+	uint32_t max_transactions;
+	uint32_t max_bytes;
+} budget_t;
+
+static budget_t budgets[MAX_CASES];
+static int nbudgets;
+
+//------------------------------------------workload-------------------------------
+
+static void run_fill_screen(TFT_t * dev) { lcdFillScreen(dev, BLACK); }
+static void run_draw_string(TFT_t * dev) { LCD_DrawString(dev, 30, 100, "Bienvenido!", &Font24, RED); }
+static void run_draw_circle(TFT_t * dev) { lcdDrawCircle(dev, 120, 120, 100, BLUE); }
+static void run_fill_rect_bar(TFT_t * dev) { lcdDrawFillRect(dev, 20, 180, 21, 191, WHITE); }
+static void run_draw_finish(TFT_t * dev) { lcdDrawFinish(dev); }
+static void setup_splash(TFT_t * dev) { ui_draw_screen(dev, UI_SCREEN_SPLASH); }
+static void run_draw_icon(TFT_t * dev) { ui_draw_icon(dev, UI_ICON_WIFI, 4, 4); }
+
+// 32x32 ring, drawn from the run table and pixel by pixel as a baseline
+#define RING_SIZE 32
+#define RING_KEY  BLACK
+static uint16_t ring_image[RING_SIZE * RING_SIZE];
+static lcd_sprite_t ring;
+
+static void ring_init(void)
+{
+	for (int y = 0; y < RING_SIZE; y++) {
+		for (int x = 0; x < RING_SIZE; x++) {
+			int dx = 2*x - (RING_SIZE-1);
+			int dy = 2*y - (RING_SIZE-1);
+			int r2 = dx*dx + dy*dy;
+			bool opaque = r2 <= (RING_SIZE-1)*(RING_SIZE-1) && r2 >= (RING_SIZE/2)*(RING_SIZE/2);
+			ring_image[y*RING_SIZE+x] = opaque ? CYAN : RING_KEY;
+		}
+	}
+	lcdSpriteBuild(&ring, RING_SIZE, RING_SIZE, ring_image, RING_KEY);
+}
+
+static void run_draw_sprite(TFT_t * dev) { lcdDrawSprite(dev, 100, 100, &ring); }
+static void run_draw_sprite_pixels(TFT_t * dev)
+{
+	for (uint16_t y = 0; y < RING_SIZE; y++) {
+		for (uint16_t x = 0; x < RING_SIZE; x++) {
+			uint16_t c = ring_image[y*RING_SIZE+x];
+			if (c != RING_KEY) lcdDrawPixel(dev, 100 + x, 100 + y, c);
+		}
+	}
+}
+static void run_status(TFT_t * dev) { ui_draw_status(dev); }
+static void setup_welcome(TFT_t * dev) { ui_draw_screen(dev, UI_SCREEN_WELCOME); }
+
+static void run_splash(TFT_t * dev) { ui_draw_screen(dev, UI_SCREEN_SPLASH); }
+static void run_welcome(TFT_t * dev) { ui_draw_screen(dev, UI_SCREEN_WELCOME); }
+static void run_granted(TFT_t * dev) { ui_draw_screen(dev, UI_SCREEN_GRANTED); }
+static void run_open(TFT_t * dev) { ui_draw_screen(dev, UI_SCREEN_OPEN); }
+static void run_denied(TFT_t * dev) { ui_draw_screen(dev, UI_SCREEN_DENIED); }
+static void run_revoked(TFT_t * dev) { ui_draw_screen(dev, UI_SCREEN_REVOKED); }
+static void run_no_response(TFT_t * dev) { ui_draw_screen(dev, UI_SCREEN_NO_RESPONSE); }
+static void setup_message(TFT_t * dev) { (void)dev; ui_set_message("Bienvenida, Ana. Piso 3"); }
+static void run_message(TFT_t * dev) { ui_draw_screen(dev, UI_SCREEN_MESSAGE); }
+
+static const bench_case_t cases[] = {
+	// primitives
+	{ "fill_screen",    run_fill_screen,   NULL,         false },
+	{ "draw_string",    run_draw_string,   NULL,         false },
+	{ "draw_circle",    run_draw_circle,   NULL,         false },
+	{ "fill_rect_bar",  run_fill_rect_bar, NULL,         false },
+	{ "draw_finish_fb", run_draw_finish,   setup_splash, true  },
+	{ "draw_icon",      run_draw_icon,     NULL,         false },
+	{ "draw_icon_fb",   run_draw_icon,     NULL,         true  },
+	{ "draw_sprite",    run_draw_sprite,   NULL,         false },
+	{ "draw_sprite_px", run_draw_sprite_pixels, NULL,    false },
+	{ "status_update",  run_status,        setup_welcome, false },
+	// screens
+	{ "screen_splash",    run_splash,  NULL, false },
+	{ "screen_splash_fb", run_splash,  NULL, true  },
+	{ "screen_welcome",   run_welcome, NULL, false },
+	{ "screen_granted",   run_granted, NULL, false },
+	{ "screen_open",      run_open,    NULL, false },
+	{ "screen_denied",    run_denied,  NULL, false },
+	{ "screen_revoked",   run_revoked, NULL, false },
+	{ "screen_no_response", run_no_response, NULL, false },
+	{ "screen_message",   run_message, setup_message, false },
+};
+
+//------------------------------------------budgets-------------------------------
+
+static bool load_budgets(const char *path)
+{
+	FILE *fp = fopen(path, "r");
+	if (fp == NULL) {
+		fprintf(stderr, "can't open %s\n", path);
+		return false;
+	}
+	char line[128];
+	while (fgets(line, sizeof(line), fp) != NULL && nbudgets < MAX_CASES) {
+		budget_t *b = &budgets[nbudgets];
+		if (line[0] == '#' || line[0] == '\n') continue;
+		if (sscanf(line, "%31s %u %u", b->name, &b->max_transactions, &b->max_bytes) == 3) nbudgets++;
+	}
+	fclose(fp);
+	return true;
+}
+
+static const budget_t *find_budget(const char *name)
+{
+	for (int i = 0; i < nbudgets; i++) {
+		if (strcmp(budgets[i].name, name) == 0) return &budgets[i];
+	}
+	return NULL;
+}
+
+//------------------------------------------screenshots-------------------------------
+// Every screen is rendered, split into chunks with lcdShotNextChunk() and
+// decoded back; the image must match and the compressed size is reported.
+// The same screen rendered band by band (lcdFrameBufferBand(), as the
+// firmware does without a frame buffer) must decode to the same image
+// without touching the bus.
+
+#define SHOT_CHUNK 1024
+#define SHOT_BAND_ROWS 16
+
+static bool shot_decode(const uint8_t *chunk, size_t len, uint16_t *image, uint32_t npixels)
+{
+	if (len < LCD_SHOT_HEADER_SIZE || chunk[0] != LCD_SHOT_MAGIC || chunk[1] != LCD_SHOT_VERSION) return false;
+	uint32_t pos = chunk[8] | (chunk[9] << 8) | (chunk[10] << 16) | ((uint32_t)chunk[11] << 24);
+	for (size_t i = LCD_SHOT_HEADER_SIZE; i < len; ) {
+		uint8_t token = chunk[i++];
+		uint32_t n = (token & 0x7F) + 1;
+		bool run = token & 0x80;
+		for (uint32_t k = 0; k < n; k++) {
+			if (i + 2 > len || pos >= npixels) return false;
+			image[pos++] = chunk[i] | (chunk[i+1] << 8);
+			if (!run || k == n - 1) i += 2;
+		}
+	}
+	return true;
+}
+
+static bool shot_bands(TFT_t * dev, ui_screen_t screen, uint16_t * decoded, uint32_t npixels)
+{
+	static uint16_t band[SHOT_BAND_ROWS * 240];
+	uint8_t chunk[SHOT_CHUNK];
+	lcd_shot_t shot;
+	lcd_bus_stats_t s;
+	size_t len;
+	bool ok = true;
+	bool last = false;
+
+	lcdShotBegin(&shot, NULL, dev->_width, dev->_height, screen);
+	lcdHostResetStats(dev);
+	for (uint16_t y = 0; y < dev->_height; y += SHOT_BAND_ROWS) {
+		uint16_t rows = (dev->_height - y < SHOT_BAND_ROWS) ? dev->_height - y : SHOT_BAND_ROWS;
+		lcdFrameBufferBand(dev, band, y, rows);
+		ui_render_screen(dev, screen);
+		lcdShotBand(&shot, band, y, rows);
+		while ((len = lcdShotNextChunk(&shot, chunk, sizeof(chunk))) > 0) {
+			ok = ok && !last && shot_decode(chunk, len, decoded, npixels);
+			last = chunk[6] & LCD_SHOT_LAST;
+		}
+	}
+	lcdFrameBufferBand(dev, NULL, 0, 0);
+	lcdHostGetStats(dev, &s);
+	return ok && last && s.transactions == 0;
+}
+
+static int run_screenshots(TFT_t * dev, uint16_t * frame_buffer)
+{
+	uint32_t npixels = dev->_width * dev->_height;
+	uint16_t *decoded = malloc(sizeof(uint16_t) * npixels);
+	uint8_t chunk[SHOT_CHUNK];
+	int failures = 0;
+
+	printf("\n%-18s %8s %9s %7s  %s\n", "screenshot", "chunks", "bytes", "ratio", "check");
+	dev->_frame_buffer = frame_buffer;
+	dev->_use_frame_buffer = true;
+	for (ui_screen_t screen = 0; screen < UI_SCREEN_MAX; screen++) {
+		ui_render_screen(dev, screen);
+		memset(decoded, 0, sizeof(uint16_t) * npixels);
+
+		lcd_shot_t shot;
+		lcdShotBegin(&shot, frame_buffer, dev->_width, dev->_height, screen);
+		uint32_t chunks = 0, bytes = 0;
+		bool ok = true;
+		size_t len;
+		while ((len = lcdShotNextChunk(&shot, chunk, sizeof(chunk))) > 0) {
+			ok = ok && shot_decode(chunk, len, decoded, npixels);
+			chunks++;
+			bytes += len;
+		}
+		ok = ok && memcmp(decoded, frame_buffer, sizeof(uint16_t) * npixels) == 0;
+
+		memset(decoded, 0, sizeof(uint16_t) * npixels);
+		ok = ok && shot_bands(dev, screen, decoded, npixels);
+		ok = ok && memcmp(decoded, frame_buffer, sizeof(uint16_t) * npixels) == 0;
+		dev->_frame_buffer = frame_buffer;
+		dev->_use_frame_buffer = true;
+		if (!ok) failures++;
+		printf("%-18s %8u %9u %6.1f%%  %s\n", ui_screen_name(screen), chunks, bytes,
+			100.0 * bytes / (npixels * 2), ok ? "ok" : "MISMATCH");
+	}
+	dev->_use_frame_buffer = false;
+	free(decoded);
+	return failures;
+}
+
+//------------------------------------------main-------------------------------
+
+static double bus_ms(const lcd_bus_stats_t *s, double hz)
+{
+	return (s->bytes * 8.0 / hz * 1e6 + s->transactions * TRANS_OVERHEAD_US) / 1000.0;
+}
+
+static double now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc > 1 && !load_budgets(argv[1])) return 2;
+
+	TFT_t dev;
+	host_master_init(&dev, 26, -1);
+	lcdInit(&dev, 240, 240, 0, 0);
+	if (!ui_init()) return 2;
+	ring_init();
+	uint16_t *frame_buffer = malloc(sizeof(uint16_t) * 240 * 240);
+
+	int failures = 0;
+	printf("%-18s %8s %9s %8s %9s %9s %9s %10s  %s\n",
+		"case", "trans", "bytes", "dc", "20MHz ms", "40MHz ms", "80MHz ms", "cpu us", "budget");
+	for (size_t i = 0; i < sizeof(cases)/sizeof(cases[0]); i++) {
+		const bench_case_t *c = &cases[i];
+		dev._frame_buffer = frame_buffer;
+		dev._use_frame_buffer = c->frame_buffer && frame_buffer != NULL;
+		if (c->setup) c->setup(&dev);
+
+		lcd_bus_stats_t s;
+		lcdHostResetStats(&dev);
+		double t0 = now_us();
+		c->run(&dev);
+		double t1 = now_us();
+		lcdHostGetStats(&dev, &s);
+
+		const char *verdict = "-";
+		const budget_t *b = find_budget(c->name);
+		if (b != NULL) {
+			verdict = "ok";
+			if (s.transactions > b->max_transactions || s.bytes > b->max_bytes) {
+				verdict = "OVER";
+				failures++;
+			}
+		}
+		printf("%-18s %8u %9u %8u %9.2f %9.2f %9.2f %10.1f  %s\n",
+			c->name, s.transactions, s.bytes, s.dc_toggles,
+			bus_ms(&s, 20e6), bus_ms(&s, 40e6), bus_ms(&s, 80e6), t1 - t0, verdict);
+		if (b != NULL && strcmp(verdict, "OVER") == 0) {
+			printf("  budget: %u transactions, %u bytes\n", b->max_transactions, b->max_bytes);
+		}
+	}
+	dev._use_frame_buffer = false;
+	failures += run_screenshots(&dev, frame_buffer);
+	free(frame_buffer);
+
+	if (failures > 0) {
+		printf("%d case(s) over budget or failed\n", failures);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,10 @@
+/* Host shim: only what the st7789 component uses from FreeRTOS. */
+#pragma once
+#include <stdint.h>
+#include "sdkconfig.h"
+
+typedef uint32_t TickType_t;
+typedef long BaseType_t;
+#define configTICK_RATE_HZ 100
+#define portTICK_PERIOD_MS (1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(((uint64_t)(ms) * configTICK_RATE_HZ) / 1000))
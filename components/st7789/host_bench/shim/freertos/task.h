@@ -0,0 +1,6 @@
+/* Host shim: delays advance a virtual tick counter instead of sleeping. */
+#pragma once
+#include "freertos/FreeRTOS.h"
+
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
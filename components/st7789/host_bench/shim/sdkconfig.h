@@ -0,0 +1,6 @@
+/* Minimal configuration to build the st7789 component on a Linux host
+ * without ESP-IDF. Mirrors the defaults of Kconfig.projbuild. */
+#pragma once
+#define CONFIG_IDF_TARGET_LINUX 1
+#define CONFIG_LCD_IDLE_TIMEOUT 30
+#define CONFIG_LCD_SLEEP_TIMEOUT 300
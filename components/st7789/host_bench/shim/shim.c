@@ -0,0 +1,13 @@
+#include "freertos/task.h"
+
+static TickType_t ticks;
+
+void vTaskDelay(TickType_t delay)
+{
+	ticks += delay;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+	return ticks;
+}
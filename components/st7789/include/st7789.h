@@ -1,7 +1,13 @@
 #ifndef MAIN_ST7789_H_
 #define MAIN_ST7789_H_
 
+#include <stdbool.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#if !CONFIG_IDF_TARGET_LINUX
+#include "freertos/event_groups.h"
 #include "driver/spi_master.h"
+#endif
 #include "fontx.h"
 
 /**
@@ -29,6 +35,114 @@ typedef enum {
 	SCROLL_UP = 4,
 } SCROLL_TYPE_t;
 
+/**
+ * @brief Estados de energía del LCD, de mayor a menor consumo.
+ */
+typedef enum {
+	LCD_POWER_ACTIVE = 0,  /**< Pantalla completa a 65K colores */
+	LCD_POWER_IDLE = 1,    /**< Modo parcial (PTLON) y 8 colores (IDMON) */
+	LCD_POWER_SLEEP = 2,   /**< Controlador en SLPIN y retroiluminación apagada */
+} LCD_POWER_t;
+
+/**
+ * @brief Interfaz del bus hacia el controlador.
+ *
+ * Todas las primitivas de dibujo pasan por estas funciones, por lo que el
+ * mismo código puede ejecutarse sobre el SPI real (spi_master_init) o sobre
+ * el emulador para Linux (host_master_init).
+ */
+typedef struct {
+	/** Envía bytes por el bus (una transacción). */
+	bool (*write)(void *ctx, const uint8_t *data, size_t length);
+	/** Fija el nivel de una línea de control (DC, retroiluminación). */
+	void (*set_level)(void *ctx, int16_t gpio, uint32_t level);
+} lcd_backend_t;
+
+/**
+ * @brief Primitivas medidas por el profiler (CONFIG_LCD_PROFILE).
+ */
+typedef enum {
+	LCD_API_DRAW_PIXEL = 0,
+	LCD_API_DRAW_MULTI_PIXELS,
+	LCD_API_FILL_RECT,
+	LCD_API_FILL_SCREEN,
+	LCD_API_DRAW_LINE,
+	LCD_API_DRAW_CIRCLE,
+	LCD_API_FILL_CIRCLE,
+	LCD_API_DRAW_CHAR,
+	LCD_API_DRAW_STRING,
+	LCD_API_DRAW_FINISH,
+	LCD_API_DRAW_FINISH_RECT,
+	LCD_API_DRAW_SPRITE,
+	LCD_API_MAX,
+} LCD_API_t;
+
+/**
+ * @brief Contadores de una primitiva.
+ */
+typedef struct {
+	uint32_t calls;               /**< Cantidad de llamadas */
+	uint64_t cycles;              /**< Ciclos de CPU (inclusivos) */
+	uint32_t transactions;        /**< Transacciones cuando es la llamada externa */
+	uint32_t bytes;               /**< Bytes enviados cuando es la llamada externa */
+	uint64_t spi_cycles;          /**< Ciclos bloqueados en la transmisión SPI */
+} lcd_api_profile_t;
+
+/**
+ * @brief Snapshot del profiler de dibujo.
+ */
+typedef struct {
+	lcd_api_profile_t api[LCD_API_MAX]; /**< Contadores por primitiva */
+	uint32_t transactions;        /**< Transacciones SPI totales */
+	uint64_t bytes;               /**< Bytes enviados totales */
+	uint64_t spi_cycles;          /**< Ciclos bloqueados en la transmisión SPI */
+	uint32_t lock_waits;          /**< Esperas por el bloqueo del LCD */
+	uint64_t lock_cycles;         /**< Ciclos esperando el bloqueo del LCD */
+} lcd_profile_t;
+
+/**
+ * @brief Tramo opaco de una fila de un sprite.
+ */
+typedef struct {
+	uint16_t x;                   /**< Columna de inicio dentro del sprite */
+	uint16_t len;                 /**< Cantidad de píxeles opacos */
+} lcd_sprite_run_t;
+
+/**
+ * @brief Sprite con transparencia por color clave precalculada en tramos.
+ *
+ * Solo se guardan los píxeles opacos, en el orden de los tramos, por lo que
+ * dibujarlo es copiar/enviar cada tramo sin evaluar la transparencia.
+ */
+typedef struct {
+	uint16_t width;               /**< Ancho del sprite */
+	uint16_t height;              /**< Alto del sprite */
+	const uint16_t *row_runs;     /**< Índice del primer tramo de cada fila (height+1 entradas) */
+	const lcd_sprite_run_t *runs; /**< Tramos opacos de todas las filas */
+	const uint16_t *pixels;       /**< Píxeles opacos (RGB565) en el orden de los tramos */
+} lcd_sprite_t;
+
+/** Captura de pantalla: formato de los fragmentos (ver lcdShotNextChunk()) */
+#define LCD_SHOT_MAGIC       0x53  /**< 'S' */
+#define LCD_SHOT_VERSION     1
+#define LCD_SHOT_HEADER_SIZE 16
+#define LCD_SHOT_LAST        0x01  /**< Flag del último fragmento */
+
+/**
+ * @brief Estado del codificador de capturas de pantalla.
+ */
+typedef struct {
+	const uint16_t *image;        /**< Imagen RGB565 a enviar, o la franja actual */
+	uint32_t base;                /**< Píxel de la pantalla donde empieza image */
+	uint32_t npixels;             /**< Píxeles de image */
+	uint32_t pos;                 /**< Próximo píxel de image a codificar */
+	uint16_t width;               /**< Ancho de la imagen */
+	uint16_t height;              /**< Alto de la imagen */
+	uint16_t id;                  /**< Identificador de la captura */
+	uint16_t seq;                 /**< Número del próximo fragmento */
+	bool done;                    /**< Ya se generó el último fragmento */
+} lcd_shot_t;
+
 typedef struct {
 	uint16_t _width;              /**< Ancho del LCD */
 	uint16_t _height;             /**< Alto del LCD */
@@ -41,11 +155,32 @@ typedef struct {
 	uint16_t _font_underline_color; /**< Color del subrayado de la fuente */
 	int16_t _dc;                  /**< Pin de control de datos/comando */
 	int16_t _bl;                  /**< Pin de control de retroiluminación */
+	int16_t _rst;                 /**< Pin de reinicio (-1 si no hay) */
+#if !CONFIG_IDF_TARGET_LINUX
 	spi_device_handle_t _SPIHandle; /**< Maneja la interfaz SPI */
+#endif
+	const lcd_backend_t *_backend; /**< Backend del bus */
+	void *_backend_ctx;           /**< Contexto del backend */
 	bool _use_frame_buffer;       /**< Indicador de uso de buffer de frame */
 	uint16_t *_frame_buffer;      /**< Puntero al buffer de frame */
+	bool _fb_band;                /**< El buffer es una franja de lcdFrameBufferBand(), no se envía */
+	uint16_t _fb_y0;              /**< Primera fila guardada en el buffer */
+	uint16_t _fb_rows;            /**< Filas guardadas en el buffer */
+	LCD_POWER_t _power_state;     /**< Estado de energía actual */
+	uint32_t _idle_timeout_ms;    /**< Inactividad antes de pasar a LCD_POWER_IDLE (0 = nunca) */
+	uint32_t _sleep_timeout_ms;   /**< Inactividad antes de pasar a LCD_POWER_SLEEP (0 = nunca) */
+	uint16_t _partial_start;      /**< Primera fila visible en modo parcial */
+	uint16_t _partial_end;        /**< Última fila visible en modo parcial */
+	TickType_t _last_activity;    /**< Tick de la última actividad registrada */
+	TickType_t _sleep_in_tick;    /**< Tick del último SLPIN */
+	TickType_t _sleep_out_tick;   /**< Tick del último SLPOUT */
+	uint8_t _init_step;           /**< Paso actual de la secuencia de inicialización */
+#if !CONFIG_IDF_TARGET_LINUX
+	EventGroupHandle_t _init_event; /**< Evento de fin de la inicialización asíncrona */
+#endif
 } TFT_t;
 
+#if !CONFIG_IDF_TARGET_LINUX
 /**
  * @brief Configura la velocidad del reloj SPI.
  * 
@@ -76,6 +211,7 @@ void spi_master_init(TFT_t * dev, int16_t GPIO_MOSI, int16_t GPIO_SCLK, int16_t
  * @return false si la escritura falló.
  */
 bool spi_master_write_byte(spi_device_handle_t SPIHandle, const uint8_t* Data, size_t DataLength);
+#endif
 
 /**
  * @brief Envía un comando a través de SPI.
@@ -158,6 +294,34 @@ void delayMS(int ms);
  */
 void lcdInit(TFT_t * dev, int width, int height, int offsetx, int offsety);
 
+#if !CONFIG_IDF_TARGET_LINUX
+/**
+ * @brief Inicia la inicialización de la pantalla sin bloquear.
+ * 
+ * Ejecuta la misma secuencia que lcdInit() (pulso de reset, SWRESET,
+ * SLPOUT, DISPON...) desde una tarea propia, de modo que las demoras del
+ * controlador corren en paralelo con el resto del arranque. No se debe
+ * dibujar hasta que lcdInitWait() devuelva true; si vence el plazo, la
+ * pantalla no está en condiciones y no se debe dibujar.
+ * 
+ * @param dev Puntero a la estructura TFT_t (inicializada en cero).
+ * @param width Ancho de la pantalla.
+ * @param height Alto de la pantalla.
+ * @param offsetx Offset horizontal.
+ * @param offsety Offset vertical.
+ */
+void lcdInitAsync(TFT_t * dev, int width, int height, int offsetx, int offsety);
+
+/**
+ * @brief Espera el fin de la inicialización iniciada con lcdInitAsync().
+ * 
+ * @param dev Puntero a la estructura TFT_t.
+ * @param timeout Tiempo máximo de espera en ticks.
+ * @return true si la pantalla está lista.
+ */
+bool lcdInitWait(TFT_t * dev, TickType_t timeout);
+#endif
+
 /**
  * @brief Dibuja un píxel en la pantalla LCD.
  * 
@@ -413,6 +577,22 @@ void lcdInversionOn(TFT_t * dev);
  */
 void lcdWrapArround(TFT_t * dev, SCROLL_TYPE_t scroll, int start, int end);
 
+/**
+ * @brief Dibuja en una franja de filas en RAM en lugar del LCD.
+ * 
+ * Las primitivas escriben solo lo que cae en las filas y..y+rows-1, en
+ * band (rows*ancho píxeles), y lcdDrawFinish()/lcdDrawFinishRect() no
+ * envían nada. Así se reconstruye la pantalla por partes con poca memoria,
+ * por ejemplo para una captura. Es solo para el modo sin buffer de frame:
+ * con band NULL se vuelve a dibujar directamente en el LCD.
+ * 
+ * @param dev Puntero a la estructura TFT_t.
+ * @param band Franja, o NULL para volver al LCD.
+ * @param y Primera fila de la franja.
+ * @param rows Filas de la franja.
+ */
+void lcdFrameBufferBand(TFT_t * dev, uint16_t * band, uint16_t y, uint16_t rows);
+
 /**
  * @brief Finaliza la operación de dibujo en la pantalla LCD.
  * 
@@ -420,6 +600,210 @@ void lcdWrapArround(TFT_t * dev, SCROLL_TYPE_t scroll, int start, int end);
  */
 void lcdDrawFinish(TFT_t *dev);
 
+/**
+ * @brief Envía al LCD solo una ventana del buffer de frame.
+ *
+ * Permite actualizaciones parciales (animaciones, barras de progreso) sin
+ * retransmitir la pantalla completa. Sin buffer de frame no hace nada, ya que
+ * las primitivas escriben directamente en la ventana correspondiente.
+ *
+ * @param dev Puntero a la estructura TFT_t.
+ * @param x1 Coordenada X de la esquina superior izquierda.
+ * @param y1 Coordenada Y de la esquina superior izquierda.
+ * @param x2 Coordenada X de la esquina inferior derecha.
+ * @param y2 Coordenada Y de la esquina inferior derecha.
+ */
+void lcdDrawFinishRect(TFT_t *dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2);
+
+/**
+ * @brief Define las filas visibles en modo parcial (PTLAR).
+ * 
+ * @param dev Puntero a la estructura TFT_t.
+ * @param start Primera fila visible.
+ * @param end Última fila visible.
+ */
+void lcdPartialArea(TFT_t * dev, uint16_t start, uint16_t end);
+
+/**
+ * @brief Activa el modo parcial (PTLON); fuera del área solo se muestra fondo.
+ * 
+ * @param dev Puntero a la estructura TFT_t.
+ */
+void lcdPartialOn(TFT_t * dev);
+
+/**
+ * @brief Vuelve al modo de pantalla normal (NORON).
+ * 
+ * @param dev Puntero a la estructura TFT_t.
+ */
+void lcdNormalOn(TFT_t * dev);
+
+/**
+ * @brief Activa el modo idle de 8 colores (IDMON).
+ * 
+ * @param dev Puntero a la estructura TFT_t.
+ */
+void lcdIdleOn(TFT_t * dev);
+
+/**
+ * @brief Desactiva el modo idle de 8 colores (IDMOFF).
+ * 
+ * @param dev Puntero a la estructura TFT_t.
+ */
+void lcdIdleOff(TFT_t * dev);
+
+/**
+ * @brief Envía SLPIN respetando los 120 ms mínimos desde el último SLPOUT.
+ * 
+ * @param dev Puntero a la estructura TFT_t.
+ */
+void lcdSleepIn(TFT_t * dev);
+
+/**
+ * @brief Envía SLPOUT respetando los 120 ms mínimos desde el último SLPIN.
+ * 
+ * La memoria de la pantalla se conserva, por lo que el contenido vuelve a
+ * verse sin redibujar.
+ * 
+ * @param dev Puntero a la estructura TFT_t.
+ */
+void lcdSleepOut(TFT_t * dev);
+
+/**
+ * @brief Configura el gestor de energía.
+ * 
+ * @param dev Puntero a la estructura TFT_t.
+ * @param idle_timeout_ms Inactividad antes de pasar a modo parcial + idle (0 = nunca).
+ * @param sleep_timeout_ms Inactividad antes de pasar a sleep (0 = nunca).
+ * @param start Primera fila visible en modo parcial.
+ * @param end Última fila visible en modo parcial.
+ */
+void lcdPowerConfig(TFT_t * dev, uint32_t idle_timeout_ms, uint32_t sleep_timeout_ms, uint16_t start, uint16_t end);
+
+/**
+ * @brief Registra actividad (teclado, tarjeta, dibujo) y vuelve a LCD_POWER_ACTIVE.
+ * 
+ * @param dev Puntero a la estructura TFT_t.
+ */
+void lcdPowerActivity(TFT_t * dev);
+
+/**
+ * @brief Avanza el gestor de energía según el tiempo de inactividad.
+ * 
+ * Debe llamarse periódicamente, con el mismo bloqueo que protege al resto de
+ * las operaciones de dibujo.
+ * 
+ * @param dev Puntero a la estructura TFT_t.
+ * @return LCD_POWER_t Estado de energía resultante.
+ */
+LCD_POWER_t lcdPowerUpdate(TFT_t * dev);
+
+
+/**
+ * @brief Construye un sprite a partir de una imagen RGB565 y un color clave.
+ * 
+ * Precalcula los tramos opacos de cada fila. La memoria se libera con
+ * lcdSpriteFree().
+ * 
+ * @param sprite Sprite a construir.
+ * @param width Ancho de la imagen.
+ * @param height Alto de la imagen.
+ * @param image Imagen RGB565 de width*height píxeles.
+ * @param key Color que se considera transparente.
+ * @return true si se pudo reservar la memoria.
+ */
+bool lcdSpriteBuild(lcd_sprite_t * sprite, uint16_t width, uint16_t height, const uint16_t * image, uint16_t key);
+
+/**
+ * @brief Libera la memoria de un sprite creado con lcdSpriteBuild().
+ * 
+ * @param sprite Sprite a liberar.
+ */
+void lcdSpriteFree(lcd_sprite_t * sprite);
+
+/**
+ * @brief Dibuja un sprite enviando solo sus tramos opacos.
+ * 
+ * Sin buffer de frame cada tramo es una escritura con ventana; con buffer
+ * de frame cada tramo es un memcpy.
+ * 
+ * @param dev Puntero a la estructura TFT_t.
+ * @param x Coordenada X de la esquina superior izquierda.
+ * @param y Coordenada Y de la esquina superior izquierda.
+ * @param sprite Sprite a dibujar.
+ */
+void lcdDrawSprite(TFT_t * dev, uint16_t x, uint16_t y, const lcd_sprite_t * sprite);
+
+/**
+ * @brief Prepara la codificación de una imagen en fragmentos.
+ * 
+ * @param shot Estado del codificador.
+ * @param image Imagen RGB565 (debe seguir válida hasta el último fragmento),
+ * o NULL para enviarla por franjas con lcdShotBand().
+ * @param width Ancho de la imagen.
+ * @param height Alto de la imagen.
+ * @param id Identificador de la captura, repetido en cada fragmento.
+ */
+void lcdShotBegin(lcd_shot_t * shot, const uint16_t * image, uint16_t width, uint16_t height, uint16_t id);
+
+/**
+ * @brief Genera el próximo fragmento comprimido de la captura.
+ * 
+ * Cada fragmento empieza con un encabezado de LCD_SHOT_HEADER_SIZE bytes
+ * (little endian): magic, versión, id, secuencia, flags, reservado, primer
+ * píxel (32 bits), ancho y alto. Sigue la imagen en RLE: un byte n con el
+ * bit 7 en 1 repite (n & 0x7F)+1 veces el color siguiente; con el bit 7 en
+ * 0 le siguen n+1 colores literales. Los fragmentos se decodifican de forma
+ * independiente, así que perder uno solo deja un hueco en la imagen.
+ * 
+ * @param shot Estado del codificador.
+ * @param buf Buffer donde se escribe el fragmento.
+ * @param size Tamaño del buffer.
+ * @return size_t Bytes escritos, 0 si ya no quedan fragmentos.
+ */
+size_t lcdShotNextChunk(lcd_shot_t * shot, uint8_t * buf, size_t size);
+
+/**
+ * @brief Sigue la captura con la próxima franja de filas.
+ * 
+ * Para capturar sin tener la pantalla entera en RAM: se empieza con
+ * lcdShotBegin() e image NULL y, por cada franja en orden, se llama a esta
+ * función y a lcdShotNextChunk() hasta que devuelva 0. Los fragmentos no
+ * cruzan franjas y el último de la última franja lleva LCD_SHOT_LAST.
+ * 
+ * @param shot Estado del codificador.
+ * @param band Filas y..y+rows-1 (rows*ancho píxeles), válidas hasta su último fragmento.
+ * @param y Primera fila de la franja.
+ * @param rows Filas de la franja.
+ */
+void lcdShotBand(lcd_shot_t * shot, const uint16_t * band, uint16_t y, uint16_t rows);
+
+#if CONFIG_LCD_PROFILE
+/**
+ * @brief Copia los contadores del profiler.
+ * 
+ * @param profile Estructura donde se copian los contadores.
+ * @param reset Si es true, los contadores vuelven a cero.
+ */
+void lcdProfileSnapshot(lcd_profile_t * profile, bool reset);
+
+/**
+ * @brief Registra una espera por el bloqueo que protege al LCD.
+ * 
+ * El bloqueo lo maneja la aplicación; esta función solo acumula el tiempo.
+ * 
+ * @param cycles Ciclos de CPU esperados.
+ */
+void lcdProfileLockWait(uint32_t cycles);
+
+/**
+ * @brief Devuelve el nombre de una primitiva.
+ * 
+ * @param api Primitiva.
+ * @return const char* Nombre.
+ */
+const char *lcdProfileApiName(LCD_API_t api);
+#endif
 
 void LCD_DrawChar(TFT_t *dev, uint16_t x, uint16_t y, char c, FontDef *font, uint16_t color);
 void LCD_DrawString(TFT_t *dev, uint16_t x, uint16_t y, const char *str, FontDef *font, uint16_t color);
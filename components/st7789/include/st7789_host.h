@@ -0,0 +1,65 @@
+#ifndef MAIN_ST7789_HOST_H_
+#define MAIN_ST7789_HOST_H_
+
+#include "st7789.h"
+
+/**
+ * @brief Contadores de costo del bus acumulados por el emulador.
+ */
+typedef struct {
+	uint32_t transactions;        /**< Transacciones enviadas al bus */
+	uint32_t bytes;               /**< Bytes enviados (comandos + datos) */
+	uint32_t dc_toggles;          /**< Cambios de nivel de la línea DC */
+	uint32_t commands;            /**< Bytes de comando recibidos */
+	uint32_t pixels;              /**< Píxeles escritos en la GRAM */
+} lcd_bus_stats_t;
+
+/**
+ * @brief Inicializa el backend emulado para Linux.
+ *
+ * Reemplaza a spi_master_init() en los builds para host. El emulador
+ * interpreta CASET/RASET/RAMWR sobre una GRAM en memoria de 240x320.
+ *
+ * @param dev Puntero a la estructura TFT_t.
+ * @param GPIO_DC Número "virtual" de la línea DC.
+ * @param GPIO_BL Número "virtual" de la línea de retroiluminación (-1 si no hay).
+ */
+void host_master_init(TFT_t * dev, int16_t GPIO_DC, int16_t GPIO_BL);
+
+/**
+ * @brief Pone a cero los contadores del bus.
+ *
+ * @param dev Puntero a la estructura TFT_t.
+ */
+void lcdHostResetStats(TFT_t * dev);
+
+/**
+ * @brief Obtiene los contadores del bus desde el último reinicio.
+ *
+ * @param dev Puntero a la estructura TFT_t.
+ * @param stats Estructura donde se copian los contadores.
+ */
+void lcdHostGetStats(TFT_t * dev, lcd_bus_stats_t * stats);
+
+/**
+ * @brief Lee un píxel de la GRAM emulada, en coordenadas de la pantalla.
+ *
+ * @param dev Puntero a la estructura TFT_t.
+ * @param x Coordenada X.
+ * @param y Coordenada Y.
+ * @return uint16_t Color RGB565 almacenado.
+ */
+uint16_t lcdHostGetPixel(TFT_t * dev, uint16_t x, uint16_t y);
+
+/**
+ * @brief Guarda lo que mostraría el panel como imagen PNG.
+ *
+ * Se tienen en cuenta los modos sleep, display off, parcial e idle.
+ *
+ * @param dev Puntero a la estructura TFT_t.
+ * @param path Ruta del archivo a escribir.
+ * @return true si el archivo se escribió correctamente.
+ */
+bool lcdHostSavePNG(TFT_t * dev, const char * path);
+
+#endif /* MAIN_ST7789_HOST_H_ */
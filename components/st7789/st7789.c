@@ -1,13 +1,19 @@
 #include <string.h>
+#include <stdlib.h>
+#include <assert.h>
 #include <inttypes.h>
 #include <math.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#if !CONFIG_IDF_TARGET_LINUX
+#include "freertos/event_groups.h"
+#endif
 
-#include <driver/spi_master.h>
-#include <driver/gpio.h>
 #include "esp_log.h"
+#if CONFIG_LCD_PROFILE
+#include "esp_cpu.h"
+#endif
 
 #include "st7789.h"
 
@@ -16,157 +22,103 @@
 #define TAG "ST7789"
 #define	_DEBUG_ 0
 
-#if 0
-#ifdef CONFIG_IDF_TARGET_ESP32
-#define LCD_HOST HSPI_HOST
-#elif defined CONFIG_IDF_TARGET_ESP32S2
-#define LCD_HOST SPI2_HOST
-#elif defined CONFIG_IDF_TARGET_ESP32S3
-#define LCD_HOST SPI2_HOST
-#elif defined CONFIG_IDF_TARGET_ESP32C3
-#define LCD_HOST SPI2_HOST
-#endif
-#endif
-
-
-#define HOST_ID SPI2_HOST //Definicion sin menuconfig
-/*
-#if CONFIG_SPI2_HOST
-#define HOST_ID SPI2_HOST
-#elif CONFIG_SPI3_HOST
-#define HOST_ID SPI3_HOST
-#endif*/
-
-#define SPI_DEFAULT_FREQUENCY SPI_MASTER_FREQ_20M; // 20MHz
-
 static const int SPI_Command_Mode = 0;
 static const int SPI_Data_Mode = 1;
-//static const int SPI_Frequency = SPI_MASTER_FREQ_20M;
-//static const int SPI_Frequency = SPI_MASTER_FREQ_26M;
-//static const int SPI_Frequency = SPI_MASTER_FREQ_40M;
-//static const int SPI_Frequency = 60000000;
-//static const int SPI_Frequency = SPI_MASTER_FREQ_80M;
 
-int clock_speed_hz = SPI_DEFAULT_FREQUENCY;
-
-void spi_clock_speed(int speed) {
-    ESP_LOGI(TAG, "SPI clock speed=%d MHz", speed/1000000);
-    clock_speed_hz = speed;
+#if CONFIG_LCD_PROFILE
+// Draw-call profiler. Cycles are inclusive (a string includes its chars and
+// pixels); bus traffic is charged to the outermost profiled call only.
+static lcd_profile_t _profile;
+static int _prof_depth = 0;
+static LCD_API_t _prof_api = LCD_API_MAX;
+
+static const char *_prof_names[LCD_API_MAX] = {
+	[LCD_API_DRAW_PIXEL] = "draw_pixel",
+	[LCD_API_DRAW_MULTI_PIXELS] = "draw_multi_pixels",
+	[LCD_API_FILL_RECT] = "fill_rect",
+	[LCD_API_FILL_SCREEN] = "fill_screen",
+	[LCD_API_DRAW_LINE] = "draw_line",
+	[LCD_API_DRAW_CIRCLE] = "draw_circle",
+	[LCD_API_FILL_CIRCLE] = "fill_circle",
+	[LCD_API_DRAW_CHAR] = "draw_char",
+	[LCD_API_DRAW_STRING] = "draw_string",
+	[LCD_API_DRAW_FINISH] = "draw_finish",
+	[LCD_API_DRAW_FINISH_RECT] = "draw_finish_rect",
+	[LCD_API_DRAW_SPRITE] = "draw_sprite",
+};
+
+static inline uint32_t prof_begin(LCD_API_t api)
+{
+	if (_prof_depth++ == 0) _prof_api = api;
+	return esp_cpu_get_cycle_count();
 }
 
-void spi_master_init(TFT_t * dev, int16_t GPIO_MOSI, int16_t GPIO_SCLK, int16_t GPIO_CS, int16_t GPIO_DC, int16_t GPIO_RESET, int16_t GPIO_BL)
+static inline void prof_end(LCD_API_t api, uint32_t start)
 {
-	esp_err_t ret;
-
-	ESP_LOGI(TAG, "GPIO_CS=%d",GPIO_CS);
-	if ( GPIO_CS >= 0 ) {
-		//gpio_pad_select_gpio( GPIO_CS );
-		gpio_reset_pin( GPIO_CS );
-		gpio_set_direction( GPIO_CS, GPIO_MODE_OUTPUT );
-		gpio_set_level( GPIO_CS, 0 );
-	}
+	_profile.api[api].calls++;
+	_profile.api[api].cycles += (uint32_t)(esp_cpu_get_cycle_count() - start);
+	if (--_prof_depth == 0) _prof_api = LCD_API_MAX;
+}
 
-	ESP_LOGI(TAG, "GPIO_DC=%d",GPIO_DC);
-	//gpio_pad_select_gpio( GPIO_DC );
-	gpio_reset_pin( GPIO_DC );
-	gpio_set_direction( GPIO_DC, GPIO_MODE_OUTPUT );
-	gpio_set_level( GPIO_DC, 0 );
-
-	ESP_LOGI(TAG, "GPIO_RESET=%d",GPIO_RESET);
-	if ( GPIO_RESET >= 0 ) {
-		//gpio_pad_select_gpio( GPIO_RESET );
-		gpio_reset_pin( GPIO_RESET );
-		gpio_set_direction( GPIO_RESET, GPIO_MODE_OUTPUT );
-		gpio_set_level( GPIO_RESET, 1 );
-		delayMS(100);
-		gpio_set_level( GPIO_RESET, 0 );
-		delayMS(100);
-		gpio_set_level( GPIO_RESET, 1 );
-		delayMS(100);
-	}
+#define PROF_BEGIN(api) uint32_t _prof_start = prof_begin(api)
+#define PROF_END(api) prof_end(api, _prof_start)
 
-	ESP_LOGI(TAG, "GPIO_BL=%d",GPIO_BL);
-	if ( GPIO_BL >= 0 ) {
-		//gpio_pad_select_gpio(GPIO_BL);
-		gpio_reset_pin(GPIO_BL);
-		gpio_set_direction( GPIO_BL, GPIO_MODE_OUTPUT );
-		gpio_set_level( GPIO_BL, 0 );
-	}
+void lcdProfileSnapshot(lcd_profile_t * profile, bool reset)
+{
+	*profile = _profile;
+	if (reset) memset(&_profile, 0, sizeof(_profile));
+}
 
-	ESP_LOGI(TAG, "GPIO_MOSI=%d",GPIO_MOSI);
-	ESP_LOGI(TAG, "GPIO_SCLK=%d",GPIO_SCLK);
-	spi_bus_config_t buscfg = {
-		.mosi_io_num = GPIO_MOSI,
-		.miso_io_num = -1,
-		.sclk_io_num = GPIO_SCLK,
-		.quadwp_io_num = -1,
-		.quadhd_io_num = -1,
-		.max_transfer_sz = 0,
-		.flags = 0
-	};
-
-	ret = spi_bus_initialize( HOST_ID, &buscfg, SPI_DMA_CH_AUTO );
-	ESP_LOGD(TAG, "spi_bus_initialize=%d",ret);
-	assert(ret==ESP_OK);
-
-	spi_device_interface_config_t devcfg;
-	memset(&devcfg, 0, sizeof(devcfg));
-	//devcfg.clock_speed_hz = SPI_Frequency;
-	devcfg.clock_speed_hz = clock_speed_hz;
-	devcfg.queue_size = 7;
-	//devcfg.mode = 2;
-	devcfg.mode = 3;
-	devcfg.flags = SPI_DEVICE_NO_DUMMY;
-
-	if ( GPIO_CS >= 0 ) {
-		devcfg.spics_io_num = GPIO_CS;
-	} else {
-		devcfg.spics_io_num = -1;
-	}
-	
-	spi_device_handle_t handle;
-	ret = spi_bus_add_device( HOST_ID, &devcfg, &handle);
-	ESP_LOGD(TAG, "spi_bus_add_device=%d",ret);
-	assert(ret==ESP_OK);
-	dev->_dc = GPIO_DC;
-	dev->_bl = GPIO_BL;
-	dev->_SPIHandle = handle;
+void lcdProfileLockWait(uint32_t cycles)
+{
+	_profile.lock_waits++;
+	_profile.lock_cycles += cycles;
 }
 
-bool spi_master_write_byte(spi_device_handle_t SPIHandle, const uint8_t* Data, size_t DataLength)
+const char *lcdProfileApiName(LCD_API_t api)
 {
-	spi_transaction_t SPITransaction;
-	esp_err_t ret;
-
-	if ( DataLength > 0 ) {
-		memset( &SPITransaction, 0, sizeof( spi_transaction_t ) );
-		SPITransaction.length = DataLength * 8;
-		SPITransaction.tx_buffer = Data;
-#if 1
-		ret = spi_device_transmit( SPIHandle, &SPITransaction );
+	if (api >= LCD_API_MAX) return "unknown";
+	return _prof_names[api];
+}
 #else
-		ret = spi_device_polling_transmit( SPIHandle, &SPITransaction );
+#define PROF_BEGIN(api)
+#define PROF_END(api)
 #endif
-		assert(ret==ESP_OK); 
-	}
 
-	return true;
+// Send bytes through the backend with DC at the given level
+static bool lcd_write(TFT_t * dev, int dc, const uint8_t* Data, size_t DataLength)
+{
+	dev->_backend->set_level( dev->_backend_ctx, dev->_dc, dc );
+#if CONFIG_LCD_PROFILE
+	uint32_t start = esp_cpu_get_cycle_count();
+	bool ret = dev->_backend->write( dev->_backend_ctx, Data, DataLength );
+	uint32_t cycles = esp_cpu_get_cycle_count() - start;
+	_profile.transactions++;
+	_profile.bytes += DataLength;
+	_profile.spi_cycles += cycles;
+	if (_prof_api < LCD_API_MAX) {
+		_profile.api[_prof_api].transactions++;
+		_profile.api[_prof_api].bytes += DataLength;
+		_profile.api[_prof_api].spi_cycles += cycles;
+	}
+	return ret;
+#else
+	return dev->_backend->write( dev->_backend_ctx, Data, DataLength );
+#endif
 }
 
 bool spi_master_write_command(TFT_t * dev, uint8_t cmd)
 {
 	static uint8_t Byte = 0;
 	Byte = cmd;
-	gpio_set_level( dev->_dc, SPI_Command_Mode );
-	return spi_master_write_byte( dev->_SPIHandle, &Byte, 1 );
+	return lcd_write( dev, SPI_Command_Mode, &Byte, 1 );
 }
 
 bool spi_master_write_data_byte(TFT_t * dev, uint8_t data)
 {
 	static uint8_t Byte = 0;
 	Byte = data;
-	gpio_set_level( dev->_dc, SPI_Data_Mode );
-	return spi_master_write_byte( dev->_SPIHandle, &Byte, 1 );
+	return lcd_write( dev, SPI_Data_Mode, &Byte, 1 );
 }
 
 
@@ -175,8 +127,7 @@ bool spi_master_write_data_word(TFT_t * dev, uint16_t data)
 	static uint8_t Byte[2];
 	Byte[0] = (data >> 8) & 0xFF;
 	Byte[1] = data & 0xFF;
-	gpio_set_level( dev->_dc, SPI_Data_Mode );
-	return spi_master_write_byte( dev->_SPIHandle, Byte, 2);
+	return lcd_write( dev, SPI_Data_Mode, Byte, 2 );
 }
 
 bool spi_master_write_addr(TFT_t * dev, uint16_t addr1, uint16_t addr2)
@@ -186,8 +137,7 @@ bool spi_master_write_addr(TFT_t * dev, uint16_t addr1, uint16_t addr2)
 	Byte[1] = addr1 & 0xFF;
 	Byte[2] = (addr2 >> 8) & 0xFF;
 	Byte[3] = addr2 & 0xFF;
-	gpio_set_level( dev->_dc, SPI_Data_Mode );
-	return spi_master_write_byte( dev->_SPIHandle, Byte, 4);
+	return lcd_write( dev, SPI_Data_Mode, Byte, 4 );
 }
 
 bool spi_master_write_color(TFT_t * dev, uint16_t color, uint16_t size)
@@ -198,8 +148,7 @@ bool spi_master_write_color(TFT_t * dev, uint16_t color, uint16_t size)
 		Byte[index++] = (color >> 8) & 0xFF;
 		Byte[index++] = color & 0xFF;
 	}
-	gpio_set_level( dev->_dc, SPI_Data_Mode );
-	return spi_master_write_byte( dev->_SPIHandle, Byte, size*2);
+	return lcd_write( dev, SPI_Data_Mode, Byte, size*2 );
 }
 
 // Add 202001
@@ -211,8 +160,7 @@ bool spi_master_write_colors(TFT_t * dev, uint16_t * colors, uint16_t size)
 		Byte[index++] = (colors[i] >> 8) & 0xFF;
 		Byte[index++] = colors[i] & 0xFF;
 	}
-	gpio_set_level( dev->_dc, SPI_Data_Mode );
-	return spi_master_write_byte( dev->_SPIHandle, Byte, size*2);
+	return lcd_write( dev, SPI_Data_Mode, Byte, size*2 );
 }
 
 void delayMS(int ms) {
@@ -223,7 +171,50 @@ void delayMS(int ms) {
 }
 
 
-void lcdInit(TFT_t * dev, int width, int height, int offsetx, int offsety)
+// Power-on sequence, shared by lcdInit() and lcdInitAsync().
+// Each step is executed and then followed by delay_ms.
+enum {
+	INIT_RESET,       // drive RESET to value
+	INIT_CMD,         // send command value
+	INIT_DATA,        // send data byte value
+	INIT_BACKLIGHT,   // turn the backlight on
+	INIT_END,
+};
+
+typedef struct {
+	uint8_t op;
+	uint8_t value;
+	uint16_t delay_ms;
+} lcd_init_step_t;
+
+static const lcd_init_step_t init_sequence[] = {
+	{ INIT_RESET, 1, 100 },
+	{ INIT_RESET, 0, 100 },
+	{ INIT_RESET, 1, 100 },
+	{ INIT_CMD, 0x01, 150 },	//Software Reset
+	{ INIT_CMD, 0x11, 255 },	//Sleep Out
+	{ INIT_CMD, 0x3A, 0 },		//Interface Pixel Format
+	{ INIT_DATA, 0x55, 10 },
+	{ INIT_CMD, 0x36, 0 },		//Memory Data Access Control
+	{ INIT_DATA, 0x00, 0 },
+	{ INIT_CMD, 0x2A, 0 },		//Column Address Set
+	{ INIT_DATA, 0x00, 0 },
+	{ INIT_DATA, 0x00, 0 },
+	{ INIT_DATA, 0x00, 0 },
+	{ INIT_DATA, 0xF0, 0 },
+	{ INIT_CMD, 0x2B, 0 },		//Row Address Set
+	{ INIT_DATA, 0x00, 0 },
+	{ INIT_DATA, 0x00, 0 },
+	{ INIT_DATA, 0x00, 0 },
+	{ INIT_DATA, 0xF0, 0 },
+	{ INIT_CMD, 0x21, 10 },		//Display Inversion On
+	{ INIT_CMD, 0x13, 10 },		//Normal Display Mode On
+	{ INIT_CMD, 0x29, 255 },	//Display ON
+	{ INIT_BACKLIGHT, 1, 0 },
+	{ INIT_END, 0, 0 },
+};
+
+static void lcd_init_fields(TFT_t * dev, int width, int height, int offsetx, int offsety)
 {
 	dev->_width = width;
 	dev->_height = height;
@@ -233,47 +224,25 @@ void lcdInit(TFT_t * dev, int width, int height, int offsetx, int offsety)
 	dev->_font_fill = false;
 	dev->_font_underline = false;
 
-	spi_master_write_command(dev, 0x01);	//Software Reset
-	delayMS(150);
-
-	spi_master_write_command(dev, 0x11);	//Sleep Out
-	delayMS(255);
-	
-	spi_master_write_command(dev, 0x3A);	//Interface Pixel Format
-	spi_master_write_data_byte(dev, 0x55);
-	delayMS(10);
-	
-	spi_master_write_command(dev, 0x36);	//Memory Data Access Control
-	spi_master_write_data_byte(dev, 0x00);
-
-	spi_master_write_command(dev, 0x2A);	//Column Address Set
-	spi_master_write_data_byte(dev, 0x00);
-	spi_master_write_data_byte(dev, 0x00);
-	spi_master_write_data_byte(dev, 0x00);
-	spi_master_write_data_byte(dev, 0xF0);
-
-	spi_master_write_command(dev, 0x2B);	//Row Address Set
-	spi_master_write_data_byte(dev, 0x00);
-	spi_master_write_data_byte(dev, 0x00);
-	spi_master_write_data_byte(dev, 0x00);
-	spi_master_write_data_byte(dev, 0xF0);
-
-	spi_master_write_command(dev, 0x21);	//Display Inversion On
-	delayMS(10);
-
-	spi_master_write_command(dev, 0x13);	//Normal Display Mode On
-	delayMS(10);
-
-	spi_master_write_command(dev, 0x29);	//Display ON
-	delayMS(255);
-
-	if(dev->_bl >= 0) {
-		gpio_set_level( dev->_bl, 1 );
-	}
+	dev->_power_state = LCD_POWER_ACTIVE;
+	dev->_idle_timeout_ms = CONFIG_LCD_IDLE_TIMEOUT * 1000;
+	dev->_sleep_timeout_ms = CONFIG_LCD_SLEEP_TIMEOUT * 1000;
+	dev->_partial_start = 0;
+	dev->_partial_end = height-1;
+	dev->_last_activity = xTaskGetTickCount();
+	dev->_sleep_in_tick = 0;
+	dev->_init_step = 0;
 
 	dev->_use_frame_buffer = false;
+	dev->_fb_band = false;
+	dev->_fb_y0 = 0;
+	dev->_fb_rows = height;
 #if CONFIG_FRAME_BUFFER
+#if CONFIG_IDF_TARGET_LINUX
+	dev->_frame_buffer = malloc(sizeof(uint16_t)*width*height);
+#else
 	dev->_frame_buffer = heap_caps_malloc(sizeof(uint16_t)*width*height, MALLOC_CAP_DMA);
+#endif
 	if (dev->_frame_buffer == NULL) {
 		ESP_LOGE(TAG, "heap_caps_malloc fail");
 	} else {
@@ -284,6 +253,82 @@ void lcdInit(TFT_t * dev, int width, int height, int offsetx, int offsety)
 #endif
 }
 
+// Run init steps until one needs a delay.
+// Returns the delay in ms, or -1 when the sequence is finished.
+static int lcd_init_run(TFT_t * dev)
+{
+	while (1) {
+		const lcd_init_step_t *step = &init_sequence[dev->_init_step];
+		if (step->op == INIT_END) return -1;
+		dev->_init_step++;
+
+		switch (step->op) {
+		case INIT_RESET:
+			if (dev->_rst >= 0) dev->_backend->set_level( dev->_backend_ctx, dev->_rst, step->value );
+			break;
+		case INIT_CMD:
+			spi_master_write_command(dev, step->value);
+			if (step->value == 0x11) dev->_sleep_out_tick = xTaskGetTickCount();
+			break;
+		case INIT_DATA:
+			spi_master_write_data_byte(dev, step->value);
+			break;
+		case INIT_BACKLIGHT:
+			lcdBacklightOn(dev);
+			break;
+		}
+		if (step->delay_ms > 0) return step->delay_ms;
+	}
+}
+
+void lcdInit(TFT_t * dev, int width, int height, int offsetx, int offsety)
+{
+	int delay;
+
+	lcd_init_fields(dev, width, height, offsetx, offsety);
+	while ((delay = lcd_init_run(dev)) >= 0) {
+		delayMS(delay);
+	}
+}
+
+#if !CONFIG_IDF_TARGET_LINUX
+#define LCD_INIT_DONE_BIT (1 << 0)
+
+// Init task: the SPI transfers block, so they must not run on the FreeRTOS
+// timer service task, where they would stall every other software timer
+static void lcd_init_task(void * arg)
+{
+	TFT_t * dev = arg;
+	int delay;
+
+	while ((delay = lcd_init_run(dev)) >= 0) {
+		delayMS(delay);
+	}
+	xEventGroupSetBits(dev->_init_event, LCD_INIT_DONE_BIT);
+	ESP_LOGI(TAG, "lcdInitAsync done");
+	vTaskDelete(NULL);
+}
+
+void lcdInitAsync(TFT_t * dev, int width, int height, int offsetx, int offsety)
+{
+	lcd_init_fields(dev, width, height, offsetx, offsety);
+	if (dev->_init_event == NULL) dev->_init_event = xEventGroupCreate();
+	assert(dev->_init_event != NULL);
+	xEventGroupClearBits(dev->_init_event, LCD_INIT_DONE_BIT);
+
+	// Same priority as the caller: the delays leave the CPU to the rest of the boot
+	BaseType_t ret = xTaskCreate(lcd_init_task, "lcd_init", 2048, dev, uxTaskPriorityGet(NULL), NULL);
+	assert(ret == pdPASS);
+}
+
+bool lcdInitWait(TFT_t * dev, TickType_t timeout)
+{
+	if (dev->_init_event == NULL) return true;	// lcdInit() was used
+	EventBits_t bits = xEventGroupWaitBits(dev->_init_event, LCD_INIT_DONE_BIT, pdFALSE, pdTRUE, timeout);
+	return (bits & LCD_INIT_DONE_BIT) != 0;
+}
+#endif
+
 
 // Draw pixel
 // x:X coordinate
@@ -292,9 +337,10 @@ void lcdInit(TFT_t * dev, int width, int height, int offsetx, int offsety)
 void lcdDrawPixel(TFT_t * dev, uint16_t x, uint16_t y, uint16_t color){
 	if (x >= dev->_width) return;
 	if (y >= dev->_height) return;
+	PROF_BEGIN(LCD_API_DRAW_PIXEL);
 
 	if (dev->_use_frame_buffer) {
-		dev->_frame_buffer[y*dev->_width+x] = color;
+		if ((uint16_t)(y - dev->_fb_y0) < dev->_fb_rows) dev->_frame_buffer[(y - dev->_fb_y0)*dev->_width+x] = color;
 	} else {
 		uint16_t _x = x + dev->_offsetx;
 		uint16_t _y = y + dev->_offsety;
@@ -307,6 +353,7 @@ void lcdDrawPixel(TFT_t * dev, uint16_t x, uint16_t y, uint16_t color){
 		//spi_master_write_data_word(dev, color);
 		spi_master_write_colors(dev, &color, 1);
 	}
+	PROF_END(LCD_API_DRAW_PIXEL);
 }
 
 
@@ -318,17 +365,11 @@ void lcdDrawPixel(TFT_t * dev, uint16_t x, uint16_t y, uint16_t color){
 void lcdDrawMultiPixels(TFT_t * dev, uint16_t x, uint16_t y, uint16_t size, uint16_t * colors) {
 	if (x+size > dev->_width) return;
 	if (y >= dev->_height) return;
+	PROF_BEGIN(LCD_API_DRAW_MULTI_PIXELS);
 
 	if (dev->_use_frame_buffer) {
-		uint16_t _x1 = x;
-		uint16_t _x2 = _x1 + (size-1);
-		uint16_t _y1 = y;
-		uint16_t _y2 = _y1;
-		int16_t index = 0;
-		for (int16_t j = _y1; j <= _y2; j++){
-			for(int16_t i = _x1; i <= _x2; i++){
-				 dev->_frame_buffer[j*dev->_width+i] = colors[index++];
-			}
+		if ((uint16_t)(y - dev->_fb_y0) < dev->_fb_rows) {
+			memcpy(&dev->_frame_buffer[(y - dev->_fb_y0)*dev->_width+x], colors, size*sizeof(uint16_t));
 		}
 	} else {
 		uint16_t _x1 = x + dev->_offsetx;
@@ -343,6 +384,7 @@ void lcdDrawMultiPixels(TFT_t * dev, uint16_t x, uint16_t y, uint16_t size, uint
 		spi_master_write_command(dev, 0x2C);	// Memory Write
 		spi_master_write_colors(dev, colors, size);
 	}
+	PROF_END(LCD_API_DRAW_MULTI_PIXELS);
 }
 
 // Draw rectangle of filling
@@ -356,13 +398,18 @@ void lcdDrawFillRect(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_
 	if (x2 >= dev->_width) x2=dev->_width-1;
 	if (y1 >= dev->_height) return;
 	if (y2 >= dev->_height) y2=dev->_height-1;
+	PROF_BEGIN(LCD_API_FILL_RECT);
 
 	ESP_LOGD(TAG,"offset(x)=%d offset(y)=%d",dev->_offsetx,dev->_offsety);
 
 	if (dev->_use_frame_buffer) {
-		for (int16_t j = y1; j <= y2; j++){
+		// Only the rows held in the buffer (all of them unless it is a band)
+		int16_t j1 = (y1 > dev->_fb_y0) ? y1 : dev->_fb_y0;
+		int16_t j2 = (y2 < dev->_fb_y0 + dev->_fb_rows - 1) ? y2 : dev->_fb_y0 + dev->_fb_rows - 1;
+		for (int16_t j = j1; j <= j2; j++){
+			uint16_t *row = &dev->_frame_buffer[(j - dev->_fb_y0)*dev->_width];
 			for(int16_t i = x1; i <= x2; i++){
-				dev->_frame_buffer[j*dev->_width+i] = color;
+				row[i] = color;
 			}
 		}
 	} else {
@@ -381,6 +428,7 @@ void lcdDrawFillRect(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_
 			spi_master_write_color(dev, color, size);
 		}
 	}
+	PROF_END(LCD_API_FILL_RECT);
 }
 
 // Display OFF
@@ -396,7 +444,9 @@ void lcdDisplayOn(TFT_t * dev) {
 // Fill screen
 // color:color
 void lcdFillScreen(TFT_t * dev, uint16_t color) {
+	PROF_BEGIN(LCD_API_FILL_SCREEN);
 	lcdDrawFillRect(dev, 0, 0, dev->_width-1, dev->_height-1, color);
+	PROF_END(LCD_API_FILL_SCREEN);
 }
 
 // Draw line
@@ -411,6 +461,7 @@ void lcdDrawLine(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2
 	int sx,sy;
 	int E;
 
+	PROF_BEGIN(LCD_API_DRAW_LINE);
 	/* distance between two points */
 	dx = ( x2 > x1 ) ? x2 - x1 : x1 - x2;
 	dy = ( y2 > y1 ) ? y2 - y1 : y1 - y2;
@@ -445,6 +496,7 @@ void lcdDrawLine(TFT_t * dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2
 			}
 		}
 	}
+	PROF_END(LCD_API_DRAW_LINE);
 }
 
 // Draw rectangle
@@ -580,6 +632,7 @@ void lcdDrawCircle(TFT_t * dev, uint16_t x0, uint16_t y0, uint16_t r, uint16_t c
 	int err;
 	int old_err;
 
+	PROF_BEGIN(LCD_API_DRAW_CIRCLE);
 	x=0;
 	y=-r;
 	err=2-2*r;
@@ -591,6 +644,7 @@ void lcdDrawCircle(TFT_t * dev, uint16_t x0, uint16_t y0, uint16_t r, uint16_t c
 		if ((old_err=err)<=x)	err+=++x*2+1;
 		if (old_err>y || err>x) err+=++y*2+1;	 
 	} while(y<0);
+	PROF_END(LCD_API_DRAW_CIRCLE);
 }
 
 // Draw circle of filling
@@ -605,6 +659,7 @@ void lcdDrawFillCircle(TFT_t * dev, uint16_t x0, uint16_t y0, uint16_t r, uint16
 	int old_err;
 	int ChangeX;
 
+	PROF_BEGIN(LCD_API_FILL_CIRCLE);
 	x=0;
 	y=-r;
 	err=2-2*r;
@@ -618,6 +673,7 @@ void lcdDrawFillCircle(TFT_t * dev, uint16_t x0, uint16_t y0, uint16_t r, uint16
 		if (ChangeX)			err+=++x*2+1;
 		if (old_err>y || err>x) err+=++y*2+1;
 	} while(y<=0);
+	PROF_END(LCD_API_FILL_CIRCLE);
 } 
 
 // Draw rectangle with round corner
@@ -754,6 +810,7 @@ void LCD_DrawChar(TFT_t *dev, uint16_t x, uint16_t y, char c, FontDef *font, uin
     uint8_t byte;
     uint32_t offset = (c - ' ') * font->height * ((font->width + 7) / 8);
 
+    PROF_BEGIN(LCD_API_DRAW_CHAR);
     for (i = 0; i < font->height; i++) {
         for (j = 0; j < font->width; j++) {
             byte = font->table[offset + i * ((font->width + 7) / 8) + (j / 8)];
@@ -762,6 +819,7 @@ void LCD_DrawChar(TFT_t *dev, uint16_t x, uint16_t y, char c, FontDef *font, uin
             }
         }
     }
+    PROF_END(LCD_API_DRAW_CHAR);
 }
 
 /**
@@ -775,6 +833,7 @@ void LCD_DrawChar(TFT_t *dev, uint16_t x, uint16_t y, char c, FontDef *font, uin
  * @param color Color del texto
  */
 void LCD_DrawString(TFT_t *dev, uint16_t x, uint16_t y, const char *str, FontDef *font, uint16_t color) {
+    PROF_BEGIN(LCD_API_DRAW_STRING);
     while (*str) {
         if (x + font->width > 240) {
             x = 0;
@@ -787,6 +846,7 @@ void LCD_DrawString(TFT_t *dev, uint16_t x, uint16_t y, const char *str, FontDef
         x += font->width;
         str++;
     }
+    PROF_END(LCD_API_DRAW_STRING);
 }
 
 /* funciones originales
@@ -1014,6 +1074,109 @@ int lcdDrawUTF8String(TFT_t * dev, FontxFile *fx, uint16_t x, uint16_t y, unsign
 }
 #endif
 
+// Build a sprite from a RGB565 image and a transparent color key
+// width:Width of the image
+// height:Height of the image
+// image:width*height pixels
+// key:transparent color
+bool lcdSpriteBuild(lcd_sprite_t * sprite, uint16_t width, uint16_t height, const uint16_t * image, uint16_t key) {
+	// First pass: count runs and opaque pixels
+	uint32_t nruns = 0;
+	uint32_t npixels = 0;
+	for (uint32_t i = 0; i < (uint32_t)width*height; i++) {
+		if (image[i] == key) continue;
+		npixels++;
+		if (i % width == 0 || image[i-1] == key) nruns++;
+	}
+
+	uint16_t *row_runs = malloc(sizeof(uint16_t)*(height+1));
+	lcd_sprite_run_t *runs = malloc(sizeof(lcd_sprite_run_t)*(nruns > 0 ? nruns : 1));
+	uint16_t *pixels = malloc(sizeof(uint16_t)*(npixels > 0 ? npixels : 1));
+	if (row_runs == NULL || runs == NULL || pixels == NULL || nruns > UINT16_MAX) {
+		free(row_runs);
+		free(runs);
+		free(pixels);
+		return false;
+	}
+
+	// Second pass: record the runs and pack the opaque pixels
+	uint16_t r = 0;
+	uint32_t p = 0;
+	for (uint16_t j = 0; j < height; j++) {
+		const uint16_t *row = &image[j*width];
+		row_runs[j] = r;
+		for (uint16_t i = 0; i < width; ) {
+			if (row[i] == key) {
+				i++;
+				continue;
+			}
+			uint16_t start = i;
+			while (i < width && row[i] != key) pixels[p++] = row[i++];
+			runs[r].x = start;
+			runs[r].len = i - start;
+			r++;
+		}
+	}
+	row_runs[height] = r;
+
+	sprite->width = width;
+	sprite->height = height;
+	sprite->row_runs = row_runs;
+	sprite->runs = runs;
+	sprite->pixels = pixels;
+	return true;
+}
+
+// Free a sprite built with lcdSpriteBuild
+void lcdSpriteFree(lcd_sprite_t * sprite) {
+	free((void *)sprite->row_runs);
+	free((void *)sprite->runs);
+	free((void *)sprite->pixels);
+	memset(sprite, 0, sizeof(lcd_sprite_t));
+}
+
+// Draw sprite
+// x:X coordinate of the upper left corner
+// y:Y coordinate of the upper left corner
+// sprite:sprite with precomputed opaque runs
+void lcdDrawSprite(TFT_t * dev, uint16_t x, uint16_t y, const lcd_sprite_t * sprite) {
+	PROF_BEGIN(LCD_API_DRAW_SPRITE);
+	const uint16_t *pixels = sprite->pixels;
+
+	for (uint16_t j = 0; j < sprite->height; j++) {
+		uint16_t _y = y + j;
+		for (uint16_t k = sprite->row_runs[j]; k < sprite->row_runs[j+1]; k++) {
+			const lcd_sprite_run_t *run = &sprite->runs[k];
+			uint16_t _x = x + run->x;
+			uint16_t len = run->len;
+			const uint16_t *src = pixels;
+			pixels += run->len;
+
+			// Clip to the screen
+			if (_y >= dev->_height || _x >= dev->_width) continue;
+			if (_x + len > dev->_width) len = dev->_width - _x;
+
+			if (dev->_use_frame_buffer) {
+				if ((uint16_t)(_y - dev->_fb_y0) >= dev->_fb_rows) continue;
+				memcpy(&dev->_frame_buffer[(_y - dev->_fb_y0)*dev->_width+_x], src, len*sizeof(uint16_t));
+			} else {
+				spi_master_write_command(dev, 0x2A);	// set column(x) address
+				spi_master_write_addr(dev, _x + dev->_offsetx, _x + dev->_offsetx + len - 1);
+				spi_master_write_command(dev, 0x2B);	// set Page(y) address
+				spi_master_write_addr(dev, _y + dev->_offsety, _y + dev->_offsety);
+				spi_master_write_command(dev, 0x2C);	// Memory Write
+				while (len > 0) {
+					uint16_t bs = (len > 512) ? 512 : len;
+					spi_master_write_colors(dev, (uint16_t *)src, bs);
+					len -= bs;
+					src += bs;
+				}
+			}
+		}
+	}
+	PROF_END(LCD_API_DRAW_SPRITE);
+}
+
 // Set font direction
 // dir:Direction
 void lcdSetFontDirection(TFT_t * dev, uint16_t dir) {
@@ -1047,14 +1210,14 @@ void lcdUnsetFontUnderLine(TFT_t * dev) {
 // Backlight OFF
 void lcdBacklightOff(TFT_t * dev) {
 	if(dev->_bl >= 0) {
-		gpio_set_level( dev->_bl, 0 );
+		dev->_backend->set_level( dev->_backend_ctx, dev->_bl, 0 );
 	}
 }
 
 // Backlight ON
 void lcdBacklightOn(TFT_t * dev) {
 	if(dev->_bl >= 0) {
-		gpio_set_level( dev->_bl, 1 );
+		dev->_backend->set_level( dev->_backend_ctx, dev->_bl, 1 );
 	}
 }
 
@@ -1068,8 +1231,103 @@ void lcdInversionOn(TFT_t * dev) {
 	spi_master_write_command(dev, 0x21); // Display Inversion On
 }
 
+// Partial Area
+// start:Start row
+// end:End row
+void lcdPartialArea(TFT_t * dev, uint16_t start, uint16_t end) {
+	spi_master_write_command(dev, 0x30);	// Partial Area
+	spi_master_write_addr(dev, start + dev->_offsety, end + dev->_offsety);
+}
+
+// Partial Display Mode On
+void lcdPartialOn(TFT_t * dev) {
+	spi_master_write_command(dev, 0x12);	// Partial Display Mode On
+}
+
+// Normal Display Mode On
+void lcdNormalOn(TFT_t * dev) {
+	spi_master_write_command(dev, 0x13);	// Normal Display Mode On
+}
+
+// Idle Mode On (8 colors)
+void lcdIdleOn(TFT_t * dev) {
+	spi_master_write_command(dev, 0x39);	// Idle Mode On
+}
+
+// Idle Mode Off
+void lcdIdleOff(TFT_t * dev) {
+	spi_master_write_command(dev, 0x38);	// Idle Mode Off
+}
+
+// Sleep In
+void lcdSleepIn(TFT_t * dev) {
+	// SLPIN can't be sent until 120ms after SLPOUT
+	TickType_t elapsed = xTaskGetTickCount() - dev->_sleep_out_tick;
+	if (elapsed < pdMS_TO_TICKS(120)) vTaskDelay(pdMS_TO_TICKS(120) - elapsed);
+	spi_master_write_command(dev, 0x10);	// Sleep In
+	dev->_sleep_in_tick = xTaskGetTickCount();
+}
+
+// Sleep Out
+void lcdSleepOut(TFT_t * dev) {
+	// SLPOUT can't be sent until 120ms after SLPIN
+	TickType_t elapsed = xTaskGetTickCount() - dev->_sleep_in_tick;
+	if (elapsed < pdMS_TO_TICKS(120)) vTaskDelay(pdMS_TO_TICKS(120) - elapsed);
+	spi_master_write_command(dev, 0x11);	// Sleep Out
+	dev->_sleep_out_tick = xTaskGetTickCount();
+	delayMS(5);	// The next command can be sent 5ms after SLPOUT
+}
+
+// Power manager configuration
+// idle_timeout_ms:Inactivity before partial + idle mode (0 = never)
+// sleep_timeout_ms:Inactivity before sleep (0 = never)
+// start:First visible row in partial mode
+// end:Last visible row in partial mode
+void lcdPowerConfig(TFT_t * dev, uint32_t idle_timeout_ms, uint32_t sleep_timeout_ms, uint16_t start, uint16_t end) {
+	if (end >= dev->_height) end = dev->_height-1;
+	dev->_idle_timeout_ms = idle_timeout_ms;
+	dev->_sleep_timeout_ms = sleep_timeout_ms;
+	dev->_partial_start = start;
+	dev->_partial_end = end;
+	dev->_last_activity = xTaskGetTickCount();
+}
+
+// Register activity and go back to full power
+void lcdPowerActivity(TFT_t * dev) {
+	dev->_last_activity = xTaskGetTickCount();
+	if (dev->_power_state == LCD_POWER_ACTIVE) return;
+
+	if (dev->_power_state == LCD_POWER_SLEEP) lcdSleepOut(dev);
+	lcdIdleOff(dev);
+	lcdNormalOn(dev);
+	lcdBacklightOn(dev);
+	ESP_LOGD(TAG, "power state %d -> %d", dev->_power_state, LCD_POWER_ACTIVE);
+	dev->_power_state = LCD_POWER_ACTIVE;
+}
+
+// Move to a lower power state after the configured inactivity
+LCD_POWER_t lcdPowerUpdate(TFT_t * dev) {
+	TickType_t idle = xTaskGetTickCount() - dev->_last_activity;
+
+	if (dev->_power_state != LCD_POWER_SLEEP && dev->_sleep_timeout_ms > 0
+		&& idle >= pdMS_TO_TICKS(dev->_sleep_timeout_ms)) {
+		ESP_LOGD(TAG, "power state %d -> %d", dev->_power_state, LCD_POWER_SLEEP);
+		lcdBacklightOff(dev);
+		lcdSleepIn(dev);
+		dev->_power_state = LCD_POWER_SLEEP;
+	} else if (dev->_power_state == LCD_POWER_ACTIVE && dev->_idle_timeout_ms > 0
+		&& idle >= pdMS_TO_TICKS(dev->_idle_timeout_ms)) {
+		ESP_LOGD(TAG, "power state %d -> %d", dev->_power_state, LCD_POWER_IDLE);
+		lcdPartialArea(dev, dev->_partial_start, dev->_partial_end);
+		lcdPartialOn(dev);
+		lcdIdleOn(dev);
+		dev->_power_state = LCD_POWER_IDLE;
+	}
+	return dev->_power_state;
+}
+
 void lcdWrapArround(TFT_t * dev, SCROLL_TYPE_t scroll, int start, int end) {
-	if (dev->_use_frame_buffer == false) return;
+	if (dev->_use_frame_buffer == false || dev->_fb_band) return;
 	
 	int _width = dev->_width;
 	int _height = dev->_height;
@@ -1121,11 +1379,25 @@ void lcdWrapArround(TFT_t * dev, SCROLL_TYPE_t scroll, int start, int end) {
 	}
 }
 
+// Draw into a band of rows in RAM instead of the panel
+// band:rows*width pixels, NULL to draw on the panel again
+// y:first row of the band
+// rows:rows of the band
+void lcdFrameBufferBand(TFT_t * dev, uint16_t * band, uint16_t y, uint16_t rows)
+{
+	dev->_frame_buffer = band;
+	dev->_use_frame_buffer = (band != NULL);
+	dev->_fb_band = (band != NULL);
+	dev->_fb_y0 = (band != NULL) ? y : 0;
+	dev->_fb_rows = (band != NULL) ? rows : dev->_height;
+}
+
 // Draw Frame Buffer
 void lcdDrawFinish(TFT_t *dev)
 {
-	if (dev->_use_frame_buffer == false) return;
+	if (dev->_use_frame_buffer == false || dev->_fb_band) return;
 
+	PROF_BEGIN(LCD_API_DRAW_FINISH);
 	spi_master_write_command(dev, 0x2A); // set column(x) address
 	spi_master_write_addr(dev, dev->_offsetx, dev->_offsetx+dev->_width-1);
 	spi_master_write_command(dev, 0x2B); // set Page(y) address
@@ -1137,10 +1409,47 @@ void lcdDrawFinish(TFT_t *dev)
 	uint16_t *image = dev->_frame_buffer;
 	while (size > 0) {
 		// 1024 bytes per time.
-		uint16_t bs = (size > 1024) ? 1024 : size;
+		uint16_t bs = (size > 512) ? 512 : size;
 		spi_master_write_colors(dev, image, bs);
 		size -= bs;
 		image += bs;
 	}
+	PROF_END(LCD_API_DRAW_FINISH);
 	return;
 }
+
+// Draw part of the Frame Buffer
+// x1:Start X coordinate
+// y1:Start Y coordinate
+// x2:End X coordinate
+// y2:End Y coordinate
+void lcdDrawFinishRect(TFT_t *dev, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2)
+{
+	if (dev->_use_frame_buffer == false || dev->_fb_band) return;
+	if (x1 >= dev->_width) return;
+	if (x2 >= dev->_width) x2=dev->_width-1;
+	if (y1 >= dev->_height) return;
+	if (y2 >= dev->_height) y2=dev->_height-1;
+	if (x1 > x2 || y1 > y2) return;
+
+	PROF_BEGIN(LCD_API_DRAW_FINISH_RECT);
+	spi_master_write_command(dev, 0x2A); // set column(x) address
+	spi_master_write_addr(dev, dev->_offsetx+x1, dev->_offsetx+x2);
+	spi_master_write_command(dev, 0x2B); // set Page(y) address
+	spi_master_write_addr(dev, dev->_offsety+y1, dev->_offsety+y2);
+	spi_master_write_command(dev, 0x2C); // Memory Write
+
+	// Rows of the window are not contiguous in the frame buffer.
+	uint16_t w = x2-x1+1;
+	for (uint16_t j = y1; j <= y2; j++) {
+		uint16_t *image = &dev->_frame_buffer[j*dev->_width+x1];
+		uint16_t size = w;
+		while (size > 0) {
+			uint16_t bs = (size > 512) ? 512 : size;
+			spi_master_write_colors(dev, image, bs);
+			size -= bs;
+			image += bs;
+		}
+	}
+	PROF_END(LCD_API_DRAW_FINISH_RECT);
+}
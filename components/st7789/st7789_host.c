@@ -0,0 +1,328 @@
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "esp_log.h"
+
+#include "st7789.h"
+#include "st7789_host.h"
+
+#define TAG "ST7789_HOST"
+
+// ST7789 frame memory
+#define GRAM_WIDTH  240
+#define GRAM_HEIGHT 320
+
+typedef struct {
+	uint16_t gram[GRAM_HEIGHT][GRAM_WIDTH];
+	int16_t dc_gpio;
+	int16_t bl_gpio;
+	uint32_t dc_level;
+	uint32_t bl_level;
+	uint8_t cmd;               // command being executed
+	uint8_t params[4];         // CASET/RASET/PTLAR parameters
+	int nparams;
+	uint16_t xs, xe, ys, ye;   // address window
+	uint16_t x, y;             // RAMWR cursor
+	uint8_t pixel_hi;          // first byte of a RGB565 pixel
+	bool pixel_half;
+	uint16_t ptl_start, ptl_end;
+	bool sleep;
+	bool display_on;
+	bool idle;
+	bool partial;
+	lcd_bus_stats_t stats;
+} host_lcd_t;
+
+static void host_reset(host_lcd_t *lcd)
+{
+	lcd->xs = 0;
+	lcd->xe = GRAM_WIDTH-1;
+	lcd->ys = 0;
+	lcd->ye = GRAM_HEIGHT-1;
+	lcd->ptl_start = 0;
+	lcd->ptl_end = GRAM_HEIGHT-1;
+	lcd->sleep = true;
+	lcd->display_on = false;
+	lcd->idle = false;
+	lcd->partial = false;
+}
+
+static void host_command(host_lcd_t *lcd, uint8_t cmd)
+{
+	lcd->cmd = cmd;
+	lcd->nparams = 0;
+	lcd->pixel_half = false;
+	lcd->stats.commands++;
+
+	switch (cmd) {
+	case 0x01: host_reset(lcd); break;            // SWRESET
+	case 0x10: lcd->sleep = true; break;          // SLPIN
+	case 0x11: lcd->sleep = false; break;         // SLPOUT
+	case 0x12: lcd->partial = true; break;        // PTLON
+	case 0x13: lcd->partial = false; break;       // NORON
+	case 0x28: lcd->display_on = false; break;    // DISPOFF
+	case 0x29: lcd->display_on = true; break;     // DISPON
+	case 0x38: lcd->idle = false; break;          // IDMOFF
+	case 0x39: lcd->idle = true; break;           // IDMON
+	case 0x2C:                                    // RAMWR
+		lcd->x = lcd->xs;
+		lcd->y = lcd->ys;
+		break;
+	default:
+		// Other commands (COLMOD, MADCTL, INVON...) don't change the emulated image.
+		break;
+	}
+}
+
+static void host_data(host_lcd_t *lcd, uint8_t data)
+{
+	switch (lcd->cmd) {
+	case 0x2A: // CASET
+	case 0x2B: // RASET
+	case 0x30: // PTLAR
+		if (lcd->nparams >= 4) break;
+		lcd->params[lcd->nparams++] = data;
+		if (lcd->nparams == 4) {
+			uint16_t start = (lcd->params[0] << 8) | lcd->params[1];
+			uint16_t end = (lcd->params[2] << 8) | lcd->params[3];
+			if (lcd->cmd == 0x2A) {
+				lcd->xs = start;
+				lcd->xe = end;
+			} else if (lcd->cmd == 0x2B) {
+				lcd->ys = start;
+				lcd->ye = end;
+			} else {
+				lcd->ptl_start = start;
+				lcd->ptl_end = end;
+			}
+		}
+		break;
+	case 0x2C: // RAMWR
+		if (!lcd->pixel_half) {
+			lcd->pixel_hi = data;
+			lcd->pixel_half = true;
+			break;
+		}
+		lcd->pixel_half = false;
+		if (lcd->x < GRAM_WIDTH && lcd->y < GRAM_HEIGHT) {
+			lcd->gram[lcd->y][lcd->x] = (lcd->pixel_hi << 8) | data;
+		}
+		lcd->stats.pixels++;
+		if (++lcd->x > lcd->xe) {
+			lcd->x = lcd->xs;
+			if (++lcd->y > lcd->ye) lcd->y = lcd->ys;
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+static bool host_backend_write(void *ctx, const uint8_t *data, size_t length)
+{
+	host_lcd_t *lcd = ctx;
+
+	if (length == 0) return true;
+	lcd->stats.transactions++;
+	lcd->stats.bytes += length;
+	for (size_t i = 0; i < length; i++) {
+		if (lcd->dc_level == 0) {
+			host_command(lcd, data[i]);
+		} else {
+			host_data(lcd, data[i]);
+		}
+	}
+	return true;
+}
+
+static void host_backend_set_level(void *ctx, int16_t gpio, uint32_t level)
+{
+	host_lcd_t *lcd = ctx;
+
+	if (gpio == lcd->dc_gpio) {
+		if (level != lcd->dc_level) lcd->stats.dc_toggles++;
+		lcd->dc_level = level;
+	} else if (gpio == lcd->bl_gpio) {
+		lcd->bl_level = level;
+	}
+}
+
+static const lcd_backend_t host_backend = {
+	.write = host_backend_write,
+	.set_level = host_backend_set_level,
+};
+
+void host_master_init(TFT_t * dev, int16_t GPIO_DC, int16_t GPIO_BL)
+{
+	host_lcd_t *lcd = calloc(1, sizeof(host_lcd_t));
+	assert(lcd != NULL);
+	host_reset(lcd);
+	lcd->dc_gpio = GPIO_DC;
+	lcd->bl_gpio = GPIO_BL;
+
+	dev->_dc = GPIO_DC;
+	dev->_bl = GPIO_BL;
+	dev->_rst = -1;
+	dev->_backend = &host_backend;
+	dev->_backend_ctx = lcd;
+	ESP_LOGI(TAG, "emulated GRAM %dx%d", GRAM_WIDTH, GRAM_HEIGHT);
+}
+
+void lcdHostResetStats(TFT_t * dev)
+{
+	host_lcd_t *lcd = dev->_backend_ctx;
+	memset(&lcd->stats, 0, sizeof(lcd->stats));
+}
+
+void lcdHostGetStats(TFT_t * dev, lcd_bus_stats_t * stats)
+{
+	host_lcd_t *lcd = dev->_backend_ctx;
+	*stats = lcd->stats;
+}
+
+uint16_t lcdHostGetPixel(TFT_t * dev, uint16_t x, uint16_t y)
+{
+	host_lcd_t *lcd = dev->_backend_ctx;
+	uint16_t _x = x + dev->_offsetx;
+	uint16_t _y = y + dev->_offsety;
+	if (_x >= GRAM_WIDTH || _y >= GRAM_HEIGHT) return 0;
+	return lcd->gram[_y][_x];
+}
+
+//------------------------------------------PNG writer-------------------------------
+// Uncompressed (stored deflate blocks) RGB PNG, so no zlib is needed on the host.
+
+static uint32_t png_crc(uint32_t crc, const uint8_t *buf, size_t len)
+{
+	static uint32_t table[256];
+	if (table[1] == 0) {
+		for (uint32_t n = 0; n < 256; n++) {
+			uint32_t c = n;
+			for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+			table[n] = c;
+		}
+	}
+	crc = ~crc;
+	for (size_t i = 0; i < len; i++) crc = table[(crc ^ buf[i]) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+static void png_put32(uint8_t *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static bool png_chunk(FILE *fp, const char *type, const uint8_t *data, uint32_t len)
+{
+	uint8_t hdr[8];
+	png_put32(hdr, len);
+	memcpy(hdr+4, type, 4);
+	uint32_t crc = png_crc(0, hdr+4, 4);
+	crc = png_crc(crc, data, len);
+	uint8_t tail[4];
+	png_put32(tail, crc);
+	if (fwrite(hdr, 1, 8, fp) != 8) return false;
+	if (len > 0 && fwrite(data, 1, len, fp) != len) return false;
+	return fwrite(tail, 1, 4, fp) == 4;
+}
+
+// Color the panel would show for a GRAM row/pixel in the current mode
+static void host_visible_rgb(host_lcd_t *lcd, uint16_t row, uint16_t color, uint8_t *rgb)
+{
+	if (lcd->sleep || !lcd->display_on || (lcd->bl_gpio >= 0 && lcd->bl_level == 0)) {
+		color = 0;
+	} else if (lcd->partial && (row < lcd->ptl_start || row > lcd->ptl_end)) {
+		color = 0;
+	}
+	uint8_t r = (color >> 11) & 0x1F;
+	uint8_t g = (color >> 5) & 0x3F;
+	uint8_t b = color & 0x1F;
+	rgb[0] = (r << 3) | (r >> 2);
+	rgb[1] = (g << 2) | (g >> 4);
+	rgb[2] = (b << 3) | (b >> 2);
+	if (lcd->idle) {
+		// 8-color mode: only the MSB of each channel is used
+		for (int i = 0; i < 3; i++) rgb[i] = (rgb[i] & 0x80) ? 0xFF : 0x00;
+	}
+}
+
+bool lcdHostSavePNG(TFT_t * dev, const char * path)
+{
+	host_lcd_t *lcd = dev->_backend_ctx;
+	uint32_t w = dev->_width;
+	uint32_t h = dev->_height;
+	uint32_t stride = 1 + 3*w;
+	uint32_t raw_len = stride * h;
+	uint32_t nblocks = (raw_len + 65534) / 65535;
+	uint32_t z_len = 2 + nblocks*5 + raw_len + 4;
+
+	uint8_t *raw = malloc(raw_len);
+	uint8_t *z = malloc(z_len);
+	if (raw == NULL || z == NULL) {
+		free(raw);
+		free(z);
+		return false;
+	}
+
+	for (uint32_t y = 0; y < h; y++) {
+		uint8_t *p = raw + y*stride;
+		*p++ = 0; // filter: none
+		for (uint32_t x = 0; x < w; x++, p += 3) {
+			host_visible_rgb(lcd, y + dev->_offsety, lcdHostGetPixel(dev, x, y), p);
+		}
+	}
+
+	// zlib stream with stored blocks
+	uint8_t *q = z;
+	*q++ = 0x78;
+	*q++ = 0x01;
+	uint32_t a = 1, b = 0;
+	for (uint32_t off = 0; off < raw_len; ) {
+		uint32_t n = raw_len - off;
+		if (n > 65535) n = 65535;
+		*q++ = (off + n == raw_len) ? 1 : 0;
+		*q++ = n & 0xFF;
+		*q++ = n >> 8;
+		*q++ = ~n & 0xFF;
+		*q++ = (~n >> 8) & 0xFF;
+		memcpy(q, raw + off, n);
+		for (uint32_t i = 0; i < n; i++) {
+			a = (a + raw[off+i]) % 65521;
+			b = (b + a) % 65521;
+		}
+		q += n;
+		off += n;
+	}
+	png_put32(q, (b << 16) | a);
+
+	uint8_t ihdr[13];
+	png_put32(ihdr, w);
+	png_put32(ihdr+4, h);
+	ihdr[8] = 8;  // bit depth
+	ihdr[9] = 2;  // color type: RGB
+	ihdr[10] = 0;
+	ihdr[11] = 0;
+	ihdr[12] = 0;
+
+	static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+	bool ok = false;
+	FILE *fp = fopen(path, "wb");
+	if (fp != NULL) {
+		ok = fwrite(signature, 1, 8, fp) == 8
+			&& png_chunk(fp, "IHDR", ihdr, sizeof(ihdr))
+			&& png_chunk(fp, "IDAT", z, z_len)
+			&& png_chunk(fp, "IEND", NULL, 0);
+		ok = (fclose(fp) == 0) && ok;
+	}
+	if (!ok) ESP_LOGE(TAG, "can't write %s", path);
+
+	free(raw);
+	free(z);
+	return ok;
+}
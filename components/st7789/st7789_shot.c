@@ -0,0 +1,91 @@
+#include <string.h>
+
+#include "st7789.h"
+
+// Token of the RLE stream
+#define SHOT_RUN      0x80      // bit 7 set: (n & 0x7F)+1 copies of the next color
+#define SHOT_MAX_LEN  128       // longest run or literal in a token
+
+static void shot_put16(uint8_t *p, uint16_t v)
+{
+	p[0] = v & 0xFF;
+	p[1] = v >> 8;
+}
+
+static void shot_put32(uint8_t *p, uint32_t v)
+{
+	shot_put16(p, v & 0xFFFF);
+	shot_put16(p+2, v >> 16);
+}
+
+// Length of the run of equal colors starting at pos
+static uint32_t shot_run_length(const lcd_shot_t *shot, uint32_t pos)
+{
+	uint32_t end = shot->npixels;
+	if (end - pos > SHOT_MAX_LEN) end = pos + SHOT_MAX_LEN;
+	uint32_t i = pos + 1;
+	while (i < end && shot->image[i] == shot->image[pos]) i++;
+	return i - pos;
+}
+
+void lcdShotBegin(lcd_shot_t * shot, const uint16_t * image, uint16_t width, uint16_t height, uint16_t id)
+{
+	memset(shot, 0, sizeof(lcd_shot_t));
+	shot->image = image;
+	shot->width = width;
+	shot->height = height;
+	shot->npixels = (image != NULL) ? (uint32_t)width * height : 0;
+	shot->id = id;
+}
+
+void lcdShotBand(lcd_shot_t * shot, const uint16_t * band, uint16_t y, uint16_t rows)
+{
+	shot->image = band;
+	shot->base = (uint32_t)y * shot->width;
+	shot->npixels = (uint32_t)rows * shot->width;
+	shot->pos = 0;
+}
+
+size_t lcdShotNextChunk(lcd_shot_t * shot, uint8_t * buf, size_t size)
+{
+	if (shot->done || shot->pos >= shot->npixels || size < LCD_SHOT_HEADER_SIZE + 3) return 0;
+
+	uint32_t first = shot->base + shot->pos;
+	size_t len = LCD_SHOT_HEADER_SIZE;
+	while (shot->pos < shot->npixels && size - len >= 3) {
+		uint32_t run = shot_run_length(shot, shot->pos);
+		if (run >= 2) {
+			buf[len++] = SHOT_RUN | (run - 1);
+			shot_put16(&buf[len], shot->image[shot->pos]);
+			len += 2;
+			shot->pos += run;
+			continue;
+		}
+		// Literals up to the next run of two, the token limit or the end of the chunk
+		size_t count = 0;
+		size_t token = len++;
+		while (shot->pos < shot->npixels && count < SHOT_MAX_LEN && size - len >= 2) {
+			if (count > 0 && shot_run_length(shot, shot->pos) >= 2) break;
+			shot_put16(&buf[len], shot->image[shot->pos]);
+			len += 2;
+			shot->pos++;
+			count++;
+		}
+		buf[token] = count - 1;
+	}
+
+	bool last = (shot->base + shot->pos >= (uint32_t)shot->width * shot->height);
+	buf[0] = LCD_SHOT_MAGIC;
+	buf[1] = LCD_SHOT_VERSION;
+	shot_put16(&buf[2], shot->id);
+	shot_put16(&buf[4], shot->seq);
+	buf[6] = last ? LCD_SHOT_LAST : 0;
+	buf[7] = 0;
+	shot_put32(&buf[8], first);
+	shot_put16(&buf[12], shot->width);
+	shot_put16(&buf[14], shot->height);
+
+	shot->seq++;
+	shot->done = last;
+	return len;
+}
@@ -0,0 +1,164 @@
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include <driver/spi_master.h>
+#include <driver/gpio.h>
+#include "esp_log.h"
+
+#include "st7789.h"
+
+#define TAG "ST7789"
+
+#if 0
+#ifdef CONFIG_IDF_TARGET_ESP32
+#define LCD_HOST HSPI_HOST
+#elif defined CONFIG_IDF_TARGET_ESP32S2
+#define LCD_HOST SPI2_HOST
+#elif defined CONFIG_IDF_TARGET_ESP32S3
+#define LCD_HOST SPI2_HOST
+#elif defined CONFIG_IDF_TARGET_ESP32C3
+#define LCD_HOST SPI2_HOST
+#endif
+#endif
+
+
+#define HOST_ID SPI2_HOST //Definicion sin menuconfig
+/*
+#if CONFIG_SPI2_HOST
+#define HOST_ID SPI2_HOST
+#elif CONFIG_SPI3_HOST
+#define HOST_ID SPI3_HOST
+#endif*/
+
+#define SPI_DEFAULT_FREQUENCY SPI_MASTER_FREQ_20M; // 20MHz
+
+//static const int SPI_Frequency = SPI_MASTER_FREQ_20M;
+//static const int SPI_Frequency = SPI_MASTER_FREQ_26M;
+//static const int SPI_Frequency = SPI_MASTER_FREQ_40M;
+//static const int SPI_Frequency = 60000000;
+//static const int SPI_Frequency = SPI_MASTER_FREQ_80M;
+
+int clock_speed_hz = SPI_DEFAULT_FREQUENCY;
+
+void spi_clock_speed(int speed) {
+    ESP_LOGI(TAG, "SPI clock speed=%d MHz", speed/1000000);
+    clock_speed_hz = speed;
+}
+
+static bool spi_backend_write(void *ctx, const uint8_t *data, size_t length)
+{
+	TFT_t * dev = ctx;
+	return spi_master_write_byte( dev->_SPIHandle, data, length );
+}
+
+static void spi_backend_set_level(void *ctx, int16_t gpio, uint32_t level)
+{
+	gpio_set_level( gpio, level );
+}
+
+static const lcd_backend_t spi_backend = {
+	.write = spi_backend_write,
+	.set_level = spi_backend_set_level,
+};
+
+void spi_master_init(TFT_t * dev, int16_t GPIO_MOSI, int16_t GPIO_SCLK, int16_t GPIO_CS, int16_t GPIO_DC, int16_t GPIO_RESET, int16_t GPIO_BL)
+{
+	esp_err_t ret;
+
+	ESP_LOGI(TAG, "GPIO_CS=%d",GPIO_CS);
+	if ( GPIO_CS >= 0 ) {
+		//gpio_pad_select_gpio( GPIO_CS );
+		gpio_reset_pin( GPIO_CS );
+		gpio_set_direction( GPIO_CS, GPIO_MODE_OUTPUT );
+		gpio_set_level( GPIO_CS, 0 );
+	}
+
+	ESP_LOGI(TAG, "GPIO_DC=%d",GPIO_DC);
+	//gpio_pad_select_gpio( GPIO_DC );
+	gpio_reset_pin( GPIO_DC );
+	gpio_set_direction( GPIO_DC, GPIO_MODE_OUTPUT );
+	gpio_set_level( GPIO_DC, 0 );
+
+	ESP_LOGI(TAG, "GPIO_RESET=%d",GPIO_RESET);
+	if ( GPIO_RESET >= 0 ) {
+		//gpio_pad_select_gpio( GPIO_RESET );
+		gpio_reset_pin( GPIO_RESET );
+		gpio_set_direction( GPIO_RESET, GPIO_MODE_OUTPUT );
+		gpio_set_level( GPIO_RESET, 1 );
+		// The reset pulse is part of the lcdInit()/lcdInitAsync() sequence
+	}
+
+	ESP_LOGI(TAG, "GPIO_BL=%d",GPIO_BL);
+	if ( GPIO_BL >= 0 ) {
+		//gpio_pad_select_gpio(GPIO_BL);
+		gpio_reset_pin(GPIO_BL);
+		gpio_set_direction( GPIO_BL, GPIO_MODE_OUTPUT );
+		gpio_set_level( GPIO_BL, 0 );
+	}
+
+	ESP_LOGI(TAG, "GPIO_MOSI=%d",GPIO_MOSI);
+	ESP_LOGI(TAG, "GPIO_SCLK=%d",GPIO_SCLK);
+	spi_bus_config_t buscfg = {
+		.mosi_io_num = GPIO_MOSI,
+		.miso_io_num = -1,
+		.sclk_io_num = GPIO_SCLK,
+		.quadwp_io_num = -1,
+		.quadhd_io_num = -1,
+		.max_transfer_sz = 0,
+		.flags = 0
+	};
+
+	ret = spi_bus_initialize( HOST_ID, &buscfg, SPI_DMA_CH_AUTO );
+	ESP_LOGD(TAG, "spi_bus_initialize=%d",ret);
+	assert(ret==ESP_OK);
+
+	spi_device_interface_config_t devcfg;
+	memset(&devcfg, 0, sizeof(devcfg));
+	//devcfg.clock_speed_hz = SPI_Frequency;
+	devcfg.clock_speed_hz = clock_speed_hz;
+	devcfg.queue_size = 7;
+	//devcfg.mode = 2;
+	devcfg.mode = 3;
+	devcfg.flags = SPI_DEVICE_NO_DUMMY;
+
+	if ( GPIO_CS >= 0 ) {
+		devcfg.spics_io_num = GPIO_CS;
+	} else {
+		devcfg.spics_io_num = -1;
+	}
+	
+	spi_device_handle_t handle;
+	ret = spi_bus_add_device( HOST_ID, &devcfg, &handle);
+	ESP_LOGD(TAG, "spi_bus_add_device=%d",ret);
+	assert(ret==ESP_OK);
+	dev->_dc = GPIO_DC;
+	dev->_bl = GPIO_BL;
+	dev->_rst = GPIO_RESET;
+	dev->_SPIHandle = handle;
+	dev->_backend = &spi_backend;
+	dev->_backend_ctx = dev;
+}
+
+bool spi_master_write_byte(spi_device_handle_t SPIHandle, const uint8_t* Data, size_t DataLength)
+{
+	spi_transaction_t SPITransaction;
+	esp_err_t ret;
+
+	if ( DataLength > 0 ) {
+		memset( &SPITransaction, 0, sizeof( spi_transaction_t ) );
+		SPITransaction.length = DataLength * 8;
+		SPITransaction.tx_buffer = Data;
+#if 1
+		ret = spi_device_transmit( SPIHandle, &SPITransaction );
+#else
+		ret = spi_device_polling_transmit( SPIHandle, &SPITransaction );
+#endif
+		assert(ret==ESP_OK); 
+	}
+
+	return true;
+}
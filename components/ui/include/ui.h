@@ -0,0 +1,127 @@
+#ifndef MAIN_UI_H_
+#define MAIN_UI_H_
+
+#include "st7789.h"
+#include "fontx.h"
+
+/**
+ * @brief Pantallas que muestra el control de acceso.
+ */
+typedef enum {
+	UI_SCREEN_SPLASH = 0,   /**< Círculos concéntricos del arranque */
+	UI_SCREEN_WELCOME,      /**< "Bienvenido!" en espera */
+	UI_SCREEN_GRANTED,      /**< "ACCESO CONCEDIDO" (respuesta 111) */
+	UI_SCREEN_OPEN,         /**< "COFRE ABIERTO" (respuesta 101) */
+	UI_SCREEN_DENIED,       /**< "NO AUTORIZADO" (respuesta 100) */
+	UI_SCREEN_REVOKED,      /**< "ACCESO REVOCADO": el backend contradijo una apertura local */
+	UI_SCREEN_NO_RESPONSE,  /**< "SIN RESPUESTA": venció el plazo del pedido */
+	UI_SCREEN_MESSAGE,      /**< Texto que manda el backend (ver ui_set_message()) */
+	UI_SCREEN_MAX,
+} ui_screen_t;
+
+/**
+ * @brief Íconos disponibles (sprites de 16x16 con fondo transparente).
+ */
+typedef enum {
+	UI_ICON_LOCK = 0,       /**< Candado cerrado */
+	UI_ICON_UNLOCK,         /**< Candado abierto */
+	UI_ICON_WIFI,           /**< Wi-Fi conectado */
+	UI_ICON_WIFI_OFF,       /**< Wi-Fi desconectado */
+	UI_ICON_MQTT,           /**< Broker MQTT conectado */
+	UI_ICON_MQTT_OFF,       /**< Broker MQTT desconectado */
+	UI_ICON_MAX,
+} ui_icon_t;
+
+/** Tamaño de los íconos */
+#define UI_ICON_SIZE 16
+
+/** Fuente de 24px usada en todas las pantallas */
+extern FontDef Font24;
+
+/** Largo máximo del texto de UI_SCREEN_MESSAGE */
+#define UI_MESSAGE_MAX 32
+
+/** Fila superior y alto del texto de la pantalla de bienvenida */
+#define UI_WELCOME_Y 100
+#define UI_WELCOME_HEIGHT 24
+
+/**
+ * @brief Construye los sprites de los íconos.
+ * 
+ * Debe llamarse una vez antes de dibujar cualquier pantalla.
+ * 
+ * @return true si se pudieron construir todos los íconos.
+ */
+bool ui_init(void);
+
+/**
+ * @brief Dibuja una pantalla completa.
+ * 
+ * @param dev Puntero a la estructura TFT_t.
+ * @param screen Pantalla a dibujar.
+ */
+void ui_draw_screen(TFT_t * dev, ui_screen_t screen);
+
+/**
+ * @brief Dibuja una pantalla sin enviar el buffer de frame al panel.
+ * 
+ * Permite reconstruir la imagen de una pantalla en un buffer propio
+ * (por ejemplo, para una captura) sin tocar el LCD.
+ * 
+ * @param dev Puntero a la estructura TFT_t.
+ * @param screen Pantalla a dibujar.
+ */
+void ui_render_screen(TFT_t * dev, ui_screen_t screen);
+
+/**
+ * @brief Devuelve la última pantalla dibujada con ui_draw_screen().
+ * 
+ * @return ui_screen_t Pantalla actual (UI_SCREEN_MAX si aún no se dibujó ninguna).
+ */
+ui_screen_t ui_current_screen(void);
+
+/**
+ * @brief Dibuja un ícono sobre lo que haya en pantalla.
+ * 
+ * @param dev Puntero a la estructura TFT_t.
+ * @param icon Ícono a dibujar.
+ * @param x Coordenada X de la esquina superior izquierda.
+ * @param y Coordenada Y de la esquina superior izquierda.
+ */
+void ui_draw_icon(TFT_t * dev, ui_icon_t icon, uint16_t x, uint16_t y);
+
+/**
+ * @brief Actualiza el estado de conexión que muestra la pantalla de bienvenida.
+ * 
+ * @param wifi true si hay conexión Wi-Fi.
+ * @param mqtt true si hay conexión con el broker.
+ * @return true si el estado cambió.
+ */
+bool ui_set_status(bool wifi, bool mqtt);
+
+/**
+ * @brief Fija el texto de UI_SCREEN_MESSAGE.
+ * 
+ * Se parte en hasta 3 renglones de 14 caracteres, en los espacios o en
+ * los '\n'; lo que no entra se descarta. Cada renglón va centrado.
+ * 
+ * @param text Texto, hasta UI_MESSAGE_MAX caracteres.
+ */
+void ui_set_message(const char *text);
+
+/**
+ * @brief Redibuja los íconos de estado si la pantalla actual los muestra.
+ * 
+ * @param dev Puntero a la estructura TFT_t.
+ */
+void ui_draw_status(TFT_t * dev);
+
+/**
+ * @brief Devuelve el nombre de una pantalla (para logs y benchmarks).
+ * 
+ * @param screen Pantalla.
+ * @return const char* Nombre de la pantalla.
+ */
+const char *ui_screen_name(ui_screen_t screen);
+
+#endif /* MAIN_UI_H_ */
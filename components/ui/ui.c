@@ -0,0 +1,280 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "ui.h"
+
+#define TAG "UI"
+
+// Definimos la fuente con la tabla y sus dimensiones
+FontDef Font24 = {Font24_Table, 17, UI_WELCOME_HEIGHT};
+
+// Posición de los íconos de estado y del candado
+#define UI_WIFI_X 4
+#define UI_MQTT_X (240 - UI_ICON_SIZE - 4)
+#define UI_STATUS_Y 4
+#define UI_LOCK_X ((240 - UI_ICON_SIZE) / 2)
+#define UI_LOCK_Y 60
+
+// Renglones de la pantalla de mensaje: 240 / 17 caracteres de Font24
+#define UI_MESSAGE_COLS 14
+#define UI_MESSAGE_LINES 3
+
+static const char *screen_names[UI_SCREEN_MAX] = {
+	[UI_SCREEN_SPLASH] = "splash",
+	[UI_SCREEN_WELCOME] = "welcome",
+	[UI_SCREEN_GRANTED] = "granted",
+	[UI_SCREEN_OPEN] = "open",
+	[UI_SCREEN_DENIED] = "denied",
+	[UI_SCREEN_REVOKED] = "revoked",
+	[UI_SCREEN_NO_RESPONSE] = "no_response",
+	[UI_SCREEN_MESSAGE] = "message",
+};
+
+// Dibujos de los íconos: '#' es opaco, '.' es transparente
+static const char *art_lock[UI_ICON_SIZE] = {
+	"................",
+	".....######.....",
+	"....########....",
+	"...###....###...",
+	"...##......##...",
+	"...##......##...",
+	"...##......##...",
+	"..############..",
+	"..############..",
+	"..#####..#####..",
+	"..####....####..",
+	"..#####..#####..",
+	"..#####..#####..",
+	"..############..",
+	"..############..",
+	"................",
+};
+
+static const char *art_unlock[UI_ICON_SIZE] = {
+	".....######.....",
+	"....########....",
+	"...###....###...",
+	"...##......##...",
+	"...##......##...",
+	"...##...........",
+	"...##...........",
+	"..############..",
+	"..############..",
+	"..#####..#####..",
+	"..####....####..",
+	"..#####..#####..",
+	"..#####..#####..",
+	"..############..",
+	"..############..",
+	"................",
+};
+
+static const char *art_wifi[UI_ICON_SIZE] = {
+	"................",
+	"................",
+	".....######.....",
+	"...##########...",
+	".###........###.",
+	"##....####....##",
+	"#...########...#",
+	"...##......##...",
+	"..#...####...#..",
+	".....######.....",
+	"....##....##....",
+	"................",
+	".......##.......",
+	"......####......",
+	".......##.......",
+	"................",
+};
+
+static const char *art_mqtt[UI_ICON_SIZE] = {
+	"................",
+	"..##........##..",
+	".####......####.",
+	".####......####.",
+	"..##.#....#.##..",
+	"......#..#......",
+	".......##.......",
+	"......####......",
+	"......####......",
+	".......##.......",
+	"......#..#......",
+	"..##.#....#.##..",
+	".####......####.",
+	".####......####.",
+	"..##........##..",
+	"................",
+};
+
+typedef struct {
+	const char **art;
+	uint16_t color;
+} ui_icon_def_t;
+
+static const ui_icon_def_t icon_defs[UI_ICON_MAX] = {
+	[UI_ICON_LOCK] = { art_lock, BLACK },
+	[UI_ICON_UNLOCK] = { art_unlock, WHITE },
+	[UI_ICON_WIFI] = { art_wifi, BLACK },
+	[UI_ICON_WIFI_OFF] = { art_wifi, GRAY },
+	[UI_ICON_MQTT] = { art_mqtt, BLACK },
+	[UI_ICON_MQTT_OFF] = { art_mqtt, GRAY },
+};
+
+static lcd_sprite_t icons[UI_ICON_MAX];
+static ui_screen_t current_screen = UI_SCREEN_MAX;
+static bool status_wifi;
+static bool status_mqtt;
+static char message_lines[UI_MESSAGE_LINES][UI_MESSAGE_COLS + 1];
+static int message_count;
+
+bool ui_init(void)
+{
+	// Color clave: cualquiera distinto del color del ícono
+	uint16_t image[UI_ICON_SIZE * UI_ICON_SIZE];
+	for (int i = 0; i < UI_ICON_MAX; i++) {
+		if (icons[i].pixels != NULL) continue;
+		uint16_t key = ~icon_defs[i].color;
+		for (int y = 0; y < UI_ICON_SIZE; y++) {
+			for (int x = 0; x < UI_ICON_SIZE; x++) {
+				image[y * UI_ICON_SIZE + x] = (icon_defs[i].art[y][x] == '#') ? icon_defs[i].color : key;
+			}
+		}
+		if (!lcdSpriteBuild(&icons[i], UI_ICON_SIZE, UI_ICON_SIZE, image, key)) {
+			ESP_LOGE(TAG, "no memory for icon %d", i);
+			return false;
+		}
+	}
+	return true;
+}
+
+void ui_draw_icon(TFT_t * dev, ui_icon_t icon, uint16_t x, uint16_t y)
+{
+	if (icon >= UI_ICON_MAX || icons[icon].pixels == NULL) return;
+	lcdDrawSprite(dev, x, y, &icons[icon]);
+}
+
+// Íconos de estado sobre el fondo de la pantalla de bienvenida
+static void ui_draw_status_icons(TFT_t * dev)
+{
+	ui_draw_icon(dev, status_wifi ? UI_ICON_WIFI : UI_ICON_WIFI_OFF, UI_WIFI_X, UI_STATUS_Y);
+	ui_draw_icon(dev, status_mqtt ? UI_ICON_MQTT : UI_ICON_MQTT_OFF, UI_MQTT_X, UI_STATUS_Y);
+}
+
+void ui_render_screen(TFT_t * dev, ui_screen_t screen)
+{
+	switch (screen) {
+	case UI_SCREEN_SPLASH:
+		lcdFillScreen(dev, BLACK);
+		for (int i = 5; i < 240; i = i + 5) {
+			lcdDrawCircle(dev, 240 / 2, 240 / 2, i, BLUE);
+		}
+		break;
+	case UI_SCREEN_WELCOME:
+		lcdFillScreen(dev, ORANGE);
+		ui_draw_icon(dev, UI_ICON_LOCK, UI_LOCK_X, UI_LOCK_Y);
+		ui_draw_status_icons(dev);
+		LCD_DrawString(dev, 30, UI_WELCOME_Y, "Bienvenido!", &Font24, RED);
+		break;
+	case UI_SCREEN_GRANTED:
+		lcdFillScreen(dev, GREEN);
+		LCD_DrawString(dev, 75, 80, "ACCESO", &Font24, RED);
+		LCD_DrawString(dev, 50, 120, "CONCEDIDO", &Font24, RED);
+		break;
+	case UI_SCREEN_OPEN:
+		lcdFillScreen(dev, BLUE);
+		ui_draw_icon(dev, UI_ICON_UNLOCK, UI_LOCK_X, 40);
+		LCD_DrawString(dev, 80, 80, "COFRE", &Font24, RED);
+		LCD_DrawString(dev, 60, 120, "ABIERTO", &Font24, RED);
+		break;
+	case UI_SCREEN_DENIED:
+		lcdFillScreen(dev, RED);
+		LCD_DrawString(dev, 100, 80, "NO", &Font24, GRAY);
+		LCD_DrawString(dev, 40, 120, "AUTORIZADO", &Font24, GRAY);
+		break;
+	case UI_SCREEN_REVOKED:
+		lcdFillScreen(dev, BLACK);
+		LCD_DrawString(dev, 75, 80, "ACCESO", &Font24, YELLOW);
+		LCD_DrawString(dev, 55, 120, "REVOCADO", &Font24, YELLOW);
+		break;
+	case UI_SCREEN_NO_RESPONSE:
+		lcdFillScreen(dev, GRAY);
+		LCD_DrawString(dev, 95, 80, "SIN", &Font24, BLACK);
+		LCD_DrawString(dev, 45, 120, "RESPUESTA", &Font24, BLACK);
+		break;
+	case UI_SCREEN_MESSAGE:
+		// Renglones cada 40px, centrados alrededor de las filas 80-120
+		lcdFillScreen(dev, BLUE);
+		for (int i = 0; i < message_count; i++) {
+			uint16_t x = (240 - strlen(message_lines[i]) * Font24.width) / 2;
+			uint16_t y = 100 - (message_count - 1) * 20 + i * 40;
+			LCD_DrawString(dev, x, y, message_lines[i], &Font24, WHITE);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+void ui_draw_screen(TFT_t * dev, ui_screen_t screen)
+{
+	ui_render_screen(dev, screen);
+	current_screen = screen;
+	lcdDrawFinish(dev);
+}
+
+ui_screen_t ui_current_screen(void)
+{
+	return current_screen;
+}
+
+bool ui_set_status(bool wifi, bool mqtt)
+{
+	bool changed = (wifi != status_wifi) || (mqtt != status_mqtt);
+	status_wifi = wifi;
+	status_mqtt = mqtt;
+	return changed;
+}
+
+void ui_set_message(const char *text)
+{
+	size_t len = strnlen(text, UI_MESSAGE_MAX);
+	size_t pos = 0;
+	message_count = 0;
+	while (pos < len && message_count < UI_MESSAGE_LINES) {
+		while (pos < len && text[pos] == ' ') pos++;
+		size_t end = pos;
+		size_t cut = 0;
+		while (end < len && end - pos < UI_MESSAGE_COLS && text[end] != '\n') {
+			if (text[end] == ' ') cut = end;
+			end++;
+		}
+		// Si el renglón se llenó a mitad de una palabra, se corta en el último espacio
+		if (end < len && text[end] != ' ' && text[end] != '\n' && cut > pos) end = cut;
+		if (end > pos) {
+			memcpy(message_lines[message_count], text + pos, end - pos);
+			message_lines[message_count][end - pos] = '\0';
+			message_count++;
+		}
+		pos = (end < len && text[end] == '\n') ? end + 1 : end;
+	}
+}
+
+void ui_draw_status(TFT_t * dev)
+{
+	if (current_screen != UI_SCREEN_WELCOME) return;
+	// Se borra el ícono anterior porque los sprites no pintan el fondo
+	lcdDrawFillRect(dev, UI_WIFI_X, UI_STATUS_Y, UI_WIFI_X + UI_ICON_SIZE - 1, UI_STATUS_Y + UI_ICON_SIZE - 1, ORANGE);
+	lcdDrawFillRect(dev, UI_MQTT_X, UI_STATUS_Y, UI_MQTT_X + UI_ICON_SIZE - 1, UI_STATUS_Y + UI_ICON_SIZE - 1, ORANGE);
+	ui_draw_status_icons(dev);
+	lcdDrawFinishRect(dev, UI_WIFI_X, UI_STATUS_Y, UI_WIFI_X + UI_ICON_SIZE - 1, UI_STATUS_Y + UI_ICON_SIZE - 1);
+	lcdDrawFinishRect(dev, UI_MQTT_X, UI_STATUS_Y, UI_MQTT_X + UI_ICON_SIZE - 1, UI_STATUS_Y + UI_ICON_SIZE - 1);
+}
+
+const char *ui_screen_name(ui_screen_t screen)
+{
+	if (screen >= UI_SCREEN_MAX) return "unknown";
+	return screen_names[screen];
+}
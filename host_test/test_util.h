@@ -0,0 +1,37 @@
+/*
+ * Helpers shared by the host tests of every component (host_test in each
+ * component directory).
+ */
+#ifndef HOST_TEST_UTIL_H_
+#define HOST_TEST_UTIL_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+static int failures __attribute__((unused));
+
+#define CHECK(cond, ...) do { \
+		if (!(cond)) { \
+			printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+			printf(__VA_ARGS__); \
+			printf("\n"); \
+			failures++; \
+		} \
+	} while (0)
+
+// xorshift32: same sequence on every host for a given seed
+static inline uint32_t rng_next(uint32_t *state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+static inline uint32_t rng_range(uint32_t *state, uint32_t n)
+{
+	return rng_next(state) % n;
+}
+
+#endif /* HOST_TEST_UTIL_H_ */
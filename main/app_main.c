@@ -2,9 +2,18 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
 #include "esp_wifi.h"
 #include "esp_system.h"
+#include "esp_attr.h"
+#include "esp_rom_crc.h"
+#include "esp_random.h"
 #include "nvs_flash.h"
+#include "esp_netif_sntp.h"
 #include "esp_event.h"
 #include "esp_netif.h"
 #include "protocol_examples_common.h"
@@ -23,6 +32,12 @@
 
 // Includes para el teclado matricial
 #include "keyboard.h"
+#include "code_entry.h"
+#include "cred_cache.h"
+#include "cred_cache_nvs.h"
+#include "cred_index_partition.h"
+#include "inflight.h"
+#include "access_msg.h"
 
 // Includes para el rc522
 #include <inttypes.h>
@@ -31,122 +46,1731 @@
 // Includes para el LCD
 #include "st7789.h"
 #include "fontx.h"
+#include "ui.h"
 
 // Includes para el Servo
-#include "driver/mcpwm.h"
-#include "soc/mcpwm_periph.h"
+#include "actuator.h"
+
+// Includes para la animación
+#include "esp_timer.h"
+#if CONFIG_LCD_PROFILE
+#include "esp_cpu.h"
+#endif
 
 static esp_mqtt_client_handle_t client = NULL; // Variable global para almacenar el cliente MQTT
 
-static const char *TAG = "mqtt-logs";
-static const char *TAG1 = "rc522-logs";
-static rc522_handle_t scanner;
+static const char *TAG = "mqtt-logs";
+static const char *TAG1 = "rc522-logs";
+static rc522_handle_t scanner;
+
+#define DEVICE_ID "24001" // Cambia este ID en cada dispositivo
+
+// Variable global para almacenar el código de la tarjeta
+uint64_t codigo_tarjeta = 0;
+
+TFT_t dev;
+static SemaphoreHandle_t lcd_mutex = NULL; // Serializa el acceso al LCD entre tareas y el timer de animación
+
+// Barra de progreso mostrada mientras el cofre está abierto
+#define ANIM_FRAME_MS 50 // Periodo de refresco de la animación (20 fps)
+#define ANIM_BAR_X1 20
+#define ANIM_BAR_Y1 180
+#define ANIM_BAR_X2 219
+#define ANIM_BAR_Y2 191
+#define ANIM_BAR_WIDTH (ANIM_BAR_X2 - ANIM_BAR_X1 + 1)
+
+typedef struct
+{
+    esp_timer_handle_t timer;
+    bool active;
+    int64_t start_us;    // Instante de inicio de la animación
+    int64_t open_us;     // Duración de la apertura (trayectoria del servo)
+    int64_t hold_us;     // Tiempo que el cofre permanece abierto
+    uint16_t drawn;      // Columnas de la barra actualmente pintadas
+    uint16_t color;      // Color de la barra
+    uint16_t background; // Color de fondo sobre el que se dibuja la barra
+} door_anim_t;
+
+static door_anim_t door_anim;
+
+// Gestor de energía del LCD
+#define LCD_POWER_POLL_MS 1000 // Periodo de evaluación de la inactividad
+static esp_timer_handle_t lcd_power_timer;
+
+//------------------------------------------estado para arranque en caliente-------------------------------
+// Se guarda en memoria RTC lenta, que sobrevive a reinicios por software,
+// panic y watchdog (no a un corte de alimentación).
+#define BOOT_STATE_MAGIC 0x53584143 // "CAXS"
+#define DOOR_MAX 4                  // Puertas que caben en boot_state (CONFIG_DOOR_COUNT como máximo)
+#define DOOR_POSITION_UNKNOWN 0xFF  // Sin posición guardada: la cerradura arranca cerrada
+
+typedef enum
+{
+    DOOR_CLOSED = 0,
+    DOOR_OPENING,
+    DOOR_OPEN,
+    DOOR_CLOSING,
+} door_state_t;
+
+typedef struct
+{
+    uint32_t magic;
+    uint8_t screen;      // Última pantalla dibujada (ui_screen_t)
+    uint8_t door[DOOR_MAX];          // door_state_t de cada puerta
+    uint8_t door_position[DOOR_MAX]; // Último ángulo del servo o 0/1 del relé
+    char broker_ip[16];  // Última dirección IPv4 resuelta del broker ("" si no hay)
+    uint32_t crc;
+} boot_state_t;
+
+static RTC_NOINIT_ATTR boot_state_t boot_state;
+static bool warm_boot = false;     // Se saltea el splash
+static bool broker_cached = false; // El cliente MQTT arrancó con la IP guardada
+
+static uint32_t boot_state_crc(void)
+{
+    return esp_rom_crc32_le(0, (const uint8_t *)&boot_state, offsetof(boot_state_t, crc));
+}
+
+static void boot_state_save(void)
+{
+    boot_state.crc = boot_state_crc();
+}
+
+// Valida el estado guardado y decide si el arranque es en caliente
+static void boot_state_load(void)
+{
+    esp_reset_reason_t reason = esp_reset_reason();
+    bool valid = boot_state.magic == BOOT_STATE_MAGIC && boot_state.crc == boot_state_crc();
+
+    if (!valid)
+    {
+        memset(&boot_state, 0, sizeof(boot_state));
+        boot_state.magic = BOOT_STATE_MAGIC;
+        boot_state.screen = UI_SCREEN_MAX;
+        for (int i = 0; i < DOOR_MAX; i++)
+        {
+            boot_state.door[i] = DOOR_CLOSED;
+            boot_state.door_position[i] = DOOR_POSITION_UNKNOWN;
+        }
+        boot_state_save();
+    }
+    boot_state.broker_ip[sizeof(boot_state.broker_ip) - 1] = '\0';
+
+    switch (reason)
+    {
+    case ESP_RST_SW:
+    case ESP_RST_PANIC:
+    case ESP_RST_INT_WDT:
+    case ESP_RST_TASK_WDT:
+    case ESP_RST_WDT:
+        warm_boot = valid;
+        break;
+    default:
+        warm_boot = false;
+        break;
+    }
+    ESP_LOGI(TAG, "[APP] Reinicio %d, arranque %s (pantalla %d, puerta 0 %d, broker \"%s\")", reason,
+             warm_boot ? "en caliente" : "en frío", boot_state.screen, boot_state.door[0], boot_state.broker_ip);
+}
+
+//------------------------------------------pines-------------------------------
+// Cada GPIO tiene un solo dueño: el LCD, el lector, las cerraduras y los
+// teclados reservan los suyos al crearse, en el arranque, y un pin repetido
+// en la configuración se rechaza en lugar de quedar con dos drivers.
+static uint64_t gpio_claimed = 0;
+
+static esp_err_t gpio_claim(int gpio, const char *owner)
+{
+    if (gpio < 0)
+        return ESP_OK; // Sin conectar
+    if (gpio_claimed & (1ULL << gpio))
+    {
+        ESP_LOGE(TAG, "GPIO %d (%s) ya está en uso", gpio, owner);
+        return ESP_ERR_INVALID_STATE;
+    }
+    gpio_claimed |= 1ULL << gpio;
+    return ESP_OK;
+}
+
+//------------------------------------------cerraduras de las puertas-------------------------------
+// Registro de puertas indexado por número de puerta. Cada una tiene su
+// cerradura (servo con perfil trapezoidal o relé, componente actuator), su
+// estado en boot_state y su timer de cierre; se mueven en paralelo porque
+// abrir y cerrar no bloquean.
+#if CONFIG_DOOR_COUNT > DOOR_MAX
+#error "CONFIG_DOOR_COUNT supera DOOR_MAX"
+#endif
+
+typedef struct
+{
+    uint8_t id;
+    actuator_handle_t lock;
+    esp_timer_handle_t relock_timer;
+    // Hora de vencimiento del timer de cierre: un aviso encolado antes de
+    // reprogramarlo llega antes de tiempo y se descarta
+    int64_t relock_at;
+    uint32_t hold_ms; // Tiempo abierta de la última apertura (el backend lo puede cambiar)
+} door_t;
+
+static door_t doors[CONFIG_DOOR_COUNT];
+
+static void door_set_state(door_t *door, door_state_t state)
+{
+    boot_state.door[door->id] = state;
+    boot_state_save();
+}
+
+static void door_save_position(door_t *door)
+{
+    boot_state.door_position[door->id] = (uint8_t)lroundf(actuator_get_position(door->lock));
+    boot_state_save();
+}
+
+static void doors_create(void)
+{
+    const char *specs[] = {
+        CONFIG_DOOR0_ACTUATOR,
+#if CONFIG_DOOR_COUNT >= 2
+        CONFIG_DOOR1_ACTUATOR,
+#endif
+#if CONFIG_DOOR_COUNT >= 3
+        CONFIG_DOOR2_ACTUATOR,
+#endif
+#if CONFIG_DOOR_COUNT >= 4
+        CONFIG_DOOR3_ACTUATOR,
+#endif
+    };
+    const servo_config_t servo = {
+        .frequency = 50, // Frecuencia de 50 Hz para servomotores
+        .min_us = CONFIG_SERVO_MIN_US,
+        .max_us = CONFIG_SERVO_MAX_US,
+        .max_speed = CONFIG_SERVO_MAX_SPEED,
+        .acceleration = CONFIG_SERVO_ACCELERATION,
+    };
+
+    for (int i = 0; i < CONFIG_DOOR_COUNT; i++)
+    {
+        actuator_config_t config;
+        esp_err_t err = actuator_config_from_string(&config, specs[i]);
+        if (err != ESP_OK)
+            ESP_LOGE(TAG, "Puerta %d: cerradura \"%s\" no válida", i, specs[i]);
+        ESP_ERROR_CHECK(err);
+        ESP_ERROR_CHECK(gpio_claim(config.gpio, "cerradura"));
+        // Desde la última posición conocida sigue un cierre tras un reinicio
+        float position = config.closed_angle;
+        if (config.type == ACTUATOR_SERVO && boot_state.door_position[i] != DOOR_POSITION_UNKNOWN)
+            position = boot_state.door_position[i];
+        doors[i].id = i;
+        doors[i].relock_at = INT64_MAX;
+        ESP_ERROR_CHECK(actuator_create(&config, &servo, position, &doors[i].lock));
+        ESP_LOGI(TAG, "Puerta %d: %s en GPIO %d", i, config.type == ACTUATOR_SERVO ? "servo" : "relé", config.gpio);
+    }
+}
+
+//------------------------------------------funciones para el LCD-------------------------------
+// La pone display_boot_task() cuando termina la inicialización; si no
+// termina, la pantalla no responde y no se le manda nada más
+static bool lcd_ready = false;
+
+// Toma el bloqueo del LCD; con el profiler activo registra el tiempo de espera
+static void lcd_lock(void)
+{
+#if CONFIG_LCD_PROFILE
+    if (xSemaphoreTake(lcd_mutex, 0) == pdTRUE)
+        return;
+    uint32_t start = esp_cpu_get_cycle_count();
+    xSemaphoreTake(lcd_mutex, portMAX_DELAY);
+    lcdProfileLockWait(esp_cpu_get_cycle_count() - start);
+#else
+    xSemaphoreTake(lcd_mutex, portMAX_DELAY);
+#endif
+}
+
+static void lcd_unlock(void)
+{
+    xSemaphoreGive(lcd_mutex);
+}
+
+// Toma el bloqueo para dibujar; false (sin bloqueo) si el LCD no arrancó
+static bool lcd_lock_ready(void)
+{
+    lcd_lock();
+    if (lcd_ready)
+        return true;
+    lcd_unlock();
+    return false;
+}
+
+// Dibuja una pantalla y la recuerda para el próximo arranque en caliente
+static void lcd_show_screen(ui_screen_t screen)
+{
+    if (!lcd_lock_ready())
+        return;
+    ui_draw_screen(&dev, screen);
+    boot_state.screen = screen;
+    boot_state_save();
+    lcd_unlock();
+}
+
+#if CONFIG_LCD_PROFILE
+static esp_timer_handle_t lcd_profile_timer;
+
+// Publica los contadores del profiler de dibujo. Corre en una tarea propia:
+// esp_mqtt_client_enqueue() puede esperar el lock del cliente.
+static void lcd_profile_publish(void)
+{
+    static char json[1024];
+    lcd_profile_t profile;
+
+    xSemaphoreTake(lcd_mutex, portMAX_DELAY);
+    lcdProfileSnapshot(&profile, true);
+    xSemaphoreGive(lcd_mutex);
+
+    int len = snprintf(json, sizeof(json),
+                       "{\"device_id\":\"%s\",\"period_s\":%d,\"transactions\":%" PRIu32 ",\"bytes\":%" PRIu64
+                       ",\"spi_cycles\":%" PRIu64 ",\"lock_waits\":%" PRIu32 ",\"lock_cycles\":%" PRIu64 ",\"api\":{",
+                       DEVICE_ID, CONFIG_LCD_PROFILE_PERIOD, profile.transactions, profile.bytes,
+                       profile.spi_cycles, profile.lock_waits, profile.lock_cycles);
+    bool first = true;
+    for (int i = 0; i < LCD_API_MAX && len < sizeof(json); i++)
+    {
+        lcd_api_profile_t *api = &profile.api[i];
+        if (api->calls == 0)
+            continue;
+        // [llamadas, ciclos, transacciones, bytes, ciclos SPI]
+        len += snprintf(json + len, sizeof(json) - len, "%s\"%s\":[%" PRIu32 ",%" PRIu64 ",%" PRIu32 ",%" PRIu32 ",%" PRIu64 "]",
+                        first ? "" : ",", lcdProfileApiName(i), api->calls, api->cycles, api->transactions, api->bytes, api->spi_cycles);
+        first = false;
+    }
+    if (len < sizeof(json))
+        len += snprintf(json + len, sizeof(json) - len, "}}");
+    if (len >= sizeof(json))
+    {
+        ESP_LOGW(TAG, "Snapshot del profiler truncado");
+        return;
+    }
+
+    ESP_LOGI(TAG, "LCD profile: %s", json);
+    if (client != NULL)
+        esp_mqtt_client_enqueue(client, "/cntrlaxs/diag/lcd", json, len, 0, 0, true);
+}
+
+static void lcd_profile_task(void *pvParameters)
+{
+    while (1)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        lcd_profile_publish();
+    }
+}
+
+// Callback del timer: solo despierta a la tarea
+static void lcd_profile_tick(void *arg)
+{
+    xTaskNotifyGive((TaskHandle_t)arg);
+}
+
+static void lcd_profile_init(void)
+{
+    TaskHandle_t task;
+    if (xTaskCreate(&lcd_profile_task, "lcd_profile", 3072, NULL, tskIDLE_PRIORITY + 1, &task) != pdPASS)
+    {
+        ESP_LOGE(TAG, "No se pudo crear la tarea del profiler del LCD");
+        return;
+    }
+
+    const esp_timer_create_args_t args = {
+        .callback = lcd_profile_tick,
+        .arg = task,
+        .name = "lcd_profile",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&args, &lcd_profile_timer));
+    ESP_ERROR_CHECK(esp_timer_start_periodic(lcd_profile_timer, CONFIG_LCD_PROFILE_PERIOD * 1000000LL));
+}
+#endif
+
+//------------------------------------------funciones para animación-------------------------------
+// Dibuja solo las columnas de la barra que cambiaron desde el último frame
+static void door_anim_draw(uint16_t target)
+{
+    uint16_t x1, x2, color;
+
+    if (target == door_anim.drawn)
+        return;
+    if (target > door_anim.drawn)
+    {
+        x1 = ANIM_BAR_X1 + door_anim.drawn;
+        x2 = ANIM_BAR_X1 + target - 1;
+        color = door_anim.color;
+    }
+    else
+    {
+        x1 = ANIM_BAR_X1 + target;
+        x2 = ANIM_BAR_X1 + door_anim.drawn - 1;
+        color = door_anim.background;
+    }
+    lcdDrawFillRect(&dev, x1, ANIM_BAR_Y1, x2, ANIM_BAR_Y2, color);
+    lcdDrawFinishRect(&dev, x1, ANIM_BAR_Y1, x2, ANIM_BAR_Y2);
+    door_anim.drawn = target;
+}
+
+// Callback del timer: la barra crece mientras el servo abre y luego decrece
+// como cuenta regresiva hasta el cierre
+static void door_anim_tick(void *arg)
+{
+    // Nunca bloquear: si el LCD está ocupado se saltea este frame
+    if (xSemaphoreTake(lcd_mutex, 0) != pdTRUE)
+        return;
+
+    if (door_anim.active && lcd_ready)
+    {
+        int64_t elapsed = esp_timer_get_time() - door_anim.start_us;
+        uint16_t target;
+
+        if (elapsed < door_anim.open_us)
+        {
+            target = (uint16_t)(ANIM_BAR_WIDTH * elapsed / door_anim.open_us);
+        }
+        else if (elapsed < door_anim.open_us + door_anim.hold_us)
+        {
+            int64_t remaining = door_anim.open_us + door_anim.hold_us - elapsed;
+            target = (uint16_t)(ANIM_BAR_WIDTH * remaining / door_anim.hold_us);
+        }
+        else
+        {
+            target = 0;
+        }
+        door_anim_draw(target);
+    }
+    xSemaphoreGive(lcd_mutex);
+}
+
+static void door_anim_init(void)
+{
+    const esp_timer_create_args_t args = {
+        .callback = door_anim_tick,
+        .name = "door_anim",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&args, &door_anim.timer));
+}
+
+// Inicia la animación; se debe llamar con el fondo de la pantalla ya dibujado
+static void door_anim_start(uint32_t open_ms, uint32_t hold_ms, uint16_t color, uint16_t background)
+{
+    lcd_lock();
+    door_anim.start_us = esp_timer_get_time();
+    door_anim.open_us = (open_ms > 0 ? open_ms : 1) * 1000LL;
+    door_anim.hold_us = (hold_ms > 0 ? hold_ms : 1) * 1000LL;
+    door_anim.drawn = 0;
+    door_anim.color = color;
+    door_anim.background = background;
+    door_anim.active = true;
+    lcd_unlock();
+    esp_timer_start_periodic(door_anim.timer, ANIM_FRAME_MS * 1000);
+}
+
+static void door_anim_stop(void)
+{
+    esp_timer_stop(door_anim.timer);
+    lcd_lock();
+    door_anim.active = false;
+    lcd_unlock();
+}
+
+//------------------------------------------funciones para energía del LCD-------------------------------
+// Baja el LCD a modo parcial/idle o sleep tras la inactividad configurada.
+// Corre en una tarea propia: entrar y salir de sleep espera hasta 120 ms.
+static void lcd_power_task(void *pvParameters)
+{
+    while (1)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (!lcd_lock_ready())
+            continue;
+        if (door_anim.active)
+            lcdPowerActivity(&dev); // No ahorrar energía con el cofre abierto
+        else
+            lcdPowerUpdate(&dev);
+        lcd_unlock();
+    }
+}
+
+// Callback del timer: solo despierta a la tarea
+static void lcd_power_tick(void *arg)
+{
+    xTaskNotifyGive((TaskHandle_t)arg);
+}
+
+static void lcd_power_init(void)
+{
+    TaskHandle_t task;
+    // En modo parcial solo queda visible la franja de "Bienvenido!"
+    lcdPowerConfig(&dev, CONFIG_LCD_IDLE_TIMEOUT * 1000, CONFIG_LCD_SLEEP_TIMEOUT * 1000, UI_WELCOME_Y, UI_WELCOME_Y + UI_WELCOME_HEIGHT - 1);
+    if (xTaskCreate(&lcd_power_task, "lcd_power", 3072, NULL, tskIDLE_PRIORITY + 1, &task) != pdPASS)
+    {
+        ESP_LOGE(TAG, "No se pudo crear la tarea de energía del LCD");
+        return;
+    }
+
+    const esp_timer_create_args_t args = {
+        .callback = lcd_power_tick,
+        .arg = task,
+        .name = "lcd_power",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&args, &lcd_power_timer));
+    ESP_ERROR_CHECK(esp_timer_start_periodic(lcd_power_timer, LCD_POWER_POLL_MS * 1000));
+}
+
+// Despierta el LCD ante actividad del teclado o del lector de tarjetas
+static void lcd_wake(void)
+{
+    if (!lcd_lock_ready())
+        return;
+    lcdPowerActivity(&dev);
+    lcd_unlock();
+}
+
+//------------------------------------------funciones para captura de pantalla-------------------------------
+#define SHOT_CMD_TOPIC "/cntrlaxs/diag/cmd/" DEVICE_ID       // Comandos de diagnóstico ("screenshot", "latencia")
+#define SHOT_DATA_TOPIC "/cntrlaxs/diag/lcd/shot/" DEVICE_ID // Fragmentos de la captura
+
+#define SHOT_BAND_ROWS 16 // Filas por franja: 7.5 KB de RAM en lugar de la pantalla entera
+
+static TaskHandle_t lcd_shot_handle = NULL;
+static volatile bool lcd_shot_busy = false;
+
+// Copia en band las filas y..y+rows-1 de lo que muestra la pantalla
+static void lcd_shot_band(uint16_t *band, uint16_t y, uint16_t rows)
+{
+    lcd_lock();
+    if (dev._use_frame_buffer)
+    {
+        memcpy(band, &dev._frame_buffer[y * dev._width], rows * dev._width * sizeof(uint16_t));
+    }
+    else
+    {
+        // El panel no se puede leer por SPI: se reconstruye la franja
+        // en el buffer de la captura, sin escribir en el LCD
+        lcdFrameBufferBand(&dev, band, y, rows);
+        ui_render_screen(&dev, ui_current_screen());
+        if (door_anim.active && door_anim.drawn > 0)
+            lcdDrawFillRect(&dev, ANIM_BAR_X1, ANIM_BAR_Y1, ANIM_BAR_X1 + door_anim.drawn - 1, ANIM_BAR_Y2, door_anim.color);
+        lcdFrameBufferBand(&dev, NULL, 0, 0);
+    }
+    lcd_unlock();
+}
+
+// Espera el pedido de lcd_shot_request() y publica la captura franja a
+// franja sin superar CONFIG_LCD_SHOT_RATE. Cada franja se toma justo antes
+// de enviarla: si la pantalla cambia en medio, la captura muestra las dos.
+static void lcd_shot_task(void *pvParameter)
+{
+    static uint8_t chunk[CONFIG_LCD_SHOT_CHUNK];
+    uint16_t shot_id = 0;
+
+    while (1)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        lcd_shot_busy = true;
+        size_t size = dev._width * SHOT_BAND_ROWS * sizeof(uint16_t);
+        uint16_t *band = malloc(size);
+        if (band == NULL)
+        {
+            ESP_LOGE(TAG, "Sin memoria para la captura (%zu bytes)", size);
+            lcd_shot_busy = false;
+            continue;
+        }
+
+        lcd_shot_t shot;
+        size_t len;
+        uint32_t bytes = 0;
+        bool sending = true;
+        shot_id++;
+        lcdShotBegin(&shot, NULL, dev._width, dev._height, shot_id);
+        for (uint16_t y = 0; sending && y < dev._height; y += SHOT_BAND_ROWS)
+        {
+            uint16_t rows = (dev._height - y < SHOT_BAND_ROWS) ? dev._height - y : SHOT_BAND_ROWS;
+            lcd_shot_band(band, y, rows);
+            lcdShotBand(&shot, band, y, rows);
+            while ((len = lcdShotNextChunk(&shot, chunk, sizeof(chunk))) > 0)
+            {
+                // enqueue copia el fragmento al outbox y no bloquea a la tarea MQTT
+                if (client == NULL || esp_mqtt_client_enqueue(client, SHOT_DATA_TOPIC, (const char *)chunk, len, 0, 0, true) < 0)
+                {
+                    ESP_LOGW(TAG, "Captura %u interrumpida en el fragmento %u", shot_id, shot.seq - 1);
+                    sending = false;
+                    break;
+                }
+                bytes += len;
+                vTaskDelay(pdMS_TO_TICKS(len * 1000 / CONFIG_LCD_SHOT_RATE) + 1);
+            }
+        }
+        ESP_LOGI(TAG, "Captura %u enviada: %u fragmentos, %" PRIu32 " bytes", shot_id, shot.seq, bytes);
+        free(band);
+        lcd_shot_busy = false;
+    }
+}
+
+static void lcd_shot_init(void)
+{
+    if (xTaskCreate(&lcd_shot_task, "lcd_shot", 3072, NULL, tskIDLE_PRIORITY + 1, &lcd_shot_handle) != pdPASS)
+    {
+        ESP_LOGE(TAG, "No se pudo crear la tarea de captura");
+        lcd_shot_handle = NULL;
+    }
+}
+
+// Corre en la tarea de MQTT: solo avisa a la tarea de la captura
+static void lcd_shot_request(void)
+{
+    if (lcd_shot_handle == NULL)
+        return;
+    if (lcd_shot_busy)
+    {
+        ESP_LOGW(TAG, "Ya hay una captura en curso");
+        return;
+    }
+    xTaskNotifyGive(lcd_shot_handle);
+}
+
+//------------------------------------------funciones para controlar acceso-------------------------------
+// access_handler() corre en la tarea de MQTT: solo traduce la respuesta y la
+// encola. La tarea de las puertas ordena los movimientos de las cerraduras,
+// dibuja las pantallas y cierra cada puerta con su timer, sin bloquear a nadie.
+//
+// La respuesta es "<código>" (puerta 0) o "<puerta>:<código>". Con la puerta
+// abierta o en movimiento:
+//  - 101 abriendo o abierta: extiende la espera hasta el cierre.
+//  - 101 cerrando: se interrumpe el cierre y vuelve a abrir desde donde está.
+//  - 102: cierra ya (abierta o abriendo).
+//  - 111 en una puerta con relé: igual que 101. Con servo y 100: solo se
+//    registran; la pantalla sigue con la cuenta regresiva.
+// Con CONFIG_CRED_CACHE_POLICY_OPTIMISTIC, la respuesta a una apertura local
+// la confirma o la revoca (ver access_confirm()). Un pedido sin respuesta en
+// CONFIG_INFLIGHT_TIMEOUT_MS muestra "SIN RESPUESTA" (ver "pedidos en vuelo").
+// Las respuestas binarias pueden traer el tiempo abierta (hasta
+// DOOR_HOLD_MAX_MS) y un texto que reemplaza a la pantalla de la respuesta.
+//
+// El LCD es uno solo: muestra la cuenta regresiva de la última puerta que se
+// abrió y, cuando se cierra, la de otra que siga abierta.
+#define DOOR_HOLD_MS 15000    // Tiempo abierta antes del cierre automático
+#define DOOR_HOLD_MAX_MS 300000 // Tope del tiempo abierta que puede pedir una respuesta binaria
+#define DOOR_SAVE_MS 100      // Periodo con que se guarda la posición en boot_state durante un movimiento
+#define DOOR_MESSAGE_MS 3000  // Tiempo en pantalla de "ACCESO CONCEDIDO" / "NO AUTORIZADO"
+#define DOOR_QUEUE_LEN 8
+#define DOOR_NONE -1
+
+typedef enum
+{
+    DOOR_CMD_GRANTED = 0, // Respuesta 111
+    DOOR_CMD_OPEN,        // Respuesta 101
+    DOOR_CMD_DENIED,      // Respuesta 100
+    DOOR_CMD_CLOSE,       // Respuesta 102
+    DOOR_CMD_RELOCK,      // Venció el timer de cierre
+    DOOR_CMD_MESSAGE_END, // Venció el timer de la pantalla de respuesta
+    DOOR_CMD_ARRIVED,     // La cerradura terminó el movimiento
+    DOOR_CMD_REVOKE,      // El backend contradijo una apertura local
+    DOOR_CMD_TIMEOUT,     // Venció el plazo de un pedido al backend
+    DOOR_CMD_RESTORE,     // Quedó abierta o en movimiento antes de un reinicio
+} door_cmd_type_t;
+
+typedef struct
+{
+    door_cmd_type_t type;
+    uint8_t door;
+    uint32_t hold_ms;              // Tiempo abierta pedido por el backend, 0 = DOOR_HOLD_MS
+    char text[UI_MESSAGE_MAX + 1]; // Texto del backend en lugar de la pantalla de la respuesta
+} door_cmd_t;
+
+static QueueHandle_t door_queue = NULL;
+static esp_timer_handle_t door_message_timer = NULL;
+static int64_t door_message_at = INT64_MAX;
+static int lcd_door = DOOR_NONE; // Puerta cuya cuenta regresiva está en pantalla
+
+static void door_post(door_cmd_type_t type, uint8_t door)
+{
+    door_cmd_t cmd = {
+        .type = type,
+        .door = door,
+    };
+    xQueueSend(door_queue, &cmd, 0);
+}
+
+static void door_relock_cb(void *arg)
+{
+    door_post(DOOR_CMD_RELOCK, ((door_t *)arg)->id);
+}
+
+static void door_message_cb(void *arg)
+{
+    door_post(DOOR_CMD_MESSAGE_END, 0);
+}
+
+// Corre en la tarea de esp_timer o en la de las puertas: solo avisa
+static void door_lock_done(actuator_handle_t lock, void *arg)
+{
+    door_post(DOOR_CMD_ARRIVED, ((door_t *)arg)->id);
+}
+
+static void door_timer_restart(esp_timer_handle_t timer, int64_t *at, uint32_t ms)
+{
+    esp_timer_stop(timer);
+    *at = esp_timer_get_time() + ms * 1000LL;
+    esp_timer_start_once(timer, ms * 1000ULL);
+}
+
+static void door_timer_cancel(esp_timer_handle_t timer, int64_t *at)
+{
+    esp_timer_stop(timer);
+    *at = INT64_MAX;
+}
+
+static bool door_timer_expired(int64_t *at)
+{
+    if (esp_timer_get_time() < *at)
+        return false;
+    *at = INT64_MAX;
+    return true;
+}
+
+static void door_move(door_t *door, bool open)
+{
+    door_set_state(door, open ? DOOR_OPENING : DOOR_CLOSING);
+    esp_err_t err = open ? actuator_open(door->lock, door_lock_done, door) : actuator_close(door->lock, door_lock_done, door);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG1, "Puerta %d: no se pudo mover la cerradura (%s)", door->id, esp_err_to_name(err));
+    }
+}
+
+// La puerta toma el LCD con su cuenta regresiva
+static void door_show(door_t *door, ui_screen_t screen, uint32_t open_ms, uint32_t hold_ms)
+{
+    lcd_door = door->id;
+    lcd_show_screen(screen);
+    door_anim_start(open_ms, hold_ms, WHITE, BLUE);
+}
+
+static void door_open(door_t *door, ui_screen_t screen)
+{
+    door_move(door, true);
+    door_show(door, screen, actuator_remaining_ms(door->lock), door->hold_ms);
+}
+
+static void door_close(door_t *door)
+{
+    door_timer_cancel(door->relock_timer, &door->relock_at);
+    door_move(door, false);
+}
+
+// Al cerrarse la puerta del LCD, pasa a otra abierta o vuelve la bienvenida
+static void door_release_lcd(door_t *door)
+{
+    if (lcd_door != door->id)
+        return;
+    door_anim_stop();
+    lcd_door = DOOR_NONE;
+    for (int i = 0; i < CONFIG_DOOR_COUNT; i++)
+    {
+        if (boot_state.door[i] == DOOR_OPEN)
+        {
+            int64_t hold = (doors[i].relock_at - esp_timer_get_time()) / 1000;
+            door_show(&doors[i], UI_SCREEN_OPEN, 0, hold > 0 ? hold : 0);
+            return;
+        }
+        if (boot_state.door[i] == DOOR_OPENING)
+        {
+            door_show(&doors[i], UI_SCREEN_OPEN, actuator_remaining_ms(doors[i].lock), doors[i].hold_ms);
+            return;
+        }
+    }
+    lcd_show_screen(UI_SCREEN_WELCOME);
+}
+
+// Con texto del backend, la pantalla de la respuesta es ese texto
+static ui_screen_t door_text_screen(ui_screen_t screen, const char *text)
+{
+    if (text[0] == '\0')
+        return screen;
+    lcd_lock();
+    ui_set_message(text);
+    lcd_unlock();
+    return UI_SCREEN_MESSAGE;
+}
+
+static void door_message(ui_screen_t screen, const char *text)
+{
+    if (lcd_door != DOOR_NONE)
+        return; // La cuenta regresiva de una puerta tiene prioridad
+    lcd_show_screen(door_text_screen(screen, text));
+    door_timer_restart(door_message_timer, &door_message_at, DOOR_MESSAGE_MS);
+}
+
+// Al llegar la cerradura la puerta pasa a abierta o cerrada
+static void door_arrived(door_t *door)
+{
+    door_save_position(door);
+    if (actuator_is_moving(door->lock))
+        return; // Aviso de un movimiento que ya fue reemplazado
+
+    if (boot_state.door[door->id] == DOOR_OPENING)
+    {
+        door_set_state(door, DOOR_OPEN);
+        door_timer_restart(door->relock_timer, &door->relock_at, door->hold_ms);
+    }
+    else if (boot_state.door[door->id] == DOOR_CLOSING)
+    {
+        door_set_state(door, DOOR_CLOSED);
+        door_release_lcd(door);
+    }
+}
+
+// Tiempo abierta de la respuesta: el de siempre o el que pidió el backend, con tope
+static uint32_t door_hold_ms(const door_cmd_t *cmd)
+{
+    if (cmd->hold_ms == 0)
+        return DOOR_HOLD_MS;
+    return cmd->hold_ms < DOOR_HOLD_MAX_MS ? cmd->hold_ms : DOOR_HOLD_MAX_MS;
+}
+
+static void door_grant(door_t *door, ui_screen_t screen, const door_cmd_t *cmd)
+{
+    lcd_wake();
+    door_timer_cancel(door_message_timer, &door_message_at);
+    switch (boot_state.door[door->id])
+    {
+    case DOOR_CLOSED:
+    case DOOR_CLOSING:
+        ESP_LOGI(TAG1, "Puerta %d %s", door->id, boot_state.door[door->id] == DOOR_CLOSED ? "abierta" : "reabierta durante el cierre");
+        door->hold_ms = door_hold_ms(cmd);
+        door_open(door, door_text_screen(screen, cmd->text));
+        break;
+    case DOOR_OPENING:
+        ESP_LOGI(TAG1, "Puerta %d ya abriéndose", door->id);
+        break;
+    case DOOR_OPEN:
+        // Se reinicia la cuenta regresiva completa
+        door->hold_ms = door_hold_ms(cmd);
+        ESP_LOGI(TAG1, "Puerta %d: apertura extendida %" PRIu32 " ms", door->id, door->hold_ms);
+        door_timer_restart(door->relock_timer, &door->relock_at, door->hold_ms);
+        door_show(door, door_text_screen(screen, cmd->text), 0, door->hold_ms);
+        break;
+    }
+}
+
+static void door_handle(const door_cmd_t *cmd)
+{
+    door_t *door = &doors[cmd->door];
+    door_state_t state = boot_state.door[cmd->door];
+
+    switch (cmd->type)
+    {
+    case DOOR_CMD_GRANTED:
+        ESP_LOGI(TAG1, "Acceso permitido (puerta %d)", door->id);
+        if (actuator_get_type(door->lock) == ACTUATOR_RELAY)
+        {
+            door_grant(door, UI_SCREEN_GRANTED, cmd);
+            break;
+        }
+        lcd_wake();
+        door_message(UI_SCREEN_GRANTED, cmd->text);
+        break;
+    case DOOR_CMD_DENIED:
+        ESP_LOGI(TAG1, "No autorizado (puerta %d)", door->id);
+        lcd_wake();
+        door_message(UI_SCREEN_DENIED, cmd->text);
+        break;
+    case DOOR_CMD_OPEN:
+        door_grant(door, UI_SCREEN_OPEN, cmd);
+        break;
+    case DOOR_CMD_CLOSE:
+        if (state == DOOR_OPEN || state == DOOR_OPENING)
+        {
+            ESP_LOGI(TAG1, "Puerta %d: cierre inmediato", door->id);
+            lcd_wake();
+            if (lcd_door == door->id)
+            {
+                door_anim_stop();
+                lcd_show_screen(UI_SCREEN_OPEN); // Borra la barra de la cuenta regresiva
+            }
+            door_close(door);
+        }
+        break;
+    case DOOR_CMD_RELOCK:
+        if (door_timer_expired(&door->relock_at) && state == DOOR_OPEN)
+        {
+            door_close(door);
+        }
+        break;
+    case DOOR_CMD_MESSAGE_END:
+        if (door_timer_expired(&door_message_at) && lcd_door == DOOR_NONE)
+        {
+            lcd_show_screen(UI_SCREEN_WELCOME);
+        }
+        break;
+    case DOOR_CMD_ARRIVED:
+        door_arrived(door);
+        break;
+    case DOOR_CMD_REVOKE:
+        // Se cierra en cualquier estado y la alarma reemplaza a la cuenta regresiva
+        ESP_LOGW(TAG1, "Puerta %d: apertura revocada por el backend", door->id);
+        lcd_wake();
+        if (state == DOOR_OPEN || state == DOOR_OPENING)
+            door_close(door);
+        if (lcd_door == door->id)
+        {
+            door_anim_stop();
+            lcd_door = DOOR_NONE;
+        }
+        door_message(UI_SCREEN_REVOKED, "");
+        break;
+    case DOOR_CMD_TIMEOUT:
+        ESP_LOGW(TAG1, "Puerta %d: el backend no respondió", door->id);
+        lcd_wake();
+        door_message(UI_SCREEN_NO_RESPONSE, "");
+        break;
+    case DOOR_CMD_RESTORE:
+        ESP_LOGW(TAG1, "Puerta %d en estado %d antes del reinicio, cerrando desde %d", door->id, state, boot_state.door_position[door->id]);
+        door_close(door);
+        break;
+    }
+}
+
+static void door_task(void *pvParameter)
+{
+    door_cmd_t cmd;
+    while (1)
+    {
+        // Mientras alguna cerradura se mueve se guarda su posición, por si hay un reinicio
+        bool moving = false;
+        for (int i = 0; i < CONFIG_DOOR_COUNT; i++)
+        {
+            moving |= actuator_is_moving(doors[i].lock);
+        }
+        TickType_t wait = moving ? pdMS_TO_TICKS(DOOR_SAVE_MS) : portMAX_DELAY;
+        if (xQueueReceive(door_queue, &cmd, wait) == pdTRUE)
+        {
+            door_handle(&cmd);
+        }
+        else
+        {
+            for (int i = 0; i < CONFIG_DOOR_COUNT; i++)
+            {
+                if (actuator_is_moving(doors[i].lock))
+                    door_save_position(&doors[i]);
+            }
+        }
+    }
+}
+
+static void door_init(void)
+{
+    const esp_timer_create_args_t message_args = {
+        .callback = door_message_cb,
+        .name = "door_message",
+    };
+    door_queue = xQueueCreate(DOOR_QUEUE_LEN, sizeof(door_cmd_t));
+    ESP_ERROR_CHECK(esp_timer_create(&message_args, &door_message_timer));
+    for (int i = 0; i < CONFIG_DOOR_COUNT; i++)
+    {
+        const esp_timer_create_args_t relock_args = {
+            .callback = door_relock_cb,
+            .arg = &doors[i],
+            .name = "door_relock",
+        };
+        ESP_ERROR_CHECK(esp_timer_create(&relock_args, &doors[i].relock_timer));
+        doors[i].hold_ms = DOOR_HOLD_MS;
+    }
+    xTaskCreate(&door_task, "door_task", 3072, NULL, 5, NULL);
+}
+
+// Las puertas que quedaron abiertas o en movimiento en un reinicio se
+// cierran desde la última posición conocida. El cierre lo hace la tarea de
+// las puertas, que también guarda la posición mientras se mueve.
+static void door_restore(void)
+{
+    for (int i = 0; i < CONFIG_DOOR_COUNT; i++)
+    {
+        if (boot_state.door[i] != DOOR_CLOSED)
+            door_post(DOOR_CMD_RESTORE, i);
+    }
+}
+
+// Encola la respuesta a una puerta; false si el código no existe o la cola está llena.
+// hold_ms (0 = el de siempre) y text ("" = la pantalla de siempre) llegan en
+// las respuestas binarias.
+static bool door_request(uint8_t door, int code, uint32_t hold_ms, const char *text)
+{
+    door_cmd_t cmd = {
+        .door = door,
+        .hold_ms = hold_ms,
+    };
+    snprintf(cmd.text, sizeof(cmd.text), "%s", text);
+    switch (code)
+    {
+    case 111:
+        cmd.type = DOOR_CMD_GRANTED;
+        break;
+    case 101:
+        cmd.type = DOOR_CMD_OPEN;
+        break;
+    case 100:
+        cmd.type = DOOR_CMD_DENIED;
+        break;
+    case 102:
+        cmd.type = DOOR_CMD_CLOSE;
+        break;
+    default:
+        ESP_LOGI(TAG1, "Código no reconocido");
+        return false;
+    }
+    if (xQueueSend(door_queue, &cmd, 0) != pdTRUE)
+    {
+        ESP_LOGW(TAG1, "Cola de la puerta llena, respuesta descartada");
+        return false;
+    }
+    return true;
+}
+
+// Separa "<puerta>:<código>@<pedido>"; puerta y pedido son opcionales (id 0
+// si no hay). false si la respuesta no es válida
+static bool access_parse(const char *response, int length, uint8_t *door, int *code, uint32_t *id)
+{
+    // Crear una copia de la cadena recibida para asegurarse de que esté terminada en nulo
+    char buffer[24]; // Suficiente para "<puerta>:<código>@<pedido>" y el terminador nulo
+    if (length >= sizeof(buffer))
+    {
+        ESP_LOGI(TAG1, "La longitud del dato es demasiado larga");
+        return false;
+    }
+    memcpy(buffer, response, length);
+    buffer[length] = '\0'; // Asegurarse de que la cadena esté terminada en nulo
+
+    // Con '@' el número tiene que estar completo: un sufijo roto no puede
+    // convertir la respuesta en una orden sin número
+    *id = 0;
+    char *at = strchr(buffer, '@');
+    if (at != NULL)
+    {
+        *at = '\0';
+        char *end;
+        unsigned long long n = strtoull(at + 1, &end, 10);
+        if (!isdigit((unsigned char)at[1]) || *end != '\0' || n == 0 || n > UINT32_MAX)
+        {
+            ESP_LOGW(TAG1, "Número de pedido no válido: \"%s\"", at + 1);
+            return false;
+        }
+        *id = n;
+    }
+
+    // Sin prefijo la respuesta es para la puerta 0
+    *door = 0;
+    const char *digits = buffer;
+    char *sep = strchr(buffer, ':');
+    if (sep != NULL)
+    {
+        *sep = '\0';
+        int n = atoi(buffer);
+        if (n < 0 || n >= CONFIG_DOOR_COUNT)
+        {
+            ESP_LOGW(TAG1, "Puerta %s no configurada", buffer);
+            return false;
+        }
+        *door = n;
+        digits = sep + 1;
+    }
+
+    // Convertir string a entero
+    *code = atoi(digits);
+    return true;
+}
+
+// Formato binario (ver access_msg.h): el aviso de conexión ofrece "proto":2 y
+// el backend que lo entiende contesta con un HELLO por el tópico de las
+// respuestas. Desde ahí los pedidos van en 36 bytes por ACCESS_BIN_TOPIC y
+// las respuestas pueden traer el tiempo abierta y un texto para el LCD. Sin
+// HELLO (un backend viejo) todo sigue en JSON y texto; en cada reconexión se
+// vuelve a negociar.
+#define ACCESS_BIN_TOPIC "/cntrlaxs/solicitud/bin"
+
+static uint8_t access_proto = 1; // Versión elegida por el backend; la escribe solo la tarea de MQTT
+
+// Lee una respuesta binaria; un HELLO cambia la versión y devuelve false
+static bool access_parse_binary(const char *response, int length, access_msg_response_t *msg)
+{
+    uint8_t version = access_msg_hello_version(response, length);
+    if (version != 0)
+    {
+        access_proto = (version == ACCESS_MSG_VERSION) ? ACCESS_MSG_VERSION : 1;
+        ESP_LOGI(TAG1, "El backend eligió el formato %u", access_proto);
+        return false;
+    }
+    if (!access_msg_decode_response(response, length, msg))
+    {
+        ESP_LOGW(TAG1, "Respuesta binaria de %d bytes no válida", length);
+        return false;
+    }
+    if (msg->door >= CONFIG_DOOR_COUNT)
+    {
+        ESP_LOGW(TAG1, "Puerta %u no configurada", msg->door);
+        return false;
+    }
+    return true;
+}
+
+// El teclado N atiende a la puerta N; el lector y los teclados sin puerta propia, a la 0
+static uint8_t keypad_door(uint8_t keypad)
+{
+    return keypad < CONFIG_DOOR_COUNT ? keypad : 0;
+}
+
+// Agrega al pedido JSON su número y, con más de una puerta, la puerta a la que responder
+static void door_request_json(char *json, size_t size, uint8_t keypad, uint32_t id)
+{
+    size_t len = strlen(json);
+    if (len == 0 || json[len - 1] != '}')
+        return;
+#if CONFIG_DOOR_COUNT > 1
+    snprintf(json + len - 1, size - len + 1, ",\"door\":%u,\"req\":%" PRIu32 "}", keypad_door(keypad), id);
+#else
+    snprintf(json + len - 1, size - len + 1, ",\"req\":%" PRIu32 "}", id);
+#endif
+}
+
+//------------------------------------------caché de credenciales-------------------------------
+// Hashes de tarjetas y códigos sincronizados desde el backend, con la
+// respuesta a aplicar, las puertas y el vencimiento de cada uno. Según
+// CONFIG_CRED_CACHE_POLICY_* decide sin conexión, antes que el backend o
+// siempre. La tabla vive en RAM (búsqueda en microsegundos) y una copia se
+// guarda en NVS cada vez que el backend cierra un lote con una versión nueva.
+// Debajo está el índice estático de las particiones CONFIG_CRED_INDEX_PARTITION
+// (decenas de miles de credenciales, solo lectura): se consulta cuando la
+// caché no tiene la credencial, así que la caché funciona como capa de
+// cambios. Para revocar una credencial del índice el backend manda una
+// entrada sin puertas ("+ hash 100 0 0"). El índice se reemplaza entero
+// con transferencias binarias por CRED_INDEX_TOPIC (ver cred_sync.h), que
+// se escriben en la partición que no está en uso.
+#define CRED_SYNC_TOPIC "/cntrlaxs/credenciales/" DEVICE_ID      // Lotes de sincronización
+#define CRED_SYNC_REQUEST_TOPIC "/cntrlaxs/credenciales/solicitud" // Pedido de cambios desde una versión
+#define CRED_INDEX_TOPIC "/cntrlaxs/credenciales/indice/" DEVICE_ID // Transferencias del índice
+#define CRED_INDEX_STATUS_TOPIC "/cntrlaxs/credenciales/indice/estado" // Resultado de cada transferencia
+#define CRED_TIME_VALID 1577836800                                // 2020-01-01: antes de esto no hay hora de SNTP
+#define SNTP_SERVER "pool.ntp.org"
+#define CRED_CACHE_TEST_KEY "000102030405060708090a0b0c0d0e0f" // Vector de prueba de SipHash: público
+
+static cred_entry_t cred_entries[CONFIG_CRED_CACHE_SIZE];
+static cred_cache_t cred_cache;
+static SemaphoreHandle_t cred_cache_mutex = NULL; // Lo usan el teclado, el lector y la tarea de MQTT
+static cred_index_t cred_index;                    // Vacío si no hay imagen; se reemplaza con el mutex tomado
+static bool cred_cache_enabled = false;            // Sin una clave propia todo lo decide el backend
+
+static void cred_cache_setup(void)
+{
+    uint8_t key[CRED_CACHE_KEY_LEN];
+    cred_cache_mutex = xSemaphoreCreateMutex();
+    // Con una clave conocida los hashes de los códigos se revierten por fuerza bruta
+    if (!cred_cache_parse_key(CONFIG_CRED_CACHE_KEY, key) || strcasecmp(CONFIG_CRED_CACHE_KEY, CRED_CACHE_TEST_KEY) == 0)
+    {
+        ESP_LOGE(TAG, "CONFIG_CRED_CACHE_KEY no es una clave propia de 32 dígitos hexadecimales: caché e índice desactivados, decide el backend");
+        return;
+    }
+    cred_cache_enabled = true;
+    cred_cache_init(&cred_cache, cred_entries, CONFIG_CRED_CACHE_SIZE, key);
+    esp_err_t err = cred_cache_load(&cred_cache);
+    if (err == ESP_OK)
+        ESP_LOGI(TAG, "Caché de credenciales: %" PRIu32 " entradas, versión %" PRIu32, cred_cache.count, cred_cache.version);
+    else
+        ESP_LOGI(TAG, "Caché de credenciales vacía (%s)", esp_err_to_name(err));
+
+    err = cred_index_mount(&cred_index, CONFIG_CRED_INDEX_PARTITION, cred_cache_key_id(key), CONFIG_CRED_INDEX_BLOOM_RAM_MAX);
+    if (err != ESP_OK)
+        ESP_LOGI(TAG, "Sin índice de credenciales (%s)", esp_err_to_name(err));
+}
+
+// Segundos Unix, 0 mientras SNTP no dio la hora
+static uint32_t cred_cache_now(void)
+{
+    time_t now = time(NULL);
+    return now >= CRED_TIME_VALID ? (uint32_t)now : 0;
+}
+
+// Lo lento de la sincronización lo hace cred_sync_task: guardar la caché en
+// NVS, borrar la flash del índice y cerrar la imagen (filtro de Bloom y CRC
+// releyendo todo) llevan de cientos de ms a segundos, que no pueden frenar
+// al cliente MQTT ni a las búsquedas.
+#define CRED_SYNC_QUEUE_LEN 8       // Unos 6 KB con los mensajes de 768 bytes de tools/cred_index.py
+#define CRED_SYNC_QUEUE_WAIT_MS 500 // Con la cola llena el cliente espera a la flash; después descarta
+
+typedef enum
+{
+    CRED_JOB_INDEX,       // Mensaje de una transferencia del índice
+    CRED_JOB_INDEX_ABORT, // Se perdió el broker o llegó un mensaje fragmentado
+    CRED_JOB_SAVE,        // La caché cambió: solo despierta a la tarea
+} cred_job_type_t;
+
+typedef struct
+{
+    cred_job_type_t type;
+    size_t len;
+    uint8_t *data; // Copia propia; la libera la tarea
+} cred_job_t;
+
+static QueueHandle_t cred_sync_queue = NULL;
+static bool cred_cache_dirty = false; // Con el mutex: la caché en RAM no está guardada
+
+// Corre en la tarea de MQTT: solo copia y encola. Un mensaje que no entra se
+// descarta y la transferencia termina con CRED_SYNC_ERR_SEQUENCE: el
+// backend la repite. Un guardado que no entra se hace después del próximo
+// pedido.
+static void cred_sync_post(cred_job_type_t type, const char *data, int length)
+{
+    cred_job_t job = {.type = type, .len = 0, .data = NULL};
+    if (cred_sync_queue == NULL)
+        return; // Sin clave no hay caché ni índice
+    if (data != NULL)
+    {
+        job.data = malloc(length);
+        if (job.data == NULL)
+        {
+            ESP_LOGW(TAG, "Sin memoria para un mensaje del índice de %d bytes, descartado", length);
+            return;
+        }
+        memcpy(job.data, data, length);
+        job.len = length;
+    }
+    if (xQueueSend(cred_sync_queue, &job, pdMS_TO_TICKS(CRED_SYNC_QUEUE_WAIT_MS)) != pdTRUE)
+    {
+        ESP_LOGW(TAG, "Cola de sincronización llena, pedido descartado");
+        free(job.data);
+    }
+}
+
+// Corre en la tarea de MQTT con un lote completo
+static void cred_cache_sync(const char *data, int length)
+{
+    if (!cred_cache_enabled)
+    {
+        ESP_LOGW(TAG, "Lote de credenciales descartado: caché desactivada");
+        return;
+    }
+    xSemaphoreTake(cred_cache_mutex, portMAX_DELAY);
+    uint32_t version = cred_cache.version;
+    int ops = cred_cache_apply(&cred_cache, data, length);
+    uint32_t purged = cred_cache_purge(&cred_cache, cred_cache_now());
+    bool changed = cred_cache.version != version;
+    cred_cache_dirty |= changed;
+    uint32_t count = cred_cache.count;
+    xSemaphoreGive(cred_cache_mutex);
 
-#define DEVICE_ID "24001" // Cambia este ID en cada dispositivo
+    if (ops < 0)
+        ESP_LOGW(TAG, "Lote de credenciales inválido, descartado");
+    else
+        ESP_LOGI(TAG, "Credenciales: %d operaciones, %" PRIu32 " vencidas, %" PRIu32 " en total", ops, purged, count);
+    if (changed)
+        cred_sync_post(CRED_JOB_SAVE, NULL, 0);
+}
 
-// Variable global para almacenar el código de la tarjeta
-uint64_t codigo_tarjeta = 0;
+// Pide al backend los cambios desde las versiones que se tienen de la caché y del índice
+static void cred_cache_request_sync(esp_mqtt_client_handle_t client)
+{
+    char payload[96];
+    if (!cred_cache_enabled)
+        return;
+    xSemaphoreTake(cred_cache_mutex, portMAX_DELAY);
+    uint32_t version = cred_cache.version;
+    uint32_t index_version = cred_index.version;
+    xSemaphoreGive(cred_cache_mutex);
+    snprintf(payload, sizeof(payload), "{\"device_id\":\"%s\",\"version\":%" PRIu32 ",\"index\":%" PRIu32 "}",
+             DEVICE_ID, version, index_version);
+    esp_mqtt_client_publish(client, CRED_SYNC_REQUEST_TOPIC, payload, 0, 1, 0);
+}
 
-// Definimos la fuente con la tabla y sus dimensiones
-FontDef Font24 = {Font24_Table, 17, 24};
+// Con cada mensaje de una transferencia del índice. La imagen nueva se
+// escribe leyendo la activa (delta) sin el mutex: solo esta tarea la cambia.
+static void cred_index_sync(const uint8_t *data, size_t length)
+{
+    cred_index_t next;
+    int64_t start = esp_timer_get_time();
+    cred_sync_status_t status = cred_index_receive(data, length, &cred_index, &next);
+    if (status == CRED_SYNC_OK || status == CRED_SYNC_DUPLICATE)
+        return;
 
-TFT_t dev;
+    if (status == CRED_SYNC_COMPLETE)
+    {
+        xSemaphoreTake(cred_cache_mutex, portMAX_DELAY);
+        cred_index = next;
+        xSemaphoreGive(cred_cache_mutex);
+        cred_index_commit();
+        ESP_LOGI(TAG, "Índice de credenciales: versión %" PRIu32 ", %" PRIu32 " credenciales (cierre en %" PRIi64 " ms)",
+                 next.version, next.count, (esp_timer_get_time() - start) / 1000);
+    }
+    else
+        ESP_LOGW(TAG, "Transferencia del índice descartada (%d)", status);
+
+    // El backend reintenta (con una copia completa si el delta no aplica)
+    char payload[96];
+    snprintf(payload, sizeof(payload), "{\"device_id\":\"%s\",\"index\":%" PRIu32 ",\"status\":%d}",
+             DEVICE_ID, cred_index.version, status);
+    if (client != NULL)
+        esp_mqtt_client_publish(client, CRED_INDEX_STATUS_TOPIC, payload, 0, 1, 0);
+}
+
+// Guarda una copia de la tabla: el mutex se tiene solo mientras se copia y
+// las búsquedas no esperan a NVS
+static void cred_cache_persist(void)
+{
+    xSemaphoreTake(cred_cache_mutex, portMAX_DELAY);
+    if (!cred_cache_dirty)
+    {
+        xSemaphoreGive(cred_cache_mutex);
+        return; // Ya lo guardó un pedido anterior
+    }
+    cred_cache_t copy = cred_cache;
+    size_t size = cred_cache.count * sizeof(cred_entry_t);
+    copy.entries = malloc(size > 0 ? size : sizeof(cred_entry_t));
+    if (copy.entries != NULL)
+    {
+        memcpy(copy.entries, cred_cache.entries, size);
+        cred_cache_dirty = false;
+    }
+    xSemaphoreGive(cred_cache_mutex);
+    if (copy.entries == NULL)
+    {
+        ESP_LOGE(TAG, "Sin memoria para guardar la caché de credenciales");
+        return;
+    }
+
+    esp_err_t err = cred_cache_save(&copy);
+    free(copy.entries);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "No se pudo guardar la caché de credenciales: %s", esp_err_to_name(err));
+        xSemaphoreTake(cred_cache_mutex, portMAX_DELAY);
+        cred_cache_dirty = true; // Se reintenta después del próximo pedido
+        xSemaphoreGive(cred_cache_mutex);
+    }
+}
+
+static void cred_sync_task(void *pvParameters)
+{
+    cred_job_t job;
+    while (1)
+    {
+        xQueueReceive(cred_sync_queue, &job, portMAX_DELAY);
+        switch (job.type)
+        {
+        case CRED_JOB_INDEX:
+            cred_index_sync(job.data, job.len);
+            break;
+        case CRED_JOB_INDEX_ABORT:
+            cred_index_receive_abort();
+            break;
+        case CRED_JOB_SAVE:
+            break;
+        }
+        free(job.data);
+        cred_cache_persist();
+    }
+}
+
+static void cred_sync_init(void)
+{
+    if (!cred_cache_enabled)
+        return;
+    cred_sync_queue = xQueueCreate(CRED_SYNC_QUEUE_LEN, sizeof(cred_job_t));
+    // Prioridad baja: solo escribe la flash y NVS y publica el resultado
+    if (cred_sync_queue == NULL || xTaskCreate(&cred_sync_task, "cred_sync", 4096, NULL, tskIDLE_PRIORITY + 1, NULL) != pdPASS)
+    {
+        ESP_LOGE(TAG, "No se pudo crear la tarea de sincronización de credenciales");
+        if (cred_sync_queue != NULL)
+            vQueueDelete(cred_sync_queue);
+        cred_sync_queue = NULL;
+    }
+}
+
+//------------------------------------------pedidos en vuelo-------------------------------
+// Cada pedido al backend lleva un número ("req":N) y la respuesta lo repite
+// al final: "<código>@N" o "<puerta>:<código>@N". La respuesta se aplica a la
+// puerta del pedido; si N ya no está en vuelo (venció, ya se respondió o es
+// de antes de un reinicio) se descarta. Un pedido sin respuesta en
+// CONFIG_INFLIGHT_TIMEOUT_MS muestra "SIN RESPUESTA" y la pantalla vuelve a
+// la bienvenida. Las respuestas sin número son órdenes del backend (abrir o
+// cerrar a distancia) y se aplican como siempre.
+//
+// Con la política optimista, una credencial que la caché habilita abre en el
+// acto y el pedido igual va al backend, que tiene la última palabra: si la
+// respuesta también abre, se confirma; si no, se cierra la puerta, se
+// muestra la alarma y la credencial se revoca en la caché. Las dos
+// decisiones se publican en ACCESS_AUDIT_TOPIC y las revocaciones, además,
+// en ACCESS_ALARM_TOPIC.
+#define INFLIGHT_STATS_TOPIC "/cntrlaxs/diag/latencia/" DEVICE_ID // Latencias, con el comando "latencia"
+#define ACCESS_AUDIT_TOPIC "/cntrlaxs/auditoria"
+#define ACCESS_ALARM_TOPIC "/cntrlaxs/alarma"
+#define INFLIGHT_RETRY_MS 10 // El timer encontró el mutex tomado
 
-//------------------------------------------funciones para controlar servo-------------------------------
-// Función para inicializar GPIO para MCPWM
-static void mcpwm_example_gpio_initialize()
+static inflight_t inflight;
+static SemaphoreHandle_t inflight_mutex = NULL; // Lo usan el teclado, el lector, MQTT y el timer
+static esp_timer_handle_t inflight_timer = NULL;
+
+// Reloj de la tabla en milisegundos; da la vuelta cada 49 días e inflight lo admite
+static uint32_t inflight_now(void)
 {
-    printf("Inicializando GPIO para control de servomotor con MCPWM...\n");
-    mcpwm_gpio_init(MCPWM_UNIT_0, MCPWM0A, 2); // Configura GPIO 2 como PWM0A
+    return (uint32_t)(esp_timer_get_time() / 1000);
 }
 
-// Función para convertir ángulo a ancho de pulso
-static uint32_t servo_angle_to_duty_us(uint32_t angle)
+#if CONFIG_CRED_CACHE_POLICY_OPTIMISTIC
+// Los registros de auditoría los publica access_audit_task: access_audit()
+// corre en la tarea de MQTT y en la de esp_timer (pedidos vencidos), y
+// esp_mqtt_client_enqueue() puede esperar el lock del cliente.
+#define ACCESS_AUDIT_QUEUE_LEN 8
+
+typedef struct
+{
+    inflight_entry_t entry;
+    int backend;        // 0 si no respondió
+    uint32_t ms;        // Del pedido a la decisión del backend o al vencimiento
+    const char *result; // Literal
+    bool alarm;         // También va a ACCESS_ALARM_TOPIC
+} access_audit_t;
+
+static QueueHandle_t access_audit_queue = NULL;
+
+// Encola la decisión local junto con la del backend; no bloquea
+static void access_audit(const inflight_entry_t *entry, int backend, const char *result, bool alarm)
 {
-    // Calcula el ancho de pulso en microsegundos
-    return (angle * (2400 - 600) / 180) + 600;
+    access_audit_t record = {
+        .entry = *entry,
+        .backend = backend,
+        .ms = inflight_now() - entry->sent_ms,
+        .result = result,
+        .alarm = alarm,
+    };
+    if (access_audit_queue == NULL || xQueueSend(access_audit_queue, &record, 0) != pdTRUE)
+        ESP_LOGW(TAG, "Auditoría del pedido %" PRIu32 " descartada (%s)", entry->id, result);
 }
 
-// Función para mover el servo
-void move_servo(uint32_t start_angle, uint32_t end_angle, uint32_t speed)
+static void access_audit_task(void *pvParameters)
 {
-    if (start_angle == end_angle)
-        return; // Si los ángulos son iguales, no hacer nada
+    access_audit_t record;
+    char payload[192];
+    while (1)
+    {
+        xQueueReceive(access_audit_queue, &record, portMAX_DELAY);
+        const inflight_entry_t *entry = &record.entry;
+        snprintf(payload, sizeof(payload),
+                 "{\"device_id\":\"%s\",\"req\":%" PRIu32 ",\"door\":%u,\"hash\":\"%016" PRIx64 "\",\"local\":%u,\"backend\":%d,\"ms\":%" PRIu32 ",\"result\":\"%s\"}",
+                 DEVICE_ID, entry->id, entry->door, entry->hash, entry->local, record.backend, record.ms, record.result);
+        ESP_LOGI(TAG, "Auditoría: %s", payload);
+        if (client == NULL)
+            continue;
+        esp_mqtt_client_enqueue(client, ACCESS_AUDIT_TOPIC, payload, 0, 1, 0, true);
+        if (record.alarm)
+            esp_mqtt_client_enqueue(client, ACCESS_ALARM_TOPIC, payload, 0, 1, 0, true);
+    }
+}
 
-    int step = (start_angle < end_angle) ? 1 : -1; // Determinar la dirección del movimiento
-    uint32_t current_angle = start_angle;
+static void access_audit_init(void)
+{
+    access_audit_queue = xQueueCreate(ACCESS_AUDIT_QUEUE_LEN, sizeof(access_audit_t));
+    if (access_audit_queue == NULL || xTaskCreate(&access_audit_task, "access_audit", 3072, NULL, tskIDLE_PRIORITY + 1, NULL) != pdPASS)
+    {
+        ESP_LOGE(TAG, "No se pudo crear la tarea de auditoría");
+        if (access_audit_queue != NULL)
+            vQueueDelete(access_audit_queue);
+        access_audit_queue = NULL;
+    }
+}
 
-    // Mover el servo gradualmente al ángulo final
-    while (current_angle != end_angle)
+// Corre en la tarea de MQTT con la respuesta a una apertura local: la
+// confirma o la revoca (la puerta se cierra con DOOR_CMD_REVOKE)
+static void access_confirm(const inflight_entry_t *entry, int code)
+{
+    if (code == 101 || code == 111)
+    {
+        access_audit(entry, code, "confirmada", false);
+        return;
+    }
+    // Solo una denegación explícita revoca: un código desconocido (un error
+    // del backend, una versión nueva) no cierra una puerta ya abierta
+    if (code != 100 && code != 102)
     {
-        uint32_t duty_us = servo_angle_to_duty_us(current_angle);
-        mcpwm_set_duty_in_us(MCPWM_UNIT_0, MCPWM_TIMER_0, MCPWM_OPR_A, duty_us);
-        current_angle += step;
-        vTaskDelay(pdMS_TO_TICKS(speed)); // Esperar entre pasos para controlar la velocidad
+        ESP_LOGW(TAG, "Código %d desconocido para una apertura local de la puerta %u, se ignora", code, entry->door);
+        access_audit(entry, code, "ignorada", false);
+        return;
     }
 
-    // Asegurar que el servo esté en el ángulo final
-    uint32_t duty_us = servo_angle_to_duty_us(end_angle);
-    mcpwm_set_duty_in_us(MCPWM_UNIT_0, MCPWM_TIMER_0, MCPWM_OPR_A, duty_us);
+    // Una entrada sin puertas tapa también a la del índice hasta que el
+    // backend mande la suya. La guarda ya cred_sync_task, para que un
+    // reinicio no la pierda.
+    cred_entry_t revoked = {
+        .hash = entry->hash,
+        .grant = 100,
+    };
+    xSemaphoreTake(cred_cache_mutex, portMAX_DELAY);
+    bool stored = cred_cache_put(&cred_cache, &revoked);
+    cred_cache_dirty |= stored;
+    xSemaphoreGive(cred_cache_mutex);
 
-    // Detener la señal PWM después de alcanzar la posición deseada
-    //mcpwm_set_signal_low(MCPWM_UNIT_0, MCPWM_TIMER_0, MCPWM_OPR_A);
+    ESP_LOGW(TAG, "El backend respondió %d a una apertura local de la puerta %u", code, entry->door);
+    door_post(DOOR_CMD_REVOKE, entry->door);
+    if (stored)
+        cred_sync_post(CRED_JOB_SAVE, NULL, 0);
+    else
+        ESP_LOGE(TAG, "Caché de credenciales llena, la revocación no se guardó");
+    access_audit(entry, code, "revocada", true);
 }
+#endif
 
-//------------------------------------------funciones para controlar acceso-------------------------------
-void access_handler(const char *response, int length)
+// Con inflight_mutex tomado: el timer queda para el próximo plazo
+static void inflight_arm(uint32_t now)
 {
-    // Crear una copia de la cadena recibida para asegurarse de que esté terminada en nulo
-    char buffer[4]; // Suficiente para tres dígitos y el terminador nulo
-    if (length >= sizeof(buffer))
+    uint32_t remaining = inflight_remaining(&inflight, now);
+    esp_timer_stop(inflight_timer);
+    if (remaining != UINT32_MAX)
+        esp_timer_start_once(inflight_timer, (remaining + 1) * 1000ULL);
+}
+
+// Un pedido que venció o que desplazaron otros con la tabla llena
+static void inflight_timed_out(const inflight_entry_t *entry)
+{
+#if CONFIG_CRED_CACHE_POLICY_OPTIMISTIC
+    if (entry->local != 0)
     {
-        ESP_LOGI(TAG1, "La longitud del dato es demasiado larga");
+        access_audit(entry, 0, "sin_respuesta", false); // La puerta ya se abrió
         return;
     }
-    memcpy(buffer, response, length);
-    buffer[length] = '\0'; // Asegurarse de que la cadena esté terminada en nulo
+#endif
+    ESP_LOGW(TAG, "Pedido %" PRIu32 " sin respuesta (puerta %u)", entry->id, entry->door);
+    door_post(DOOR_CMD_TIMEOUT, entry->door);
+}
 
-    // Convertir string a entero
-    int value = atoi(buffer);
+// Corre en la tarea de esp_timer, que no puede esperar: si el mutex está
+// tomado reintenta en INFLIGHT_RETRY_MS. Los vencidos solo se encolan
+// (door_post() y access_audit() no bloquean).
+static void inflight_timer_cb(void *arg)
+{
+    inflight_entry_t expired[INFLIGHT_MAX];
+    if (xSemaphoreTake(inflight_mutex, 0) != pdTRUE)
+    {
+        esp_timer_start_once(inflight_timer, INFLIGHT_RETRY_MS * 1000ULL);
+        return;
+    }
+    uint32_t now = inflight_now();
+    int count = inflight_expire(&inflight, now, expired, INFLIGHT_MAX);
+    inflight_arm(now);
+    xSemaphoreGive(inflight_mutex);
+    for (int i = 0; i < count; i++)
+    {
+        inflight_timed_out(&expired[i]);
+    }
+}
 
-    switch (value)
+static void inflight_setup(void)
+{
+    const esp_timer_create_args_t timer_args = {
+        .callback = inflight_timer_cb,
+        .name = "inflight",
+    };
+    inflight_mutex = xSemaphoreCreateMutex();
+    // El primer número es al azar: una respuesta tardía a un pedido de antes
+    // de un reinicio no coincide con uno nuevo
+    inflight_init(&inflight, CONFIG_INFLIGHT_TIMEOUT_MS, esp_random());
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &inflight_timer));
+#if CONFIG_CRED_CACHE_POLICY_OPTIMISTIC
+    access_audit_init();
+#endif
+}
+
+// Anota un pedido antes de publicarlo; local es la respuesta ya aplicada (0 si ninguna)
+static uint32_t inflight_begin(uint8_t door, uint16_t local, uint64_t hash)
+{
+    inflight_entry_t evicted;
+    xSemaphoreTake(inflight_mutex, portMAX_DELAY);
+    uint32_t now = inflight_now();
+    uint32_t id = inflight_start(&inflight, door, local, hash, now, &evicted);
+    inflight_arm(now);
+    xSemaphoreGive(inflight_mutex);
+    if (evicted.id != 0)
+        inflight_timed_out(&evicted);
+    return id;
+}
+
+static void inflight_publish_stats(esp_mqtt_client_handle_t client)
+{
+    char payload[192];
+    xSemaphoreTake(inflight_mutex, portMAX_DELAY);
+    snprintf(payload, sizeof(payload),
+             "{\"device_id\":\"%s\",\"in_flight\":%d,\"answered\":%" PRIu32 ",\"timeouts\":%" PRIu32 ",\"unmatched\":%" PRIu32
+             ",\"p50_ms\":%" PRIu32 ",\"p99_ms\":%" PRIu32 ",\"max_ms\":%" PRIu32 "}",
+             DEVICE_ID, inflight_count(&inflight), inflight.answered, inflight.timeouts, inflight.unmatched,
+             inflight_percentile(&inflight, 50), inflight_percentile(&inflight, 99), inflight.latency_max_ms);
+    xSemaphoreGive(inflight_mutex);
+    esp_mqtt_client_publish(client, INFLIGHT_STATS_TOPIC, payload, 0, 0, 0);
+}
+
+// Corre en la tarea de MQTT: traduce la respuesta y la encola
+void access_handler(const char *response, int length)
+{
+    access_msg_response_t msg = {0}; // Las respuestas de texto no traen tiempo ni texto
+    uint8_t door;
+    int code;
+    uint32_t id;
+    if (access_msg_is_binary(response, length))
     {
-    case 111:
-        ESP_LOGI(TAG1, "Acceso permitido");
-        lcdFillScreen(&dev, GREEN);
-        LCD_DrawString(&dev, 75, 80, "ACCESO", &Font24, RED);
-        LCD_DrawString(&dev, 50, 120, "CONCEDIDO", &Font24, RED);
-        vTaskDelay(300);
-        lcdFillScreen(&dev, ORANGE);
-        LCD_DrawString(&dev, 30, 100, "Bienvenido!", &Font24, RED);
-        break;
-    case 101:
-        ESP_LOGI(TAG1, "Cofre abierto");
-        lcdFillScreen(&dev, BLUE);
-        LCD_DrawString(&dev, 80, 80, "COFRE", &Font24, RED);
-        LCD_DrawString(&dev, 60, 120, "ABIERTO", &Font24, RED);
-        move_servo(60, 10, 40);            // Mover el servo de 60 grados a 0
-        vTaskDelay(pdMS_TO_TICKS(15000)); // Esperar 15 segundos
-        move_servo(10, 60, 40);            // Mover el servo de regreso a 60 grados
-        lcdFillScreen(&dev, ORANGE);
-        LCD_DrawString(&dev, 30, 100, "Bienvenido!", &Font24, RED);
-        break;
-    case 100:
-        ESP_LOGI(TAG1, "No autorizado");
-        lcdFillScreen(&dev, RED);
-        LCD_DrawString(&dev, 100, 80, "NO", &Font24, GRAY);
-        LCD_DrawString(&dev, 40, 120, "AUTORIZADO", &Font24, GRAY);
-        vTaskDelay(300);
-        lcdFillScreen(&dev, ORANGE);
-        LCD_DrawString(&dev, 30, 100, "Bienvenido!", &Font24, RED);
-        break;
-    default:
-        ESP_LOGI(TAG1, "Código no reconocido");
-        break;
+        if (!access_parse_binary(response, length, &msg))
+            return;
+        door = msg.door;
+        code = msg.code;
+        id = msg.id;
+    }
+    else if (!access_parse(response, length, &door, &code, &id))
+        return;
+    inflight_entry_t entry;
+    bool found = false;
+    bool drop = false;
+    xSemaphoreTake(inflight_mutex, portMAX_DELAY);
+    uint32_t now = inflight_now();
+    if (id != 0)
+        found = inflight_match(&inflight, id, now, &entry);
+#if CONFIG_INFLIGHT_ACCEPT_UNTAGGED
+    else
+        found = inflight_match_door(&inflight, door, now, &entry);
+#else
+    else
+        // Sin número, una habilitación con un pedido pendiente puede ser la
+        // respuesta tardía a otro anterior: no se aplica
+        drop = (code == 101 || code == 111) && inflight_pending(&inflight, door);
+#endif
+    inflight_arm(now);
+    xSemaphoreGive(inflight_mutex);
+    if (id != 0 && !found)
+    {
+        ESP_LOGW(TAG1, "Respuesta al pedido %" PRIu32 ", que ya no está en vuelo: descartada", id);
+        return;
+    }
+    if (drop)
+    {
+        ESP_LOGW(TAG1, "Respuesta %d sin número con un pedido de la puerta %u en vuelo: descartada", code, door);
+        return;
+    }
+    if (found)
+    {
+        ESP_LOGI(TAG1, "Respuesta al pedido %" PRIu32 " en %" PRIu32 " ms", entry.id, now - entry.sent_ms);
+        door = entry.door;
+#if CONFIG_CRED_CACHE_POLICY_OPTIMISTIC
+        if (entry.local != 0)
+        {
+            access_confirm(&entry, code);
+            return;
+        }
+#endif
     }
+    door_request(door, code, msg.hold_ms, msg.text);
 }
 
 //------------------------------------------funciones para Mqtt-------------------------------
+// Devuelve en host el nombre del broker de una URI sin TLS ("mqtt://host[:port][/path]")
+// y en rest lo que sigue al nombre; false si la URI no admite usar la IP guardada
+static bool broker_uri_split(const char *uri, char *host, size_t size, const char **rest)
+{
+    const char *scheme = "mqtt://";
+    if (strncmp(uri, scheme, strlen(scheme)) != 0)
+        return false; // Con TLS el certificado se valida contra el nombre
+    const char *start = uri + strlen(scheme);
+    size_t len = strcspn(start, ":/");
+    if (len == 0 || len >= size)
+        return false;
+    memcpy(host, start, len);
+    host[len] = '\0';
+    *rest = start + len;
+    return true;
+}
+
+// La IP guardada ya se usó para conectar o se resolvió en este arranque
+static bool broker_fresh = false;
+static volatile bool broker_resolving = false;
+
+// Guarda la IP del broker ya conectado para evitar el DNS en el próximo
+// arranque en caliente. getaddrinfo() bloquea: corre en su propia tarea.
+static void broker_resolve_task(void *pvParameter)
+{
+    char host[64];
+    const char *rest;
+    struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_STREAM};
+    struct addrinfo *res = NULL;
+
+    if (broker_uri_split(CONFIG_BROKER_URL, host, sizeof(host), &rest) && getaddrinfo(host, NULL, &hints, &res) == 0 && res != NULL)
+    {
+        struct sockaddr_in *addr = (struct sockaddr_in *)res->ai_addr;
+        char ip[sizeof(boot_state.broker_ip)];
+        inet_ntop(AF_INET, &addr->sin_addr, ip, sizeof(ip));
+        freeaddrinfo(res);
+        if (strcmp(ip, boot_state.broker_ip) != 0)
+        {
+            snprintf(boot_state.broker_ip, sizeof(boot_state.broker_ip), "%s", ip);
+            boot_state_save();
+        }
+        broker_fresh = true;
+    }
+    broker_resolving = false;
+    vTaskDelete(NULL);
+}
+
+// Corre en la tarea de MQTT al conectar: si la conexión no usó la IP
+// guardada (falta, no respondió o no se usó en un arranque en frío) la
+// resuelve de nuevo en segundo plano, una sola vez por arranque
+static void broker_cache_update(void)
+{
+    char host[64];
+    const char *rest;
+
+    if (broker_cached)
+        broker_fresh = true; // La dirección usada funcionó
+    if (broker_fresh || broker_resolving || !broker_uri_split(CONFIG_BROKER_URL, host, sizeof(host), &rest))
+        return;
+    broker_resolving = true;
+    if (xTaskCreate(&broker_resolve_task, "broker_dns", 3072, NULL, tskIDLE_PRIORITY + 1, NULL) != pdPASS)
+    {
+        ESP_LOGW(TAG, "No se pudo crear la tarea de DNS del broker");
+        broker_resolving = false;
+    }
+}
+
+// Si la IP guardada no respondió, se vuelve a la URI con nombre
+static void broker_cache_invalidate(void)
+{
+    if (!broker_cached)
+        return;
+    ESP_LOGW(TAG, "IP guardada del broker sin respuesta, se usa %s", CONFIG_BROKER_URL);
+    broker_cached = false;
+    broker_fresh = false;
+    boot_state.broker_ip[0] = '\0';
+    boot_state_save();
+    esp_mqtt_client_set_uri(client, CONFIG_BROKER_URL);
+}
+
+// Estado de conexión mostrado con íconos en la pantalla de bienvenida
+static bool wifi_connected = false;
+static bool mqtt_connected = false;
+
+static void lcd_status_update(void)
+{
+    if (!ui_set_status(wifi_connected, mqtt_connected))
+        return;
+    if (!lcd_lock_ready())
+        return;
+    ui_draw_status(&dev);
+    lcd_unlock();
+}
+
+static void wifi_status_handler(void *arg, esp_event_base_t base, int32_t event_id, void *event_data)
+{
+    wifi_connected = (base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP);
+    if (!wifi_connected)
+        mqtt_connected = false;
+    lcd_status_update();
+}
+
 static void log_error_if_nonzero(const char *message, int error_code)
 {
     if (error_code != 0)
@@ -170,15 +1794,34 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
     {
     case MQTT_EVENT_CONNECTED:
         ESP_LOGI(TAG, "MQTT_EVENT_CONNECTED");
+        // Primero la suscripción: el HELLO que responde a la oferta llega por ese tópico
+        msg_id = esp_mqtt_client_subscribe(client, topic, 1);
+        ESP_LOGI(TAG, "Suscrito correctamente a %s, msg_id=%d", topic, msg_id);
         char payload[100];
-        snprintf(payload, sizeof(payload), "{\"device_id\":\"%s\",\"status\":\"connected\"}", DEVICE_ID);
+        // "proto" ofrece el formato binario; hasta que llegue el HELLO se usa JSON
+        snprintf(payload, sizeof(payload), "{\"device_id\":\"%s\",\"status\":\"connected\",\"proto\":%d}", DEVICE_ID, ACCESS_MSG_VERSION);
+        access_proto = 1;
         msg_id = esp_mqtt_client_publish(client, "/cntrlaxs/solicitud", payload, 0, 1, 0);
         ESP_LOGI(TAG, "se publicó el mensaje, msg_id=%d", msg_id);
-        msg_id = esp_mqtt_client_subscribe(client, topic, 1);
-        ESP_LOGI(TAG, "Suscrito correctamente a %s, msg_id=%d", topic, msg_id);
+        msg_id = esp_mqtt_client_subscribe(client, SHOT_CMD_TOPIC, 0);
+        ESP_LOGI(TAG, "Suscrito correctamente a %s, msg_id=%d", SHOT_CMD_TOPIC, msg_id);
+        msg_id = esp_mqtt_client_subscribe(client, CRED_SYNC_TOPIC, 1);
+        ESP_LOGI(TAG, "Suscrito correctamente a %s, msg_id=%d", CRED_SYNC_TOPIC, msg_id);
+        msg_id = esp_mqtt_client_subscribe(client, CRED_INDEX_TOPIC, 1);
+        ESP_LOGI(TAG, "Suscrito correctamente a %s, msg_id=%d", CRED_INDEX_TOPIC, msg_id);
+        cred_cache_request_sync(client);
+        mqtt_connected = true;
+        broker_cache_update();
+        broker_cached = false; // La dirección usada funcionó
+        lcd_status_update();
         break;
     case MQTT_EVENT_DISCONNECTED:
         ESP_LOGI(TAG, "MQTT_EVENT_DISCONNECTED");
+        broker_cache_invalidate();
+        cred_sync_post(CRED_JOB_INDEX_ABORT, NULL, 0); // Al reconectar el backend empieza de nuevo
+        access_proto = 1;           // Y vuelve a elegir el formato
+        mqtt_connected = false;
+        lcd_status_update();
         break;
     case MQTT_EVENT_SUBSCRIBED:
         ESP_LOGI(TAG, "MQTT_EVENT_SUBSCRIBED, msg_id=%d", event->msg_id);
@@ -191,8 +1834,42 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
         break;
     case MQTT_EVENT_DATA:
         ESP_LOGI(TAG, "MQTT_EVENT_DATA"); // acá se reciben los msjs mqtt
+        if (event->topic_len == strlen(CRED_INDEX_TOPIC) && strncmp(event->topic, CRED_INDEX_TOPIC, event->topic_len) == 0)
+        {
+            // Binario y en cientos de mensajes: no se imprime
+            if (event->data_len == event->total_data_len)
+                cred_sync_post(CRED_JOB_INDEX, event->data, event->data_len);
+            else
+            {
+                ESP_LOGW(TAG, "Mensaje del índice de %d bytes fragmentado, descartado", event->total_data_len);
+                cred_sync_post(CRED_JOB_INDEX_ABORT, NULL, 0);
+            }
+            break;
+        }
         printf("TOPIC=%.*s\r\n", event->topic_len, event->topic);
-        printf("DATA=%.*s\r\n", event->data_len, event->data);
+        if (access_msg_is_binary(event->data, event->data_len))
+            printf("DATA=<%d bytes>\r\n", event->data_len);
+        else
+            printf("DATA=%.*s\r\n", event->data_len, event->data);
+        if (event->topic_len == strlen(SHOT_CMD_TOPIC) && strncmp(event->topic, SHOT_CMD_TOPIC, event->topic_len) == 0)
+        {
+            if (event->data_len == strlen("screenshot") && strncmp(event->data, "screenshot", event->data_len) == 0)
+                lcd_shot_request();
+            else if (event->data_len == strlen("latencia") && strncmp(event->data, "latencia", event->data_len) == 0)
+                inflight_publish_stats(client);
+            break;
+        }
+        if (event->topic_len == strlen(CRED_SYNC_TOPIC) && strncmp(event->topic, CRED_SYNC_TOPIC, event->topic_len) == 0)
+        {
+            // Cada lote tiene que entrar en un mensaje MQTT sin fragmentar
+            if (event->data_len == event->total_data_len)
+                cred_cache_sync(event->data, event->data_len);
+            else
+                ESP_LOGW(TAG, "Lote de credenciales de %d bytes fragmentado, descartado", event->total_data_len);
+            break;
+        }
+        if (event->current_data_offset > 0)
+            break; // Continuación de un mensaje fragmentado
         access_handler(event->data, event->data_len);
         break;
     case MQTT_EVENT_ERROR:
@@ -226,8 +1903,20 @@ void mqtt_publish_message(const char *topic, const char *json_message)
 
 static void mqtt_app_start(void)
 {
+    static char uri[128];
+    char host[64];
+    const char *rest;
+
+    snprintf(uri, sizeof(uri), "%s", CONFIG_BROKER_URL);
+    if (warm_boot && boot_state.broker_ip[0] != '\0' && broker_uri_split(CONFIG_BROKER_URL, host, sizeof(host), &rest))
+    {
+        snprintf(uri, sizeof(uri), "mqtt://%s%s", boot_state.broker_ip, rest);
+        broker_cached = true;
+        ESP_LOGI(TAG, "Arranque en caliente: broker en %s", uri);
+    }
+
     esp_mqtt_client_config_t mqtt_cfg = {
-        .broker.address.uri = CONFIG_BROKER_URL,
+        .broker.address.uri = uri,
     };
 
     client = esp_mqtt_client_init(&mqtt_cfg);
@@ -235,6 +1924,162 @@ static void mqtt_app_start(void)
     esp_mqtt_client_start(client);
 }
 
+//------------------------------------------ingreso de códigos-------------------------------
+// La lógica del ingreso (dígitos, cancelar, enviar, vencimiento, código +
+// tarjeta) está en el componente code_entry; acá solo se le pasa la hora y
+// se publica lo que devuelve.
+static code_entry_t code_entries[KEYBOARD_MAX_KEYPADS]; // Uno por teclado
+static SemaphoreHandle_t code_entry_mutex = NULL;       // Lo usan el teclado y el lector de tarjetas
+
+static void code_entry_setup(void)
+{
+    code_entry_policy_t policy = CODE_ENTRY_POLICY_DEFAULT;
+    policy.min_len = CONFIG_CODE_ENTRY_MIN_LEN;
+    policy.max_len = CONFIG_CODE_ENTRY_MAX_LEN;
+    policy.timeout_ms = CONFIG_CODE_ENTRY_TIMEOUT_MS;
+#if CONFIG_CODE_ENTRY_AUTO_SUBMIT
+    policy.auto_submit = true;
+#endif
+#if CONFIG_CODE_ENTRY_REQUIRE_CARD
+    policy.require_card = true;
+#endif
+    code_entry_mutex = xSemaphoreCreateMutex();
+    for (int i = 0; i < KEYBOARD_MAX_KEYPADS; i++)
+    {
+        code_entry_init(&code_entries[i], &policy);
+    }
+}
+
+// Reloj del ingreso en milisegundos; da la vuelta cada 49 días y code_entry lo admite
+static uint32_t code_entry_now(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+// Decide con la caché de credenciales según la política; false si hay que
+// preguntar al backend. Con la política optimista puede abrir y devolver
+// false igual: en local queda la respuesta aplicada y en hash la credencial.
+static bool access_local(const code_entry_credential_t *credential, uint8_t door, uint16_t *local, uint64_t *hash_out)
+{
+    if (!cred_cache_enabled)
+        return false;
+#if CONFIG_CRED_CACHE_POLICY_OFFLINE
+    if (mqtt_connected)
+        return false;
+#endif
+    cred_entry_t entry;
+    int64_t start = esp_timer_get_time();
+    xSemaphoreTake(cred_cache_mutex, portMAX_DELAY);
+    uint64_t hash = cred_cache_hash(&cred_cache, credential->has_card, credential->card, credential->code);
+    uint32_t now = cred_cache_now();
+    cred_cache_result_t result = cred_cache_lookup(&cred_cache, hash, door, now, &entry);
+    // Lo que la caché no conoce se busca en el índice
+    if (result == CRED_CACHE_MISS)
+        result = cred_index_lookup(&cred_index, hash, door, now, &entry);
+    xSemaphoreGive(cred_cache_mutex);
+
+#if CONFIG_CRED_CACHE_POLICY_FIRST || CONFIG_CRED_CACHE_POLICY_OPTIMISTIC
+    // Lo que la caché no confirma lo decide el backend, si está
+    if (result != CRED_CACHE_HIT && mqtt_connected)
+        return false;
+#endif
+    int grant = (result == CRED_CACHE_HIT) ? entry.grant : 100;
+    ESP_LOGI(TAG, "Decisión local (resultado %d): %d para la puerta %u en %" PRIi64 " us", result, grant, door, esp_timer_get_time() - start);
+    door_request(door, grant, 0, "");
+#if CONFIG_CRED_CACHE_POLICY_OPTIMISTIC
+    // Ya abrió: el pedido sigue al backend para que lo confirme
+    if ((grant == 101 || grant == 111) && mqtt_connected)
+    {
+        *local = grant;
+        *hash_out = hash;
+        return false;
+    }
+#endif
+    return true;
+}
+
+// Publica el pedido en el formato binario; false si no se puede armar
+// (el código tiene algo que no es un dígito) y hay que mandarlo en JSON
+static bool access_request_binary(const code_entry_credential_t *credential, uint8_t door, uint32_t id)
+{
+    access_msg_request_t request = {
+        .id = id,
+        .has_card = credential->has_card,
+        .card = credential->card,
+        .door = door,
+        .device_id = DEVICE_ID,
+    };
+    uint8_t msg[ACCESS_MSG_REQUEST_SIZE];
+    snprintf(request.code, sizeof(request.code), "%s", credential->code);
+    size_t len = access_msg_encode_request(&request, msg, sizeof(msg));
+    if (len == 0)
+        return false;
+    int msg_id = esp_mqtt_client_publish(client, ACCESS_BIN_TOPIC, (const char *)msg, len, 1, 0);
+    if (msg_id != -1)
+        ESP_LOGI(TAG, "Pedido binario enviado, msg_id=%d", msg_id);
+    else
+        ESP_LOGE(TAG, "Error al enviar mensaje");
+    return true;
+}
+
+// Pedido de acceso con una credencial completa (código, tarjeta o ambos)
+static void access_request(const code_entry_credential_t *credential, uint8_t keypad)
+{
+    if (credential->code[0] != '\0')
+        ESP_LOGI(TAG, "Código completo ingresado: %s", credential->code);
+    uint8_t door = keypad_door(keypad);
+    uint16_t local = 0;
+    uint64_t hash = 0;
+    if (access_local(credential, door, &local, &hash))
+        return;
+
+    uint32_t id = inflight_begin(door, local, hash);
+    if (access_proto == ACCESS_MSG_VERSION && access_request_binary(credential, door, id))
+        return;
+    char json_message[128];
+    if (code_entry_json(credential, DEVICE_ID, json_message, sizeof(json_message)) > 0)
+    {
+        door_request_json(json_message, sizeof(json_message), keypad, id);
+        // Publicar el pedido a través de MQTT
+        mqtt_publish_message(credential->code[0] != '\0' ? "/cntrlaxs/solicitud/code" : "/cntrlaxs/solicitud/card", json_message);
+    }
+}
+
+#if CONFIG_CODE_ENTRY_REQUIRE_CARD
+// La tarjeta va al teclado que espera una; si ninguno espera, al que tiene algo ingresado
+static code_entry_t *code_entry_for_card(void)
+{
+    for (int i = 0; i < KEYBOARD_MAX_KEYPADS; i++)
+    {
+        if (code_entries[i].code_ready) return &code_entries[i];
+    }
+    for (int i = 0; i < KEYBOARD_MAX_KEYPADS; i++)
+    {
+        if (code_entry_busy(&code_entries[i])) return &code_entries[i];
+    }
+    return &code_entries[0];
+}
+
+static void code_entry_card_scanned(uint64_t card)
+{
+    code_entry_credential_t credential;
+    xSemaphoreTake(code_entry_mutex, portMAX_DELAY);
+    code_entry_t *entry = code_entry_for_card();
+    code_entry_result_t result = code_entry_card(entry, card, code_entry_now());
+    credential = entry->submitted;
+    xSemaphoreGive(code_entry_mutex);
+
+    if (result == CODE_ENTRY_SUBMIT)
+    {
+        access_request(&credential, entry - code_entries);
+    }
+    else
+    {
+        ESP_LOGI(TAG, "Tarjeta leída, falta el código");
+    }
+}
+#endif
+
 //----------------------------------------------------------------funciones para rc522----------------------------------------------------------------------------------
 static void rc522_handler(void *arg, esp_event_base_t base, int32_t event_id, void *event_data)
 {
@@ -246,87 +2091,156 @@ static void rc522_handler(void *arg, esp_event_base_t base, int32_t event_id, vo
     {
         rc522_tag_t *tag = (rc522_tag_t *)data->ptr;
         ESP_LOGI(TAG1, "Tarjeta escaneada (sn: %" PRIu64 ")", tag->serial_number);
+        lcd_wake();
 
         codigo_tarjeta = tag->serial_number;                                  // Obtener el valor de la variable global codigo_tarjeta
-        char json_message[100];                                               // Buffer para almacenar el mensaje JSON
-        snprintf(json_message, sizeof(json_message), "{\"device_id\":\"%s\",\"card\":\"%" PRIu64 "\"}", DEVICE_ID, codigo_tarjeta);
-
-        // Publicar el mensaje a través de MQTT
-        mqtt_publish_message("/cntrlaxs/solicitud/card", json_message);
+#if CONFIG_CODE_ENTRY_REQUIRE_CARD
+        // La tarjeta sola no alcanza: completa el código de un teclado
+        code_entry_card_scanned(codigo_tarjeta);
+#else
+        const code_entry_credential_t credential = {
+            .has_card = true,
+            .card = codigo_tarjeta,
+        };
+        access_request(&credential, 0);
+#endif
     }
     break;
     }
 }
 
 //------------------------------------------funciones para teclado-------------------------------
+// Crea los teclados configurados: pines y layout de Kconfig, que se pueden
+// reemplazar desde NVS sin recompilar
+static void keypads_init(void)
+{
+    const char *pins[][3] = {
+        {CONFIG_KEYBOARD0_ROWS, CONFIG_KEYBOARD0_COLS, CONFIG_KEYBOARD0_LAYOUT},
+#if CONFIG_KEYBOARD1_ENABLE
+        {CONFIG_KEYBOARD1_ROWS, CONFIG_KEYBOARD1_COLS, CONFIG_KEYBOARD1_LAYOUT},
+#endif
+    };
+    // Columnas con pull-ups en la placa (pueden ser GPIO 34-39)
+    const bool external_pullup[] = {
+#if CONFIG_KEYBOARD0_COLS_EXTERNAL_PULLUP
+        true,
+#else
+        false,
+#endif
+#if CONFIG_KEYBOARD1_ENABLE && CONFIG_KEYBOARD1_COLS_EXTERNAL_PULLUP
+        true,
+#elif CONFIG_KEYBOARD1_ENABLE
+        false,
+#endif
+    };
+    for (int i = 0; i < sizeof(pins) / sizeof(pins[0]); i++)
+    {
+        keyboard_config_t config;
+        keyboard_handle_t keypad;
+        ESP_ERROR_CHECK(keyboard_config_from_strings(&config, pins[i][0], pins[i][1], pins[i][2], external_pullup[i]));
+        if (keyboard_config_load(&config, i) == ESP_OK)
+        {
+            ESP_LOGI(TAG, "Teclado %d: configuración de NVS", i);
+        }
+        for (int j = 0; j < config.num_rows; j++)
+            ESP_ERROR_CHECK(gpio_claim(config.rows[j], "fila del teclado"));
+        for (int j = 0; j < config.num_cols; j++)
+            ESP_ERROR_CHECK(gpio_claim(config.cols[j], "columna del teclado"));
+        ESP_ERROR_CHECK(keyboard_create(&config, &keypad));
+        ESP_LOGI(TAG, "Teclado %d: %dx%d \"%s\"", keyboard_get_id(keypad), config.num_rows, config.num_cols, config.layout);
+    }
+}
+
 void keyboard_task(void *pvParameter)
 {
-    int digit_count = 0;                                         // Contador de dígitos ingresados
-    char code_buffer[7] = {0};                                   // Buffer para almacenar el código ingresado (6 dígitos + terminador nulo)
-    TickType_t last_key_time = 0;                                // Registro del tiempo del último dígito ingresado
-    const TickType_t debounce_delay = 50 / portTICK_PERIOD_MS;   // Tiempo de debounce
-    const TickType_t timeout_delay = 15000 / portTICK_PERIOD_MS; // Tiempo de espera de 15 segundos
+    keyboard_event_t event;
 
     while (1)
     {
-        if (keyboard_check())
+        // La tarea queda bloqueada hasta el próximo evento del teclado
+        // o hasta que vence el primer código a medio ingresar
+        uint32_t remaining = UINT32_MAX;
+        xSemaphoreTake(code_entry_mutex, portMAX_DELAY);
+        uint32_t now = code_entry_now();
+        for (int i = 0; i < KEYBOARD_MAX_KEYPADS; i++)
         {
-            // Implementar debounce
-            if (xTaskGetTickCount() - last_key_time < debounce_delay)
-            {
-                vTaskDelay(debounce_delay); // Esperar el tiempo de debounce
-                continue;
-            }
+            uint32_t left = code_entry_remaining(&code_entries[i], now);
+            if (left < remaining) remaining = left;
+        }
+        xSemaphoreGive(code_entry_mutex);
+        TickType_t wait = (remaining == UINT32_MAX) ? portMAX_DELAY : pdMS_TO_TICKS(remaining) + 1;
 
-            char key = keyboard_get_char();
-            ESP_LOGI(TAG, "Tecla presionada: %c", key);
+        if (keyboard_get_event(&event, wait) && event.type == KEYBOARD_EVENT_DOWN && event.keypad < KEYBOARD_MAX_KEYPADS)
+        {
+            code_entry_t *entry = &code_entries[event.keypad];
+            code_entry_credential_t credential;
+            ESP_LOGI(TAG, "Tecla presionada: %c (teclado %u)", event.key, event.keypad);
+            lcd_wake();
 
-            // Si se presiona una tecla numérica y no se ha alcanzado el límite de dígitos
-            if (isdigit(key) && digit_count < 6)
+            xSemaphoreTake(code_entry_mutex, portMAX_DELAY);
+            code_entry_result_t result = code_entry_key(entry, event.key, code_entry_now());
+            if (result == CODE_ENTRY_DIGIT)
             {
-                // Almacenar el dígito en el buffer
-                code_buffer[digit_count++] = key;
-                last_key_time = xTaskGetTickCount(); // Actualizar el tiempo del último dígito ingresado
-                ESP_LOGI(TAG, "Código ingresado hasta ahora: %s", code_buffer);
+                ESP_LOGI(TAG, "Código ingresado hasta ahora: %s", entry->code);
             }
-            // Si se presiona el botón de cancelar
-            else if (key == '*')
+            credential = entry->submitted;
+            xSemaphoreGive(code_entry_mutex);
+
+            switch (result)
             {
-                // Reiniciar el buffer y el contador de dígitos
-                memset(code_buffer, 0, sizeof(code_buffer));
-                digit_count = 0;
+            case CODE_ENTRY_CANCELLED:
                 ESP_LOGI(TAG, "Código cancelado");
-            }
-            // Si se presiona el botón de terminar
-            else if (key == '#' && digit_count > 0)
-            {
-                // Verificar si se ha ingresado el número completo
-                if (digit_count == 6)
-                {
-                    // Publicar el código ingresado a través de MQTT
-                    char json_message[100];
-                    snprintf(json_message, sizeof(json_message), "{\"device_id\":\"%s\",\"code\":\"%s\"}", DEVICE_ID, code_buffer);
-                    mqtt_publish_message("/cntrlaxs/solicitud/code", json_message);
-                    ESP_LOGI(TAG, "Código completo ingresado: %s", code_buffer);
-                    // Limpiar el buffer y el contador de dígitos
-                    memset(code_buffer, 0, sizeof(code_buffer));
-                    digit_count = 0;
-                    ESP_LOGI(TAG, "Memoria limpia");
-                }
+                break;
+            case CODE_ENTRY_WAIT_CARD:
+                ESP_LOGI(TAG, "Código completo, falta la tarjeta");
+                break;
+            case CODE_ENTRY_SUBMIT:
+                access_request(&credential, event.keypad);
+                break;
+            default:
+                break;
             }
         }
 
-        // Verificar si el tiempo de espera ha excedido los 15 segundos
-        if (digit_count > 0 && (xTaskGetTickCount() - last_key_time) > timeout_delay)
+        // Verificar si venció el tiempo de espera
+        xSemaphoreTake(code_entry_mutex, portMAX_DELAY);
+        now = code_entry_now();
+        for (int i = 0; i < KEYBOARD_MAX_KEYPADS; i++)
         {
-            // Limpiar el buffer y el contador de dígitos
-            memset(code_buffer, 0, sizeof(code_buffer));
-            digit_count = 0;
-            ESP_LOGI(TAG, "Tiempo de espera excedido, memoria limpia");
+            if (code_entry_tick(&code_entries[i], now) == CODE_ENTRY_TIMEOUT)
+            {
+                ESP_LOGI(TAG, "Tiempo de espera excedido, memoria limpia");
+            }
         }
+        xSemaphoreGive(code_entry_mutex);
+    }
+}
 
-        vTaskDelay(10 / portTICK_PERIOD_MS); // Pequeño retraso para evitar la sobrecarga de la CPU
+//------------------------------------------arranque del LCD-------------------------------
+// Dibuja la pantalla inicial apenas termina lcdInitAsync(), sin demorar la conexión
+static void display_boot_task(void *pvParameter)
+{
+    lcd_lock(); // Nadie dibuja hasta que la pantalla esté lista
+    if (!lcdInitWait(&dev, pdMS_TO_TICKS(5000)))
+    {
+        // La secuencia puede seguir corriendo: dibujar mezclaría sus comandos
+        ESP_LOGE(TAG, "Timeout inicializando el LCD, la pantalla queda apagada");
+        lcd_unlock();
+        vTaskDelete(NULL);
+    }
+    lcd_ready = true;
+    // En caliente no se repite el splash. Las pantallas de respuesta
+    // pertenecen a un pedido que murió con el reinicio: se vuelve a la espera.
+    if (!warm_boot)
+    {
+        ui_draw_screen(&dev, UI_SCREEN_SPLASH);
     }
+    ui_draw_screen(&dev, UI_SCREEN_WELCOME);
+    boot_state.screen = UI_SCREEN_WELCOME;
+    boot_state_save();
+    lcd_unlock();
+    ESP_LOGI(TAG, "[APP] LCD listo");
+    vTaskDelete(NULL);
 }
 
 //------------------------------------------funcion principal-------------------------------
@@ -335,6 +2249,7 @@ void app_main(void)
     ESP_LOGI(TAG, "[APP] Startup..");
     ESP_LOGI(TAG, "[APP] Free memory: %" PRIu32 " bytes", esp_get_free_heap_size());
     ESP_LOGI(TAG, "[APP] IDF version: %s", esp_get_idf_version());
+    boot_state_load();
 
     //----------------------------LCD--------------------------
     // Define the GPIOs for your SPI interface
@@ -344,23 +2259,29 @@ void app_main(void)
     int16_t GPIO_DC = 26;
     int16_t GPIO_RESET = 25;
     int16_t GPIO_BL = -1;
+    const int16_t lcd_pins[] = {GPIO_MOSI, GPIO_SCLK, GPIO_CS, GPIO_DC, GPIO_RESET, GPIO_BL};
+    for (int i = 0; i < sizeof(lcd_pins) / sizeof(lcd_pins[0]); i++)
+        ESP_ERROR_CHECK(gpio_claim(lcd_pins[i], "LCD"));
 
     // Initialize the SPI interface
     spi_master_init(&dev, GPIO_MOSI, GPIO_SCLK, GPIO_CS, GPIO_DC, GPIO_RESET, GPIO_BL);
 
-    // Initialize the display with the specified width, height, and offsets
-    lcdInit(&dev, 240, 240, 0, 0);
+    // Initialize the display with the specified width, height, and offsets.
+    // La secuencia corre en su propia tarea mientras se levantan Wi-Fi y MQTT.
+    lcdInitAsync(&dev, 240, 240, 0, 0);
 
-    lcdFillScreen(&dev, BLACK);
-    uint16_t xpos = 240 / 2;
-    uint16_t ypos = 240 / 2;
-    for (int i = 5; i < 240; i = i + 5)
+    lcd_mutex = xSemaphoreCreateMutex();
+    if (!ui_init())
     {
-        lcdDrawCircle(&dev, xpos, ypos, i, BLUE);
+        ESP_LOGE(TAG, "No se pudieron crear los íconos");
     }
-    lcdDrawFinish(&dev);
-    lcdFillScreen(&dev, ORANGE);
-    LCD_DrawString(&dev, 30, 100, "Bienvenido!", &Font24, RED);
+    xTaskCreate(&display_boot_task, "display_boot", 3072, NULL, 5, NULL);
+    door_anim_init();
+    lcd_power_init();
+    lcd_shot_init();
+#if CONFIG_LCD_PROFILE
+    lcd_profile_init();
+#endif
 
     esp_log_level_set("*", ESP_LOG_INFO);
     esp_log_level_set("mqtt_client", ESP_LOG_VERBOSE);
@@ -370,24 +2291,27 @@ void app_main(void)
     esp_log_level_set("transport", ESP_LOG_VERBOSE);
     esp_log_level_set("outbox", ESP_LOG_VERBOSE);
 
+    // Crea las cerraduras (servos en MCPWM, relés en GPIO)
+    doors_create();
+
+    // Antes de levantar la red: una puerta que quedó abierta empieza a cerrarse ya
+    door_init();
+    door_restore();
+
     ESP_ERROR_CHECK(nvs_flash_init());
+    cred_cache_setup();
+    cred_sync_init();
+    inflight_setup();
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
+    ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &wifi_status_handler, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &wifi_status_handler, NULL));
 
     ESP_ERROR_CHECK(example_connect());
 
-    // Inicializa GPIO servo
-    mcpwm_example_gpio_initialize();
-
-    // Configura MCPWM
-    mcpwm_config_t pwm_config = {
-        .frequency = 50, // Frecuencia de 50 Hz para servomotores
-        .cmpr_a = 0,     // Ciclo de trabajo inicial del 0%
-        .cmpr_b = 0,
-        .counter_mode = MCPWM_UP_COUNTER,
-        .duty_mode = MCPWM_DUTY_MODE_0,
-    };
-    mcpwm_init(MCPWM_UNIT_0, MCPWM_TIMER_0, &pwm_config);
+    // Hora para los vencimientos de la caché de credenciales
+    esp_sntp_config_t sntp_config = ESP_NETIF_SNTP_DEFAULT_CONFIG(SNTP_SERVER);
+    esp_netif_sntp_init(&sntp_config);
 
     rc522_config_t config = {
         .spi.host = VSPI_HOST,
@@ -396,12 +2320,17 @@ void app_main(void)
         .spi.sck_gpio = 19,
         .spi.sda_gpio = 22,
     };
+    ESP_ERROR_CHECK(gpio_claim(config.spi.miso_gpio, "RC522"));
+    ESP_ERROR_CHECK(gpio_claim(config.spi.mosi_gpio, "RC522"));
+    ESP_ERROR_CHECK(gpio_claim(config.spi.sck_gpio, "RC522"));
+    ESP_ERROR_CHECK(gpio_claim(config.spi.sda_gpio, "RC522"));
 
     mqtt_app_start();
+    code_entry_setup();
     rc522_create(&config, &scanner);
     rc522_register_events(scanner, RC522_EVENT_ANY, rc522_handler, NULL);
     rc522_start(scanner);
 
-    keyboard_init();
-    xTaskCreate(&keyboard_task, "keyboard_task", 2048, NULL, 5, NULL);
+    keypads_init();
+    xTaskCreate(&keyboard_task, "keyboard_task", 3072, NULL, 5, NULL);
 }
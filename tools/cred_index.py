@@ -0,0 +1,245 @@
+#!/usr/bin/env python3
+"""Build credential index images and sync transfers for the device.
+
+Credentials are read as CSV rows "kind,value,grant,doors,expires":
+
+    card,3205931452,101,1,0            card serial (decimal)
+    code,123456,101,3,1767225600       keypad code
+    card+code,3205931452:123456,111,ff,0
+    hash,9f3c2a0d11e47b60,100,1,0      hash already computed by the backend
+
+grant is the response code to apply (101, 111, 100), doors a hex mask (bit N
+opens door N) and expires a Unix time (0 = never). Lines starting with # are
+ignored. The key is the one in CONFIG_CRED_CACHE_KEY:
+
+    tools/cred_index.py build creds.csv credidx.bin --key 000102...0f --version 42
+    parttool.py write_partition --partition-name credidx0 --input credidx.bin
+
+Over MQTT, "sync" writes the messages of a transfer to a directory, one file
+each: a full snapshot, or with --base the changes from an older CSV the
+device already has. Publish them in order with QoS 1:
+
+    tools/cred_index.py sync creds.csv out --key 000102...0f --version 43 --base old.csv --base-version 42
+    for f in out/*.bin; do mosquitto_pub -h BROKER -q 1 -t /cntrlaxs/credenciales/indice/24001 -f $f; done
+
+The image layout is described in components/cred_cache/include/cred_index.h
+and the transfer format in components/cred_cache/include/cred_sync.h.
+"""
+import argparse
+import csv
+import math
+import os
+import struct
+import sys
+import zlib
+
+MAGIC = 0x31584943
+FORMAT = 1
+HEADER = struct.Struct('<IHHIIIIB3xIIIII')
+ATTR = struct.Struct('<IHBx')
+MSG = struct.Struct('<BBHIII')      # type, kind, 0, transfer, seq, CRC-32 of the payload
+RECORD = struct.Struct('<BQIHB')    # op, hash, expires, grant, doors
+MSG_BEGIN, MSG_DATA, MSG_END = 1, 2, 3
+SNAPSHOT, DELTA = 0, 1
+OP_PUT, OP_REMOVE = 1, 2
+WINDOW_BITS = 12                    # The device inflates with a 4 KB dictionary
+MASK64 = (1 << 64) - 1
+
+
+def _rotl(x, b):
+    return ((x << b) | (x >> (64 - b))) & MASK64
+
+
+def siphash24(key, data):
+    k0, k1 = struct.unpack('<QQ', key)
+    v0 = 0x736f6d6570736575 ^ k0
+    v1 = 0x646f72616e646f6d ^ k1
+    v2 = 0x6c7967656e657261 ^ k0
+    v3 = 0x7465646279746573 ^ k1
+
+    def rounds(n):
+        nonlocal v0, v1, v2, v3
+        for _ in range(n):
+            v0 = (v0 + v1) & MASK64; v1 = _rotl(v1, 13) ^ v0; v0 = _rotl(v0, 32)
+            v2 = (v2 + v3) & MASK64; v3 = _rotl(v3, 16) ^ v2
+            v0 = (v0 + v3) & MASK64; v3 = _rotl(v3, 21) ^ v0
+            v2 = (v2 + v1) & MASK64; v1 = _rotl(v1, 17) ^ v2; v2 = _rotl(v2, 32)
+
+    tail = len(data) & ~7
+    for i in range(0, tail, 8):
+        m, = struct.unpack_from('<Q', data, i)
+        v3 ^= m
+        rounds(2)
+        v0 ^= m
+    b = (len(data) & 0xff) << 56
+    for i, c in enumerate(data[tail:]):
+        b |= c << (8 * i)
+    v3 ^= b
+    rounds(2)
+    v0 ^= b
+    v2 ^= 0xff
+    rounds(4)
+    return v0 ^ v1 ^ v2 ^ v3
+
+
+def key_id(key):
+    return siphash24(key, b'cred_cache') & 0xffffffff
+
+
+def credential_hash(key, card=None, code=None):
+    msg = b''
+    if card is not None:
+        msg += b'C' + struct.pack('<Q', card)
+    if code:
+        msg += b'P' + code.encode('ascii')
+    return siphash24(key, msg)
+
+
+def parse_row(key, row):
+    kind, value, grant, doors, expires = (f.strip() for f in row)
+    if kind == 'card':
+        h = credential_hash(key, card=int(value))
+    elif kind == 'code':
+        h = credential_hash(key, code=value)
+    elif kind == 'card+code':
+        card, code = value.split(':')
+        h = credential_hash(key, card=int(card), code=code)
+    elif kind == 'hash':
+        h = int(value, 16)
+    else:
+        raise ValueError(f'unknown kind {kind!r}')
+    grant, doors, expires = int(grant), int(doors, 16), int(expires)
+    if not (0 <= grant <= 0xffff and 0 <= doors <= 0xff and 0 <= expires <= 0xffffffff):
+        raise ValueError('grant, doors or expires out of range')
+    return h, (expires, grant, doors)
+
+
+def bloom_bit_indices(h, bits, hashes):
+    h1 = h & 0xffffffff
+    h2 = (h >> 32) | 1
+    return [((h1 + i * h2) & 0xffffffff) & (bits - 1) for i in range(hashes)]
+
+
+def build(entries, key, version, bits_per_entry, hashes):
+    """entries: dict hash -> (expires, grant, doors). Returns the image bytes."""
+    keys = sorted(entries)
+    count = len(keys)
+    bloom_bits = 0
+    if bits_per_entry > 0 and count > 0:
+        bloom_bits = max(8, 1 << math.ceil(math.log2(count * bits_per_entry)))
+        if hashes == 0:
+            hashes = max(1, min(16, round(bloom_bits / count * math.log(2))))
+    bloom = bytearray(bloom_bits // 8)
+    for h in keys:
+        for bit in bloom_bit_indices(h, bloom_bits, hashes) if bloom_bits else []:
+            bloom[bit >> 3] |= 1 << (bit & 7)
+
+    bloom_offset = HEADER.size
+    keys_offset = (bloom_offset + len(bloom) + 7) & ~7
+    attrs_offset = keys_offset + 8 * count
+    body = bytearray(attrs_offset + ATTR.size * count - HEADER.size)
+    body[0:len(bloom)] = bloom
+    for i, h in enumerate(keys):
+        struct.pack_into('<Q', body, keys_offset - HEADER.size + 8 * i, h)
+        struct.pack_into(ATTR.format, body, attrs_offset - HEADER.size + ATTR.size * i, *entries[h])
+    header = HEADER.pack(MAGIC, FORMAT, HEADER.size, key_id(key), version, count, bloom_bits,
+                         hashes if bloom_bits else 0, bloom_offset, keys_offset, attrs_offset,
+                         zlib.crc32(body), 0)
+    return header + bytes(body)
+
+
+def message(msg_type, kind, transfer, seq, payload):
+    return MSG.pack(msg_type, kind, 0, transfer, seq, zlib.crc32(payload)) + payload
+
+
+def sync_messages(entries, version, base=None, base_version=0, chunk=768):
+    """Messages of a transfer to version: a snapshot of entries, or the delta from base."""
+    if base is None:
+        records = [RECORD.pack(OP_PUT, h, *entries[h]) for h in sorted(entries)]
+    else:
+        records = []
+        for h in sorted(set(entries) | set(base)):
+            if h not in entries:
+                records.append(RECORD.pack(OP_REMOVE, h, 0, 0, 0))
+            elif base.get(h) != entries[h]:
+                records.append(RECORD.pack(OP_PUT, h, *entries[h]))
+    stream = b''.join(records)
+    comp = zlib.compressobj(9, zlib.DEFLATED, WINDOW_BITS)
+    data = comp.compress(stream) + comp.flush()
+
+    kind = SNAPSHOT if base is None else DELTA
+    msgs = [message(MSG_BEGIN, kind, version, 0, struct.pack('<II', base_version, len(records)))]
+    for i in range(0, len(data), chunk):
+        msgs.append(message(MSG_DATA, 0, version, len(msgs), data[i:i + chunk]))
+    msgs.append(message(MSG_END, 0, version, len(msgs), struct.pack('<I', len(stream))))
+    return msgs
+
+
+def read_csv(path, key):
+    entries = {}
+    with open(path, newline='') as f:
+        for n, row in enumerate(csv.reader(f), 1):
+            if not row or row[0].lstrip().startswith('#'):
+                continue
+            try:
+                h, attrs = parse_row(key, row)
+            except ValueError as e:
+                sys.exit(f'{path}:{n}: {e}')
+            entries[h] = attrs  # The last row for a credential wins
+    return entries
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest='cmd', required=True)
+    b = sub.add_parser('build', help='CSV of credentials to index image')
+    b.add_argument('csv')
+    b.add_argument('output')
+    b.add_argument('--key', required=True, help='CONFIG_CRED_CACHE_KEY (32 hex digits)')
+    b.add_argument('--version', type=int, default=0, help='backend version of this snapshot')
+    b.add_argument('--bits-per-entry', type=float, default=8, help='Bloom filter size (0: no filter)')
+    b.add_argument('--hashes', type=int, default=0, help='Bloom hashes per entry (0: optimal)')
+    b.add_argument('--max-size', type=lambda s: int(s, 0), default=0x78000, help='partition size')
+    y = sub.add_parser('sync', help='CSV of credentials to the MQTT messages of a transfer')
+    y.add_argument('csv')
+    y.add_argument('outdir')
+    y.add_argument('--key', required=True, help='CONFIG_CRED_CACHE_KEY (32 hex digits)')
+    y.add_argument('--version', type=int, required=True, help='version the device reaches')
+    y.add_argument('--base', help='CSV of the version the device has (delta instead of snapshot)')
+    y.add_argument('--base-version', type=int, default=0)
+    y.add_argument('--chunk', type=int, default=768, help='compressed bytes per message (fit the MQTT buffer)')
+    h = sub.add_parser('hash', help='print the hash of a credential')
+    h.add_argument('--key', required=True)
+    h.add_argument('--card', type=int)
+    h.add_argument('--code')
+    args = parser.parse_args()
+
+    key = bytes.fromhex(args.key)
+    if len(key) != 16:
+        sys.exit('the key must be 32 hex digits')
+
+    if args.cmd == 'hash':
+        print(f'{credential_hash(key, args.card, args.code):016x}')
+        return
+
+    entries = read_csv(args.csv, key)
+    if args.cmd == 'sync':
+        base = read_csv(args.base, key) if args.base else None
+        msgs = sync_messages(entries, args.version, base, args.base_version, args.chunk)
+        os.makedirs(args.outdir, exist_ok=True)
+        for i, m in enumerate(msgs):
+            with open(os.path.join(args.outdir, f'{i:05d}.bin'), 'wb') as f:
+                f.write(m)
+        print(f'{len(entries)} credentials, {len(msgs)} messages, {sum(map(len, msgs))} bytes')
+        return
+
+    image = build(entries, key, args.version, args.bits_per_entry, args.hashes)
+    if len(image) > args.max_size:
+        sys.exit(f'{len(image)} bytes do not fit in the partition ({args.max_size} bytes)')
+    with open(args.output, 'wb') as f:
+        f.write(image)
+    print(f'{len(entries)} credentials, {len(image)} bytes')
+
+
+if __name__ == '__main__':
+    main()
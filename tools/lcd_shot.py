@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+"""Reassemble a screenshot published on /cntrlaxs/diag/lcd/shot/{id}.
+
+Chunks are read as hex lines from stdin, for example:
+
+    mosquitto_pub -h BROKER -t /cntrlaxs/diag/cmd/24001 -m screenshot
+    mosquitto_sub -h BROKER -t /cntrlaxs/diag/lcd/shot/24001 -F %x -C 200 | tools/lcd_shot.py shot.png
+
+The image is written as soon as the chunk flagged as last arrives. Missing
+chunks are left black and reported.
+"""
+import struct
+import sys
+import zlib
+
+HEADER = struct.Struct('<BBHHBBIHH')
+MAGIC = 0x53
+VERSION = 1
+LAST = 0x01
+
+
+def decode(chunk, image):
+    magic, version, shot_id, seq, flags, _, pos, width, height = HEADER.unpack_from(chunk)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError('not a screenshot chunk')
+    i = HEADER.size
+    while i < len(chunk):
+        token = chunk[i]
+        i += 1
+        n = (token & 0x7F) + 1
+        if token & 0x80:
+            color = chunk[i] | (chunk[i + 1] << 8)
+            i += 2
+            image[pos:pos + n] = [color] * n
+        else:
+            for k in range(n):
+                image[pos + k] = chunk[i] | (chunk[i + 1] << 8)
+                i += 2
+        pos += n
+    return shot_id, seq, flags, width, height
+
+
+def rgb565_to_png(image, width, height, path):
+    raw = bytearray()
+    for y in range(height):
+        raw.append(0)
+        for c in image[y * width:(y + 1) * width]:
+            r, g, b = (c >> 11) & 0x1F, (c >> 5) & 0x3F, c & 0x1F
+            raw += bytes(((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2)))
+
+    def chunk(kind, data):
+        body = kind + data
+        return struct.pack('>I', len(data)) + body + struct.pack('>I', zlib.crc32(body))
+
+    with open(path, 'wb') as fp:
+        fp.write(b'\x89PNG\r\n\x1a\n')
+        fp.write(chunk(b'IHDR', struct.pack('>IIBBBBB', width, height, 8, 2, 0, 0, 0)))
+        fp.write(chunk(b'IDAT', zlib.compress(bytes(raw))))
+        fp.write(chunk(b'IEND', b''))
+
+
+def main():
+    path = sys.argv[1] if len(sys.argv) > 1 else 'shot.png'
+    image = None
+    current = None
+    seen = set()
+    for line in sys.stdin:
+        line = line.strip()
+        if not line:
+            continue
+        data = bytes.fromhex(line)
+        shot_id = HEADER.unpack_from(data)[2]
+        if shot_id != current:
+            width, height = HEADER.unpack_from(data)[7:9]
+            image = [0] * (width * height)
+            current = shot_id
+            seen = set()
+        _, seq, flags, width, height = decode(data, image)
+        seen.add(seq)
+        if flags & LAST:
+            missing = sorted(set(range(seq + 1)) - seen)
+            if missing:
+                print('missing chunks: %s' % missing, file=sys.stderr)
+            rgb565_to_png(image, width, height, path)
+            print('shot %d: %d chunks -> %s' % (shot_id, seq + 1, path))
+            return 0
+    print('last chunk not received', file=sys.stderr)
+    return 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())